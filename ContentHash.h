@@ -0,0 +1,275 @@
+#ifndef C_CONTENTHASH_H_INCLUDED
+#define C_CONTENTHASH_H_INCLUDED
+
+//
+// Shared pieces of the content hashes: feeding wide strings to a hasher as
+// UTF-16LE, so that digests agree between Windows (2-byte wchar_t) and
+// everything else, and lowercase hex formatting into a fixed buffer. Also
+// CHash128, a fast non-cryptographic 128-bit hash (MurmurHash3 x64-128) with
+// the same streaming interface as CMD5, for content that only needs telling
+// apart, not protecting.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+
+namespace Hlib
+{
+
+namespace Digest
+{
+
+// Holds 32 hex digits and the terminating zero
+constexpr size_t cuiHex128Length_ = 33;
+
+// szOut must hold 2 * uiBytes + 1 characters
+inline void ToHex (const unsigned char * pDigest, size_t uiBytes, wchar_t * szOut)
+{
+    static const wchar_t s_arrDigits[] = L"0123456789abcdef";
+    for (size_t uiByte = 0; uiByte < uiBytes; ++uiByte)
+    {
+        szOut[2 * uiByte] = s_arrDigits[pDigest[uiByte] >> 4];
+        szOut[2 * uiByte + 1] = s_arrDigits[pDigest[uiByte] & 0x0F];
+    }
+    szOut[2 * uiBytes] = L'\0';
+}
+
+//
+// Passes the characters to hasher.Update() as UTF-16LE, a stack buffer at
+// a time. Code points past U+FFFF become surrogate pairs.
+//
+template <typename T_Hasher>
+void UpdateUtf16 (T_Hasher& hasher, const wchar_t * pchrData, size_t uiLength)
+{
+    unsigned char arrBuffer[512];
+    size_t uiBytes = 0;
+    auto fnPut = [&](uint32_t uiUnit)
+    {
+        arrBuffer[uiBytes++] = (unsigned char)(uiUnit & 0xFF);
+        arrBuffer[uiBytes++] = (unsigned char)(uiUnit >> 8);
+    };
+
+    for (size_t uiAt = 0; uiAt < uiLength; ++uiAt)
+    {
+        uint32_t uiChar = (uint32_t)pchrData[uiAt];
+        if (uiChar > 0xFFFF && uiChar <= 0x10FFFF)
+        {
+            uiChar -= 0x10000;
+            fnPut (0xD800 | (uiChar >> 10));
+            fnPut (0xDC00 | (uiChar & 0x3FF));
+        }
+        else
+        {
+            fnPut (uiChar & 0xFFFF);
+        }
+
+        if (uiBytes > sizeof (arrBuffer) - 4)
+        {
+            hasher.Update (arrBuffer, uiBytes);
+            uiBytes = 0;
+        }
+    }
+
+    hasher.Update (arrBuffer, uiBytes);
+
+}   //  UpdateUtf16 (...)
+
+namespace Detail
+{
+
+inline uint64_t ullRead64 (const unsigned char * pchrAt)
+{
+    uint64_t ullValue = 0;
+    for (int iByte = 7; iByte >= 0; --iByte)
+    {
+        ullValue = (ullValue << 8) | pchrAt[iByte];
+    }
+    return ullValue;
+}
+
+inline void Write64 (uint64_t ullValue, unsigned char * pchrAt)
+{
+    for (int iByte = 0; iByte < 8; ++iByte)
+    {
+        pchrAt[iByte] = (unsigned char)(ullValue >> (8 * iByte));
+    }
+}
+
+inline uint64_t ullRotl (uint64_t ullValue, int iBits)
+{
+    return (ullValue << iBits) | (ullValue >> (64 - iBits));
+}
+
+inline uint64_t ullFinalMix (uint64_t ullValue)
+{
+    ullValue ^= ullValue >> 33;
+    ullValue *= 0xFF51AFD7ED558CCDull;
+    ullValue ^= ullValue >> 33;
+    ullValue *= 0xC4CEB9FE1A85EC53ull;
+    ullValue ^= ullValue >> 33;
+    return ullValue;
+}
+
+}   //  namespace Detail
+
+}   //  namespace Digest
+
+//
+// MurmurHash3 x64-128, fed in pieces. The digest is h1 then h2, each
+// little-endian, which is what the reference implementation writes out.
+//
+class CHash128
+{
+public:
+    static constexpr size_t cuiDigestBytes_ = 16;
+
+    CHash128 (uint32_t uiSeed = 0) : m_uiSeed (uiSeed)
+    {
+        Init();
+    }
+
+    void Init()
+    {
+        m_ullH1 = m_uiSeed;
+        m_ullH2 = m_uiSeed;
+        m_ullLength = 0;
+        m_uiBuffered = 0;
+    }
+
+    void Update (const void * pData, size_t uiBytes)
+    {
+        const unsigned char * pchrAt = static_cast<const unsigned char *> (pData);
+        m_ullLength += uiBytes;
+
+        if (m_uiBuffered > 0)
+        {
+            size_t uiTake = (uiBytes < cuiBlock_ - m_uiBuffered) ? uiBytes : cuiBlock_ - m_uiBuffered;
+            memcpy (m_arrBuffer + m_uiBuffered, pchrAt, uiTake);
+            m_uiBuffered += uiTake;
+            pchrAt += uiTake;
+            uiBytes -= uiTake;
+            if (m_uiBuffered < cuiBlock_)
+            {
+                return;
+            }
+            Block (m_arrBuffer);
+            m_uiBuffered = 0;
+        }
+
+        for (; uiBytes >= cuiBlock_; pchrAt += cuiBlock_, uiBytes -= cuiBlock_)
+        {
+            Block (pchrAt);
+        }
+
+        memcpy (m_arrBuffer, pchrAt, uiBytes);
+        m_uiBuffered = uiBytes;
+    }
+
+    void UpdateUtf16 (const wchar_t * pchrData, size_t uiLength)
+    {
+        Digest::UpdateUtf16 (*this, pchrData, uiLength);
+    }
+
+    // Leaves the hasher to be Init()'ed before reuse
+    void Final (unsigned char * pDigest)
+    {
+        using namespace Digest::Detail;
+
+        uint64_t ullK1 = 0, ullK2 = 0;
+        const unsigned char * pchrTail = m_arrBuffer;
+        switch (m_uiBuffered)
+        {
+            case 15: ullK2 ^= (uint64_t)pchrTail[14] << 48; [[fallthrough]];
+            case 14: ullK2 ^= (uint64_t)pchrTail[13] << 40; [[fallthrough]];
+            case 13: ullK2 ^= (uint64_t)pchrTail[12] << 32; [[fallthrough]];
+            case 12: ullK2 ^= (uint64_t)pchrTail[11] << 24; [[fallthrough]];
+            case 11: ullK2 ^= (uint64_t)pchrTail[10] << 16; [[fallthrough]];
+            case 10: ullK2 ^= (uint64_t)pchrTail[9] << 8; [[fallthrough]];
+            case 9:
+                ullK2 ^= (uint64_t)pchrTail[8];
+                ullK2 *= cullC2_;
+                ullK2 = ullRotl (ullK2, 33);
+                ullK2 *= cullC1_;
+                m_ullH2 ^= ullK2;
+                [[fallthrough]];
+            case 8: ullK1 ^= (uint64_t)pchrTail[7] << 56; [[fallthrough]];
+            case 7: ullK1 ^= (uint64_t)pchrTail[6] << 48; [[fallthrough]];
+            case 6: ullK1 ^= (uint64_t)pchrTail[5] << 40; [[fallthrough]];
+            case 5: ullK1 ^= (uint64_t)pchrTail[4] << 32; [[fallthrough]];
+            case 4: ullK1 ^= (uint64_t)pchrTail[3] << 24; [[fallthrough]];
+            case 3: ullK1 ^= (uint64_t)pchrTail[2] << 16; [[fallthrough]];
+            case 2: ullK1 ^= (uint64_t)pchrTail[1] << 8; [[fallthrough]];
+            case 1:
+                ullK1 ^= (uint64_t)pchrTail[0];
+                ullK1 *= cullC1_;
+                ullK1 = ullRotl (ullK1, 31);
+                ullK1 *= cullC2_;
+                m_ullH1 ^= ullK1;
+        }
+
+        m_ullH1 ^= m_ullLength;
+        m_ullH2 ^= m_ullLength;
+        m_ullH1 += m_ullH2;
+        m_ullH2 += m_ullH1;
+        m_ullH1 = ullFinalMix (m_ullH1);
+        m_ullH2 = ullFinalMix (m_ullH2);
+        m_ullH1 += m_ullH2;
+        m_ullH2 += m_ullH1;
+
+        Write64 (m_ullH1, pDigest);
+        Write64 (m_ullH2, pDigest + 8);
+    }
+
+    // szOut must hold Digest::cuiHex128Length_ characters
+    void FinalHex (wchar_t * szOut)
+    {
+        unsigned char arrDigest[cuiDigestBytes_];
+        Final (arrDigest);
+        Digest::ToHex (arrDigest, cuiDigestBytes_, szOut);
+    }
+
+private:
+    static constexpr size_t cuiBlock_ = 16;
+    static constexpr uint64_t cullC1_ = 0x87C37B91114253D5ull;
+    static constexpr uint64_t cullC2_ = 0x4CF5AD432745937Full;
+
+    void Block (const unsigned char * pchrBlock)
+    {
+        using namespace Digest::Detail;
+
+        uint64_t ullK1 = ullRead64 (pchrBlock);
+        uint64_t ullK2 = ullRead64 (pchrBlock + 8);
+
+        ullK1 *= cullC1_;
+        ullK1 = ullRotl (ullK1, 31);
+        ullK1 *= cullC2_;
+        m_ullH1 ^= ullK1;
+
+        m_ullH1 = ullRotl (m_ullH1, 27);
+        m_ullH1 += m_ullH2;
+        m_ullH1 = m_ullH1 * 5 + 0x52DCE729;
+
+        ullK2 *= cullC2_;
+        ullK2 = ullRotl (ullK2, 33);
+        ullK2 *= cullC1_;
+        m_ullH2 ^= ullK2;
+
+        m_ullH2 = ullRotl (m_ullH2, 31);
+        m_ullH2 += m_ullH1;
+        m_ullH2 = m_ullH2 * 5 + 0x38495AB5;
+    }
+
+    uint32_t m_uiSeed;
+    uint64_t m_ullH1;
+    uint64_t m_ullH2;
+    uint64_t m_ullLength;
+    unsigned char m_arrBuffer[cuiBlock_];
+    size_t m_uiBuffered;
+
+};      //  class CHash128
+
+}   //  namespace Hlib
+
+#endif  //  C_CONTENTHASH_H_INCLUDED
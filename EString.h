@@ -4,18 +4,28 @@
 #define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
 #define _SILENCE_CXX17_STRSTREAM_DEPRECATION_WARNING
 
-#include <codecvt>
 #include <memory>
 #include <regex>
 #include <iterator> // For std::forward_iterator_tag
 #include <cstddef>  // For std::ptrdiff_t
 #include <cwctype>
 #include <cwchar>
+#include <climits>
 #include <cassert>
 #include <locale>
+#include <array>
+#include <mutex>
+#include <unordered_map>
+#include <list>
+#include <string_view>
+#include <vector>
+#include <algorithm>
 
 #include "Exception.h"
 #include "Logging.h"
+#include "EStringScan.h"
+#include "EStringRegex.h"
+#include "EStringUtf8.h"
 
 using namespace std;
 
@@ -103,106 +113,270 @@ struct StToken
 
 };    // struct StToken
 
+//
+// Non-owning view of a run of characters, typically a field or a token 
+// inside a CEString. The view is not null-terminated and is valid only as 
+// long as the string it was taken from is neither modified nor destroyed.
+//
+class CEStringView
+{
+public:
+    CEStringView() : m_pchrData (L""), m_uiLength (0)
+    {}
+
+    CEStringView (const wchar_t * pchrData, unsigned int uiLength) : m_pchrData (pchrData), m_uiLength (uiLength)
+    {}
+
+    CEStringView (const wchar_t * szSource) : m_pchrData (szSource), m_uiLength ((unsigned int)wcslen (szSource))
+    {}
+
+    const wchar_t * pchrData() const
+    {
+        return m_pchrData;
+    }
+
+    unsigned int uiLength() const
+    {
+        return m_uiLength;
+    }
+
+    bool bIsEmpty() const
+    {
+        return 0 == m_uiLength;
+    }
+
+    wchar_t operator[] (unsigned int uiAt) const
+    {
+        assert(uiAt < m_uiLength);
+        return m_pchrData[uiAt];
+    }
+
+    const wchar_t * begin() const
+    {
+        return m_pchrData;
+    }
+
+    const wchar_t * end() const
+    {
+        return m_pchrData + m_uiLength;
+    }
+
+    CEStringView svSubstr (unsigned int uiOffset, unsigned int uiLength = UINT_MAX) const
+    {
+        if (uiOffset > m_uiLength)
+        {
+            const wchar_t * szMsg = L"Invalid offset.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_UNEXPECTED, szMsg);
+        }
+
+        return CEStringView (m_pchrData + uiOffset, min (uiLength, m_uiLength - uiOffset));
+    }
+
+    bool bStartsWith (const CEStringView& svPrefix) const
+    {
+        return svPrefix.m_uiLength <= m_uiLength && 
+            0 == wmemcmp (m_pchrData, svPrefix.m_pchrData, svPrefix.m_uiLength);
+    }
+
+    bool bEndsWith (const CEStringView& svSuffix) const
+    {
+        return svSuffix.m_uiLength <= m_uiLength && 
+            0 == wmemcmp (m_pchrData + m_uiLength - svSuffix.m_uiLength, svSuffix.m_pchrData, svSuffix.m_uiLength);
+    }
+
+    wstring stl_sToWstring() const
+    {
+        return wstring (m_pchrData, m_uiLength);
+    }
+
+    static ERelation eCompare (const CEStringView& svLhs, const CEStringView& svRhs)
+    {
+        int iRet = wmemcmp (svLhs.m_pchrData, svRhs.m_pchrData, min (svLhs.m_uiLength, svRhs.m_uiLength));
+        if (0 == iRet)
+        {
+            if (svLhs.m_uiLength == svRhs.m_uiLength)
+            {
+                return ecEqual;
+            }
+            return (svLhs.m_uiLength > svRhs.m_uiLength) ? ecGreater : ecLess;
+        }
+
+        return (iRet > 0) ? ecGreater : ecLess;
+
+    }       // eCompare (...)
+
+    friend bool operator== (const CEStringView& svLhs, const CEStringView& svRhs)
+    {
+        return svLhs.m_uiLength == svRhs.m_uiLength && 
+            0 == wmemcmp (svLhs.m_pchrData, svRhs.m_pchrData, svLhs.m_uiLength);
+    }
+
+    friend bool operator!= (const CEStringView& svLhs, const CEStringView& svRhs)
+    {
+        return !(svLhs == svRhs);
+    }
+
+    friend bool operator< (const CEStringView& svLhs, const CEStringView& svRhs)
+    {
+        return ecLess == eCompare (svLhs, svRhs);
+    }
+
+    friend bool operator> (const CEStringView& svLhs, const CEStringView& svRhs)
+    {
+        return ecGreater == eCompare (svLhs, svRhs);
+    }
+
+    friend bool operator<= (const CEStringView& svLhs, const CEStringView& svRhs)
+    {
+        return ecGreater != eCompare (svLhs, svRhs);
+    }
+
+    friend bool operator>= (const CEStringView& svLhs, const CEStringView& svRhs)
+    {
+        return ecLess != eCompare (svLhs, svRhs);
+    }
+
+private:
+    const wchar_t * m_pchrData;
+    unsigned int m_uiLength;
+
+};      //  class CEStringView
+
 //static const wchar_t * szDefaultBreakChars_ = L" \n";
 //static const wchar_t * szDefaultTabs_ = L"\t";
 //static const wchar_t * szDefaultPunctuation_ = L".,;:/?<>[]{}~!()-_\'\"\\…";
 //static const wchar_t * szDefaultPunctuation_ = Ln".,;:?!\'\"";
 //static const wchar_t * szDefaultEscapeChars_ = L"\27";
 //static const wchar_t * szDefaultVowels_ = L"аеёиоуыэюя";
-struct StBreakChars
-{
-    const wchar_t * m_szDefault;
-    StBreakChars() : m_szDefault (L" \n") {}
-};
-
-struct StTabs
-{
-    const wchar_t * m_szDefault;
-    StTabs() : m_szDefault (L"\t") {}
-};
-
-struct StPunctuation
+enum ESeparatorType
 {
-    const wchar_t * m_szDefault;
-    StPunctuation() : m_szDefault (L".,;:/?<>[]{}~!()-—_\'\"\\…") {}
+    ecSeparatorBreaks,
+    ecSeparatorTabs,
+    ecSeparatorPunctuation,
+    ecSeparatorEscape,
+    ecSeparatorVowels,
+    ecSeparatorTypeCount
 };
 
-struct StEscape
+// Character class bits, one per separator type
+enum ECharClass
 {
-    const wchar_t * m_szDefault;
-    StEscape() : m_szDefault (L"\27") {}
+    ecCharBreak         = 1 << ecSeparatorBreaks,
+    ecCharTab           = 1 << ecSeparatorTabs,
+    ecCharPunctuation   = 1 << ecSeparatorPunctuation,
+    ecCharEscape        = 1 << ecSeparatorEscape,
+    ecCharVowel         = 1 << ecSeparatorVowels
 };
 
-struct StVowels
+//
+// Separator sets used by CEString. Profiles are immutable and interned: strings 
+// configured the same way share one reference-counted instance, so copying
+// or moving a string never duplicates its separators.
+//
+class CSeparatorProfile : public enable_shared_from_this<CSeparatorProfile>
 {
-    const wchar_t * m_szDefault;
-    StVowels() : m_szDefault(L"аеёиоуыэюяАЕЁИОУЫЭЮЯ") {}
-};
+public:
+    static constexpr unsigned int cuiMaxSeparatorLength_ = 1000;
+    static constexpr unsigned int cuiClassTableSize_ = 0x500;     // Basic Latin through Cyrillic
 
-struct StRegex
-{
-    const wchar_t * m_szDefault;
-    StRegex() : m_szDefault (nullptr) {}
-};
+    struct StSeparatorSet
+    {
+        wstring sVolatile;          // set by the user, empty means default
+        bool bDisabled {false};
+    };
+    using ArrSeparatorSets = array<StSeparatorSet, ecSeparatorTypeCount>;
+
+    static const wchar_t * szDefault (ESeparatorType eType)
+    {
+        switch (eType)
+        {
+            case ecSeparatorBreaks:
+                return L" \n";
+            case ecSeparatorTabs:
+                return L"\t";
+            case ecSeparatorPunctuation:
+                return L".,;:/?<>[]{}~!()-—_\'\"\\…";
+            case ecSeparatorEscape:
+                return L"\27";
+            case ecSeparatorVowels:
+                return L"аеёиоуыэюяАЕЁИОУЫЭЮЯ";
+            default:
+                return L"";
+        }
+    }
 
-template<typename SeparatorPolicy>
-class CSeparators : public SeparatorPolicy
-{
-friend class CEString;
-using SeparatorPolicy::m_szDefault;
+    // NULL if disabled
+    const wchar_t * szGet (ESeparatorType eType) const
+    {
+        return m_arrActive[eType];
+    }
 
-private:
-    static const unsigned int cuiMaxSeparatorLength_ = 1000;
+    unsigned int uiLength (ESeparatorType eType) const
+    {
+        return m_arrLengths[eType];
+    }
 
-public:
-    CSeparators() : m_szVolatile (nullptr), m_bDisabled (false)
-    {}
+    bool bDisabled (ESeparatorType eType) const
+    {
+        return m_arrSets[eType].bDisabled;
+    }
 
-    CSeparators (const CSeparators& S) : m_szVolatile (nullptr), m_bDisabled(false)
+    // Empty set if disabled
+    const Scan::CCharSet& rGetCharSet (ESeparatorType eType) const
     {
-        Set (S.m_szVolatile.get());
+        return m_arrCharSets[eType];
     }
 
-    CSeparators(CSeparators&& S) : m_szVolatile(nullptr), m_bDisabled(false)
+    // ECharClass bits for chr from all enabled sets, a single lookup for
+    // Latin and Cyrillic
+    unsigned int uiGetClasses (wchar_t chr) const
     {
-        m_szVolatile = std::move(S.m_szVolatile);
+        if ((unsigned int)chr < cuiClassTableSize_)
+        {
+            return m_arrClasses[chr];
+        }
+
+        auto it = lower_bound (m_vecOtherClasses.begin(), m_vecOtherClasses.end(), chr,
+                               [](const pair<wchar_t, unsigned char>& pairEntry, wchar_t chrKey) { return pairEntry.first < chrKey; });
+        return (it != m_vecOtherClasses.end() && it->first == chr) ? it->second : 0;
     }
 
-    ~CSeparators()
+    // Default-constructed CEString: all sets enabled
+    static const shared_ptr<const CSeparatorProfile>& spDefault()
     {
-//        if (m_szVolatile)
-//        {
-//            delete[] m_szVolatile;
-//            m_szVolatile = nullptr;
-//        }
+        static const shared_ptr<const CSeparatorProfile> s_spDefault (new CSeparatorProfile (ArrSeparatorSets()));
+        return s_spDefault;
     }
 
-    CSeparators& operator=(const CSeparators& S)
+    // CEString constructed from text: break chars only
+    static const shared_ptr<const CSeparatorProfile>& spText()
     {
-        m_szVolatile = nullptr;
-        m_bDisabled = false;
-        Set(S.m_szVolatile.get());
-        return *this;
+        static const shared_ptr<const CSeparatorProfile> s_spText (new CSeparatorProfile (arrTextSets()));
+        return s_spText;
     }
 
-    CSeparators& operator=(CSeparators&& S)
+    // Number of live profiles in the intern map; the built-in ones are not counted
+    static unsigned int uiInterned()
     {
-        m_szVolatile = nullptr;
-        m_bDisabled = false;
-        m_szVolatile = std::move(S.m_szVolatile);
-        return *this;
+        StInterned& stInterned = rGetInterned();
+        lock_guard<mutex> lock (stInterned.Mutex);
+        Prune (stInterned);
+        return (unsigned int)stInterned.mapProfiles.size();
     }
 
-    void Set (const wchar_t * szSeparators)
+    //
+    // Derived profiles; these return the profile itself when nothing changes
+    //
+    shared_ptr<const CSeparatorProfile> spSet (ESeparatorType eType, const wchar_t * szSeparators) const
     {
+        ArrSeparatorSets arrSets (m_arrSets);
         if (!szSeparators)
         {
-            m_bDisabled = true;
-            return;
+            arrSets[eType].bDisabled = true;
+            return spDerive (arrSets);
         }
 
-        m_bDisabled = false;
-
         auto uiLength = wcslen (szSeparators);
         if (uiLength > cuiMaxSeparatorLength_)
         {
@@ -213,63 +387,386 @@ public:
 
         if (0 == uiLength)
         {
-            m_bDisabled = true;
-//            const wchar_t * szMsg = L"Empty separator string.";
-//            ERROR_LOG(szMsg);
-//            throw CException (H_ERROR_INVALID_ARG, szMsg);
-            return;
+            arrSets[eType].bDisabled = true;
+            return spDerive (arrSets);
         }
 
-//        if (m_szVolatile)
-//        {
-//            delete[] m_szVolatile;
-//            m_szVolatile = nullptr;
-//        }
+        arrSets[eType].bDisabled = false;
+        arrSets[eType].sVolatile.assign (szSeparators, uiLength);
+        return spDerive (arrSets);
+    }
+
+    shared_ptr<const CSeparatorProfile> spEnable (ESeparatorType eType) const
+    {
+        ArrSeparatorSets arrSets (m_arrSets);
+        arrSets[eType].bDisabled = false;
+        return spDerive (arrSets);
+    }
+
+    // Break chars enabled, everything else disabled; user-defined sets are kept
+    shared_ptr<const CSeparatorProfile> spReset() const
+    {
+        ArrSeparatorSets arrSets (m_arrSets);
+        for (auto& stSet : arrSets)
+        {
+            stSet.bDisabled = true;
+        }
+        arrSets[ecSeparatorBreaks].bDisabled = false;
+        return spDerive (arrSets);
+    }
+
+private:
+    CSeparatorProfile (const ArrSeparatorSets& arrSets) : m_arrSets (arrSets)
+    {
+        for (int iType = 0; iType < ecSeparatorTypeCount; ++iType)
+        {
+            const StSeparatorSet& stSet = m_arrSets[iType];
+            if (stSet.bDisabled)
+            {
+                m_arrActive[iType] = NULL;
+                m_arrLengths[iType] = 0;
+                continue;
+            }
+            m_arrActive[iType] = stSet.sVolatile.empty() ? szDefault ((ESeparatorType)iType) : stSet.sVolatile.c_str();
+            m_arrLengths[iType] = (unsigned int)wcslen (m_arrActive[iType]);
+            m_arrCharSets[iType] = Scan::CCharSet (m_arrActive[iType], m_arrLengths[iType]);
+        }
+
+        CompileClasses();
+    }
+
+    void CompileClasses()
+    {
+        fill (begin (m_arrClasses), end (m_arrClasses), (unsigned char)0);
+        for (int iType = 0; iType < ecSeparatorTypeCount; ++iType)
+        {
+            const wchar_t * szSet = m_arrActive[iType];
+            if (!szSet)
+            {
+                continue;
+            }
 
-        m_szVolatile = make_unique<wchar_t[]>(uiLength + 1);
-        m_szVolatile[uiLength] = L'\0';
+            unsigned char uchClass = (unsigned char)(1 << iType);
+            for (const wchar_t * pchr = szSet; *pchr; ++pchr)
+            {
+                if ((unsigned int)*pchr < cuiClassTableSize_)
+                {
+                    m_arrClasses[*pchr] |= uchClass;
+                    continue;
+                }
 
-        wmemcpy(m_szVolatile.get(), szSeparators, uiLength);
+                auto it = find_if (m_vecOtherClasses.begin(), m_vecOtherClasses.end(), 
+                                   [pchr](const pair<wchar_t, unsigned char>& pairEntry) { return pairEntry.first == *pchr; });
+                if (it != m_vecOtherClasses.end())
+                {
+                    it->second |= uchClass;
+                }
+                else
+                {
+                    m_vecOtherClasses.emplace_back (*pchr, uchClass);
+                }
+            }
+        }
+        sort (m_vecOtherClasses.begin(), m_vecOtherClasses.end());
 
-    }   //  void Set (...)
+    }   //  CompileClasses()
 
-    void Reset()
+    static bool bEqual (const ArrSeparatorSets& arrLhs, const ArrSeparatorSets& arrRhs)
     {
-//        if (m_szVolatile)
-//        {
-//            delete[] m_szVolatile;
-//            m_szVolatile = nullptr;
-//        }
+        for (int iType = 0; iType < ecSeparatorTypeCount; ++iType)
+        {
+            if (arrLhs[iType].bDisabled != arrRhs[iType].bDisabled || arrLhs[iType].sVolatile != arrRhs[iType].sVolatile)
+            {
+                return false;
+            }
+        }
+        return true;
     }
 
-    const wchar_t * szGet() const
+    static ArrSeparatorSets arrTextSets()
     {
-        if (m_bDisabled)
+        ArrSeparatorSets arrSets;
+        for (auto& stSet : arrSets)
         {
-            return NULL;
+            stSet.bDisabled = true;
         }
-        return (m_szVolatile) ? m_szVolatile.get() : m_szDefault;
+        arrSets[ecSeparatorBreaks].bDisabled = false;
+        return arrSets;
     }
 
-    unsigned int uiLength() const
+    // Text profile that breaks on '_' only, as used to split grammatical hashes
+    static const shared_ptr<const CSeparatorProfile>& spUnderscore()
     {
-        if (m_bDisabled)
+        static const shared_ptr<const CSeparatorProfile> s_spUnderscore = []()
         {
-            return 0;
+            ArrSeparatorSets arrSets (arrTextSets());
+            arrSets[ecSeparatorBreaks].sVolatile = L"_";
+            return shared_ptr<const CSeparatorProfile> (new CSeparatorProfile (arrSets));
+        }();
+        return s_spUnderscore;
+    }
+
+    shared_ptr<const CSeparatorProfile> spDerive (const ArrSeparatorSets& arrSets) const
+    {
+        if (bEqual (arrSets, m_arrSets))
+        {
+            return shared_from_this();
+        }
+
+        // Built-in profiles are never interned, so the common switches take no lock
+        for (auto pfnBuiltIn : { &spText, &spUnderscore, &spDefault })
+        {
+            const shared_ptr<const CSeparatorProfile>& spBuiltIn = pfnBuiltIn();
+            if (bEqual (arrSets, spBuiltIn->m_arrSets))
+            {
+                return spBuiltIn;
+            }
+        }
+
+        return spIntern (arrSets);
+    }
+
+    struct StSetsHash
+    {
+        size_t operator() (const ArrSeparatorSets& arrSets) const
+        {
+            size_t uiHash = 0;
+            for (const auto& stSet : arrSets)
+            {
+                uiHash = uiHash * 31 + hash<wstring>()(stSet.sVolatile) * 2 + (stSet.bDisabled ? 1 : 0);
+            }
+            return uiHash;
         }
-        return m_szVolatile ? (unsigned int)wcslen (m_szVolatile.get()) : (unsigned int)wcslen (m_szDefault);
+    };
+
+    struct StSetsEqual
+    {
+        bool operator() (const ArrSeparatorSets& arrLhs, const ArrSeparatorSets& arrRhs) const
+        {
+            return bEqual (arrLhs, arrRhs);
+        }
+    };
+
+    // User-defined profiles, shared while some string holds them. The map only
+    // observes them; expired entries are dropped whenever it has doubled in size.
+    struct StInterned
+    {
+        static constexpr size_t cuiMinPruneSize_ = 64;
+
+        mutex Mutex;
+        unordered_map<ArrSeparatorSets, weak_ptr<const CSeparatorProfile>, StSetsHash, StSetsEqual> mapProfiles;
+        size_t uiPruneAt { cuiMinPruneSize_ };
+    };
+
+    static StInterned& rGetInterned()
+    {
+        static StInterned s_stInterned;
+        return s_stInterned;
     }
 
-    bool bDisabled()
+    static void Prune (StInterned& stInterned)
     {
-        return m_bDisabled;
+        for (auto itEntry = stInterned.mapProfiles.begin(); itEntry != stInterned.mapProfiles.end();)
+        {
+            itEntry = itEntry->second.expired() ? stInterned.mapProfiles.erase (itEntry) : next (itEntry);
+        }
+        stInterned.uiPruneAt = max (StInterned::cuiMinPruneSize_, 2 * stInterned.mapProfiles.size());
     }
 
-private:
-    unique_ptr<wchar_t[]> m_szVolatile;
-    bool m_bDisabled;
+    static shared_ptr<const CSeparatorProfile> spIntern (const ArrSeparatorSets& arrSets)
+    {
+        StInterned& stInterned = rGetInterned();
+        lock_guard<mutex> lock (stInterned.Mutex);
+        auto& wpProfile = stInterned.mapProfiles[arrSets];
+        auto spProfile = wpProfile.lock();
+        if (!spProfile)
+        {
+            spProfile = shared_ptr<const CSeparatorProfile> (new CSeparatorProfile (arrSets));
+            wpProfile = spProfile;
+        }
+
+        if (stInterned.mapProfiles.size() > stInterned.uiPruneAt)
+        {
+            Prune (stInterned);
+        }
+
+        return spProfile;
+    }
+
+    ArrSeparatorSets m_arrSets;
+    const wchar_t * m_arrActive[ecSeparatorTypeCount];
+    unsigned int m_arrLengths[ecSeparatorTypeCount];
+    Scan::CCharSet m_arrCharSets[ecSeparatorTypeCount];
+    unsigned char m_arrClasses[cuiClassTableSize_];
+    vector<pair<wchar_t, unsigned char>> m_vecOtherClasses;      // sorted, chars outside the table
+
+};      //  class CSeparatorProfile
+
+enum ERegexEngine
+{
+    ecRegexEngineAuto,          // NFA matcher where the pattern allows it, std::regex otherwise
+    ecRegexEngineStd
 };
 
+//
+// Compiled regular expression. Instances are immutable and may be shared 
+// between threads; spGet() hands out cached instances so that a pattern 
+// applied to many strings is compiled only once.
+//
+class CRegex
+{
+public:
+    static constexpr unsigned int cuiDefaultCacheCapacity_ = 128;
+
+    // Throws regex_error if the pattern does not compile
+    explicit CRegex (const wchar_t * szPattern, ERegexEngine eEngine = ecRegexEngineAuto) : m_sPattern (szPattern)
+    {
+        if (ecRegexEngineAuto == eEngine)
+        {
+            m_spProgram = Regex::CProgram::spCompile (m_sPattern.c_str(), m_sPattern.length());
+        }
+        if (!m_spProgram)
+        {
+            m_spStdRegex = make_unique<const wregex> (m_sPattern);
+        }
+    }
+
+    const wstring& sPattern() const
+    {
+        return m_sPattern;
+    }
+
+    // True if matching runs on the NFA rather than std::regex
+    bool bNfa() const
+    {
+        return static_cast<bool> (m_spProgram);
+    }
+
+    unsigned int uiGroups() const
+    {
+        return m_spProgram ? m_spProgram->uiGroups() : static_cast<unsigned int> (m_spStdRegex->mark_count());
+    }
+
+    // Start and end offsets of the match followed by those of each group, -1 
+    // for groups that did not participate. Match mode requires the whole input
+    // to match, search mode takes the leftmost match.
+    bool bEvaluate (const wchar_t * pchrData, unsigned int uiLength, bool bMatchMode, vector<int>& vecSlots) const
+    {
+        if (m_spProgram)
+        {
+            return m_spProgram->bExecute (pchrData, uiLength, bMatchMode, vecSlots);
+        }
+
+        wcmatch match_;
+        bool bRet = bMatchMode
+            ? regex_match (pchrData, pchrData + uiLength, match_, *m_spStdRegex)
+            : regex_search (pchrData, pchrData + uiLength, match_, *m_spStdRegex);
+
+        vecSlots.assign (2 * (m_spStdRegex->mark_count() + 1), -1);
+        if (bRet)
+        {
+            for (unsigned int uiAt = 0; uiAt < match_.size(); ++uiAt)
+            {
+                if (match_[uiAt].matched)
+                {
+                    vecSlots[2 * uiAt] = static_cast<int> (match_.position (uiAt));
+                    vecSlots[2 * uiAt + 1] = static_cast<int> (match_.position (uiAt) + match_.length (uiAt));
+                }
+            }
+        }
+
+        return bRet;
+
+    }   //  bEvaluate (...)
+
+    // Compiled regex for szPattern from the process-wide LRU cache
+    static shared_ptr<const CRegex> spGet (const wchar_t * szPattern)
+    {
+        StCache& stCache = rGetCache();
+        wstring_view svPattern (szPattern);
+        {
+            lock_guard<mutex> lock (stCache.Mutex);
+            auto itEntry = stCache.mapEntries.find (svPattern);
+            if (stCache.mapEntries.end() != itEntry)
+            {
+                stCache.lstEntries.splice (stCache.lstEntries.begin(), stCache.lstEntries, itEntry->second);
+                return *itEntry->second;
+            }
+        }
+
+        // Compile without holding the lock; if another thread got there first, its copy wins
+        auto spRegex = make_shared<const CRegex> (szPattern);
+
+        lock_guard<mutex> lock (stCache.Mutex);
+        auto itEntry = stCache.mapEntries.find (svPattern);
+        if (stCache.mapEntries.end() != itEntry)
+        {
+            stCache.lstEntries.splice (stCache.lstEntries.begin(), stCache.lstEntries, itEntry->second);
+            return *itEntry->second;
+        }
+
+        stCache.lstEntries.push_front (spRegex);
+        stCache.mapEntries.emplace (wstring_view (spRegex->m_sPattern), stCache.lstEntries.begin());
+        Trim (stCache);
+
+        return spRegex;
+
+    }   //  spGet (...)
+
+    static void SetCacheCapacity (unsigned int uiCapacity)
+    {
+        StCache& stCache = rGetCache();
+        lock_guard<mutex> lock (stCache.Mutex);
+        stCache.uiCapacity = max (uiCapacity, 1u);
+        Trim (stCache);
+    }
+
+    static unsigned int uiCacheSize()
+    {
+        StCache& stCache = rGetCache();
+        lock_guard<mutex> lock (stCache.Mutex);
+        return (unsigned int)stCache.lstEntries.size();
+    }
+
+    static void ClearCache()
+    {
+        StCache& stCache = rGetCache();
+        lock_guard<mutex> lock (stCache.Mutex);
+        stCache.mapEntries.clear();
+        stCache.lstEntries.clear();
+    }
+
+private:
+    wstring m_sPattern;
+    unique_ptr<const Regex::CProgram> m_spProgram;
+    unique_ptr<const wregex> m_spStdRegex;         // only if the NFA cannot take the pattern
+
+    // Most recently used first; map keys point into the cached patterns
+    struct StCache
+    {
+        mutex Mutex;
+        list<shared_ptr<const CRegex>> lstEntries;
+        unordered_map<wstring_view, list<shared_ptr<const CRegex>>::iterator> mapEntries;
+        unsigned int uiCapacity { cuiDefaultCacheCapacity_ };
+    };
+
+    static StCache& rGetCache()
+    {
+        static StCache s_stCache;
+        return s_stCache;
+    }
+
+    static void Trim (StCache& stCache)
+    {
+        while (stCache.lstEntries.size() > stCache.uiCapacity)
+        {
+            stCache.mapEntries.erase (wstring_view (stCache.lstEntries.back()->m_sPattern));
+            stCache.lstEntries.pop_back();
+        }
+    }
+
+};      //  class CRegex
+
 class CEString
 {
 public:
@@ -290,7 +787,9 @@ public:
     //static const wchar_t * szDefaultPunctuation_ = Ln".,;:?!\'\"";
     static constexpr wchar_t szDefaultEscapeChars_[] = L"\27";
     //static const wchar_t * szDefaultVowels_ = L"аеёиоуыэюя";
-    static constexpr unsigned int uiBlockSize_ = 10;
+    static constexpr unsigned int cuiInlineCapacity_ = 24;    // short strings live inside the object
+    static constexpr unsigned int cuiMinCapacity_ = 16;       // smallest heap allocation, in wchar_t's
+    static constexpr unsigned int cuiCapacityAlignment_ = 8;
     static constexpr unsigned int cuiMaxSize_ = 100000;
     static constexpr unsigned int cuiMaxRegexLength_ = 2000;
     static constexpr unsigned int cuiMaxVowelsLength_ = 100;
@@ -298,23 +797,31 @@ public:
     static constexpr unsigned int cuiMaxConversionLength_ = 129;
     static constexpr unsigned int cuiMaxSearchStringLength_ = 1000;
     static constexpr unsigned int cuiMaxSearchSetLength_ = 1000;
+    static constexpr unsigned int cuiTokenTypes_ = ecTokenTypeBack - ecTokenText;
+    static constexpr unsigned int cuiMaxLinearTokenScan_ = 16;    // shorter token lists are not worth indexing
 
 private:
-    unique_ptr<wchar_t[]> m_szData;
+    wchar_t * m_szData;             // points to either m_szInline or m_spHeap
+    unique_ptr<wchar_t[]> m_spHeap;
+    wchar_t m_szInline[cuiInlineCapacity_];
 
     unsigned int m_uiLength;
-    unsigned int m_uiBlocksAllocated;
+    unsigned int m_uiCapacity;      // wchar_t's available, including the terminating null
   
-    CSeparators<StBreakChars> m_Breaks;
-    CSeparators<StTabs> m_Tabs;
-    CSeparators<StPunctuation> m_Punctuation;
-    CSeparators<StEscape> m_Escape;
-    CSeparators<StVowels> m_Vowels;
-    CSeparators<StRegex> m_Regex;
+    shared_ptr<const CSeparatorProfile> m_spSeparators;
+    shared_ptr<const CRegex> m_spRegex;         // last regex; empty pattern disables regex matches
 
     vector<StToken> m_vecTokens;
     vector<StToken> m_vecRegexMatches;
 
+    // Positions in m_vecTokens grouped by token type: the i-th token of type e
+    // is m_vecTokens[m_vecTokenIndex[m_arrTypeStart[e - ecTokenText] + i]].
+    // m_arrTypeStart is filled on every Tokenize(), the index itself only
+    // when a long token list is searched.
+    vector<unsigned int> m_vecTokenIndex;
+    array<unsigned int, cuiTokenTypes_ + 1> m_arrTypeStart {};
+    bool m_bTokenIndexValid {false};
+
 //    json11::Json m_JsonParser;
 
     bool m_bInvalid;
@@ -365,15 +872,353 @@ public:
 
     // end of Iterator implementation
 
-    CEString() : m_uiLength(0), m_uiBlocksAllocated (1), m_bInvalid (true)
+    //
+    // Pull-style tokenizer: returns one token at a time, in the same order and
+    // with the same boundaries that Tokenize() stores in m_vecTokens
+    //
+    class CTokenScanner
+    {
+    public:
+        // Empty scanner, yields no tokens
+        CTokenScanner() : 
+            m_pchrData (L""), 
+            m_uiLength (0), 
+            m_pSeparators (nullptr), 
+            m_uiAt (0), 
+            m_uiPending (0), 
+            m_uiNextPending (0), 
+            m_bDone (true)
+        {}
+
+        CTokenScanner (const wchar_t * pchrData, unsigned int uiLength, const CSeparatorProfile& Separators) :
+            m_pchrData (pchrData), 
+            m_uiLength (uiLength), 
+            m_pSeparators (&Separators), 
+            m_uiAt (0), 
+            m_uiPending (0), 
+            m_uiNextPending (0), 
+            m_bDone (false)
+        {}
+
+        // Returns false when there are no more tokens
+        bool bNext (StToken& stToken)
+        {
+            while (m_uiNextPending == m_uiPending)
+            {
+                if (m_bDone)
+                {
+                    return false;
+                }
+                m_uiPending = m_uiNextPending = 0;
+                Step();
+            }
+
+            stToken = m_arrPending[m_uiNextPending++];
+            return true;
+        }
+
+    private:
+        const wchar_t * m_pchrData;
+        unsigned int m_uiLength;
+        const CSeparatorProfile * m_pSeparators;
+        unsigned int m_uiAt;
+        StToken m_stCurrent;
+        StToken m_arrPending[2];    // a tag closes the preceding token and itself in one step
+        unsigned int m_uiPending;
+        unsigned int m_uiNextPending;
+        bool m_bDone;
+
+        void Emit (const StToken& stToken)
+        {
+            assert(m_uiPending < 2);
+            m_arrPending[m_uiPending++] = stToken;
+        }
+
+        // Consumes one character
+        void Step()
+        {
+            unsigned int uiAt = m_uiAt++;
+            wchar_t chrCurrent = m_pchrData[uiAt];
+
+            if (L'\0' == chrCurrent)
+            {
+                if (uiAt != m_uiLength)
+                {
+                    const wchar_t * szMsg = L"Unexpected NULL character.";
+                    ERROR_LOG(szMsg);
+                    throw CException (H_ERROR_UNEXPECTED, szMsg);
+                }
+
+                m_bDone = true;
+                if (0 == uiAt)
+                {
+                    return;
+                }
+
+                if (ecTokenTypeFront == m_stCurrent.eType)
+                {
+                    const wchar_t * szMsg = L"Illegal token type.";
+                    ERROR_LOG(szMsg);
+                    throw CException (H_ERROR_UNEXPECTED, szMsg);
+                }
+
+                Emit (m_stCurrent);
+                return;
+            }
+
+            unsigned int uiClasses = m_pSeparators->uiGetClasses (chrCurrent);
+            if (0 == uiClasses)
+            {
+                Advance (ecTokenText, uiAt);
+                return;
+            }
+
+            if (uiClasses & ecCharBreak)
+            {
+                Advance (ecTokenBreakChars, uiAt);
+                return;
+            }
+
+            if (uiClasses & ecCharTab)
+            {
+                Advance (ecTokenTab, uiAt);
+                return;
+            }
+
+            if (uiClasses & ecCharPunctuation)
+            {
+                Advance (ecTokenPunctuation, uiAt);
+                return;
+            }
+
+            if (uiClasses & ecCharEscape)
+            {
+                assert(m_uiLength > 0);
+                if (uiAt >= m_uiLength-1)
+                {
+                    const wchar_t * szMsg = L"Unexpected escape character.";
+                    ERROR_LOG(szMsg);
+                    throw CException (H_ERROR_UNEXPECTED, szMsg);
+                }
+
+                bool bDoubleEscape = false;
+                if (chrCurrent == m_pchrData[uiAt+1])
+                {
+                    bDoubleEscape = true;
+                }
+                else if (uiAt > 0 && (chrCurrent == m_pchrData[uiAt-1]))
+                {
+                    bDoubleEscape = true;
+                }
+
+                if (!bDoubleEscape)
+                {
+                    AddTag (uiAt);
+                    return;
+                }
+            }
+
+            Advance (ecTokenText, uiAt);
+
+        }   //  Step()
+
+        void Advance (ETokenType eType, unsigned int uiOffset)
+        {
+            if (eType <= ecTokenTypeFront || eType > ecTokenTypeBack)
+            {
+                const wchar_t * szMsg = L"Unexpected token state.";
+                ERROR_LOG(szMsg);
+                throw CException (H_ERROR_UNEXPECTED, szMsg);
+            }
+
+            if (eType != m_stCurrent.eType)
+            {
+                if (ecTokenTypeFront != m_stCurrent.eType)
+                {
+                    Emit (m_stCurrent);
+                }
+
+                m_stCurrent.eType = eType;
+                m_stCurrent.uiOffset = uiOffset;
+                m_stCurrent.uiLength = 1;
+            }
+            else
+            {
+                ++m_stCurrent.uiLength;
+            }
+        
+        }   // void Advance (...)
+
+        void AddTag (unsigned int uiOffset)
+        {
+            if (ecTokenMeta == m_stCurrent.eType)
+            {
+                const wchar_t * szMsg = L"Unexpected token state.";
+                ERROR_LOG(szMsg);
+                throw CException (H_ERROR_UNEXPECTED, szMsg);
+            }
+
+            if (ecTokenTypeFront != m_stCurrent.eType)
+            {
+                Emit (m_stCurrent);
+            }
+
+            m_stCurrent.eType = ecTokenMeta;
+            m_stCurrent.uiOffset = uiOffset;
+            m_stCurrent.uiLength = 0;
+
+            for (unsigned int uiAt = uiOffset + 1; uiAt <= m_uiLength; ++uiAt)
+            {
+                if (L'\0' == m_pchrData[uiAt])
+                {
+                    const wchar_t * szMsg = L"Unterminated escape sequence.";
+                    ERROR_LOG(szMsg);
+                    throw CException (H_ERROR_UNEXPECTED, szMsg);
+                }
+
+                if (m_pSeparators->uiGetClasses (m_pchrData[uiAt]) & ecCharEscape)
+                {
+                    if (uiOffset+1 == uiAt)
+                    {
+                        const wchar_t * szMsg = L"Empty escape sequence.";
+                        ERROR_LOG(szMsg);
+                        throw CException (H_ERROR_UNEXPECTED, szMsg);
+                    }
+                    m_stCurrent.uiLength = uiAt - uiOffset + 1;
+                    Emit (m_stCurrent);
+                    break;
+                }
+            }
+        }       //  AddTag (...)
+
+    };      //  class CTokenScanner
+
+    //
+    // Forward iterator over the fields of one token type. Fields are found
+    // lazily by a CTokenScanner, so breaking out of the loop early leaves the
+    // rest of the string unscanned; m_vecTokens is neither used nor built.
+    // The string must not change while it is being iterated.
+    //
+    class CFieldIterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = CEStringView;
+        using pointer = const CEStringView*; 
+        using reference = const CEStringView&;
+
+        // End iterator
+        CFieldIterator() : m_pchrData (nullptr), 
+                           m_eType (ecTokenText), 
+                           m_bEnd (true)
+        {}
+
+        CFieldIterator (const CEString& sSource, ETokenType eType) : 
+            m_Scanner (sSource.m_szData, sSource.m_uiLength, *sSource.m_spSeparators),
+            m_pchrData (sSource.m_szData),
+            m_eType (eType),
+            m_bEnd (false)
+        {
+            Next();
+        }
+
+        const CEStringView& operator*() const { return m_svField; }
+        const CEStringView * operator->() const { return &m_svField; }
+
+        unsigned int uiOffset() const 
+        { 
+            return m_stToken.uiOffset; 
+        }
+
+        CFieldIterator& operator++() { Next(); return *this; }
+
+        CFieldIterator operator++(int) { CFieldIterator itTmp = *this; Next(); return itTmp; }
+
+        friend bool operator== (const CFieldIterator& itLhs, const CFieldIterator& itRhs) 
+        { 
+            if (itLhs.m_bEnd || itRhs.m_bEnd)
+            {
+                return itLhs.m_bEnd == itRhs.m_bEnd;
+            }
+            return itLhs.m_pchrData == itRhs.m_pchrData && itLhs.m_stToken.uiOffset == itRhs.m_stToken.uiOffset; 
+        };
+        
+        friend bool operator!= (const CFieldIterator& itLhs, const CFieldIterator& itRhs) 
+        { 
+            return !(itLhs == itRhs); 
+        };
+
+    private:
+        CTokenScanner m_Scanner;
+        const wchar_t * m_pchrData;
+        ETokenType m_eType;
+        StToken m_stToken;
+        CEStringView m_svField;
+        bool m_bEnd;
+
+        void Next()
+        {
+            while (m_Scanner.bNext (m_stToken))
+            {
+                if (m_eType == m_stToken.eType)
+                {
+                    m_svField = CEStringView (m_pchrData + m_stToken.uiOffset, m_stToken.uiLength);
+                    return;
+                }
+            }
+            m_bEnd = true;
+            m_svField = CEStringView();
+        }
+    };
+
+    class CFieldRange
+    {
+    public:
+        CFieldRange (const CEString& sSource, ETokenType eType) : m_pSource (&sSource), m_eType (eType)
+        {}
+
+        CFieldIterator begin() const
+        {
+            return CFieldIterator (*m_pSource, m_eType);
+        }
+
+        CFieldIterator end() const
+        {
+            return CFieldIterator();
+        }
+
+    private:
+        const CEString * m_pSource;
+        ETokenType m_eType;
+    };
+
+    // for (CEStringView svField : sLine.Fields()) { ... }
+    CFieldRange Fields (ETokenType eType = ecTokenText) const
+    {
+        return CFieldRange (*this, eType);
+    }
+
+    CEString() : m_szData (m_szInline), 
+                 m_uiLength(0), 
+                 m_uiCapacity (cuiInlineCapacity_), 
+                 m_spSeparators (CSeparatorProfile::spDefault()), 
+                 m_bInvalid (true)
     {
-        m_szData = make_unique<wchar_t[]>(uiBlockSize_);
         m_szData[0] = L'\0';
+    }
 
-        m_Breaks.m_bDisabled = false;
-        m_Tabs.m_bDisabled = false;
-        m_Punctuation.m_bDisabled = false;
-        m_Escape.m_bDisabled = false;
+    // Explicit: an implicit conversion would make comparisons with views ambiguous.
+    // Separators as for CEString (const wchar_t *), so the same text tokenizes 
+    // the same way whichever constructor built it.
+    explicit CEString (const CEStringView& svSource) : m_szData (m_szInline), 
+                                                       m_uiLength(0), 
+                                                       m_uiCapacity (cuiInlineCapacity_), 
+                                                       m_spSeparators (CSeparatorProfile::spText()), 
+                                                       m_bInvalid (true)
+    {
+        m_szData[0] = L'\0';
+        AssignChars (svSource.pchrData(), svSource.uiLength());
     }
 
 /*
@@ -393,37 +1238,37 @@ public:
 
     // Copy ctor
     CEString (const CEString& Source) : 
-        m_szData (NULL), 
+        m_szData (m_szInline), 
         m_uiLength (Source.m_uiLength), 
-        m_uiBlocksAllocated (Source.m_uiBlocksAllocated),
-        m_Breaks (Source.m_Breaks),
-        m_Tabs (Source.m_Tabs),
-        m_Punctuation (Source.m_Punctuation),
-        m_Escape (Source.m_Escape),
-        m_Vowels (Source.m_Vowels),
+        m_uiCapacity (cuiInlineCapacity_),
+        m_spSeparators (Source.m_spSeparators),
+        m_spRegex (Source.m_spRegex),
         m_bInvalid (Source.m_bInvalid)
     {
         if (Source.m_uiLength >= cuiMaxSize_ || 
-            Source.m_uiLength >= Source.m_uiBlocksAllocated * uiBlockSize_)
+            Source.m_uiLength >= Source.m_uiCapacity)
         {
             wstring wstrMsg(L"Source string too long.");            
             ERROR_LOG(wstrMsg.c_str());
             throw CException (H_ERROR_INVALID_ARG, wstrMsg.c_str());
         }
 
-        m_szData = make_unique<wchar_t[]>(m_uiBlocksAllocated * uiBlockSize_);
-        if (m_uiLength > m_uiBlocksAllocated * uiBlockSize_)
+        // Copies get a tight buffer: the source's spare capacity is not inherited
+        if (m_uiLength >= m_uiCapacity)
         {
-            wstring wstrMsg(L"Buffer overflow.");
-            ERROR_LOG(wstrMsg.c_str());
-            throw CException (H_EXCEPTION, wstrMsg.c_str());
+            m_uiCapacity = uiRoundCapacity (m_uiLength + 1);
+            m_spHeap = make_unique<wchar_t[]>(m_uiCapacity);
+            m_szData = m_spHeap.get();
         }
-        wmemcpy(m_szData.get(), Source.m_szData.get(), m_uiLength); 
+        wmemcpy(m_szData, Source.m_szData, m_uiLength); 
         m_szData[m_uiLength] = L'\0';
 
         if (!m_bInvalid)
         {
             m_vecTokens = Source.m_vecTokens;
+            m_vecTokenIndex = Source.m_vecTokenIndex;
+            m_arrTypeStart = Source.m_arrTypeStart;
+            m_bTokenIndexValid = Source.m_bTokenIndexValid;
         }
 
         m_vecRegexMatches = Source.m_vecRegexMatches;
@@ -432,20 +1277,20 @@ public:
 
     // Move ctor
     CEString(CEString&& Source) :
-        m_szData(std::move(Source.m_szData)),
-        m_uiLength(Source.m_uiLength),
-        m_uiBlocksAllocated(Source.m_uiBlocksAllocated),
-        m_Breaks(std::move(Source.m_Breaks)),
-        m_Tabs(Source.m_Tabs),
-        m_Punctuation(std::move(Source.m_Punctuation)),
-        m_Escape(std::move(Source.m_Escape)),
-        m_Vowels(std::move(Source.m_Vowels)),
+        m_szData(m_szInline),
+        m_uiLength(0),
+        m_uiCapacity(cuiInlineCapacity_),
+        m_spSeparators(Source.m_spSeparators),     // copied, source remains usable
+        m_spRegex(std::move(Source.m_spRegex)),
         m_bInvalid(Source.m_bInvalid)
     {
-        Source.m_szData = nullptr;
+        TakeBuffer (Source);
         if (!m_bInvalid)
         {
             m_vecTokens = std::move(Source.m_vecTokens);
+            m_vecTokenIndex = std::move(Source.m_vecTokenIndex);
+            m_arrTypeStart = Source.m_arrTypeStart;
+            m_bTokenIndexValid = Source.m_bTokenIndexValid;
         }
         m_vecRegexMatches = std::move(Source.m_vecRegexMatches);
 
@@ -456,7 +1301,10 @@ public:
               const wchar_t * szTabs = NULL, 
               const wchar_t * szPunctuation = NULL,
               const wchar_t * szEscape = NULL,
-              const wchar_t * szVowels = NULL) : m_szData (NULL), m_uiBlocksAllocated (0), m_bInvalid(true)
+              const wchar_t * szVowels = NULL) : m_szData (m_szInline), 
+                                                  m_uiCapacity (cuiInlineCapacity_), 
+                                                  m_spSeparators (CSeparatorProfile::spText()),
+                                                  m_bInvalid(true)
     {
         m_uiLength = (unsigned int)wcslen (szSource);
         if (m_uiLength >= cuiMaxSize_)
@@ -468,46 +1316,39 @@ public:
 
         Assign (szSource, m_uiLength);
 
-        ResetSeparators();
-
         if (szBreaks)
         {
-            m_Breaks.Set (szBreaks);
+            m_spSeparators = m_spSeparators->spSet (ecSeparatorBreaks, szBreaks);
         }
 
         if (szTabs)
         {
-            m_Tabs.Set (szTabs);
+            m_spSeparators = m_spSeparators->spSet (ecSeparatorTabs, szTabs);
         }
         
         if (szPunctuation)
         {
-            m_Punctuation.Set (szPunctuation);
+            m_spSeparators = m_spSeparators->spSet (ecSeparatorPunctuation, szPunctuation);
         }
         
         if (szEscape)
         {
-            m_Escape.Set (szEscape);
+            m_spSeparators = m_spSeparators->spSet (ecSeparatorEscape, szEscape);
         }
 
         if (szVowels)
         {
-            m_Vowels.Set (szVowels);
+            m_spSeparators = m_spSeparators->spSet (ecSeparatorVowels, szVowels);
         }
     
-    }   //  CEString (const wchar_t *)
-
-    CEString (wchar_t chrValue) : m_uiLength(1), m_uiBlocksAllocated (1), m_bInvalid (true)
-    {
-        unsigned int uiSize = m_uiBlocksAllocated * uiBlockSize_;
-        if (uiSize >= cuiMaxSize_)
-        {
-            const wchar_t * szMsg = L"Requested size exceeds maximum allowed.";
-            ERROR_LOG(szMsg); 
-             
-            throw CException (H_ERROR_INVALID_ARG, szMsg);
-        }
-        m_szData = make_unique<wchar_t[]>(m_uiBlocksAllocated * uiBlockSize_);
+    }   //  CEString (const wchar_t *)
+
+    CEString (wchar_t chrValue) : m_szData (m_szInline), 
+                                  m_uiLength(1), 
+                                  m_uiCapacity (cuiInlineCapacity_), 
+                                  m_spSeparators (CSeparatorProfile::spDefault()),
+                                  m_bInvalid (true)
+    {
         m_szData[0] = chrValue;
         m_szData[1] = L'\0';
     
@@ -526,7 +1367,12 @@ public:
 
     operator wchar_t *() const
     {
-        return m_szData.get();
+        return m_szData;
+    }
+
+    operator CEStringView() const
+    {
+        return CEStringView (m_szData, m_uiLength);
     }
 
     wchar_t chrGetAt(int iAt)
@@ -548,6 +1394,14 @@ public:
     
     }   //  operator= 
 
+    CEString& operator= (const CEStringView& svRhs)
+    {
+        AssignChars (svRhs.pchrData(), svRhs.uiLength());
+
+        return *this;
+    
+    }   //  operator= 
+
     CEString& operator= (const CEString& sRhs)
     {
         if (&sRhs == this)
@@ -555,7 +1409,7 @@ public:
             return *this;
         }
 
-        Assign (sRhs.m_szData.get(), sRhs.m_uiLength);
+        Assign (sRhs.m_szData, sRhs.m_uiLength);
         
         return *this;
     
@@ -563,18 +1417,21 @@ public:
 
     CEString& operator= (CEString&& sRhs)
     {
-        m_szData = std::move(sRhs.m_szData);
-        m_uiLength = std::move(sRhs.m_uiLength);
-        m_uiBlocksAllocated = std::move(sRhs.m_uiBlocksAllocated);
-        m_Breaks = std::move(sRhs.m_Breaks);
-        m_Tabs = std::move(sRhs.m_Tabs);
-        m_Punctuation = std::move(sRhs.m_Punctuation);
-        m_Escape = std::move(sRhs.m_Escape);
-        m_Vowels = std::move(sRhs.m_Vowels);
-        m_bInvalid = std::move(sRhs.m_bInvalid);
-
-        sRhs.m_szData = nullptr;
+        if (&sRhs == this)
+        {
+            return *this;
+        }
+
+        bool bInvalid = sRhs.m_bInvalid;
+        TakeBuffer (sRhs);
+        m_spSeparators = sRhs.m_spSeparators;
+        m_spRegex = std::move(sRhs.m_spRegex);
+        m_bInvalid = bInvalid;
+
         m_vecTokens = std::move(sRhs.m_vecTokens);
+        m_vecTokenIndex = std::move(sRhs.m_vecTokenIndex);
+        m_arrTypeStart = sRhs.m_arrTypeStart;
+        m_bTokenIndexValid = sRhs.m_bTokenIndexValid;
         m_vecRegexMatches = std::move(sRhs.m_vecRegexMatches);
 
         return *this;
@@ -608,7 +1465,23 @@ public:
             throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        Concatenate (sRhs.m_szData.get(), sRhs.m_uiLength);
+        Concatenate (sRhs.m_szData, sRhs.m_uiLength);
+
+        return *this;
+
+    }   //  operator+=
+
+    CEString& operator+= (const CEStringView& svRhs)
+    {
+        unsigned int uiNewSize = svRhs.uiLength() + m_uiLength;
+        if (uiNewSize >= cuiMaxSize_)
+        {
+            const wchar_t * szMsg = L"Right-hand side string too long.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_INVALID_ARG, szMsg);
+        }
+
+        Concatenate (svRhs.pchrData(), svRhs.uiLength());
 
         return *this;
 
@@ -688,71 +1561,62 @@ public:
     // Mutators
     void ResetSeparators()
     {
-        m_Breaks.Reset();
-        m_Breaks.m_bDisabled = false;
-        m_Tabs.Reset();
-        m_Tabs.m_bDisabled = true;
-        m_Punctuation.Reset();
-        m_Punctuation.m_bDisabled = true;
-        m_Escape.Reset();
-        m_Escape.m_bDisabled = true;
-        m_Vowels.Reset();
-        m_Vowels.m_bDisabled = true;
+        m_spSeparators = m_spSeparators->spReset();
     }
 
     void SetBreakChars (const wchar_t * szBreakChars)
     {
-        m_Breaks.Set (szBreakChars);
+        m_spSeparators = m_spSeparators->spSet (ecSeparatorBreaks, szBreakChars);
         m_bInvalid = true;
     }
 
     void EnableBreaks()
     {
-        m_Breaks.m_bDisabled = false;
+        m_spSeparators = m_spSeparators->spEnable (ecSeparatorBreaks);
     }
 
     void SetTabs (const wchar_t * szTabs)
     {
-        m_Tabs.Set (szTabs);
+        m_spSeparators = m_spSeparators->spSet (ecSeparatorTabs, szTabs);
         m_bInvalid = true;
     }
 
     void EnableTabs()
     {
-        m_Tabs.m_bDisabled = false;
+        m_spSeparators = m_spSeparators->spEnable (ecSeparatorTabs);
     }
 
     void SetPunctuation (const wchar_t * szPunctuation)
     {
-        m_Punctuation.Set (szPunctuation);
+        m_spSeparators = m_spSeparators->spSet (ecSeparatorPunctuation, szPunctuation);
         m_bInvalid = true;
     }
 
     void EnablePunctuation()
     {
-        m_Punctuation.m_bDisabled = false;
+        m_spSeparators = m_spSeparators->spEnable (ecSeparatorPunctuation);
     }
     
     void SetEscapeChars (const wchar_t * szEscapeChars)
     {
-        m_Escape.Set (szEscapeChars);
+        m_spSeparators = m_spSeparators->spSet (ecSeparatorEscape, szEscapeChars);
         m_bInvalid = true;
     }
 
     void EnableEscapeChars()
     {
-        m_Escape.m_bDisabled = false;
+        m_spSeparators = m_spSeparators->spEnable (ecSeparatorEscape);
     }
 
     void SetVowels (const wchar_t * szVowels)
     {
-        m_Vowels.Set (szVowels);
+        m_spSeparators = m_spSeparators->spSet (ecSeparatorVowels, szVowels);
         m_bInvalid = true;
     }
 
     void EnableVowels()
     {
-        m_Vowels.m_bDisabled = false;
+        m_spSeparators = m_spSeparators->spEnable (ecSeparatorVowels);
     }
 
     // State/accessors
@@ -766,9 +1630,39 @@ public:
         return m_uiLength;
     }
 
+    // Number of characters the string can hold without reallocating
+    unsigned int uiCapacity() const
+    {
+        return (m_uiCapacity > 0) ? m_uiCapacity - 1 : 0;
+    }
+
+    void Reserve (unsigned int uiChars)
+    {
+        if (uiChars >= cuiMaxSize_)
+        {
+            const wchar_t * szMsg = L"Requested size exceeds maximum allowed.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_INVALID_ARG, szMsg);
+        }
+
+        if (uiChars + 1 > m_uiCapacity)
+        {
+            Reallocate (uiRoundCapacity (uiChars + 1));
+        }
+    }
+
+    void ShrinkToFit()
+    {
+        unsigned int uiTightCapacity = uiRoundCapacity (m_uiLength + 1);
+        if (uiTightCapacity < m_uiCapacity)
+        {
+            Reallocate (uiTightCapacity);
+        }
+    }
+
     unsigned char * pToBytes() const
     {
-        return (unsigned char *)m_szData.get();
+        return (unsigned char *)m_szData;
     }
 
     // Iterators
@@ -788,19 +1682,19 @@ public:
 
     static ERelation eCompare (const CEString& sLhs, const wchar_t * szRhs)
     {
-        return eCompare (sLhs.m_szData.get(), szRhs);
+        return eCompare (sLhs.m_szData, szRhs);
 
     }       // eCompare (...)
 
     static ERelation eCompare (const wchar_t * szLhs, const CEString& sRhs)
     {
-        return eCompare (szLhs, sRhs.m_szData.get());
+        return eCompare (szLhs, sRhs.m_szData);
 
     }       // eCompare (...)
 
     static ERelation eCompare (const CEString& sLhs, const CEString& sRhs)
     {
-        return eCompare (sLhs.m_szData.get(), sRhs.m_szData.get());
+        return eCompare (sLhs.m_szData, sRhs.m_szData);
 
     }       // eCompare (...)
 
@@ -884,12 +1778,10 @@ public:
         CEString sRegex(L"^([");
         sRegex += szAlphabet;
         sRegex += L"]+)";
-        wregex regex(sRegex.m_szData.get());
-        wsmatch match;
-        wstring wstrData(str);
-        auto bRet = regex_match(wstrData, match, regex);
+        auto spRegex = CRegex::spGet(sRegex.m_szData);
 
-        return bRet && match[0].matched;
+        thread_local vector<int> t_vecSlots;
+        return spRegex->bEvaluate(str.m_szData, str.m_uiLength, true, t_vecSlots);
     }
 
     unsigned int uiFind (const wchar_t * szRhs, unsigned int uiStartAt = 0) const
@@ -919,10 +1811,10 @@ public:
             throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        const wchar_t * pPos = wcsstr (&m_szData[uiStartAt], szRhs);
-        if (pPos)
+        size_t uiAt = Scan::uiFindSubstring (&m_szData[uiStartAt], m_uiLength - uiStartAt, szRhs, uiLength);
+        if (uiAt < m_uiLength - uiStartAt)
         {
-            return static_cast<unsigned int>(pPos - m_szData.get());
+            return static_cast<unsigned int>(uiStartAt + uiAt);
         }
 
         return ecNotFound;
@@ -973,7 +1865,7 @@ public:
             throw CException(H_EXCEPTION, szMsg);
         }
 
-//        wmemcpy(spDataLC.get(), m_szData.get(), m_uiLength+1); 
+//        wmemcpy(spDataLC.get(), m_szData, m_uiLength+1); 
         for (int iAt = 0; iAt < (int)m_uiLength; ++iAt)
         {
             spDataLC[iAt] = towlower(m_szData[iAt]);
@@ -1048,7 +1940,13 @@ public:
 
     unsigned int uiFindFirstOf (const wchar_t * szSet) const
     {
-        size_t uiAt = wcscspn (m_szData.get(), szSet);
+        return uiFindFirstOf (Scan::rGetCachedSet (szSet));
+    }
+
+    // Takes a set compiled once by the caller, e.g. outside a loop
+    unsigned int uiFindFirstOf (const Scan::CCharSet& Set) const
+    {
+        size_t uiAt = Scan::uiFindFirst (m_szData, m_uiLength, Set);
 
         if (m_uiLength == uiAt)
         {
@@ -1076,6 +1974,11 @@ public:
 */
 
     unsigned int uiFindOneOf (unsigned int uiStartAt, const wchar_t * szSet) const
+    {
+        return uiFindOneOf (uiStartAt, Scan::rGetCachedSet (szSet));
+    }
+
+    unsigned int uiFindOneOf (unsigned int uiStartAt, const Scan::CCharSet& Set) const
     {
         if (uiStartAt >= m_uiLength)
         {
@@ -1084,7 +1987,7 @@ public:
             throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        size_t uiAt = wcscspn (&m_szData[uiStartAt], szSet) + uiStartAt;
+        size_t uiAt = Scan::uiFindFirst (&m_szData[uiStartAt], m_uiLength - uiStartAt, Set) + uiStartAt;
 
         if (m_uiLength == uiAt)
         {
@@ -1097,15 +2000,18 @@ public:
 
     unsigned int uiFindLastOf (const wchar_t * szSet) const
     {
-        for (int iAt = m_uiLength-1; iAt >= 0; --iAt)
+        return uiFindLastOf (Scan::rGetCachedSet (szSet));
+    }
+
+    unsigned int uiFindLastOf (const Scan::CCharSet& Set) const
+    {
+        size_t uiAt = Scan::uiFindLast (m_szData, m_uiLength, Set);
+        if (m_uiLength == uiAt)
         {
-            if (bIn (m_szData[iAt], szSet))
-            {
-                return (unsigned int)iAt;
-            }
+            return ecNotFound;
         }
 
-        return ecNotFound;
+        return (unsigned int)uiAt;
     
     }   //  uiFindLastOf (...)
 
@@ -1139,9 +2045,7 @@ public:
             return false;
         }
         
-        int iRet = wcsncmp (m_szData.get(), szRhs, uiRhsLength);
-
-        return (0 == iRet);
+        return Scan::bEqual (m_szData, szRhs, uiRhsLength);
     
     }   // bStartsWith (...)
 
@@ -1296,7 +2200,7 @@ public:
             return false;
         }
 
-        wmemcpy(spDataLC.get(), m_szData.get(), m_uiLength+1);
+        wmemcpy(spDataLC.get(), m_szData, m_uiLength+1);
 
         for (int iAt = 0; iAt < (int)m_uiLength; ++iAt)
         {
@@ -1360,24 +2264,20 @@ public:
         }
 
         unsigned int uiNewLength = m_uiLength + 1;
-        if (uiNewLength >= m_uiBlocksAllocated * uiBlockSize_)
+        if (uiNewLength >= cuiMaxSize_)
         {
-            wchar_t szInsert[2];
-            szInsert[0] = chrInsert;
-            szInsert[1] = L'\0';
-            sInsert (uiInsertAt, szInsert);
-
-            return *this;
+            const wchar_t * szMsg = L"Insertions string too long.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        for (unsigned int uiAt = m_uiLength+1; uiAt > uiInsertAt; --uiAt)
-        {
-            m_szData[uiAt] = m_szData[uiAt-1];
-        }
+        EnsureCapacity (uiNewLength);
 
+        // Shift the tail including the terminating null
+        wmemmove (&m_szData[uiInsertAt+1], &m_szData[uiInsertAt], m_uiLength - uiInsertAt + 1);
         m_szData[uiInsertAt] = chrInsert;
         ++m_uiLength;
-//        m_szData[++m_uiLength] = L'\0';
+        m_bInvalid = true;
 
         return *this;
 
@@ -1407,24 +2307,20 @@ public:
             throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        if (uiNewLength >= m_uiBlocksAllocated * uiBlockSize_)
+        if (bIsOwnBuffer (szInsert))
         {
-            m_uiBlocksAllocated = (unsigned int)((uiNewLength+1)/uiBlockSize_) + 1;
+            CEString sCopy (szInsert);
+            return sInsert (uiInsertAt, sCopy.m_szData);
         }
 
-        auto uiNewAllocSize = m_uiBlocksAllocated * uiBlockSize_;
-        unique_ptr<wchar_t[]> szNewData = make_unique<wchar_t[]>(uiNewAllocSize);
-
-        wmemmove(szNewData.get(), m_szData.get(), uiInsertAt); 
-        wmemmove(&szNewData[uiInsertAt], szInsert, uiCharsToInsert); 
+        EnsureCapacity (uiNewLength);
 
         auto uiPastInsertion = uiInsertAt + uiCharsToInsert;
-        wmemmove (&szNewData[uiPastInsertion], &m_szData[uiInsertAt], m_uiLength - uiInsertAt); 
+        wmemmove (&m_szData[uiPastInsertion], &m_szData[uiInsertAt], m_uiLength - uiInsertAt + 1); 
+        wmemmove (&m_szData[uiInsertAt], szInsert, uiCharsToInsert); 
 
         m_uiLength += uiCharsToInsert;
-        szNewData[m_uiLength] = L'\0';
-
-        m_szData = move(szNewData);
+        m_bInvalid = true;
 
         return *this;
 
@@ -1481,22 +2377,20 @@ public:
             throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        auto uiBlocksToAllocate = ((uiNewLength+1)/uiBlockSize_) + 1;
-        auto uiNewSize = uiBlocksToAllocate * uiBlockSize_;
-        unique_ptr<wchar_t[]> szNewData = make_unique<wchar_t[]>(uiNewSize);
-        wmemmove(szNewData.get(), m_szData.get(), uiAt); 
-        wmemmove(&szNewData[uiAt], szReplace, uiCharsToInsert); 
-        
-        if (m_uiLength > uiAt+uiCharsToErase)
+        if (bIsOwnBuffer (szReplace))
         {
-            unsigned int uiRemainder = m_uiLength - (uiAt+uiCharsToErase) + 1;
-            wmemmove(&szNewData[uiAt+uiCharsToInsert], &m_szData[uiAt+uiCharsToErase], uiRemainder); 
+            CEString sCopy (szReplace);
+            return sReplace (uiAt, uiMaxCharsToErase, sCopy.m_szData);
         }
 
-        m_szData = move(szNewData);
-        m_uiBlocksAllocated = static_cast<unsigned int>(uiBlocksToAllocate);
-        m_uiLength = static_cast<unsigned int>(m_uiLength - uiCharsToErase + uiCharsToInsert);
-        m_szData[m_uiLength] = L'\0';
+        EnsureCapacity (static_cast<unsigned int>(uiNewLength));
+
+        unsigned int uiRemainder = m_uiLength - (uiAt+uiCharsToErase) + 1;     // incl. terminating null
+        wmemmove(&m_szData[uiAt+uiCharsToInsert], &m_szData[uiAt+uiCharsToErase], uiRemainder); 
+        wmemmove(&m_szData[uiAt], szReplace, uiCharsToInsert); 
+
+        m_uiLength = static_cast<unsigned int>(uiNewLength);
+        m_bInvalid = true;
 
         return *this;
 
@@ -1567,7 +2461,7 @@ public:
 
     void Erase()
     {
-        if (m_uiLength >= (m_uiBlocksAllocated * uiBlockSize_))
+        if (m_uiLength >= m_uiCapacity)
         {
             const wchar_t * szMsg = L"Illegal length.";
             ERROR_LOG(szMsg);
@@ -1586,10 +2480,10 @@ public:
             return;
         }
 
+        // Capacity is kept so that a cleared string can be refilled without reallocating
         m_szData[0] = L'\0';
         m_uiLength = 0;
-
-        Shrink();
+        m_bInvalid = true;
 
     }   //  Erase()
 
@@ -1792,14 +2686,42 @@ public:
         CEString sResult;
         unsigned int uiCharsToMove = min (uiLength, m_uiLength - uiOffset);
         assert(uiCharsToMove <= m_uiLength);
-        wchar_t chrSave = m_szData[uiOffset + uiCharsToMove];
-        m_szData[uiOffset + uiCharsToMove] = L'\0';
-        sResult.Assign (&m_szData[uiOffset], uiCharsToMove);
-        m_szData[uiOffset + uiCharsToMove] = chrSave;
+        sResult.AssignChars (&m_szData[uiOffset], uiCharsToMove);
         return sResult;
 
     }   //  CEString sSubstr (...)
 
+    // Same as sSubstr() but returns a view into this string instead of a copy
+    CEStringView svSubstr (unsigned int uiOffset, unsigned int uiLength = cuiMaxSize_) const
+    {
+        if (uiLength > cuiMaxSize_)
+        {
+            const wchar_t * szMsg = L"Source string too long.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_INVALID_ARG, szMsg);
+        }
+
+        if (uiOffset > m_uiLength)
+        {
+            const wchar_t * szMsg = L"Invalid offset.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_UNEXPECTED, szMsg);
+        }
+
+        if (uiLength < cuiMaxSize_)
+        {
+            if (uiOffset + uiLength > m_uiLength)
+            {
+                const wchar_t * szMsg = L"Invalid length.";
+                ERROR_LOG(szMsg);
+                throw CException (H_ERROR_UNEXPECTED, szMsg);
+            }
+        }
+
+        return CEStringView (&m_szData[uiOffset], min (uiLength, m_uiLength - uiOffset));
+
+    }   //  CEStringView svSubstr (...)
+
     // Trim
     void TrimLeft (const wchar_t * szCharsToTrim)
     {
@@ -1808,7 +2730,7 @@ public:
             return;
         }
 
-        if (m_uiLength >= (m_uiBlocksAllocated * uiBlockSize_))
+        if (m_uiLength >= m_uiCapacity)
         {
             const wchar_t * szMsg = L"Illegal length.";
             ERROR_LOG(szMsg);
@@ -1852,14 +2774,14 @@ public:
         }
 
         m_uiLength -= uiAt;
-        wmemmove (m_szData.get(), &m_szData[uiAt], m_uiLength); 
+        wmemmove (m_szData, &m_szData[uiAt], m_uiLength); 
         m_szData[m_uiLength] = L'\0';
     
     }       // TrimLeft (...)
 
     void TrimLeft()
     {
-        TrimLeft (m_Breaks.szGet());
+        TrimLeft (m_spSeparators->szGet (ecSeparatorBreaks));
     }
 
     void TrimRight (const wchar_t * szCharsToTrim)
@@ -1869,7 +2791,7 @@ public:
             return;
         }
 
-        if (m_uiLength >= m_uiBlocksAllocated * uiBlockSize_)
+        if (m_uiLength >= m_uiCapacity)
         {
             const wchar_t * szMsg = L"Illegal length.";
             ERROR_LOG(szMsg);
@@ -1914,7 +2836,7 @@ public:
 
     void TrimRight()
     {
-        TrimRight (m_Breaks.szGet());
+        TrimRight (m_spSeparators->szGet (ecSeparatorBreaks));
     }
 
     void Trim (const wchar_t * szCharsToTrim)
@@ -1925,13 +2847,13 @@ public:
 
     void Trim()
     {
-        TrimLeft (m_Breaks.szGet());
-        TrimRight (m_Breaks.szGet());
+        TrimLeft (m_spSeparators->szGet (ecSeparatorBreaks));
+        TrimRight (m_spSeparators->szGet (ecSeparatorBreaks));
     }
 
     void Reverse()
     {
-//        _wcsrev (m_szData.get());
+//        _wcsrev (m_szData);
         for(int iAt = 0; iAt < (int)m_uiLength/2; ++iAt)
         {
             wchar_t chrTmp = m_szData[iAt];
@@ -1958,6 +2880,22 @@ public:
     
     }   // sGetField (...)
 
+    // The view is invalidated by any change to this string
+    CEStringView svGetField (int iAt, ETokenType eType = ecTokenText)
+    {
+        vector<StToken>& rvecTokens = (ecTokenRegexMatch == eType) ? m_vecRegexMatches : m_vecTokens;
+        vector<StToken>::iterator itToken = itFindToken (iAt, eType);
+        if (rvecTokens.end() == itToken)
+        {
+            const wchar_t * szMsg = L"Failed to find token.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_GENERAL, szMsg);
+        }
+
+        return CEStringView (&m_szData[(*itToken).uiOffset], (*itToken).uiLength);
+    
+    }   // svGetField (...)
+
     StToken stGetField (int iAt, ETokenType eType = ecTokenText)
     {
 //        Tokenize();
@@ -2054,6 +2992,22 @@ public:
     
     }   //  CEString sGetToken (...)
 
+    CEStringView svGetToken (unsigned int uiAt)
+    {
+        Tokenize();
+
+        if (uiAt >= m_vecTokens.size())
+        {
+            const wchar_t * szMsg = L"Token index out of range.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_GENERAL, szMsg);
+        }
+
+        const StToken& stToken = m_vecTokens[uiAt];
+        return CEStringView (&m_szData[stToken.uiOffset], stToken.uiLength);
+    
+    }   //  CEStringView svGetToken (...)
+
     bool bGetNextToken (StToken& stToken)
     {
         Tokenize();
@@ -2189,7 +3143,7 @@ public:
         //    return CEString (L"");
         //}
 
-        if (m_Regex.m_bDisabled)
+        if (bRegexDisabled())
         {
             ERROR_LOG(L"Warning: regex string missing or invalid");
             return CEString (L"");
@@ -2210,25 +3164,41 @@ public:
 
     }   //  sGetRegexMatch (...)
 
+    CEStringView svGetRegexMatch (unsigned int iAt)
+    {
+        if (bRegexDisabled())
+        {
+            ERROR_LOG(L"Warning: regex string missing or invalid");
+            return CEStringView();
+        }
+
+        if (iAt >= m_vecRegexMatches.size())
+        {
+            ERROR_LOG(L"*** m_vecRegexMatches member index out of range");
+            return CEStringView();
+        }
+
+        const StToken& stToken = m_vecRegexMatches[iAt];
+        return CEStringView (&m_szData[stToken.uiOffset], stToken.uiLength);
+
+    }   //  svGetRegexMatch (...)
+
     unsigned int uiGetNumOfFields (ETokenType eType = ecTokenText)
     {
-        if (ecTokenRegexMatch != eType)
+        if (ecTokenRegexMatch == eType)
         {
-            Tokenize();
+            return static_cast<unsigned int>(m_vecRegexMatches.size());
         }
 
-        int iTokens = 0;
-        vector<StToken>& rvecTokens = (ecTokenRegexMatch == eType) ? m_vecRegexMatches : m_vecTokens;
-        vector<StToken>::iterator it_ = rvecTokens.begin();
-        for (; it_ != rvecTokens.end(); ++it_)
+        Tokenize();
+
+        if (eType < ecTokenText || eType >= ecTokenTypeBack)
         {
-            if ((*it_).eType == eType)
-            {
-                ++iTokens;
-            }
+            return 0;
         }
-        
-        return iTokens;
+
+        unsigned int uiType = eType - ecTokenText;
+        return m_arrTypeStart[uiType + 1] - m_arrTypeStart[uiType];
     
     }   //  uiGetNumOfFields (...)
 
@@ -2379,30 +3349,16 @@ public:
 
     unsigned int uiGetNumOfSyllables() const
     {
-        if (m_Vowels.uiLength() == 0)
+        if (m_spSeparators->uiLength (ecSeparatorVowels) == 0)
         {
             wchar_t szMsgBuf[1000];
             wcscpy(szMsgBuf, L"Vowels not defined, string = ");
-            wcscat(szMsgBuf, m_szData.get());
+            wcscat(szMsgBuf, m_szData);
             ERROR_LOG(szMsgBuf);
             throw CException (H_ERROR_GENERAL, szMsgBuf);
         }
 
-        unsigned int uiSyllables = 0;
-        unsigned int uiAt = 0;
-        do
-        {
-            unsigned int uiStartAt = uiAt;
-            uiAt = (unsigned int)wcscspn (&m_szData[uiAt], m_Vowels.szGet());
-            uiAt += uiStartAt;
-            if (uiAt < m_uiLength)
-            {
-                ++uiSyllables;
-            }
-
-        } while (++uiAt < m_uiLength);
-
-        return uiSyllables;
+        return (unsigned int)Scan::uiCount (m_szData, m_uiLength, m_spSeparators->rGetCharSet (ecSeparatorVowels));
 
     }   //  uiGetNumOfSyllables()
 
@@ -2424,7 +3380,7 @@ public:
 
     unsigned int uiGetVowelPos (unsigned int uiVowel = 0) const
     {
-        if (m_Vowels.uiLength() == 0)
+        if (m_spSeparators->uiLength (ecSeparatorVowels) == 0)
         {
 //            assert(0);
             const wchar_t * szMsg = L"Vowels not defined";
@@ -2437,7 +3393,7 @@ public:
         for (unsigned int ui_ = 0; ui_ <= uiVowel; ++ui_)
         {
             unsigned int uiStartAt = uiAt;
-            uiAt = (unsigned int)wcscspn (&m_szData[uiAt], m_Vowels.szGet());
+            uiAt = (unsigned int)Scan::uiFindFirst (&m_szData[uiAt], m_uiLength - uiAt, m_spSeparators->rGetCharSet (ecSeparatorVowels));
             uiAt += uiStartAt;
             if (uiAt >= m_uiLength)
             {
@@ -2461,7 +3417,7 @@ public:
     
     unsigned int uiGetSyllableFromVowelPos (unsigned int uiAbsPos) const
     {
-        if (m_Vowels.uiLength() == 0)
+        if (m_spSeparators->uiLength (ecSeparatorVowels) == 0)
         {
 //            assert(0);
             const wchar_t * szMsg = L"Vowels not defined";
@@ -2482,7 +3438,7 @@ public:
         do
         {
             unsigned int uiStartAt = uiVowelPos;
-            uiVowelPos = (unsigned int)wcscspn (&m_szData[uiVowelPos], m_Vowels.szGet());
+            uiVowelPos = (unsigned int)Scan::uiFindFirst (&m_szData[uiVowelPos], m_uiLength - uiVowelPos, m_spSeparators->rGetCharSet (ecSeparatorVowels));
             uiVowelPos += uiStartAt;
             if (uiVowelPos < m_uiLength)
             {
@@ -2566,8 +3522,7 @@ public:
 //    template<typename fake>
     static CEString sToString(const char * pchrSource)    // only basic conversions
     {
-        std::wstring str = std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>>().from_bytes(pchrSource);
-        return CEString(str.c_str());
+        return sFromUtf8(pchrSource);
     }
 
     // Regex
@@ -2581,40 +3536,100 @@ public:
         return bRegexEvaluate (szRegex, false);
     }
 
+    // Precompiled regex, e.g. from CRegex::spGet()
+    bool bRegexMatch (const shared_ptr<const CRegex>& spRegex)
+    {
+        return bRegexEvaluate (spRegex, true);
+    }
+
+    bool bRegexSearch (const shared_ptr<const CRegex>& spRegex)
+    {
+        return bRegexEvaluate (spRegex, false);
+    }
+
 
 // TODO RegexReplace?
  
     //
     // Unicode conversions
     //
-    string stl_sToUtf8()
+    // Malformed input, either way, is replaced with U+FFFD
+    string stl_sToUtf8() const
     {
-        wchar_t arrSource[cuiMaxSize_ + 1];
-        int iLength = (int)min(m_uiLength, cuiMaxSize_);
-        wmemmove(arrSource, m_szData.get(), iLength+1);
-        wstring_convert<codecvt_utf8<wchar_t>> converter;
-        const string utf8_string = converter.to_bytes(arrSource);
-
-        return utf8_string;
+        string stl_sUtf8;
+        ToUtf8(stl_sUtf8);
+        return stl_sUtf8;
     }
 
     static string stl_sToUtf8(const wchar_t * szSource)
     {
-        wchar_t arrSource[cuiMaxSize_ + 1];
-        auto uiLength = (unsigned int)wcslen(szSource);
-        int iLength = (int)min(uiLength, cuiMaxSize_);
-        wmemmove(arrSource, szSource, iLength+1);
-        wstring_convert<codecvt_utf8<wchar_t>> converter;
-        const string utf8_string = converter.to_bytes(arrSource);
+        size_t uiLength = wcslen(szSource);
+        string stl_sUtf8(Utf8::uiMaxEncodedLength(uiLength), '\0');
+        stl_sUtf8.resize(Utf8::uiEncode(szSource, uiLength, &stl_sUtf8[0]));
+        return stl_sUtf8;
+    }
+
+    // Overwrites stl_sOut reusing its capacity, for loops over many strings
+    void ToUtf8(string& stl_sOut) const
+    {
+        stl_sOut.resize(Utf8::uiMaxEncodedLength(m_uiLength));
+        stl_sOut.resize(Utf8::uiEncode(m_szData, m_uiLength, &stl_sOut[0]));
+    }
+
+    static CEString sFromUtf8(const char * pchrSource, size_t uiBytes)
+    {
+        CEString sResult;
+        sResult.AssignUtf8(pchrSource, uiBytes);
+        return sResult;
+    }
 
-        return utf8_string;
+    static CEString sFromUtf8(const char * szSource)
+    {
+        return sFromUtf8(szSource, strlen(szSource));
     }
 
     static CEString sFromUtf8(const string& stl_sSource)
     {
-        wstring_convert<std::codecvt_utf8<wchar_t>> converter;
-        return converter.from_bytes(stl_sSource).c_str();
+        return sFromUtf8(stl_sSource.data(), stl_sSource.length());
     }
+
+    // Decodes straight into this string's buffer
+    void AssignUtf8(const char * pchrSource, size_t uiBytes)
+    {
+        // Nothing decodes to fewer than a quarter as many characters as bytes
+        if (uiBytes / 4 >= cuiMaxSize_)
+        {
+            const wchar_t * szMsg = L"Source string too long.";
+            ERROR_LOG(szMsg);
+            throw CException(H_ERROR_INVALID_ARG, szMsg);
+        }
+
+        unsigned int uiMaxLength = (unsigned int)Utf8::uiMaxDecodedLength(uiBytes);
+        if (uiMaxLength >= m_uiCapacity)
+        {
+            // Old contents are discarded, no need to copy them over
+            // May exceed cuiMaxSize_ if the input is mostly multibyte
+            unsigned int uiNewCapacity = max(uiGrowthCapacity(uiMaxLength + 1), uiMaxLength + 1);
+            m_spHeap = make_unique<wchar_t[]>(uiNewCapacity);
+            m_szData = m_spHeap.get();
+            m_uiCapacity = uiNewCapacity;
+        }
+
+        auto uiLength = (unsigned int)Utf8::uiDecode(pchrSource, uiBytes, m_szData);
+        m_bInvalid = true;
+        if (uiLength >= cuiMaxSize_)
+        {
+            m_szData[0] = L'\0';
+            m_uiLength = 0;
+            const wchar_t * szMsg = L"Source string too long.";
+            ERROR_LOG(szMsg);
+            throw CException(H_ERROR_INVALID_ARG, szMsg);
+        }
+
+        m_szData[uiLength] = L'\0';
+        m_uiLength = uiLength;
+
+    }   //  AssignUtf8 (...)
  
     /*
     //
@@ -2705,51 +3720,123 @@ public:
 ////////////////////////////////////////////////////////////////////////////////////////////
 
 
-private:
+private:
+
+//    void Null()
+//    {
+//        m_szRegex[0] = L'\0';
+//          m_szVowels[0] = L'\0';
+//        m_szBreakChars[0] = L'\0';
+//        m_szTabs[0] = L'\0';
+//        m_szPunctuation[0] = L'\0';
+//        m_szEscapeChars[0] = L'\0';
+//    }
+
+    //
+    // Buffer management: capacity grows geometrically so that a sequence of appends
+    // copies O(n) characters in total
+    //
+    static unsigned int uiRoundCapacity (unsigned int uiRequired)
+    {
+        unsigned int uiCapacity = max (uiRequired, cuiMinCapacity_);
+        uiCapacity = (uiCapacity + cuiCapacityAlignment_ - 1) & ~(cuiCapacityAlignment_ - 1);
+        return min (uiCapacity, cuiMaxSize_);
+    }
+
+    unsigned int uiGrowthCapacity (unsigned int uiRequired) const
+    {
+        unsigned int uiGrown = m_uiCapacity + m_uiCapacity / 2;
+        return uiRoundCapacity (max (uiRequired, uiGrown));
+    }
+
+    bool bIsInline() const
+    {
+        return m_szData == m_szInline;
+    }
+
+    void Reallocate (unsigned int uiNewCapacity)
+    {
+        assert(uiNewCapacity > m_uiLength);
+        if (uiNewCapacity <= cuiInlineCapacity_)
+        {
+            if (!bIsInline())
+            {
+                wmemcpy(m_szInline, m_szData, m_uiLength); 
+                m_szInline[m_uiLength] = L'\0';
+                m_szData = m_szInline;
+                m_uiCapacity = cuiInlineCapacity_;
+                m_spHeap.reset();
+            }
+            return;
+        }
+
+        unique_ptr<wchar_t[]> szNewBuffer = make_unique<wchar_t[]>(uiNewCapacity);
+        wmemcpy(szNewBuffer.get(), m_szData, m_uiLength); 
+        szNewBuffer[m_uiLength] = L'\0';
+        m_spHeap = move(szNewBuffer);
+        m_szData = m_spHeap.get();
+        m_uiCapacity = uiNewCapacity;
+    
+    }   //  Reallocate()
+
+    // Move contents out of Source leaving it empty; heap buffers change owners, 
+    // inline ones are copied
+    void TakeBuffer (CEString& Source)
+    {
+        if (Source.bIsInline())
+        {
+            wmemcpy(m_szInline, Source.m_szInline, Source.m_uiLength + 1);
+            m_szData = m_szInline;
+            m_uiCapacity = cuiInlineCapacity_;
+            m_spHeap.reset();
+        }
+        else
+        {
+            m_spHeap = std::move(Source.m_spHeap);
+            m_szData = m_spHeap.get();
+            m_uiCapacity = Source.m_uiCapacity;
+        }
+        m_uiLength = Source.m_uiLength;
+
+        Source.m_szData = Source.m_szInline;
+        Source.m_szInline[0] = L'\0';
+        Source.m_uiLength = 0;
+        Source.m_uiCapacity = cuiInlineCapacity_;
+        Source.m_bInvalid = true;
 
-//    void Null()
-//    {
-//        m_szRegex[0] = L'\0';
-//          m_szVowels[0] = L'\0';
-//        m_szBreakChars[0] = L'\0';
-//        m_szTabs[0] = L'\0';
-//        m_szPunctuation[0] = L'\0';
-//        m_szEscapeChars[0] = L'\0';
-//    }
+    }   //  TakeBuffer (...)
 
-    void Grow (unsigned int uiCharsToAdd)
+    // Make room for uiNewLength characters plus terminator
+    void EnsureCapacity (unsigned int uiNewLength)
     {
-        unsigned int uiNewLength = m_uiLength + uiCharsToAdd;
-        unsigned int uiNewBlocks = (uiNewLength+1)/uiBlockSize_;
-        assert(uiNewBlocks >= m_uiBlocksAllocated);
-        if (uiNewBlocks == m_uiBlocksAllocated)
+        if (uiNewLength < m_uiCapacity)
         {
             return;
         }
-        
-        unique_ptr<wchar_t[]> szNewBuffer = make_unique<wchar_t[]>(uiNewBlocks * uiBlockSize_);
-        if (m_uiLength > 0)
-        {
-            wmemmove(szNewBuffer.get(), m_szData.get(), m_uiLength+1); 
-        }
-//        delete[] m_szData;
-        m_szData = move(szNewBuffer);
-    
-    }   //  Grow()
 
+        Reallocate (uiGrowthCapacity (uiNewLength + 1));
+    }
+
+    bool bRegexDisabled() const
+    {
+        return m_spRegex && m_spRegex->sPattern().empty();
+    }
+
+    bool bIsOwnBuffer (const wchar_t * pchr) const
+    {
+        return pchr >= m_szData && pchr < m_szData + m_uiCapacity;
+    }
+
+    // Give memory back only when most of the buffer is unused so that 
+    // alternating erase/append does not thrash; ShrinkToFit() trims explicitly
     void Shrink()
     {
-        unsigned int uiBlocksToFree = ((m_uiBlocksAllocated * uiBlockSize_) - (m_uiLength + 1)) / uiBlockSize_;
-        if (uiBlocksToFree < 1)
+        if (m_uiCapacity <= 4 * cuiMinCapacity_ || (m_uiLength + 1) * 4 > m_uiCapacity)
         {
             return;
         }
 
-        m_uiBlocksAllocated -= uiBlocksToFree;
-        m_uiBlocksAllocated = max ((int)m_uiBlocksAllocated, 1);
-        unique_ptr<wchar_t[]> szNewBuffer = make_unique<wchar_t[]>(m_uiBlocksAllocated * uiBlockSize_);
-        wmemmove(szNewBuffer.get(), m_szData.get(), m_uiLength + 1); 
-        m_szData = move(szNewBuffer);
+        Reallocate (uiRoundCapacity ((m_uiLength + 1) * 2));
     
     }   //  Shrink()
 
@@ -2763,17 +3850,21 @@ private:
             throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        if (uiNewLength >= m_uiBlocksAllocated * uiBlockSize_)
+        if (uiNewLength >= m_uiCapacity)
         {
-            m_uiBlocksAllocated = ((uiNewLength+1)/uiBlockSize_) + 1;
-            unsigned int uiAllocSize = m_uiBlocksAllocated * uiBlockSize_;
-            unique_ptr<wchar_t[]> szNewData = make_unique<wchar_t[]>(uiAllocSize);
-            wmemmove(szNewData.get(), m_szData.get(), m_uiLength + 1);
-            m_szData = move(szNewData);
+            // Rhs may point into our own buffer, e.g. s += s
+            ptrdiff_t iRhsOffset = bIsOwnBuffer (szRhs) ? szRhs - m_szData : -1;
+            Reallocate (uiGrowthCapacity (uiNewLength + 1));
+            if (iRhsOffset >= 0)
+            {
+                szRhs = m_szData + iRhsOffset;
+            }
         }
 
-        wmemmove(&m_szData[m_uiLength], szRhs, uiRhsLength + 1); 
+        wmemmove(&m_szData[m_uiLength], szRhs, uiRhsLength); 
         m_uiLength = uiNewLength;
+        m_szData[m_uiLength] = L'\0';
+        m_bInvalid = true;
 
     }   //  void Concatenate (...)
 
@@ -2787,165 +3878,59 @@ private:
         m_bInvalid = false;
         m_vecTokens.clear();
 
-        StToken stToken;
-        for (unsigned int uiAt = 0; uiAt < m_uiBlocksAllocated * uiBlockSize_; ++uiAt)
-        {
-            wchar_t chrCurrent = m_szData[uiAt];
-
-            if (L'\0' == chrCurrent)
-            {
-                if (uiAt != m_uiLength)
-                {
-                    m_bInvalid = true;
-                    const wchar_t * szMsg = L"Unexpected NULL character.";
-                    ERROR_LOG(szMsg);
-                    throw CException (H_ERROR_UNEXPECTED, szMsg);
-                }
-
-                if (0 == uiAt)
-                {
-                    return;
-                }
-
-                if (ecTokenTypeFront == stToken.eType)
-                {
-                    m_bInvalid = true;
-                    const wchar_t * szMsg = L"Illegal token type.";
-                    ERROR_LOG(szMsg);
-                    throw CException (H_ERROR_UNEXPECTED, szMsg);
-                }
-
-                m_vecTokens.push_back (stToken);
-                return;
-            }
-
-            if (bIn (chrCurrent, m_Breaks.szGet()))
-            {
-                Advance (ecTokenBreakChars, uiAt, stToken);
-                continue;
-            }
-
-            if (bIn (chrCurrent, m_Tabs.szGet()))
-            {
-                Advance (ecTokenTab, uiAt, stToken);
-                continue;
-            }
-
-            if (bIn (chrCurrent, m_Punctuation.szGet()))
-            {
-                Advance (ecTokenPunctuation, uiAt, stToken);
-                continue;
-            }
-
-            if (bIn (chrCurrent, m_Escape.szGet()))
-            {
-
-                assert(m_uiLength > 0);
-                if (uiAt >= m_uiLength-1)
-                {
-                    m_bInvalid = true;
-                    const wchar_t * szMsg = L"Unexpected escape character.";
-                    ERROR_LOG(szMsg);
-                    throw CException (H_ERROR_UNEXPECTED, szMsg);
-                }
-
-                bool bDoubleEscape = false;
-                if (chrCurrent == m_szData[uiAt+1])
-                {
-                    bDoubleEscape = true;
-                }
-                else if (uiAt > 0 && (chrCurrent == m_szData[uiAt-1]))
-                {
-                    bDoubleEscape = true;
-                }
-
-                if (!bDoubleEscape)
-                {
-                    AddTag (uiAt, stToken);
-                    continue;
-                }
-
-            }   //  for (int uiAt = 0; ...)
-
-            Advance (ecTokenText, uiAt, stToken);
-            
-        }   //  for ...
-
-        m_bInvalid = true;
-        const wchar_t * szMsg = L"Tokenizer failed.";
-        ERROR_LOG(szMsg);
-        throw CException (H_ERROR_UNEXPECTED, szMsg);
+        ScanTokens();
+        CountTokens();
 
-    }   //  Tokenize_ (...)
+    }   //  Tokenize()
 
-    void Advance (ETokenType eType, unsigned int uiOffset, StToken& stToken)
+    void CountTokens()
     {
-        if (eType <= ecTokenTypeFront || eType > ecTokenTypeBack)
+        m_bTokenIndexValid = false;
+        m_arrTypeStart.fill (0);
+        for (const StToken& stToken : m_vecTokens)
         {
-            const wchar_t * szMsg = L"Unexpected token state.";
-            ERROR_LOG(szMsg);
-            throw CException (H_ERROR_UNEXPECTED, szMsg);
+            assert(stToken.eType >= ecTokenText && stToken.eType < ecTokenTypeBack);
+            ++m_arrTypeStart[stToken.eType - ecTokenText + 1];
         }
 
-        if (eType != stToken.eType)
-        {
-            if (ecTokenTypeFront != stToken.eType)
-            {
-                m_vecTokens.push_back (stToken);
-            }
-
-            stToken.eType = eType;
-            stToken.uiOffset = uiOffset;
-            stToken.uiLength = 1;
-        }
-        else
+        for (unsigned int uiType = 1; uiType <= cuiTokenTypes_; ++uiType)
         {
-            ++stToken.uiLength;
+            m_arrTypeStart[uiType] += m_arrTypeStart[uiType - 1];
         }
-    
-    }   // void Advance (...)
 
-    void AddTag (unsigned int uiOffset, StToken& stToken)
-    {
-        if (ecTokenMeta == stToken.eType)
-        {
-            const wchar_t * szMsg = L"Unexpected token state.";
-            ERROR_LOG(szMsg);
-            throw CException (H_ERROR_UNEXPECTED, szMsg);
-        }
+    }   //  CountTokens()
 
-        if (ecTokenTypeFront != stToken.eType)
+    // Counting sort of token positions by type, see m_vecTokenIndex
+    void IndexTokens()
+    {
+        array<unsigned int, cuiTokenTypes_ + 1> arrNext = m_arrTypeStart;
+        m_vecTokenIndex.resize (m_vecTokens.size());
+        for (unsigned int uiToken = 0; uiToken < (unsigned int)m_vecTokens.size(); ++uiToken)
         {
-            m_vecTokens.push_back (stToken);
+            m_vecTokenIndex[arrNext[m_vecTokens[uiToken].eType - ecTokenText]++] = uiToken;
         }
+        m_bTokenIndexValid = true;
 
-        stToken.eType = ecTokenMeta;
-        stToken.uiOffset = uiOffset;
-        stToken.uiLength = 0;
+    }   //  IndexTokens()
 
-        for (int iAt = uiOffset + 1; iAt < (int)(m_uiBlocksAllocated * uiBlockSize_); ++iAt)
+    void ScanTokens()
+    {
+        try
         {
-            if (L'\0' == m_szData[iAt])
+            CTokenScanner Scanner (m_szData, m_uiLength, *m_spSeparators);
+            StToken stToken;
+            while (Scanner.bNext (stToken))
             {
-                const wchar_t * szMsg = L"Unterminated escape sequence.";
-                ERROR_LOG(szMsg);
-                throw CException (H_ERROR_UNEXPECTED, szMsg);
-            }
-
-            if (bIn (m_szData[iAt], m_Escape.szGet()))
-            {
-                if ((int)uiOffset+1 == iAt)
-                {
-                    const wchar_t * szMsg = L"Empty escape sequence.";
-                    ERROR_LOG(szMsg);
-                    throw CException (H_ERROR_UNEXPECTED, szMsg);
-                }
-                stToken.uiLength = iAt - uiOffset + 1;
                 m_vecTokens.push_back (stToken);
-                break;
             }
         }
-    }       //  AddTag (...)
+        catch (CException&)
+        {
+            m_bInvalid = true;
+            throw;
+        }
+
+    }   //  ScanTokens()
 
     // Assign null-terminated string erasing current contents
     // uiSourceLength does not count final '0'
@@ -2965,24 +3950,38 @@ private:
             throw CException (H_ERROR_UNEXPECTED, szMsg);
         }
 
-        if (uiSourceLength >= (m_uiBlocksAllocated * uiBlockSize_))
+        AssignChars (szSource, uiSourceLength);
+    
+    }   //  Assign (...)
+
+    // Same as Assign() but the source need not be null-terminated; it may
+    // also point into this string's own buffer
+    void AssignChars (const wchar_t * pchrSource, unsigned int uiSourceLength)
+    {
+        if (uiSourceLength >= cuiMaxSize_)
+        {
+            const wchar_t * szMsg = L"Source string too long.";
+            ERROR_LOG(szMsg);
+            throw CException (H_ERROR_INVALID_ARG, szMsg);
+        }
+
+        if (uiSourceLength >= m_uiCapacity)
         {
-            m_uiBlocksAllocated = ((uiSourceLength+1)/uiBlockSize_) + 1;
-//            if (m_szData)
-//            {
-//                delete[] m_szData;
-//            }
-            m_szData = make_unique<wchar_t[]>(uiBlockSize_ * m_uiBlocksAllocated);
+            // Old contents are discarded, no need to copy them over
+            unsigned int uiNewCapacity = uiGrowthCapacity (uiSourceLength + 1);
+            m_spHeap = make_unique<wchar_t[]>(uiNewCapacity);
+            m_szData = m_spHeap.get();
+            m_uiCapacity = uiNewCapacity;
         }
 
-        wmemmove(m_szData.get(), szSource, uiSourceLength); 
+        wmemmove(m_szData, pchrSource, uiSourceLength); 
 
         m_szData[uiSourceLength] = L'\0';
         m_uiLength = uiSourceLength;
 
         m_bInvalid = true;
     
-    }   //  Assign (...)
+    }   //  AssignChars (...)
 
     vector<StToken>::iterator itFindToken (unsigned int uiAt, ETokenType eType)
     {
@@ -2990,7 +3989,7 @@ private:
         if (ecTokenRegexMatch == eType)
         {
 //            if ((0 == wcslen (m_szRegex)) || m_vecRegexMatches.empty())
-            if (m_Regex.bDisabled() || m_vecRegexMatches.empty())
+            if (bRegexDisabled() || m_vecRegexMatches.empty())
             {
                 ERROR_LOG(L"*** Warning: no regex matches.");
                 return rvecTokens.end();
@@ -3008,30 +4007,44 @@ private:
             throw CException (H_ERROR_UNEXPECTED, szMsg);
         }
 
-        unsigned int uiField = 0;
-        vector<StToken>::iterator it_ = rvecTokens.begin();
-        for (; it_ != rvecTokens.end(); ++it_)
+        // All regex matches are of the same type
+        if (ecTokenRegexMatch == eType)
+        {
+            return rvecTokens.begin() + uiAt;
+        }
+
+        if (uiAt >= uiGetNumOfFields (eType))
+        {
+            wstring wstrMsg (L"Token position out of range, string = ");
+            wstrMsg.append (m_szData, min (m_uiLength, 900u));
+            ERROR_LOG(wstrMsg.c_str());
+            throw CException (H_ERROR_UNEXPECTED, wstrMsg.c_str());
+        }
+
+        if (rvecTokens.size() <= cuiMaxLinearTokenScan_)
         {
-            if (eType == (*it_).eType)
+            unsigned int uiField = 0;
+            vector<StToken>::iterator it_ = rvecTokens.begin();
+            for (; it_ != rvecTokens.end(); ++it_)
             {
-                if (uiAt == uiField)
+                if (eType == (*it_).eType)
                 {
-                    break;
+                    if (uiAt == uiField)
+                    {
+                        break;
+                    }
+                    ++uiField;
                 }
-                ++uiField;
             }
+            return it_;
         }
 
-        if (rvecTokens.end() == it_)
+        if (!m_bTokenIndexValid)
         {
-            wchar_t szMsgBuf[1000];
-            wcscpy(szMsgBuf, L"Token position out of range, string = ");
-            wcscat(szMsgBuf, m_szData.get());
-            ERROR_LOG(szMsgBuf);
-            throw CException (H_ERROR_UNEXPECTED, szMsgBuf);
+            IndexTokens();
         }
 
-        return it_;
+        return rvecTokens.begin() + m_vecTokenIndex[m_arrTypeStart[eType - ecTokenText] + uiAt];
 
     }   //  itFindToken (...)
 
@@ -3041,7 +4054,7 @@ private:
         if (ecTokenRegexMatch == eType)
         {
 //            if ((0 == wcslen (m_szRegex)) || m_vecRegexMatches.empty())
-            if (m_Regex.bDisabled() || m_vecRegexMatches.empty())
+            if (bRegexDisabled() || m_vecRegexMatches.empty())
             {
                 ERROR_LOG(L"*** Warning: no regex matches.");
                 return rvecTokens.end();
@@ -3094,46 +4107,61 @@ private:
             throw CException (H_ERROR_INVALID_ARG, szMsg);
         }
 
-        m_Regex.Set (szRegex);
-/*
-        errno_t error = wmemmove_s (m_szRegex, cuiMaxRegexLength_-1, szRegex, uiRegexLength); 
-        if (error)
+        shared_ptr<const CRegex> spRegex;
+        try
+        {
+            spRegex = CRegex::spGet (szRegex);
+        }
+        catch (regex_error& rxError_)
+        {
+            wstring str_msg (L"Regex error: ");
+            str_msg += str_RegexError_ (rxError_.code());
+            ERROR_LOG(str_msg.c_str());
+            m_spRegex.reset();
+            return false;
+        }
+
+        return bRegexEvaluate (spRegex, bMatchMode);
+
+    }   //  RegexEvaluate (...)
+
+    bool bRegexEvaluate (const shared_ptr<const CRegex>& spRegex, bool bMatchMode)
+    {
+        if (!spRegex)
         {
-            wchar_t * szMsg = L"wmemmove_s error.";
+            const wchar_t* szMsg = L"Regular expression is null.";
             ERROR_LOG(szMsg);
-            throw CException (error, szMsg);
+            throw CException(H_ERROR_INVALID_ARG, szMsg);
         }
 
-        m_szRegex[uiRegexLength] = L'\0';
-*/
+        if (0 == m_uiLength)
+        {
+            return false;
+        }
+
+        m_spRegex = spRegex;
+
         bool bRet = false;
 
         try
         {
-            wregex regex_ (m_Regex.szGet());
-            wsmatch match_;
-            wstring wstrData (m_szData.get());
-            if (bMatchMode)
-            {
-                bRet = regex_match (wstrData, match_, regex_);
-            }
-            else
-            {
-                bRet = regex_search (wstrData, match_, regex_);
-            }
-
-            if (match_[0].matched)
+            // Match in place, positions are relative to the start of the buffer
+            thread_local vector<int> t_vecSlots;
+            bRet = spRegex->bEvaluate (m_szData, m_uiLength, bMatchMode, t_vecSlots);
+            if (bRet)
             {
                 m_vecRegexMatches.clear();
-                for (unsigned int uiAt = 1; uiAt < match_.size(); ++uiAt)
+                for (unsigned int uiAt = 1; uiAt < t_vecSlots.size() / 2; ++uiAt)
                 {
                     StToken stToken;
                     stToken.eType = ecTokenRegexMatch;
-                    if (match_[uiAt].length() > 0)
+                    int iStart = t_vecSlots[2 * uiAt];
+                    int iEnd = t_vecSlots[2 * uiAt + 1];
+                    if (iStart >= 0 && iEnd > iStart)
                     {
-                        stToken.uiOffset = static_cast <int> (match_.position(uiAt));
+                        stToken.uiOffset = static_cast <unsigned int> (iStart);
+                        stToken.uiLength = static_cast <unsigned int> (iEnd - iStart);
                     }
-                    stToken.uiLength = static_cast<unsigned int>(match_.length(uiAt));
                     m_vecRegexMatches.push_back (stToken);
                 }
             }
@@ -3360,6 +4388,129 @@ friend bool operator>= (const CEString& sLhs, const CEString& sRhs)
 
 };   //  class  CEString
 
+//
+// UTF-8 encoded string for bulk storage -- large word lists, dictionary 
+// entries held in memory -- and for passing text to and from sqlite without 
+// transcoding. Russian text takes about 2 bytes per character here vs. 4 in 
+// a CEString on Linux. Only storage, comparison and conversion are provided;
+// convert to CEString (sToEString()) to tokenize, search, match etc.
+//
+class CEStringUtf8
+{
+public:
+    CEStringUtf8()
+    {}
+
+    // Bytes are taken as is, e.g. from sqlite3_column_text()
+    CEStringUtf8 (const char * pchrUtf8, size_t uiBytes) : m_stl_sData (pchrUtf8, uiBytes)
+    {}
+
+    explicit CEStringUtf8 (const char * szUtf8) : m_stl_sData (szUtf8)
+    {}
+
+    explicit CEStringUtf8 (const CEStringView& svSource)
+    {
+        Assign (svSource);
+    }
+
+    explicit CEStringUtf8 (const CEString& sSource) : CEStringUtf8 (CEStringView (sSource))
+    {}
+
+    explicit CEStringUtf8 (const wchar_t * szSource) : CEStringUtf8 (CEStringView (szSource))
+    {}
+
+    void Assign (const char * pchrUtf8, size_t uiBytes)
+    {
+        m_stl_sData.assign (pchrUtf8, uiBytes);
+    }
+
+    // Sized exactly, so that stored strings carry no worst-case slack
+    void Assign (const CEStringView& svSource)
+    {
+        m_stl_sData.resize (Utf8::uiEncodedLength (svSource.pchrData(), svSource.uiLength()));
+        Utf8::uiEncode (svSource.pchrData(), svSource.uiLength(), &m_stl_sData[0]);
+    }
+
+    CEStringUtf8& operator= (const CEStringView& svSource)
+    {
+        Assign (svSource);
+        return *this;
+    }
+
+    // Null-terminated
+    const char * szData() const
+    {
+        return m_stl_sData.c_str();
+    }
+
+    unsigned int uiBytes() const
+    {
+        return static_cast<unsigned int> (m_stl_sData.length());
+    }
+
+    bool bIsEmpty() const
+    {
+        return m_stl_sData.empty();
+    }
+
+    const string& stl_sGet() const
+    {
+        return m_stl_sData;
+    }
+
+    CEString sToEString() const
+    {
+        return CEString::sFromUtf8 (m_stl_sData.data(), m_stl_sData.length());
+    }
+
+    // Reuses the capacity of sOut
+    void ToEString (CEString& sOut) const
+    {
+        sOut.AssignUtf8 (m_stl_sData.data(), m_stl_sData.length());
+    }
+
+    void Erase()
+    {
+        m_stl_sData.clear();
+    }
+
+    // Byte order of UTF-8 is code point order, i.e. the order CEString
+    // comparisons give where wchar_t is UTF-32
+    friend bool operator== (const CEStringUtf8& sLhs, const CEStringUtf8& sRhs)
+    {
+        return sLhs.m_stl_sData == sRhs.m_stl_sData;
+    }
+
+    friend bool operator!= (const CEStringUtf8& sLhs, const CEStringUtf8& sRhs)
+    {
+        return sLhs.m_stl_sData != sRhs.m_stl_sData;
+    }
+
+    friend bool operator< (const CEStringUtf8& sLhs, const CEStringUtf8& sRhs)
+    {
+        return sLhs.m_stl_sData < sRhs.m_stl_sData;
+    }
+
+    friend bool operator> (const CEStringUtf8& sLhs, const CEStringUtf8& sRhs)
+    {
+        return sLhs.m_stl_sData > sRhs.m_stl_sData;
+    }
+
+    friend bool operator<= (const CEStringUtf8& sLhs, const CEStringUtf8& sRhs)
+    {
+        return sLhs.m_stl_sData <= sRhs.m_stl_sData;
+    }
+
+    friend bool operator>= (const CEStringUtf8& sLhs, const CEStringUtf8& sRhs)
+    {
+        return sLhs.m_stl_sData >= sRhs.m_stl_sData;
+    }
+
+private:
+    string m_stl_sData;
+
+};      //  class CEStringUtf8
+
 }   //  namespace Hlib
 
 #endif
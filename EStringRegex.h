@@ -0,0 +1,975 @@
+#ifndef C_ESTRINGREGEX_H_INCLUDED
+#define C_ESTRINGREGEX_H_INCLUDED
+
+//
+// Thompson NFA matcher ("Pike VM") for the subset of ECMAScript regular
+// expressions that CEString patterns use: literals, '.', bracket classes with
+// ranges, ^ and $, capturing and (?:) groups, alternation and greedy or lazy
+// quantifiers. Threads are kept in priority order, so the overall match and the
+// submatches are the ones std::regex's backtracking would report, but time is
+// linear in the input. Anything outside the subset -- including constructs
+// whose submatches could come out differently -- is rejected by the compiler,
+// and the caller falls back on std::wregex.
+//
+
+#include <algorithm>
+#include <cwchar>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Hlib
+{
+
+namespace Regex
+{
+
+class CProgram
+{
+public:
+    static constexpr unsigned int cuiMaxInstructions_ = 10000;
+    static constexpr unsigned int cuiMaxRepeat_ = 1000;
+    static constexpr unsigned int cuiInfinite_ = 0xFFFFFFFF;
+
+    // Returns null if the pattern is not in the supported subset or is malformed;
+    // std::regex is then left to either handle it or report the error
+    static std::unique_ptr<CProgram> spCompile (const wchar_t * pchrPattern, size_t uiLength)
+    {
+        std::unique_ptr<CProgram> spProgram (new CProgram());
+        CParser Parser (pchrPattern, uiLength, spProgram->m_vecClasses);
+        StNode stRoot;
+        if (!Parser.bParse (stRoot))
+        {
+            return nullptr;
+        }
+
+        spProgram->m_uiGroups = Parser.uiGroups();
+        spProgram->m_bAnchored = bStartsWithBegin (stRoot);
+
+        spProgram->Emit (ecOpSave, 0);
+        if (!spProgram->bCompile (stRoot))
+        {
+            return nullptr;
+        }
+        spProgram->Emit (ecOpSave, 1);
+        spProgram->Emit (ecOpMatch);
+
+        return spProgram;
+
+    }   //  spCompile (...)
+
+    // Capturing groups, not counting the whole match
+    unsigned int uiGroups() const
+    {
+        return m_uiGroups;
+    }
+
+    // vecSlots receives start and end offsets of the match and of each group,
+    // -1 for groups that did not participate. In full match mode the whole
+    // input must match, as with regex_match; otherwise this is regex_search.
+    bool bExecute (const wchar_t * pchrData, unsigned int uiLength, bool bFullMatch, std::vector<int>& vecSlots) const
+    {
+        unsigned int uiSlots = 2 * (m_uiGroups + 1);
+        vecSlots.assign (uiSlots, -1);
+
+        thread_local StScratch t_stScratch;
+        t_stScratch.Reset ((unsigned int)m_vecProgram.size(), uiSlots);
+        StThreadList * pCurrent = &t_stScratch.arrLists[0];
+        StThreadList * pNext = &t_stScratch.arrLists[1];
+        int * pWorkCaps = t_stScratch.vecWorkCaps.data();
+
+        StExecution stRun { pchrData, (int)uiLength, uiSlots };
+        bool bAnchored = bFullMatch || m_bAnchored;
+        bool bMatched = false;
+        for (int iPos = 0; ; ++iPos)
+        {
+            if (!bMatched && (0 == iPos || !bAnchored))
+            {
+                std::fill (pWorkCaps, pWorkCaps + uiSlots, -1);
+                AddThread (stRun, *pCurrent, 0, iPos, pWorkCaps);
+            }
+
+            if (0 == pCurrent->uiSize)
+            {
+                break;
+            }
+
+            // AddThread() only keeps consuming threads that accept the character
+            // at their position, so all of them advance
+            pNext->Clear();
+            bool bHaveChar = iPos < stRun.iLength;
+            for (unsigned int uiThread = 0; uiThread < pCurrent->uiSize; ++uiThread)
+            {
+                unsigned int uiPc = pCurrent->vecDense[uiThread];
+                int * pThreadCaps = &pCurrent->vecCaps[uiThread * uiSlots];
+                EOpcode eOp = m_vecProgram[uiPc].eOp;
+                if (ecOpChar == eOp || ecOpAny == eOp || ecOpClass == eOp)
+                {
+                    AddThread (stRun, *pNext, uiPc + 1, iPos + 1, pThreadCaps);
+                    continue;
+                }
+
+                if (ecOpMatch != eOp || (bFullMatch && bHaveChar))
+                {
+                    continue;
+                }
+
+                bMatched = true;
+                std::copy (pThreadCaps, pThreadCaps + uiSlots, vecSlots.begin());
+                break;      // lower-priority threads are cut off
+            }
+
+            std::swap (pCurrent, pNext);
+            if (!bHaveChar)
+            {
+                break;
+            }
+        }
+
+        return bMatched;
+
+    }   //  bExecute (...)
+
+private:
+    enum EOpcode
+    {
+        ecOpChar,
+        ecOpAny,
+        ecOpClass,
+        ecOpMatch,
+        ecOpJump,
+        ecOpSplit,          // try uiX first, then uiY
+        ecOpSave,
+        ecOpAssertBegin,
+        ecOpAssertEnd
+    };
+
+    struct StInstruction
+    {
+        EOpcode eOp;
+        wchar_t chr;
+        unsigned int uiArg;
+        unsigned int uiX;
+        unsigned int uiY;
+    };
+
+    struct StClass
+    {
+        std::vector<std::pair<wchar_t, wchar_t>> vecRanges;     // sorted, disjoint
+        bool bNegated { false };
+
+        bool bContains (wchar_t chr) const
+        {
+            auto itRange = std::upper_bound (vecRanges.begin(), vecRanges.end(), chr,
+                [](wchar_t chrKey, const std::pair<wchar_t, wchar_t>& pairRange) { return chrKey < pairRange.first; });
+            bool bIn = itRange != vecRanges.begin() && chr <= (itRange - 1)->second;
+            return bIn != bNegated;
+        }
+
+        void Normalize()
+        {
+            std::sort (vecRanges.begin(), vecRanges.end());
+            std::vector<std::pair<wchar_t, wchar_t>> vecMerged;
+            for (const auto& pairRange : vecRanges)
+            {
+                if (!vecMerged.empty() && pairRange.first <= vecMerged.back().second + 1)
+                {
+                    vecMerged.back().second = std::max (vecMerged.back().second, pairRange.second);
+                }
+                else
+                {
+                    vecMerged.push_back (pairRange);
+                }
+            }
+            vecRanges.swap (vecMerged);
+        }
+    };
+
+    enum ENodeType
+    {
+        ecNodeEmpty,
+        ecNodeChar,
+        ecNodeAny,
+        ecNodeClass,
+        ecNodeBegin,
+        ecNodeEnd,
+        ecNodeGroup,
+        ecNodeConcat,
+        ecNodeAlternation,
+        ecNodeRepeat
+    };
+
+    struct StNode
+    {
+        ENodeType eType { ecNodeEmpty };
+        wchar_t chr { 0 };
+        unsigned int uiClass { 0 };
+        int iGroup { -1 };                  // -1 for (?:...)
+        unsigned int uiMin { 0 };
+        unsigned int uiMax { 0 };
+        bool bGreedy { true };
+        std::vector<StNode> vecChildren;
+    };
+
+    //
+    // Recursive descent over the pattern; bParse() fails on anything it does not
+    // fully understand
+    //
+    class CParser
+    {
+    public:
+        CParser (const wchar_t * pchrPattern, size_t uiLength, std::vector<StClass>& vecClasses) :
+            m_pchrPattern (pchrPattern),
+            m_uiLength (uiLength),
+            m_uiPos (0),
+            m_uiGroups (0),
+            m_bSupported (true),
+            m_vecClasses (vecClasses)
+        {}
+
+        bool bParse (StNode& stRoot)
+        {
+            stRoot = stParseAlternation (0);
+            return m_bSupported && m_uiPos == m_uiLength;
+        }
+
+        unsigned int uiGroups() const
+        {
+            return m_uiGroups;
+        }
+
+    private:
+        static constexpr unsigned int cuiMaxDepth_ = 200;
+
+        const wchar_t * m_pchrPattern;
+        size_t m_uiLength;
+        size_t m_uiPos;
+        unsigned int m_uiGroups;
+        bool m_bSupported;
+        std::vector<StClass>& m_vecClasses;
+
+        bool bAtEnd() const
+        {
+            return m_uiPos >= m_uiLength;
+        }
+
+        wchar_t chrPeek (size_t uiAhead = 0) const
+        {
+            return (m_uiPos + uiAhead < m_uiLength) ? m_pchrPattern[m_uiPos + uiAhead] : L'\0';
+        }
+
+        StNode stUnsupported()
+        {
+            m_bSupported = false;
+            return StNode();
+        }
+
+        StNode stParseAlternation (unsigned int uiDepth)
+        {
+            if (uiDepth > cuiMaxDepth_)
+            {
+                return stUnsupported();
+            }
+
+            StNode stAlternation;
+            stAlternation.eType = ecNodeAlternation;
+            stAlternation.vecChildren.push_back (stParseConcat (uiDepth));
+            while (m_bSupported && !bAtEnd() && L'|' == chrPeek())
+            {
+                ++m_uiPos;
+                stAlternation.vecChildren.push_back (stParseConcat (uiDepth));
+            }
+
+            if (1 == stAlternation.vecChildren.size())
+            {
+                StNode stOnly = std::move (stAlternation.vecChildren[0]);
+                return stOnly;
+            }
+            return stAlternation;
+        }
+
+        StNode stParseConcat (unsigned int uiDepth)
+        {
+            StNode stConcat;
+            stConcat.eType = ecNodeConcat;
+            while (m_bSupported && !bAtEnd() && L'|' != chrPeek() && L')' != chrPeek())
+            {
+                stConcat.vecChildren.push_back (stParseRepeat (uiDepth));
+            }
+            return stConcat;
+        }
+
+        StNode stParseRepeat (unsigned int uiDepth)
+        {
+            StNode stAtom = stParseAtom (uiDepth);
+            if (!m_bSupported || bAtEnd())
+            {
+                return stAtom;
+            }
+
+            unsigned int uiMin = 0, uiMax = 0;
+            wchar_t chr = chrPeek();
+            if (L'*' == chr)
+            {
+                uiMin = 0;
+                uiMax = cuiInfinite_;
+                ++m_uiPos;
+            }
+            else if (L'+' == chr)
+            {
+                uiMin = 1;
+                uiMax = cuiInfinite_;
+                ++m_uiPos;
+            }
+            else if (L'?' == chr)
+            {
+                uiMin = 0;
+                uiMax = 1;
+                ++m_uiPos;
+            }
+            else if (L'{' == chr)
+            {
+                if (!bParseBraces (uiMin, uiMax))
+                {
+                    return stUnsupported();
+                }
+            }
+            else
+            {
+                return stAtom;
+            }
+
+            if (ecNodeBegin == stAtom.eType || ecNodeEnd == stAtom.eType)
+            {
+                return stUnsupported();
+            }
+
+            StNode stRepeat;
+            stRepeat.eType = ecNodeRepeat;
+            stRepeat.uiMin = uiMin;
+            stRepeat.uiMax = uiMax;
+            if (L'?' == chrPeek())
+            {
+                stRepeat.bGreedy = false;
+                ++m_uiPos;
+            }
+
+            wchar_t chrNext = chrPeek();
+            if (L'*' == chrNext || L'+' == chrNext || L'?' == chrNext || L'{' == chrNext)
+            {
+                return stUnsupported();
+            }
+
+            // std::regex restarts captures on every iteration and rejects iterations
+            // that match nothing; the NFA does neither, so leave those to it
+            if (bNullable (stAtom) || (uiMax > 1 && bHasGroups (stAtom)))
+            {
+                return stUnsupported();
+            }
+
+            stRepeat.vecChildren.push_back (std::move (stAtom));
+            return stRepeat;
+
+        }   //  stParseRepeat (...)
+
+        bool bParseBraces (unsigned int& uiMin, unsigned int& uiMax)
+        {
+            ++m_uiPos;      // '{'
+            if (!bParseNumber (uiMin))
+            {
+                return false;
+            }
+
+            uiMax = uiMin;
+            if (L',' == chrPeek())
+            {
+                ++m_uiPos;
+                if (L'}' == chrPeek())
+                {
+                    uiMax = cuiInfinite_;
+                }
+                else if (!bParseNumber (uiMax) || uiMax < uiMin)
+                {
+                    return false;
+                }
+            }
+
+            if (L'}' != chrPeek())
+            {
+                return false;
+            }
+            ++m_uiPos;
+
+            return uiMin <= cuiMaxRepeat_ && (cuiInfinite_ == uiMax || uiMax <= cuiMaxRepeat_);
+        }
+
+        bool bParseNumber (unsigned int& uiValue)
+        {
+            size_t uiStart = m_uiPos;
+            uiValue = 0;
+            while (!bAtEnd() && chrPeek() >= L'0' && chrPeek() <= L'9')
+            {
+                uiValue = uiValue * 10 + (chrPeek() - L'0');
+                if (uiValue > cuiMaxRepeat_)
+                {
+                    return false;
+                }
+                ++m_uiPos;
+            }
+            return m_uiPos > uiStart;
+        }
+
+        StNode stParseAtom (unsigned int uiDepth)
+        {
+            StNode stAtom;
+            wchar_t chr = chrPeek();
+            switch (chr)
+            {
+                case L'(':
+                {
+                    ++m_uiPos;
+                    stAtom.eType = ecNodeGroup;
+                    if (L'?' == chrPeek())
+                    {
+                        if (L':' != chrPeek (1))
+                        {
+                            return stUnsupported();     // lookahead
+                        }
+                        m_uiPos += 2;
+                    }
+                    else
+                    {
+                        stAtom.iGroup = (int)++m_uiGroups;
+                    }
+
+                    stAtom.vecChildren.push_back (stParseAlternation (uiDepth + 1));
+                    if (!m_bSupported || L')' != chrPeek())
+                    {
+                        return stUnsupported();
+                    }
+                    ++m_uiPos;
+                    return stAtom;
+                }
+
+                case L'[':
+                    return stParseClass();
+
+                case L'.':
+                    ++m_uiPos;
+                    stAtom.eType = ecNodeAny;
+                    return stAtom;
+
+                case L'^':
+                    ++m_uiPos;
+                    stAtom.eType = ecNodeBegin;
+                    return stAtom;
+
+                case L'$':
+                    ++m_uiPos;
+                    stAtom.eType = ecNodeEnd;
+                    return stAtom;
+
+                case L'\\':
+                {
+                    ++m_uiPos;
+                    wchar_t chrLiteral = 0;
+                    if (!bParseEscape (chrLiteral))
+                    {
+                        return stUnsupported();
+                    }
+                    stAtom.eType = ecNodeChar;
+                    stAtom.chr = chrLiteral;
+                    return stAtom;
+                }
+
+                case L'*':
+                case L'+':
+                case L'?':
+                case L'{':
+                case L'}':
+                case L']':
+                    return stUnsupported();
+
+                default:
+                    ++m_uiPos;
+                    stAtom.eType = ecNodeChar;
+                    stAtom.chr = chr;
+                    return stAtom;
+            }
+
+        }   //  stParseAtom (...)
+
+        // The character after a backslash: control escapes and escaped ASCII
+        // punctuation only; \d, \w, \b, back references etc. are not supported
+        bool bParseEscape (wchar_t& chrLiteral)
+        {
+            if (bAtEnd())
+            {
+                return false;
+            }
+
+            wchar_t chr = chrPeek();
+            ++m_uiPos;
+            switch (chr)
+            {
+                case L't': chrLiteral = L'\t'; return true;
+                case L'n': chrLiteral = L'\n'; return true;
+                case L'r': chrLiteral = L'\r'; return true;
+                case L'f': chrLiteral = L'\f'; return true;
+                case L'v': chrLiteral = L'\v'; return true;
+                default: break;
+            }
+
+            bool bAsciiPunct = chr > L' ' && chr < 0x7F &&
+                !(chr >= L'0' && chr <= L'9') && !(chr >= L'a' && chr <= L'z') && !(chr >= L'A' && chr <= L'Z');
+            if (!bAsciiPunct)
+            {
+                return false;
+            }
+
+            chrLiteral = chr;
+            return true;
+        }
+
+        bool bParseClassChar (wchar_t& chr)
+        {
+            if (bAtEnd())
+            {
+                return false;
+            }
+
+            chr = chrPeek();
+            if (L'[' == chr)
+            {
+                return false;       // [:alpha:] and friends
+            }
+
+            ++m_uiPos;
+            if (L'\\' == chr)
+            {
+                return bParseEscape (chr);
+            }
+            return true;
+        }
+
+        StNode stParseClass()
+        {
+            ++m_uiPos;      // '['
+            StClass stClass;
+            if (L'^' == chrPeek())
+            {
+                stClass.bNegated = true;
+                ++m_uiPos;
+            }
+
+            if (L']' == chrPeek())
+            {
+                return stUnsupported();     // [] and [^]
+            }
+
+            bool bFirst = true;
+            while (!bAtEnd() && L']' != chrPeek())
+            {
+                if (L'-' == chrPeek() && !bFirst && L']' != chrPeek (1))
+                {
+                    return stUnsupported();     // e.g. [a-c-e]
+                }
+
+                wchar_t chrLow = 0;
+                if (!bParseClassChar (chrLow))
+                {
+                    return stUnsupported();
+                }
+
+                wchar_t chrHigh = chrLow;
+                if (L'-' == chrPeek() && L']' != chrPeek (1) && m_uiPos + 1 < m_uiLength)
+                {
+                    ++m_uiPos;
+                    if (!bParseClassChar (chrHigh) || chrHigh < chrLow)
+                    {
+                        return stUnsupported();
+                    }
+                }
+
+                stClass.vecRanges.emplace_back (chrLow, chrHigh);
+                bFirst = false;
+            }
+
+            if (bAtEnd())
+            {
+                return stUnsupported();
+            }
+            ++m_uiPos;      // ']'
+
+            stClass.Normalize();
+            StNode stNode;
+            stNode.eType = ecNodeClass;
+            stNode.uiClass = (unsigned int)m_vecClasses.size();
+            m_vecClasses.push_back (std::move (stClass));
+            return stNode;
+
+        }   //  stParseClass()
+
+        static bool bNullable (const StNode& stNode)
+        {
+            switch (stNode.eType)
+            {
+                case ecNodeChar:
+                case ecNodeAny:
+                case ecNodeClass:
+                    return false;
+                case ecNodeGroup:
+                    return bNullable (stNode.vecChildren[0]);
+                case ecNodeConcat:
+                    return std::all_of (stNode.vecChildren.begin(), stNode.vecChildren.end(), bNullable);
+                case ecNodeAlternation:
+                    return std::any_of (stNode.vecChildren.begin(), stNode.vecChildren.end(), bNullable);
+                case ecNodeRepeat:
+                    return 0 == stNode.uiMin || bNullable (stNode.vecChildren[0]);
+                default:
+                    return true;
+            }
+        }
+
+        static bool bHasGroups (const StNode& stNode)
+        {
+            if (ecNodeGroup == stNode.eType && stNode.iGroup > 0)
+            {
+                return true;
+            }
+            return std::any_of (stNode.vecChildren.begin(), stNode.vecChildren.end(), bHasGroups);
+        }
+
+    };      //  class CParser
+
+    struct StThreadList
+    {
+        std::vector<unsigned int> vecSparse;
+        std::vector<unsigned int> vecDense;
+        std::vector<int> vecCaps;           // uiSlots per entry of vecDense
+        unsigned int uiSize { 0 };
+
+        void Clear()
+        {
+            uiSize = 0;
+        }
+
+        bool bContains (unsigned int uiPc) const
+        {
+            unsigned int uiIdx = vecSparse[uiPc];
+            return uiIdx < uiSize && vecDense[uiIdx] == uiPc;
+        }
+
+        unsigned int uiAdd (unsigned int uiPc)
+        {
+            vecSparse[uiPc] = uiSize;
+            vecDense[uiSize] = uiPc;
+            return uiSize++;
+        }
+    };
+
+    struct StScratch
+    {
+        StThreadList arrLists[2];
+        std::vector<int> vecWorkCaps;
+
+        void Reset (unsigned int uiInstructions, unsigned int uiSlots)
+        {
+            for (auto& stList : arrLists)
+            {
+                if (stList.vecSparse.size() < uiInstructions)
+                {
+                    stList.vecSparse.resize (uiInstructions);
+                    stList.vecDense.resize (uiInstructions);
+                }
+                if (stList.vecCaps.size() < (size_t)uiInstructions * uiSlots)
+                {
+                    stList.vecCaps.resize ((size_t)uiInstructions * uiSlots);
+                }
+                stList.Clear();
+            }
+            if (vecWorkCaps.size() < uiSlots)
+            {
+                vecWorkCaps.resize (uiSlots);
+            }
+        }
+    };
+
+    struct StExecution
+    {
+        const wchar_t * pchrData;
+        int iLength;
+        unsigned int uiSlots;
+    };
+
+    std::vector<StInstruction> m_vecProgram;
+    std::vector<StClass> m_vecClasses;
+    unsigned int m_uiGroups { 0 };
+    bool m_bAnchored { false };
+
+    CProgram() {}
+
+    static bool bStartsWithBegin (const StNode& stNode)
+    {
+        if (ecNodeBegin == stNode.eType)
+        {
+            return true;
+        }
+        if ((ecNodeConcat == stNode.eType || ecNodeGroup == stNode.eType) && !stNode.vecChildren.empty())
+        {
+            return bStartsWithBegin (stNode.vecChildren[0]);
+        }
+        return false;
+    }
+
+    unsigned int Emit (EOpcode eOp, unsigned int uiArg = 0, wchar_t chr = 0)
+    {
+        m_vecProgram.push_back (StInstruction { eOp, chr, uiArg, 0, 0 });
+        return (unsigned int)m_vecProgram.size() - 1;
+    }
+
+    unsigned int uiPc() const
+    {
+        return (unsigned int)m_vecProgram.size();
+    }
+
+    bool bCompile (const StNode& stNode)
+    {
+        if (m_vecProgram.size() > cuiMaxInstructions_)
+        {
+            return false;
+        }
+
+        switch (stNode.eType)
+        {
+            case ecNodeEmpty:
+                return true;
+
+            case ecNodeChar:
+                Emit (ecOpChar, 0, stNode.chr);
+                return true;
+
+            case ecNodeAny:
+                Emit (ecOpAny);
+                return true;
+
+            case ecNodeClass:
+                Emit (ecOpClass, stNode.uiClass);
+                return true;
+
+            case ecNodeBegin:
+                Emit (ecOpAssertBegin);
+                return true;
+
+            case ecNodeEnd:
+                Emit (ecOpAssertEnd);
+                return true;
+
+            case ecNodeGroup:
+            {
+                if (stNode.iGroup > 0)
+                {
+                    Emit (ecOpSave, 2 * stNode.iGroup);
+                }
+                if (!bCompile (stNode.vecChildren[0]))
+                {
+                    return false;
+                }
+                if (stNode.iGroup > 0)
+                {
+                    Emit (ecOpSave, 2 * stNode.iGroup + 1);
+                }
+                return true;
+            }
+
+            case ecNodeConcat:
+            {
+                for (const StNode& stChild : stNode.vecChildren)
+                {
+                    if (!bCompile (stChild))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            case ecNodeAlternation:
+            {
+                //      split L1, L2
+                //  L1: first; jump end
+                //  L2: split ... ; last
+                std::vector<unsigned int> vecJumps;
+                for (size_t uiAlt = 0; uiAlt < stNode.vecChildren.size(); ++uiAlt)
+                {
+                    bool bLast = (uiAlt + 1 == stNode.vecChildren.size());
+                    unsigned int uiSplit = 0;
+                    if (!bLast)
+                    {
+                        uiSplit = Emit (ecOpSplit);
+                        m_vecProgram[uiSplit].uiX = uiPc();
+                    }
+                    if (!bCompile (stNode.vecChildren[uiAlt]))
+                    {
+                        return false;
+                    }
+                    if (!bLast)
+                    {
+                        vecJumps.push_back (Emit (ecOpJump));
+                        m_vecProgram[uiSplit].uiY = uiPc();
+                    }
+                }
+                for (unsigned int uiJump : vecJumps)
+                {
+                    m_vecProgram[uiJump].uiX = uiPc();
+                }
+                return true;
+            }
+
+            case ecNodeRepeat:
+                return bCompileRepeat (stNode);
+
+            default:
+                return false;
+        }
+
+    }   //  bCompile (...)
+
+    bool bCompileRepeat (const StNode& stNode)
+    {
+        const StNode& stChild = stNode.vecChildren[0];
+        for (unsigned int uiCopy = 0; uiCopy < stNode.uiMin; ++uiCopy)
+        {
+            if (!bCompile (stChild))
+            {
+                return false;
+            }
+        }
+
+        if (cuiInfinite_ == stNode.uiMax)
+        {
+            //  L: split body, out
+            //     body; jump L
+            unsigned int uiSplit = Emit (ecOpSplit);
+            if (!bCompile (stChild))
+            {
+                return false;
+            }
+            unsigned int uiJump = Emit (ecOpJump);
+            m_vecProgram[uiJump].uiX = uiSplit;
+            SetSplit (uiSplit, uiSplit + 1, uiPc(), stNode.bGreedy);
+            return true;
+        }
+
+        // Optional copies: split body, out; body; split body, out; ...
+        std::vector<unsigned int> vecSplits;
+        for (unsigned int uiCopy = stNode.uiMin; uiCopy < stNode.uiMax; ++uiCopy)
+        {
+            vecSplits.push_back (Emit (ecOpSplit));
+            if (!bCompile (stChild))
+            {
+                return false;
+            }
+        }
+        for (unsigned int uiSplit : vecSplits)
+        {
+            SetSplit (uiSplit, uiSplit + 1, uiPc(), stNode.bGreedy);
+        }
+        return true;
+
+    }   //  bCompileRepeat (...)
+
+    void SetSplit (unsigned int uiSplit, unsigned int uiBody, unsigned int uiOut, bool bGreedy)
+    {
+        m_vecProgram[uiSplit].uiX = bGreedy ? uiBody : uiOut;
+        m_vecProgram[uiSplit].uiY = bGreedy ? uiOut : uiBody;
+    }
+
+    // Consuming instructions are tested against the next character as the 
+    // thread is added; everything else passes
+    bool bAccepts (const StInstruction& stInst, const StExecution& stRun, int iPos) const
+    {
+        switch (stInst.eOp)
+        {
+            case ecOpChar:
+                return iPos < stRun.iLength && stRun.pchrData[iPos] == stInst.chr;
+            case ecOpAny:
+            {
+                if (iPos >= stRun.iLength)
+                {
+                    return false;
+                }
+                wchar_t chr = stRun.pchrData[iPos];
+                return chr != L'\n' && chr != L'\r' && chr != 0x2028 && chr != 0x2029;
+            }
+            case ecOpClass:
+                return iPos < stRun.iLength && m_vecClasses[stInst.uiArg].bContains (stRun.pchrData[iPos]);
+            default:
+                return true;
+        }
+    }
+
+    // Follows jumps, splits, saves and assertions from uiPc and appends the
+    // threads that end up on consuming instructions, in priority order
+    void AddThread (const StExecution& stRun, StThreadList& stList, unsigned int uiPc, int iPos, int * pCaps) const
+    {
+        if (stList.bContains (uiPc))
+        {
+            return;
+        }
+
+        const StInstruction& stInst = m_vecProgram[uiPc];
+        if (!bAccepts (stInst, stRun, iPos))
+        {
+            return;
+        }
+
+        unsigned int uiIdx = stList.uiAdd (uiPc);
+        switch (stInst.eOp)
+        {
+            case ecOpJump:
+                AddThread (stRun, stList, stInst.uiX, iPos, pCaps);
+                break;
+
+            case ecOpSplit:
+                AddThread (stRun, stList, stInst.uiX, iPos, pCaps);
+                AddThread (stRun, stList, stInst.uiY, iPos, pCaps);
+                break;
+
+            case ecOpSave:
+            {
+                int iSaved = pCaps[stInst.uiArg];
+                pCaps[stInst.uiArg] = iPos;
+                AddThread (stRun, stList, uiPc + 1, iPos, pCaps);
+                pCaps[stInst.uiArg] = iSaved;
+                break;
+            }
+
+            case ecOpAssertBegin:
+                if (0 == iPos)
+                {
+                    AddThread (stRun, stList, uiPc + 1, iPos, pCaps);
+                }
+                break;
+
+            case ecOpAssertEnd:
+                if (stRun.iLength == iPos)
+                {
+                    AddThread (stRun, stList, uiPc + 1, iPos, pCaps);
+                }
+                break;
+
+            default:
+                std::copy (pCaps, pCaps + stRun.uiSlots, &stList.vecCaps[uiIdx * stRun.uiSlots]);
+                break;
+        }
+
+    }   //  AddThread (...)
+
+};      //  class CProgram
+
+}   //  namespace Regex
+
+}   //  namespace Hlib
+
+#endif  //  C_ESTRINGREGEX_H_INCLUDED
@@ -0,0 +1,548 @@
+#ifndef C_ESTRINGSCAN_H_INCLUDED
+#define C_ESTRINGSCAN_H_INCLUDED
+
+//
+// Scanning kernels used by CEString: character set membership, substring search
+// and counting over wchar_t buffers. With GCC/Clang on x86-64 and a 4-byte
+// wchar_t these run on SSE2, or on AVX2 when the CPU has it; everywhere else
+// the scalar versions are used.
+//
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <string>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && (WCHAR_MAX > 0xFFFF)
+    #define HLIB_SCAN_X86
+    #include <immintrin.h>
+#endif
+
+namespace Hlib
+{
+
+namespace Scan
+{
+
+//
+// Character set compiled for fast membership tests. Small sets are matched by
+// comparing against each member; larger ones use a bitmap over a 256-char window
+// (e.g. the Cyrillic block) plus a few out-of-window extras.
+//
+class CCharSet
+{
+    friend struct StKernels;
+
+public:
+    static constexpr unsigned int cuiMaxBroadcast_ = 8;
+    static constexpr unsigned int cuiMaxVectorExtras_ = 4;
+    static constexpr unsigned int cuiWindowSize_ = 256;
+
+    enum EMode
+    {
+        ecEmpty,
+        ecBroadcast,        // <= 8 chars, compared one by one
+        ecWindow,           // bitmap window + <= 4 extras
+        ecGeneric           // bitmap window + sorted extras, scalar only
+    };
+
+    CCharSet() : m_eMode (ecEmpty), m_uiChars (0), m_uiBase (0), m_arrBitmap {}
+    {}
+
+    explicit CCharSet (const wchar_t * szSet) : CCharSet()
+    {
+        if (szSet)
+        {
+            Compile (szSet, wcslen (szSet));
+        }
+    }
+
+    CCharSet (const wchar_t * pchrSet, size_t uiLength) : CCharSet()
+    {
+        Compile (pchrSet, uiLength);
+    }
+
+    EMode eMode() const
+    {
+        return m_eMode;
+    }
+
+    bool bContains (wchar_t chr) const
+    {
+        switch (m_eMode)
+        {
+            case ecEmpty:
+                return false;
+
+            case ecBroadcast:
+                for (unsigned int uiAt = 0; uiAt < m_uiChars; ++uiAt)
+                {
+                    if (m_arrChars[uiAt] == chr)
+                    {
+                        return true;
+                    }
+                }
+                return false;
+
+            default:
+            {
+                uint32_t uiOffset = (uint32_t)chr - m_uiBase;
+                if (uiOffset < cuiWindowSize_)
+                {
+                    return (m_arrBitmap[uiOffset >> 5] >> (uiOffset & 31)) & 1;
+                }
+                return std::binary_search (m_vecExtras.begin(), m_vecExtras.end(), chr);
+            }
+        }
+    }
+
+private:
+    void Compile (const wchar_t * pchrSet, size_t uiLength)
+    {
+        // Typical sets are short, sort them on the stack
+        wchar_t arrLocal[64];
+        std::vector<wchar_t> vecHeap;
+        wchar_t * pchrChars = arrLocal;
+        if (uiLength > sizeof (arrLocal) / sizeof (wchar_t))
+        {
+            vecHeap.resize (uiLength);
+            pchrChars = vecHeap.data();
+        }
+        std::copy (pchrSet, pchrSet + uiLength, pchrChars);
+        wchar_t * pchrEnd = std::remove (pchrChars, pchrChars + uiLength, L'\0');
+        std::sort (pchrChars, pchrEnd);
+        pchrEnd = std::unique (pchrChars, pchrEnd);
+        size_t uiChars = pchrEnd - pchrChars;
+
+        if (0 == uiChars)
+        {
+            m_eMode = ecEmpty;
+            return;
+        }
+
+        if (uiChars <= cuiMaxBroadcast_)
+        {
+            m_eMode = ecBroadcast;
+            m_uiChars = (unsigned int)uiChars;
+            std::copy (pchrChars, pchrEnd, m_arrChars);
+            return;
+        }
+
+        // Pick the window that covers the most members
+        size_t uiBest = 0, uiBestCount = 0;
+        for (size_t uiFirst = 0, uiLast = 0; uiFirst < uiChars; ++uiFirst)
+        {
+            while (uiLast < uiChars && (uint32_t)pchrChars[uiLast] - (uint32_t)pchrChars[uiFirst] < cuiWindowSize_)
+            {
+                ++uiLast;
+            }
+            if (uiLast - uiFirst > uiBestCount)
+            {
+                uiBest = uiFirst;
+                uiBestCount = uiLast - uiFirst;
+            }
+        }
+
+        m_uiBase = (uint32_t)pchrChars[uiBest];
+        for (const wchar_t * pchr = pchrChars; pchr != pchrEnd; ++pchr)
+        {
+            uint32_t uiOffset = (uint32_t)*pchr - m_uiBase;
+            if (uiOffset < cuiWindowSize_)
+            {
+                m_arrBitmap[uiOffset >> 5] |= 1u << (uiOffset & 31);
+            }
+            else
+            {
+                m_vecExtras.push_back (*pchr);
+            }
+        }
+
+        m_eMode = (m_vecExtras.size() <= cuiMaxVectorExtras_) ? ecWindow : ecGeneric;
+
+    }   //  Compile (...)
+
+    EMode m_eMode;
+    wchar_t m_arrChars[cuiMaxBroadcast_];
+    unsigned int m_uiChars;
+    uint32_t m_uiBase;
+    uint32_t m_arrBitmap[cuiWindowSize_ / 32];
+    std::vector<wchar_t> m_vecExtras;       // sorted
+
+};      //  class CCharSet
+
+//
+// Kernels. All of them take a pointer and a length, embedded nulls are
+// ordinary characters. "Not found" is reported as uiLength.
+//
+struct StKernels
+{
+    static size_t uiFindFirstScalar (const wchar_t * pchr, size_t uiLength, const CCharSet& Set, size_t uiAt = 0)
+    {
+        for (; uiAt < uiLength; ++uiAt)
+        {
+            if (Set.bContains (pchr[uiAt]))
+            {
+                return uiAt;
+            }
+        }
+        return uiLength;
+    }
+
+    static size_t uiFindLastScalar (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+    {
+        for (size_t uiAt = uiLength; uiAt > 0; --uiAt)
+        {
+            if (Set.bContains (pchr[uiAt-1]))
+            {
+                return uiAt-1;
+            }
+        }
+        return uiLength;
+    }
+
+    static size_t uiCountScalar (const wchar_t * pchr, size_t uiLength, const CCharSet& Set, size_t uiAt = 0)
+    {
+        size_t uiCount = 0;
+        for (; uiAt < uiLength; ++uiAt)
+        {
+            uiCount += Set.bContains (pchr[uiAt]) ? 1 : 0;
+        }
+        return uiCount;
+    }
+
+    static size_t uiFindSubstringScalar (const wchar_t * pchr, size_t uiLength, const wchar_t * pchrNeedle, size_t uiNeedleLength)
+    {
+        if (0 == uiNeedleLength)
+        {
+            return 0;
+        }
+        if (uiNeedleLength > uiLength)
+        {
+            return uiLength;
+        }
+        for (size_t uiAt = 0; uiAt + uiNeedleLength <= uiLength; ++uiAt)
+        {
+            if (pchr[uiAt] == pchrNeedle[0] &&
+                0 == memcmp (pchr + uiAt, pchrNeedle, uiNeedleLength * sizeof (wchar_t)))
+            {
+                return uiAt;
+            }
+        }
+        return uiLength;
+    }
+
+#ifdef HLIB_SCAN_X86
+
+    static bool bHasAvx2()
+    {
+        static const bool s_bAvx2 = __builtin_cpu_supports ("avx2");
+        return s_bAvx2;
+    }
+
+    //
+    // SSE2: 4 chars per step, comparison sets only
+    //
+    static int iMatchMaskSse2 (__m128i v, const CCharSet& Set)
+    {
+        __m128i vMatch = _mm_setzero_si128();
+        for (unsigned int uiAt = 0; uiAt < Set.m_uiChars; ++uiAt)
+        {
+            vMatch = _mm_or_si128 (vMatch, _mm_cmpeq_epi32 (v, _mm_set1_epi32 (Set.m_arrChars[uiAt])));
+        }
+        return _mm_movemask_ps (_mm_castsi128_ps (vMatch));
+    }
+
+    static size_t uiFindFirstSse2 (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+    {
+        size_t uiAt = 0;
+        for (; uiAt + 4 <= uiLength; uiAt += 4)
+        {
+            int iMask = iMatchMaskSse2 (_mm_loadu_si128 ((const __m128i *)(pchr + uiAt)), Set);
+            if (iMask)
+            {
+                return uiAt + __builtin_ctz (iMask);
+            }
+        }
+        return uiFindFirstScalar (pchr, uiLength, Set, uiAt);
+    }
+
+    static size_t uiFindLastSse2 (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+    {
+        size_t uiEnd = uiLength;
+        for (; uiEnd >= 4; uiEnd -= 4)
+        {
+            int iMask = iMatchMaskSse2 (_mm_loadu_si128 ((const __m128i *)(pchr + uiEnd - 4)), Set);
+            if (iMask)
+            {
+                return uiEnd - 4 + (31 - __builtin_clz (iMask));
+            }
+        }
+        size_t uiAt = uiFindLastScalar (pchr, uiEnd, Set);
+        return (uiAt == uiEnd) ? uiLength : uiAt;
+    }
+
+    static size_t uiCountSse2 (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+    {
+        size_t uiCount = 0;
+        size_t uiAt = 0;
+        for (; uiAt + 4 <= uiLength; uiAt += 4)
+        {
+            uiCount += __builtin_popcount (iMatchMaskSse2 (_mm_loadu_si128 ((const __m128i *)(pchr + uiAt)), Set));
+        }
+        return uiCount + uiCountScalar (pchr, uiLength, Set, uiAt);
+    }
+
+    //
+    // AVX2: 8 chars per step, comparison and window sets
+    //
+    __attribute__((target("avx2")))
+    static int iMatchMaskAvx2 (__m256i v, const CCharSet& Set)
+    {
+        __m256i vMatch = _mm256_setzero_si256();
+        if (CCharSet::ecBroadcast == Set.m_eMode)
+        {
+            for (unsigned int uiAt = 0; uiAt < Set.m_uiChars; ++uiAt)
+            {
+                vMatch = _mm256_or_si256 (vMatch, _mm256_cmpeq_epi32 (v, _mm256_set1_epi32 (Set.m_arrChars[uiAt])));
+            }
+        }
+        else
+        {
+            // Bitmap lookup: the dword is picked by permute, the bit by a variable shift
+            __m256i vOffset = _mm256_sub_epi32 (v, _mm256_set1_epi32 ((int)Set.m_uiBase));
+            __m256i vInWindow = _mm256_cmpeq_epi32 (_mm256_and_si256 (vOffset, _mm256_set1_epi32 (~0xFF)), _mm256_setzero_si256());
+            __m256i vBitmap = _mm256_loadu_si256 ((const __m256i *)Set.m_arrBitmap);
+            __m256i vWord = _mm256_permutevar8x32_epi32 (vBitmap, _mm256_srli_epi32 (vOffset, 5));
+            __m256i vBit = _mm256_srlv_epi32 (vWord, _mm256_and_si256 (vOffset, _mm256_set1_epi32 (31)));
+            __m256i vOne = _mm256_set1_epi32 (1);
+            vMatch = _mm256_and_si256 (vInWindow, _mm256_cmpeq_epi32 (_mm256_and_si256 (vBit, vOne), vOne));
+            for (wchar_t chrExtra : Set.m_vecExtras)
+            {
+                vMatch = _mm256_or_si256 (vMatch, _mm256_cmpeq_epi32 (v, _mm256_set1_epi32 (chrExtra)));
+            }
+        }
+        return _mm256_movemask_ps (_mm256_castsi256_ps (vMatch));
+    }
+
+    __attribute__((target("avx2")))
+    static size_t uiFindFirstAvx2 (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+    {
+        size_t uiAt = 0;
+        for (; uiAt + 8 <= uiLength; uiAt += 8)
+        {
+            int iMask = iMatchMaskAvx2 (_mm256_loadu_si256 ((const __m256i *)(pchr + uiAt)), Set);
+            if (iMask)
+            {
+                return uiAt + __builtin_ctz (iMask);
+            }
+        }
+        return uiFindFirstScalar (pchr, uiLength, Set, uiAt);
+    }
+
+    __attribute__((target("avx2")))
+    static size_t uiFindLastAvx2 (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+    {
+        size_t uiEnd = uiLength;
+        for (; uiEnd >= 8; uiEnd -= 8)
+        {
+            int iMask = iMatchMaskAvx2 (_mm256_loadu_si256 ((const __m256i *)(pchr + uiEnd - 8)), Set);
+            if (iMask)
+            {
+                return uiEnd - 8 + (31 - __builtin_clz (iMask));
+            }
+        }
+        size_t uiAt = uiFindLastScalar (pchr, uiEnd, Set);
+        return (uiAt == uiEnd) ? uiLength : uiAt;
+    }
+
+    __attribute__((target("avx2")))
+    static size_t uiCountAvx2 (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+    {
+        size_t uiCount = 0;
+        size_t uiAt = 0;
+        for (; uiAt + 8 <= uiLength; uiAt += 8)
+        {
+            uiCount += __builtin_popcount (iMatchMaskAvx2 (_mm256_loadu_si256 ((const __m256i *)(pchr + uiAt)), Set));
+        }
+        return uiCount + uiCountScalar (pchr, uiLength, Set, uiAt);
+    }
+
+    // Candidates are positions where both the first and the last char of the needle
+    // match; only those are compared in full
+    __attribute__((target("avx2")))
+    static size_t uiFindSubstringAvx2 (const wchar_t * pchr, size_t uiLength, const wchar_t * pchrNeedle, size_t uiNeedleLength)
+    {
+        __m256i vFirst = _mm256_set1_epi32 (pchrNeedle[0]);
+        __m256i vLast = _mm256_set1_epi32 (pchrNeedle[uiNeedleLength-1]);
+        size_t uiAt = 0;
+        for (; uiAt + uiNeedleLength - 1 + 8 <= uiLength; uiAt += 8)
+        {
+            __m256i vBlockFirst = _mm256_loadu_si256 ((const __m256i *)(pchr + uiAt));
+            __m256i vBlockLast = _mm256_loadu_si256 ((const __m256i *)(pchr + uiAt + uiNeedleLength - 1));
+            __m256i vCandidates = _mm256_and_si256 (_mm256_cmpeq_epi32 (vFirst, vBlockFirst), _mm256_cmpeq_epi32 (vLast, vBlockLast));
+            unsigned int uiMask = (unsigned int)_mm256_movemask_ps (_mm256_castsi256_ps (vCandidates));
+            while (uiMask)
+            {
+                unsigned int uiBit = __builtin_ctz (uiMask);
+                if (0 == memcmp (pchr + uiAt + uiBit + 1, pchrNeedle + 1, (uiNeedleLength - 1) * sizeof (wchar_t)))
+                {
+                    return uiAt + uiBit;
+                }
+                uiMask &= uiMask - 1;
+            }
+        }
+
+        size_t uiTail = uiFindSubstringScalar (pchr + uiAt, uiLength - uiAt, pchrNeedle, uiNeedleLength);
+        return (uiTail == uiLength - uiAt) ? uiLength : uiAt + uiTail;
+    }
+
+    static size_t uiFindSubstringSse2 (const wchar_t * pchr, size_t uiLength, const wchar_t * pchrNeedle, size_t uiNeedleLength)
+    {
+        __m128i vFirst = _mm_set1_epi32 (pchrNeedle[0]);
+        __m128i vLast = _mm_set1_epi32 (pchrNeedle[uiNeedleLength-1]);
+        size_t uiAt = 0;
+        for (; uiAt + uiNeedleLength - 1 + 4 <= uiLength; uiAt += 4)
+        {
+            __m128i vBlockFirst = _mm_loadu_si128 ((const __m128i *)(pchr + uiAt));
+            __m128i vBlockLast = _mm_loadu_si128 ((const __m128i *)(pchr + uiAt + uiNeedleLength - 1));
+            __m128i vCandidates = _mm_and_si128 (_mm_cmpeq_epi32 (vFirst, vBlockFirst), _mm_cmpeq_epi32 (vLast, vBlockLast));
+            unsigned int uiMask = (unsigned int)_mm_movemask_ps (_mm_castsi128_ps (vCandidates));
+            while (uiMask)
+            {
+                unsigned int uiBit = __builtin_ctz (uiMask);
+                if (0 == memcmp (pchr + uiAt + uiBit + 1, pchrNeedle + 1, (uiNeedleLength - 1) * sizeof (wchar_t)))
+                {
+                    return uiAt + uiBit;
+                }
+                uiMask &= uiMask - 1;
+            }
+        }
+
+        size_t uiTail = uiFindSubstringScalar (pchr + uiAt, uiLength - uiAt, pchrNeedle, uiNeedleLength);
+        return (uiTail == uiLength - uiAt) ? uiLength : uiAt + uiTail;
+    }
+
+#endif  //  HLIB_SCAN_X86
+
+};      //  struct StKernels
+
+//
+// Compiled sets for callers that get the set as a string, so that a loop
+// searching for the same set does not compile it again on every call. A few
+// recent sets per thread, looked up by contents; the reference is good until
+// the next call.
+//
+inline const CCharSet& rGetCachedSet (const wchar_t * szSet)
+{
+    struct StEntry
+    {
+        std::wstring sKey;
+        CCharSet Set;
+    };
+    static constexpr unsigned int cuiEntries = 8;
+    thread_local StEntry arrEntries[cuiEntries];
+    thread_local unsigned int uiNext = 0;
+
+    if (nullptr == szSet)
+    {
+        szSet = L"";
+    }
+
+    for (auto& stEntry : arrEntries)
+    {
+        if (0 == wcscmp (stEntry.sKey.c_str(), szSet))
+        {
+            return stEntry.Set;
+        }
+    }
+
+    StEntry& stEntry = arrEntries[uiNext];
+    uiNext = (uiNext + 1) % cuiEntries;
+    stEntry.sKey = szSet;
+    stEntry.Set = CCharSet (szSet);
+
+    return stEntry.Set;
+
+}   //  rGetCachedSet (...)
+
+//
+// Dispatching entry points
+//
+inline size_t uiFindFirst (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+{
+#ifdef HLIB_SCAN_X86
+    if (StKernels::bHasAvx2() && Set.eMode() <= CCharSet::ecWindow)
+    {
+        return StKernels::uiFindFirstAvx2 (pchr, uiLength, Set);
+    }
+    if (CCharSet::ecBroadcast == Set.eMode())
+    {
+        return StKernels::uiFindFirstSse2 (pchr, uiLength, Set);
+    }
+#endif
+    return StKernels::uiFindFirstScalar (pchr, uiLength, Set);
+}
+
+inline size_t uiFindLast (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+{
+#ifdef HLIB_SCAN_X86
+    if (StKernels::bHasAvx2() && Set.eMode() <= CCharSet::ecWindow)
+    {
+        return StKernels::uiFindLastAvx2 (pchr, uiLength, Set);
+    }
+    if (CCharSet::ecBroadcast == Set.eMode())
+    {
+        return StKernels::uiFindLastSse2 (pchr, uiLength, Set);
+    }
+#endif
+    return StKernels::uiFindLastScalar (pchr, uiLength, Set);
+}
+
+inline size_t uiCount (const wchar_t * pchr, size_t uiLength, const CCharSet& Set)
+{
+#ifdef HLIB_SCAN_X86
+    if (StKernels::bHasAvx2() && Set.eMode() <= CCharSet::ecWindow)
+    {
+        return StKernels::uiCountAvx2 (pchr, uiLength, Set);
+    }
+    if (CCharSet::ecBroadcast == Set.eMode())
+    {
+        return StKernels::uiCountSse2 (pchr, uiLength, Set);
+    }
+#endif
+    return StKernels::uiCountScalar (pchr, uiLength, Set);
+}
+
+inline size_t uiFindSubstring (const wchar_t * pchr, size_t uiLength, const wchar_t * pchrNeedle, size_t uiNeedleLength)
+{
+    if (0 == uiNeedleLength)
+    {
+        return 0;
+    }
+    if (uiNeedleLength > uiLength)
+    {
+        return uiLength;
+    }
+#ifdef HLIB_SCAN_X86
+    if (StKernels::bHasAvx2())
+    {
+        return StKernels::uiFindSubstringAvx2 (pchr, uiLength, pchrNeedle, uiNeedleLength);
+    }
+    return StKernels::uiFindSubstringSse2 (pchr, uiLength, pchrNeedle, uiNeedleLength);
+#else
+    return StKernels::uiFindSubstringScalar (pchr, uiLength, pchrNeedle, uiNeedleLength);
+#endif
+}
+
+inline bool bEqual (const wchar_t * pchrLhs, const wchar_t * pchrRhs, size_t uiLength)
+{
+    return 0 == memcmp (pchrLhs, pchrRhs, uiLength * sizeof (wchar_t));
+}
+
+}   //  namespace Scan
+
+}   //  namespace Hlib
+
+#endif  //  C_ESTRINGSCAN_H_INCLUDED
@@ -0,0 +1,320 @@
+#ifndef C_ESTRINGUTF8_H_INCLUDED
+#define C_ESTRINGUTF8_H_INCLUDED
+
+//
+// UTF-8 <-> wchar_t transcoding into caller-supplied buffers. wchar_t holds
+// UTF-32 where it is 4 bytes wide and UTF-16 where it is 2 (Windows). Runs of
+// ASCII are converted 16 characters at a time (SSE2 on x86-64, 8-byte words
+// elsewhere); everything else goes through a strict scalar coder. Malformed
+// input -- invalid or overlong sequences, surrogates, code points past
+// U+10FFFF -- comes out as U+FFFD instead of failing the whole conversion.
+//
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__) && (WCHAR_MAX > 0xFFFF)
+    #define HLIB_UTF8_SSE2
+    #include <emmintrin.h>
+#endif
+
+namespace Hlib
+{
+
+namespace Utf8
+{
+
+constexpr bool cbWideIsUtf32_ = (WCHAR_MAX > 0xFFFF);
+
+// UTF-16 needs at most 3 bytes per code unit: 4-byte sequences come from pairs
+constexpr size_t cuiMaxBytesPerChar_ = cbWideIsUtf32_ ? 4 : 3;
+
+constexpr uint32_t cuiReplacementChar_ = 0xFFFD;
+
+// Output buffer size that fits the encoding of any uiLength wide characters
+inline size_t uiMaxEncodedLength (size_t uiLength)
+{
+    return uiLength * cuiMaxBytesPerChar_;
+}
+
+// Every byte decodes to at most one wchar_t, so uiBytes is always enough
+inline size_t uiMaxDecodedLength (size_t uiBytes)
+{
+    return uiBytes;
+}
+
+namespace Detail
+{
+
+inline size_t uiCodePointBytes (uint32_t uiCodePoint)
+{
+    return (uiCodePoint < 0x80) ? 1 : (uiCodePoint < 0x800) ? 2 : (uiCodePoint < 0x10000) ? 3 : 4;
+}
+
+inline bool bContinuation (unsigned char chr)
+{
+    return 0x80 == (chr & 0xC0);
+}
+
+inline char * pchrPutUtf8 (uint32_t uiCodePoint, char * pchrOut)
+{
+    if (uiCodePoint < 0x80)
+    {
+        *pchrOut++ = (char)uiCodePoint;
+    }
+    else if (uiCodePoint < 0x800)
+    {
+        *pchrOut++ = (char)(0xC0 | (uiCodePoint >> 6));
+        *pchrOut++ = (char)(0x80 | (uiCodePoint & 0x3F));
+    }
+    else if (uiCodePoint < 0x10000)
+    {
+        *pchrOut++ = (char)(0xE0 | (uiCodePoint >> 12));
+        *pchrOut++ = (char)(0x80 | ((uiCodePoint >> 6) & 0x3F));
+        *pchrOut++ = (char)(0x80 | (uiCodePoint & 0x3F));
+    }
+    else
+    {
+        *pchrOut++ = (char)(0xF0 | (uiCodePoint >> 18));
+        *pchrOut++ = (char)(0x80 | ((uiCodePoint >> 12) & 0x3F));
+        *pchrOut++ = (char)(0x80 | ((uiCodePoint >> 6) & 0x3F));
+        *pchrOut++ = (char)(0x80 | (uiCodePoint & 0x3F));
+    }
+    return pchrOut;
+}
+
+inline wchar_t * pchrPutWide (uint32_t uiCodePoint, wchar_t * pchrOut)
+{
+    if (!cbWideIsUtf32_ && uiCodePoint >= 0x10000)
+    {
+        uiCodePoint -= 0x10000;
+        *pchrOut++ = (wchar_t)(0xD800 | (uiCodePoint >> 10));
+        *pchrOut++ = (wchar_t)(0xDC00 | (uiCodePoint & 0x3FF));
+        return pchrOut;
+    }
+    *pchrOut++ = (wchar_t)uiCodePoint;
+    return pchrOut;
+}
+
+// Converts the leading run of ASCII, returns the number of characters done
+inline size_t uiEncodeAscii (const wchar_t * pchrSource, size_t uiLength, char * pchrOut)
+{
+    size_t uiAt = 0;
+#ifdef HLIB_UTF8_SSE2
+    const __m128i nNonAscii = _mm_set1_epi32 (~0x7F);
+    const __m128i nZero = _mm_setzero_si128();
+    for (; uiAt + 16 <= uiLength; uiAt += 16)
+    {
+        const __m128i * pSource = reinterpret_cast<const __m128i *> (pchrSource + uiAt);
+        __m128i nA = _mm_loadu_si128 (pSource);
+        __m128i nB = _mm_loadu_si128 (pSource + 1);
+        __m128i nC = _mm_loadu_si128 (pSource + 2);
+        __m128i nD = _mm_loadu_si128 (pSource + 3);
+        __m128i nAll = _mm_or_si128 (_mm_or_si128 (nA, nB), _mm_or_si128 (nC, nD));
+        if (0xFFFF != _mm_movemask_epi8 (_mm_cmpeq_epi32 (_mm_and_si128 (nAll, nNonAscii), nZero)))
+        {
+            break;
+        }
+        __m128i nBytes = _mm_packus_epi16 (_mm_packs_epi32 (nA, nB), _mm_packs_epi32 (nC, nD));
+        _mm_storeu_si128 (reinterpret_cast<__m128i *> (pchrOut + uiAt), nBytes);
+    }
+#endif
+    for (; uiAt < uiLength && (uint32_t)pchrSource[uiAt] < 0x80; ++uiAt)
+    {
+        pchrOut[uiAt] = (char)pchrSource[uiAt];
+    }
+    return uiAt;
+}
+
+inline size_t uiDecodeAscii (const char * pchrSource, size_t uiBytes, wchar_t * pchrOut)
+{
+    size_t uiAt = 0;
+#ifdef HLIB_UTF8_SSE2
+    const __m128i nZero = _mm_setzero_si128();
+    for (; uiAt + 16 <= uiBytes; uiAt += 16)
+    {
+        __m128i nBytes = _mm_loadu_si128 (reinterpret_cast<const __m128i *> (pchrSource + uiAt));
+        if (0 != _mm_movemask_epi8 (nBytes))
+        {
+            break;
+        }
+        __m128i nLow = _mm_unpacklo_epi8 (nBytes, nZero);
+        __m128i nHigh = _mm_unpackhi_epi8 (nBytes, nZero);
+        __m128i * pOut = reinterpret_cast<__m128i *> (pchrOut + uiAt);
+        _mm_storeu_si128 (pOut, _mm_unpacklo_epi16 (nLow, nZero));
+        _mm_storeu_si128 (pOut + 1, _mm_unpackhi_epi16 (nLow, nZero));
+        _mm_storeu_si128 (pOut + 2, _mm_unpacklo_epi16 (nHigh, nZero));
+        _mm_storeu_si128 (pOut + 3, _mm_unpackhi_epi16 (nHigh, nZero));
+    }
+#else
+    for (; uiAt + 8 <= uiBytes; uiAt += 8)
+    {
+        uint64_t ullWord;
+        memcpy (&ullWord, pchrSource + uiAt, sizeof (ullWord));
+        if (ullWord & 0x8080808080808080ULL)
+        {
+            break;
+        }
+        for (size_t uiByte = 0; uiByte < 8; ++uiByte)
+        {
+            pchrOut[uiAt + uiByte] = (wchar_t)pchrSource[uiAt + uiByte];
+        }
+    }
+#endif
+    for (; uiAt < uiBytes && (unsigned char)pchrSource[uiAt] < 0x80; ++uiAt)
+    {
+        pchrOut[uiAt] = (wchar_t)pchrSource[uiAt];
+    }
+    return uiAt;
+}
+
+}   //  namespace Detail
+
+// Exact size of the encoding, for callers that want to allocate once
+inline size_t uiEncodedLength (const wchar_t * pchrSource, size_t uiLength)
+{
+    size_t uiBytes = 0;
+    for (size_t uiAt = 0; uiAt < uiLength; ++uiAt)
+    {
+        uint32_t uiCodePoint = (uint32_t)pchrSource[uiAt];
+        if (uiCodePoint >= 0xD800 && uiCodePoint <= 0xDFFF)
+        {
+            bool bPair = !cbWideIsUtf32_ && uiCodePoint < 0xDC00 && uiAt + 1 < uiLength &&
+                (uint32_t)pchrSource[uiAt + 1] >= 0xDC00 && (uint32_t)pchrSource[uiAt + 1] <= 0xDFFF;
+            uiBytes += bPair ? 4 : 3;
+            uiAt += bPair ? 1 : 0;
+        }
+        else
+        {
+            uiBytes += (uiCodePoint > 0x10FFFF) ? 3 : Detail::uiCodePointBytes (uiCodePoint);
+        }
+    }
+    return uiBytes;
+}
+
+//
+// Encodes uiLength wide characters into pchrOut, which must have room for
+// uiMaxEncodedLength (uiLength) bytes. Not null-terminated; returns the
+// number of bytes written.
+//
+inline size_t uiEncode (const wchar_t * pchrSource, size_t uiLength, char * pchrOut)
+{
+    char * pchrStart = pchrOut;
+    size_t uiAt = 0;
+    while (uiAt < uiLength)
+    {
+        size_t uiAscii = Detail::uiEncodeAscii (pchrSource + uiAt, uiLength - uiAt, pchrOut);
+        uiAt += uiAscii;
+        pchrOut += uiAscii;
+
+        // Scalar until the next ASCII character, i.e. over a word in most texts
+        while (uiAt < uiLength && (uint32_t)pchrSource[uiAt] >= 0x80)
+        {
+            uint32_t uiCodePoint = (uint32_t)pchrSource[uiAt++];
+            if (uiCodePoint < 0x800)
+            {
+                pchrOut[0] = (char)(0xC0 | (uiCodePoint >> 6));
+                pchrOut[1] = (char)(0x80 | (uiCodePoint & 0x3F));
+                pchrOut += 2;
+                continue;
+            }
+
+            if (uiCodePoint >= 0xD800 && uiCodePoint <= 0xDFFF)
+            {
+                bool bPair = !cbWideIsUtf32_ && uiCodePoint < 0xDC00 && uiAt < uiLength &&
+                    (uint32_t)pchrSource[uiAt] >= 0xDC00 && (uint32_t)pchrSource[uiAt] <= 0xDFFF;
+                if (bPair)
+                {
+                    uiCodePoint = 0x10000 + ((uiCodePoint - 0xD800) << 10) + ((uint32_t)pchrSource[uiAt++] - 0xDC00);
+                }
+                else
+                {
+                    uiCodePoint = cuiReplacementChar_;
+                }
+            }
+            else if (uiCodePoint > 0x10FFFF)
+            {
+                uiCodePoint = cuiReplacementChar_;
+            }
+            pchrOut = Detail::pchrPutUtf8 (uiCodePoint, pchrOut);
+        }
+    }
+
+    return pchrOut - pchrStart;
+
+}   //  uiEncode (...)
+
+//
+// Decodes uiBytes of UTF-8 into pchrOut, which must have room for
+// uiMaxDecodedLength (uiBytes) characters. Not null-terminated; returns the
+// number of characters written.
+//
+inline size_t uiDecode (const char * pchrSource, size_t uiBytes, wchar_t * pchrOut)
+{
+    using Detail::bContinuation;
+
+    const unsigned char * pchrIn = reinterpret_cast<const unsigned char *> (pchrSource);
+    wchar_t * pchrStart = pchrOut;
+    size_t uiAt = 0;
+    while (uiAt < uiBytes)
+    {
+        size_t uiAscii = Detail::uiDecodeAscii (pchrSource + uiAt, uiBytes - uiAt, pchrOut);
+        uiAt += uiAscii;
+        pchrOut += uiAscii;
+
+        while (uiAt < uiBytes && pchrIn[uiAt] >= 0x80)
+        {
+            unsigned char chrLead = pchrIn[uiAt];
+            size_t uiLeft = uiBytes - uiAt;
+            uint32_t uiCodePoint = cuiReplacementChar_;
+            size_t uiSequence = 1;      // on error skip the lead byte only
+            if (chrLead >= 0xC2 && chrLead < 0xE0)
+            {
+                if (uiLeft >= 2 && bContinuation (pchrIn[uiAt + 1]))
+                {
+                    uiCodePoint = ((chrLead & 0x1F) << 6) | (pchrIn[uiAt + 1] & 0x3F);
+                    uiSequence = 2;
+                }
+            }
+            else if (chrLead >= 0xE0 && chrLead < 0xF0)
+            {
+                if (uiLeft >= 3 && bContinuation (pchrIn[uiAt + 1]) && bContinuation (pchrIn[uiAt + 2]))
+                {
+                    uint32_t uiDecoded = ((chrLead & 0x0F) << 12) | ((pchrIn[uiAt + 1] & 0x3F) << 6) | (pchrIn[uiAt + 2] & 0x3F);
+                    if (uiDecoded >= 0x800 && (uiDecoded < 0xD800 || uiDecoded > 0xDFFF))
+                    {
+                        uiCodePoint = uiDecoded;
+                        uiSequence = 3;
+                    }
+                }
+            }
+            else if (chrLead >= 0xF0 && chrLead < 0xF5)
+            {
+                if (uiLeft >= 4 && bContinuation (pchrIn[uiAt + 1]) && bContinuation (pchrIn[uiAt + 2]) && bContinuation (pchrIn[uiAt + 3]))
+                {
+                    uint32_t uiDecoded = ((chrLead & 0x07) << 18) | ((pchrIn[uiAt + 1] & 0x3F) << 12) |
+                        ((pchrIn[uiAt + 2] & 0x3F) << 6) | (pchrIn[uiAt + 3] & 0x3F);
+                    if (uiDecoded >= 0x10000 && uiDecoded <= 0x10FFFF)
+                    {
+                        uiCodePoint = uiDecoded;
+                        uiSequence = 4;
+                    }
+                }
+            }
+
+            pchrOut = Detail::pchrPutWide (uiCodePoint, pchrOut);
+            uiAt += uiSequence;
+        }
+    }
+
+    return pchrOut - pchrStart;
+
+}   //  uiDecode (...)
+
+}   //  namespace Utf8
+
+}   //  namespace Hlib
+
+#endif  //  C_ESTRINGUTF8_H_INCLUDED
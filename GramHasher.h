@@ -1,22 +1,193 @@
 #ifndef GRAMHASHER_H_INCLUDED
 #define GRAMHASHER_H_INCLUDED
 
+#include <algorithm>
+#include <cstdint>
+#include <deque>
 #include <map>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 #include "Enums.h"
 #include "EString.h"
 
 namespace Hlib
 {
     //
-    // Initializing static class members at file scope
+    // Compile-time tables for the tag <-> enum conversions below. The string 
+    // side is a perfect hash: the constructor looks for a seed under which no 
+    // two keys share a slot, so a lookup is one hash, one probe and one compare. 
+    // The enum side is an array indexed by the enum value.
     //
-    static ET_Subparadigm eStrToSubparadigm(const CEString& sKey)
+    namespace GramTables
     {
-        static const map<CEString, ET_Subparadigm> mapStrToSubparadigm =
+        template <typename T>
+        struct StEntry
+        {
+            const wchar_t * szKey;
+            T eValue;
+        };
+
+        constexpr unsigned int uiKeyLength(const wchar_t * szKey)
+        {
+            unsigned int uiLength = 0;
+            while (szKey[uiLength])
+            {
+                ++uiLength;
+            }
+            return uiLength;
+        }
+
+        constexpr uint32_t uiHashKey(const wchar_t * pchrKey, unsigned int uiLength, uint32_t uiSeed)
+        {
+            uint32_t uiHash = 2166136261u ^ (uiSeed * 0x9E3779B9u);
+            for (unsigned int uiAt = 0; uiAt < uiLength; ++uiAt)
+            {
+                uiHash = (uiHash ^ (uint32_t)pchrKey[uiAt]) * 16777619u;
+            }
+            return uiHash ^ (uiHash >> 16);
+        }
+
+        template <typename T, size_t N>
+        class CPerfectHash
+        {
+        public:
+            constexpr CPerfectHash(const StEntry<T> (&arrEntries)[N])
+            {
+                // Duplicate keys exhaust the seeds and fail to compile
+                for (uint32_t uiSeed = 1; uiSeed < 0x10000; ++uiSeed)
+                {
+                    if (bTrySeed(arrEntries, uiSeed))
+                    {
+                        m_uiSeed = uiSeed;
+                        return;
+                    }
+                }
+                throw CException(H_ERROR_UNEXPECTED, L"No perfect hash seed found.");
+            }
+
+            bool bFind(const CEStringView& svKey, T& eValue) const
+            {
+                const StSlot& stSlot = m_arrSlots[uiHashKey(svKey.pchrData(), svKey.uiLength(), m_uiSeed) & (cuiSlots_ - 1)];
+                if (nullptr == stSlot.szKey || stSlot.uiLength != svKey.uiLength() || 
+                    0 != wmemcmp(stSlot.szKey, svKey.pchrData(), svKey.uiLength()))
+                {
+                    return false;
+                }
+                eValue = stSlot.eValue;
+                return true;
+            }
+
+        private:
+            struct StSlot
+            {
+                const wchar_t * szKey = nullptr;
+                unsigned int uiLength = 0;
+                T eValue {};
+            };
+
+            static constexpr size_t uiSlotsFor(size_t uiEntries)
+            {
+                size_t uiSlots = 1;
+                while (uiSlots < 2 * uiEntries)
+                {
+                    uiSlots <<= 1;
+                }
+                return uiSlots;
+            }
+
+            static constexpr size_t cuiSlots_ = uiSlotsFor(N);
+
+            constexpr bool bTrySeed(const StEntry<T> (&arrEntries)[N], uint32_t uiSeed)
+            {
+                for (auto& stSlot : m_arrSlots)
+                {
+                    stSlot = StSlot();
+                }
+                for (auto& stEntry : arrEntries)
+                {
+                    unsigned int uiLength = uiKeyLength(stEntry.szKey);
+                    StSlot& stSlot = m_arrSlots[uiHashKey(stEntry.szKey, uiLength, uiSeed) & (cuiSlots_ - 1)];
+                    if (stSlot.szKey)
+                    {
+                        return false;
+                    }
+                    stSlot.szKey = stEntry.szKey;
+                    stSlot.uiLength = uiLength;
+                    stSlot.eValue = stEntry.eValue;
+                }
+                return true;
+            }
+
+            StSlot m_arrSlots[cuiSlots_] {};
+            uint32_t m_uiSeed = 0;
+
+        };      //  class CPerfectHash
+
+        // COUNT is the enum's _COUNT member
+        template <typename T, size_t N, size_t COUNT>
+        class CEnumNames
+        {
+        public:
+            constexpr CEnumNames(const StEntry<T> (&arrEntries)[N])
+            {
+                for (auto& stEntry : arrEntries)
+                {
+                    m_arrNames[stEntry.eValue] = stEntry.szKey;
+                    m_arrLengths[stEntry.eValue] = uiKeyLength(stEntry.szKey);
+                }
+            }
+
+            bool bFind(T eValue, CEStringView& svName) const
+            {
+                if ((size_t)eValue >= COUNT || nullptr == m_arrNames[eValue])
+                {
+                    return false;
+                }
+                svName = CEStringView(m_arrNames[eValue], m_arrLengths[eValue]);
+                return true;
+            }
+
+        private:
+            const wchar_t * m_arrNames[COUNT] {};
+            unsigned int m_arrLengths[COUNT] {};
+
+        };      //  class CEnumNames
+
+        template <typename T, size_t N>
+        T eFind(const CPerfectHash<T, N>& phTable, const CEStringView& svKey, T eDefault, bool bLogMiss = true)
+        {
+            T eValue = eDefault;
+            if (!phTable.bFind(svKey, eValue) && bLogMiss)
+            {
+                CEString sMsg(L"Key not found: ");
+                sMsg += svKey;
+                ERROR_LOG(sMsg);
+            }
+            return eValue;
+        }
+
+        template <typename T, size_t N, size_t COUNT>
+        CEStringView svFind(const CEnumNames<T, N, COUNT>& enTable, T eValue)
+        {
+            CEStringView svName;
+            if (!enTable.bFind(eValue, svName))
+            {
+                CEString sMsg(L"Value not found: ");
+                sMsg += CEString::sToString((int)eValue);
+                ERROR_LOG(sMsg);
+            }
+            return svName;
+        }
+
+        constexpr StEntry<ET_Subparadigm> arrSubparadigms[] =
         {
             { L"AdjComp", SUBPARADIGM_COMPARATIVE }, { L"AdjL", SUBPARADIGM_LONG_ADJ }, { L"AdjS", SUBPARADIGM_SHORT_ADJ },
             { L"Adv", SUBPARADIGM_ADVERB }, { L"AspectPair", SUBPARADIGM_ASPECT_PAIR }, { L"Conj", SUBPARADIGM_CONJUNCTION }, 
             { L"Impv", SUBPARADIGM_IMPERATIVE }, { L"Inf", SUBPARADIGM_INFINITIVE }, { L"Interj", SUBPARADIGM_INTERJECTION }, 
+            { L"LastNameNoun", SUBPARADIGM_LAST_NAME_NOUN }, { L"LastNameNounFeminine", SUBPARADIGM_LAST_NAME_NOUN_F },
+            { L"LastNameLongAdj", SUBPARADIGM_LAST_NAME_LONG_ADJ }, { L"LastNamePronAdj", SUBPARADIGM_LAST_NAME_PRONOUN_ADJ },
             { L"Noun", SUBPARADIGM_NOUN }, { L"NumAdj", SUBPARADIGM_NUM_ADJ }, { L"Numeral24", SUBPARADIGM_NUM_2TO4 }, { L"Numeral", SUBPARADIGM_NUM },
             { L"Parenth", SUBPARADIGM_PARENTHESIS }, { L"Particle", SUBPARADIGM_PARTICLE }, { L"Past", SUBPARADIGM_PAST_TENSE }, 
             { L"PPastA", SUBPARADIGM_PART_PAST_ACT }, { L"PPastPL", SUBPARADIGM_PART_PAST_PASS_LONG }, { L"PPastPS", SUBPARADIGM_PART_PAST_PASS_SHORT }, 
@@ -24,265 +195,265 @@ namespace Hlib
             { L"PPresPL", SUBPARADIGM_PART_PRES_PASS_LONG }, { L"PPresPS", SUBPARADIGM_PART_PRES_PASS_SHORT }, { L"Pres", SUBPARADIGM_PRESENT_TENSE },
             { L"PronAdj", SUBPARADIGM_PRONOUN_ADJ }, { L"Pronoun", SUBPARADIGM_PRONOUN }, { L"VAdv_Past", SUBPARADIGM_ADVERBIAL_PAST }, 
             { L"VAdv_Pres", SUBPARADIGM_ADVERBIAL_PRESENT }
-            
         };
 
-        ET_Subparadigm eSubparadigm = SUBPARADIGM_UNDEFINED;
-        try
-        {
-            if (1 == mapStrToSubparadigm.count(sKey))
-            {
-                eSubparadigm = mapStrToSubparadigm.at(sKey);
-            }
-        }
-        catch (std::exception& ex)
-        {
-            CEString sMsg(L"STL exception: ");
-            sMsg += CEString::sFromUtf8(ex.what());
-            ERROR_LOG(sMsg);
-        }
+        constexpr StEntry<ET_Number> arrNumbers[] = { { L"Sg", NUM_SG }, { L"Pl", NUM_PL } };
 
-        return eSubparadigm;
-    }
+        constexpr StEntry<ET_Gender> arrGenders[] = { { L"M", GENDER_M }, { L"F", GENDER_F }, { L"N", GENDER_N } };
+        constexpr StEntry<ET_Gender> arrGenderNames[] = { { L"M", GENDER_M }, { L"F", GENDER_F }, { L"N", GENDER_N }, { L"", GENDER_UNDEFINED } };
 
-    static CEString sSubparadigmToStr(ET_Subparadigm eKey)
-    {
-        static const map<ET_Subparadigm, CEString> mapSubparadigmToStr =
+        constexpr StEntry<ET_Animacy> arrAnimacyNames[] = { { L"Anim", ANIM_YES }, { L"Inanim", ANIM_NO }, { L"", ANIM_UNDEFINED } };
+
+        constexpr StEntry<ET_Case> arrCases[] =
         {
-            { SUBPARADIGM_COMPARATIVE, L"AdjComp" },{ SUBPARADIGM_LONG_ADJ, L"AdjL" }, { SUBPARADIGM_SHORT_ADJ, L"AdjS" }, 
-            { SUBPARADIGM_ADVERB, L"Adv" }, { SUBPARADIGM_ASPECT_PAIR, L"AspectPair" }, { SUBPARADIGM_CONJUNCTION, L"Conj" }, 
-            { SUBPARADIGM_IMPERATIVE, L"Impv" }, { SUBPARADIGM_INFINITIVE, L"Inf" }, { SUBPARADIGM_INTERJECTION, L"Interj" }, 
-            { SUBPARADIGM_NOUN, L"Noun" }, { SUBPARADIGM_NUM_ADJ, L"NumAdj" }, { SUBPARADIGM_NUM_2TO4, L"Numeral24" }, 
-            { SUBPARADIGM_NUM, L"Numeral" }, { SUBPARADIGM_LAST_NAME_NOUN, L"LastNameNoun" }, { SUBPARADIGM_LAST_NAME_NOUN_F, L"LastNameNounFeminine" },
-            { SUBPARADIGM_LAST_NAME_LONG_ADJ, L"LastNameLongAdj" }, { SUBPARADIGM_LAST_NAME_PRONOUN_ADJ, L"LastNamePronAdj" }, 
-            { SUBPARADIGM_PARENTHESIS, L"Parenth" }, { SUBPARADIGM_PARTICLE, L"Particle" }, { SUBPARADIGM_PAST_TENSE, L"Past" }, 
-            { SUBPARADIGM_PART_PAST_ACT, L"PPastA" }, { SUBPARADIGM_PART_PAST_PASS_LONG, L"PPastPL" }, 
-            { SUBPARADIGM_PART_PAST_PASS_SHORT, L"PPastPS" }, { SUBPARADIGM_PREDICATIVE, L"Predic" }, 
-            { SUBPARADIGM_PREPOSITION, L"Prep" }, { SUBPARADIGM_PART_PRES_ACT, L"PPresA" }, 
-            { SUBPARADIGM_PART_PRES_PASS_LONG, L"PPresPL" }, { SUBPARADIGM_PART_PRES_PASS_SHORT, L"PPresPS" }, 
-            { SUBPARADIGM_PRESENT_TENSE, L"Pres" }, { SUBPARADIGM_PRONOUN_ADJ, L"PronAdj" }, 
-            { SUBPARADIGM_PRONOUN, L"Pronoun" }, { SUBPARADIGM_ADVERBIAL_PAST, L"VAdv_Past" }, 
-            { SUBPARADIGM_ADVERBIAL_PRESENT, L"VAdv_Pres" }
+            { L"N", CASE_NOM }, { L"A", CASE_ACC }, { L"G", CASE_GEN }, { L"Part", CASE_PART }, { L"D", CASE_DAT }, { L"I", CASE_INST },
+            { L"P", CASE_PREP }, { L"L", CASE_LOC }, { L"Num", CASE_NUM }
         };
 
-        CEString sSubparadigm;
-        try
-        {
-            sSubparadigm = mapSubparadigmToStr.at(eKey);
-        }
-        catch (std::exception& ex)
+        constexpr StEntry<ET_Person> arrPersons[] = { { L"1", PERSON_1 }, { L"2", PERSON_2 }, { L"3", PERSON_3 } };
+
+        constexpr StEntry<ET_PartOfSpeech> arrPosNames[] =
         {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
-        }
+            { L"", POS_UNDEFINED }, { L"Adv", POS_ADV }, { L"Prep", POS_PREPOSITION }, { L"Conj", POS_CONJUNCTION }, { L"Particle", POS_PARTICLE },
+            { L"AdjComp", POS_COMPAR }, { L"Predic", POS_PREDIC }, { L"Interj", POS_INTERJ }, { L"Parenth", POS_PARENTH }
+        };
 
-        return sSubparadigm;
+    }   //  namespace GramTables
+
+    static ET_Subparadigm eStrToSubparadigm(const CEStringView& svKey)
+    {
+        static constexpr GramTables::CPerfectHash phSubparadigms(GramTables::arrSubparadigms);
+        return GramTables::eFind(phSubparadigms, svKey, SUBPARADIGM_UNDEFINED, false);
     }
 
-    static ET_Number eStrToNumber(const CEString& sKey)
+    static CEStringView svSubparadigmToStr(ET_Subparadigm eKey)
     {
-        static const map<CEString, ET_Number> mapStrToNumber = { { L"Sg", NUM_SG }, { L"Pl", NUM_PL } };
+        static constexpr GramTables::CEnumNames<ET_Subparadigm, size(GramTables::arrSubparadigms), SUBPARADIGM_COUNT> 
+            enSubparadigms(GramTables::arrSubparadigms);
+        return GramTables::svFind(enSubparadigms, eKey);
+    }
 
-        ET_Number eNumber = NUM_UNDEFINED;
-        try
-        {
-            eNumber = mapStrToNumber.at(sKey);
-        }
-        catch (std::exception& ex)
-        {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
-        }
+    static inline CEString sSubparadigmToStr(ET_Subparadigm eKey)
+    {
+        return CEString(svSubparadigmToStr(eKey));
+    }
 
-        return eNumber;
+    static ET_Number eStrToNumber(const CEStringView& svKey)
+    {
+        static constexpr GramTables::CPerfectHash phNumbers(GramTables::arrNumbers);
+        return GramTables::eFind(phNumbers, svKey, NUM_UNDEFINED);
     }
 
-    static CEString sNumberToStr(ET_Number eKey)
+    static CEStringView svNumberToStr(ET_Number eKey)
     {
-        static const map<ET_Number, CEString> mapNumberToStr = { { NUM_SG, L"Sg" }, { NUM_PL, L"Pl" } };
+        static constexpr GramTables::CEnumNames<ET_Number, size(GramTables::arrNumbers), NUM_COUNT> enNumbers(GramTables::arrNumbers);
+        return GramTables::svFind(enNumbers, eKey);
+    }
 
-        CEString sNumber;
-        try
-        {
-            sNumber = mapNumberToStr.at(eKey);
-        }
-        catch (std::exception& ex)
-        {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
-        }
+    static inline CEString sNumberToStr(ET_Number eKey)
+    {
+        return CEString(svNumberToStr(eKey));
+    }
 
-        return sNumber;
+    static ET_Gender eStrToGender(const CEStringView& svKey)
+    {
+        static constexpr GramTables::CPerfectHash phGenders(GramTables::arrGenders);
+        return GramTables::eFind(phGenders, svKey, GENDER_UNDEFINED);
     }
 
-    static ET_Gender eStrToGender(const CEString& sKey)
+    static CEStringView svGenderToStr(ET_Gender eKey)
     {
-        static const map<CEString, ET_Gender> mapStrToGender = { { L"M", GENDER_M }, { L"F", GENDER_F }, { L"N", GENDER_N } };
+        static constexpr GramTables::CEnumNames<ET_Gender, size(GramTables::arrGenderNames), GENDER_COUNT> enGenders(GramTables::arrGenderNames);
+        return GramTables::svFind(enGenders, eKey);
+    }
 
-        ET_Gender eGender = GENDER_UNDEFINED;
-        try
-        {
-            eGender = mapStrToGender.at(sKey);
-        }
-        catch (std::exception& ex)
-        {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
-        }
+    static inline CEString sGenderToStr(ET_Gender eKey)
+    {
+        return CEString(svGenderToStr(eKey));
+    }
 
-        return eGender;
+    static CEStringView svAnimacyToStr(ET_Animacy eKey)
+    {
+        static constexpr GramTables::CEnumNames<ET_Animacy, size(GramTables::arrAnimacyNames), ANIM_COUNT> enAnimacy(GramTables::arrAnimacyNames);
+        return GramTables::svFind(enAnimacy, eKey);
     }
 
-    static CEString sGenderToStr(ET_Gender eKey)
+    static inline CEString sAnimacyToStr(ET_Animacy eKey)
     {
-        static const map<ET_Gender, CEString> mapGenderToStr = { { GENDER_M, L"M" }, { GENDER_F, L"F" }, { GENDER_N, L"N" }, { GENDER_UNDEFINED, L"" } };
+        return CEString(svAnimacyToStr(eKey));
+    }
 
-        CEString sGender;
-        try
-        {
-            sGender = mapGenderToStr.at(eKey);
-        }
-        catch (std::exception& ex)
-        {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
-        }
+    static ET_Case eStrToCase(const CEStringView& svKey)
+    {
+        static constexpr GramTables::CPerfectHash phCases(GramTables::arrCases);
+        return GramTables::eFind(phCases, svKey, CASE_UNDEFINED);
+    }
 
-        return sGender;
+    static CEStringView svCaseToStr(ET_Case eKey)
+    {
+        static constexpr GramTables::CEnumNames<ET_Case, size(GramTables::arrCases), CASE_COUNT> enCases(GramTables::arrCases);
+        return GramTables::svFind(enCases, eKey);
     }
 
-    static CEString sAnimacyToStr(ET_Animacy eKey)
+    static inline CEString sCaseToStr(ET_Case eKey)
     {
-        static const map<ET_Animacy, CEString> mapAnimacyToStr = { { ANIM_YES, L"Anim" }, { ANIM_NO, L"Inanim" }, { ANIM_UNDEFINED, L"" } };
+        return CEString(svCaseToStr(eKey));
+    }
 
-        CEString sAnimacy;
-        try
-        {
-            sAnimacy = mapAnimacyToStr.at(eKey);
-        }
-        catch (std::exception& ex)
-        {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
-        }
+    static ET_Person eStrToPerson(const CEStringView& svKey)
+    {
+        static constexpr GramTables::CPerfectHash phPersons(GramTables::arrPersons);
+        return GramTables::eFind(phPersons, svKey, PERSON_UNDEFINED);
+    }
 
-        return sAnimacy;
+    static CEStringView svPersonToStr(ET_Person ePerson)
+    {
+        static constexpr GramTables::CEnumNames<ET_Person, size(GramTables::arrPersons), PERSON_COUNT> enPersons(GramTables::arrPersons);
+        return GramTables::svFind(enPersons, ePerson);
     }
 
-    static ET_Case eStrToCase(const CEString& sKey)
+    static inline CEString sPersonToStr(const ET_Person ePerson)
     {
-        static const map<CEString, ET_Case> mapStrToCase =
-        {
-            { L"N", CASE_NOM }, { L"A", CASE_ACC }, { L"G", CASE_GEN }, { L"Part", CASE_PART }, { L"D", CASE_DAT }, { L"I", CASE_INST },
-            { L"P", CASE_PREP }, { L"L", CASE_LOC }, { L"Num", CASE_NUM }
-        };
+        return CEString(svPersonToStr(ePerson));
+    }
 
-        ET_Case eCase = CASE_UNDEFINED;
-        try
-        {
-            eCase = mapStrToCase.at(sKey);
-        }
-        catch (std::exception& ex)
-        {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
-        }
+    static CEStringView svPosToStr(ET_PartOfSpeech ePos)
+    {
+        static constexpr GramTables::CEnumNames<ET_PartOfSpeech, size(GramTables::arrPosNames), POS_COUNT> enPos(GramTables::arrPosNames);
+        return GramTables::svFind(enPos, ePos);
+    }
 
-        return eCase;
+    static inline CEString sPosToStr(const ET_PartOfSpeech ePos)
+    {
+        return CEString(svPosToStr(ePos));
     }
 
-    static CEString sCaseToStr(ET_Case eKey)
+    //
+    // The whole CGramInfo tuple packed into one integer so that hot code can 
+    // store and compare tags without building or parsing hash strings.
+    // Fields from the low bit up: POS 5 bits, subparadigm 6, case 4, number 2, 
+    // gender 2, person 2, animacy 2, aspect 2, reflexivity 2. Each field holds 
+    // the enum value as is, so 0 is the all-undefined tuple.
+    //
+    namespace GramCode
     {
-        static const map<ET_Case, CEString> mapCaseToStr =
+        constexpr unsigned int cuiPosShift_ = 0;
+        constexpr unsigned int cuiPosBits_ = 5;
+        constexpr unsigned int cuiSubparadigmShift_ = cuiPosShift_ + cuiPosBits_;
+        constexpr unsigned int cuiSubparadigmBits_ = 6;
+        constexpr unsigned int cuiCaseShift_ = cuiSubparadigmShift_ + cuiSubparadigmBits_;
+        constexpr unsigned int cuiCaseBits_ = 4;
+        constexpr unsigned int cuiNumberShift_ = cuiCaseShift_ + cuiCaseBits_;
+        constexpr unsigned int cuiNumberBits_ = 2;
+        constexpr unsigned int cuiGenderShift_ = cuiNumberShift_ + cuiNumberBits_;
+        constexpr unsigned int cuiGenderBits_ = 2;
+        constexpr unsigned int cuiPersonShift_ = cuiGenderShift_ + cuiGenderBits_;
+        constexpr unsigned int cuiPersonBits_ = 2;
+        constexpr unsigned int cuiAnimacyShift_ = cuiPersonShift_ + cuiPersonBits_;
+        constexpr unsigned int cuiAnimacyBits_ = 2;
+        constexpr unsigned int cuiAspectShift_ = cuiAnimacyShift_ + cuiAnimacyBits_;
+        constexpr unsigned int cuiAspectBits_ = 2;
+        constexpr unsigned int cuiReflexivityShift_ = cuiAspectShift_ + cuiAspectBits_;
+        constexpr unsigned int cuiReflexivityBits_ = 2;
+        constexpr unsigned int cuiBits_ = cuiReflexivityShift_ + cuiReflexivityBits_;
+
+        // Never produced by uiEncode(); marks a hash that did not decode
+        constexpr uint32_t cuiInvalid_ = 0xFFFFFFFF;
+
+        static_assert(POS_COUNT <= (1 << cuiPosBits_), "POS does not fit its field");
+        static_assert(SUBPARADIGM_COUNT <= (1 << cuiSubparadigmBits_), "Subparadigm does not fit its field");
+        static_assert(CASE_COUNT <= (1 << cuiCaseBits_), "Case does not fit its field");
+        static_assert(NUM_COUNT <= (1 << cuiNumberBits_), "Number does not fit its field");
+        static_assert(GENDER_COUNT <= (1 << cuiGenderBits_), "Gender does not fit its field");
+        static_assert(PERSON_COUNT <= (1 << cuiPersonBits_), "Person does not fit its field");
+        static_assert(ANIM_COUNT <= (1 << cuiAnimacyBits_), "Animacy does not fit its field");
+        static_assert(ASPECT_COUNT <= (1 << cuiAspectBits_), "Aspect does not fit its field");
+        static_assert(REFL_COUNT <= (1 << cuiReflexivityBits_), "Reflexivity does not fit its field");
+        static_assert(cuiBits_ <= 32, "Gram code does not fit 32 bits");
+
+        constexpr uint32_t uiField(uint32_t uiCode, unsigned int uiShift, unsigned int uiBits)
         {
-            { CASE_NOM, L"N" }, { CASE_ACC, L"A" }, { CASE_GEN, L"G" }, { CASE_PART, L"Part" }, { CASE_DAT, L"D" }, { CASE_INST, L"I" },
-            { CASE_PREP, L"P" }, { CASE_LOC, L"L" }, { CASE_NUM, L"Num" }
-        };
-
-        CEString sCase;
+            return (uiCode >> uiShift) & ((1u << uiBits) - 1);
+        }
 
-        try
+        constexpr uint32_t uiEncode(ET_PartOfSpeech ePos, 
+                                    ET_Subparadigm eSubparadigm, 
+                                    ET_Case eCase, 
+                                    ET_Number eNumber, 
+                                    ET_Gender eGender, 
+                                    ET_Person ePerson, 
+                                    ET_Animacy eAnimacy, 
+                                    ET_Aspect eAspect, 
+                                    ET_Reflexivity eReflexivity)
         {
-            sCase = mapCaseToStr.at(eKey);
+            return ((uint32_t)ePos << cuiPosShift_) 
+                | ((uint32_t)eSubparadigm << cuiSubparadigmShift_) 
+                | ((uint32_t)eCase << cuiCaseShift_) 
+                | ((uint32_t)eNumber << cuiNumberShift_) 
+                | ((uint32_t)eGender << cuiGenderShift_) 
+                | ((uint32_t)ePerson << cuiPersonShift_) 
+                | ((uint32_t)eAnimacy << cuiAnimacyShift_) 
+                | ((uint32_t)eAspect << cuiAspectShift_) 
+                | ((uint32_t)eReflexivity << cuiReflexivityShift_);
         }
-        catch (std::exception& ex)
+
+        constexpr ET_PartOfSpeech ePos(uint32_t uiCode)
         {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
+            return (ET_PartOfSpeech)uiField(uiCode, cuiPosShift_, cuiPosBits_);
         }
 
-        return sCase;
-    }
-
-    static ET_Person eStrToPerson(const CEString& sKey)
-    {
-        static const map<CEString, ET_Person> mapStrToPerson = { { L"1", PERSON_1 }, { L"2", PERSON_2 }, { L"3", PERSON_3 } };
-
-        ET_Person ePerson = PERSON_UNDEFINED;
-
-        try
+        constexpr ET_Subparadigm eSubparadigm(uint32_t uiCode)
         {
-            ePerson = mapStrToPerson.at(sKey);
+            return (ET_Subparadigm)uiField(uiCode, cuiSubparadigmShift_, cuiSubparadigmBits_);
         }
-        catch (std::exception& ex)
+
+        constexpr ET_Case eCase(uint32_t uiCode)
         {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
+            return (ET_Case)uiField(uiCode, cuiCaseShift_, cuiCaseBits_);
         }
 
-        return ePerson;
-    }
-
-    static CEString sPersonToStr(const ET_Person ePerson)
-    {
-        static const map<ET_Person, CEString> mapPersonToStr = { { PERSON_1, L"1" }, { PERSON_2, L"2" }, { PERSON_3, L"3" } };
+        constexpr ET_Number eNumber(uint32_t uiCode)
+        {
+            return (ET_Number)uiField(uiCode, cuiNumberShift_, cuiNumberBits_);
+        }
 
-        CEString sPerson;
-        try
+        constexpr ET_Gender eGender(uint32_t uiCode)
         {
-            sPerson = mapPersonToStr.at(ePerson);
+            return (ET_Gender)uiField(uiCode, cuiGenderShift_, cuiGenderBits_);
         }
-        catch (std::exception& ex)
+
+        constexpr ET_Person ePerson(uint32_t uiCode)
         {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
+            return (ET_Person)uiField(uiCode, cuiPersonShift_, cuiPersonBits_);
         }
 
-        return sPerson;
-    }
+        constexpr ET_Animacy eAnimacy(uint32_t uiCode)
+        {
+            return (ET_Animacy)uiField(uiCode, cuiAnimacyShift_, cuiAnimacyBits_);
+        }
 
-    static CEString sPosToStr(const ET_PartOfSpeech ePos)
-    {
-        static const map<ET_PartOfSpeech, CEString> mapPosToStr =
+        constexpr ET_Aspect eAspect(uint32_t uiCode)
         {
-            { POS_UNDEFINED, L"" }, { POS_ADV, L"Adv" }, { POS_PREPOSITION, L"Prep" }, { POS_CONJUNCTION, L"Conj" }, { POS_PARTICLE, L"Particle" },
-            { POS_COMPAR, L"AdjComp" }, { POS_PREDIC, L"Predic" }, { POS_INTERJ, L"Interj" }, { POS_PARENTH, L"Parenth" }
-        };
+            return (ET_Aspect)uiField(uiCode, cuiAspectShift_, cuiAspectBits_);
+        }
 
-        CEString sPos;
-        try
+        constexpr ET_Reflexivity eReflexivity(uint32_t uiCode)
         {
-            sPos = mapPosToStr.at(ePos);
+            return (ET_Reflexivity)uiField(uiCode, cuiReflexivityShift_, cuiReflexivityBits_);
         }
-        catch (std::exception& ex)
+
+        // Every field names an existing enum value and no bits are set above the last field
+        constexpr bool bIsValid(uint32_t uiCode)
         {
-            CEString sMsg(L"Exception: ");
-            sMsg += CEString::sToString(ex.what());
-            ERROR_LOG(sMsg);
+            return (cuiBits_ >= 32 || (uiCode >> cuiBits_) == 0) 
+                && ePos(uiCode) < POS_COUNT && eSubparadigm(uiCode) < SUBPARADIGM_COUNT 
+                && eCase(uiCode) < CASE_COUNT && eNumber(uiCode) < NUM_COUNT 
+                && eGender(uiCode) < GENDER_COUNT && ePerson(uiCode) < PERSON_COUNT 
+                && eAnimacy(uiCode) < ANIM_COUNT && eAspect(uiCode) < ASPECT_COUNT 
+                && eReflexivity(uiCode) < REFL_COUNT;
         }
 
-        return sPos;
-    }
+    }   //  namespace GramCode
 
     class CGramInfo
     {
@@ -338,6 +509,34 @@ namespace Hlib
             GramClear();
         }
 
+        uint32_t uiGramCode() const
+        {
+            return GramCode::uiEncode(m_ePos, m_eSubparadigm, m_eCase, m_eNumber, m_eGender, 
+                                      m_ePerson, m_eAnimacy, m_eAspect, m_eReflexivity);
+        }
+
+        ET_ReturnCode eDecodeCode(uint32_t uiCode)
+        {
+            if (!GramCode::bIsValid(uiCode))
+            {
+                CEString sMsg(L"Invalid gram code: ");
+                ERROR_LOG(sMsg + CEString::sToString(uiCode));
+                return ET_ReturnCode(H_ERROR_INVALID_ARG);
+            }
+
+            m_ePos = GramCode::ePos(uiCode);
+            m_eSubparadigm = GramCode::eSubparadigm(uiCode);
+            m_eCase = GramCode::eCase(uiCode);
+            m_eNumber = GramCode::eNumber(uiCode);
+            m_eGender = GramCode::eGender(uiCode);
+            m_ePerson = GramCode::ePerson(uiCode);
+            m_eAnimacy = GramCode::eAnimacy(uiCode);
+            m_eAspect = GramCode::eAspect(uiCode);
+            m_eReflexivity = GramCode::eReflexivity(uiCode);
+
+            return H_NO_ERROR;
+        }
+
         virtual ~CGramInfo() {}
     };
 
@@ -364,16 +563,8 @@ public:
         GramClear();
     }
 
-    CGramHasher (const CEString& sHash)
-    {
-        ET_ReturnCode rc = H_NO_ERROR;
-        GramClear();
-        rc = eDecodeHash (sHash);
-        if (H_NO_ERROR != rc)
-        {
-            throw CException (rc, L"CGramHasher::eDecode() failed.");
-        }
-    }
+    // Goes through the shared CGramDecoder, see below
+    CGramHasher (const CEString& sHash);
 
     CGramHasher (ET_PartOfSpeech ePos, 
                  ET_Subparadigm eSubparadigm, 
@@ -429,48 +620,63 @@ public:
                    REFL_UNDEFINED)
     {}
 
+    //
+    // Appends the tag views to one string. Hashes of up to 23 characters fit 
+    // CEString's inline buffer and need no allocation; the few longer ones 
+    // (LastNameNounFeminine_...) grow into the heap once.
+    //
     CEString sGramHash()
     {
         if (POS_UNDEFINED == m_ePos || POS_ADV == m_ePos || POS_PREPOSITION == m_ePos ||
             POS_CONJUNCTION == m_ePos || POS_PARTICLE == m_ePos || POS_COMPAR == m_ePos ||
             POS_PREDIC == m_ePos || POS_INTERJ == m_ePos || POS_PARENTH == m_ePos)
         {
-            return sPosToStr(m_ePos);
+            return CEString(svPosToStr(m_ePos));
         }
 
         CEString sHash;
+        auto fnAppend = [&sHash](const CEStringView& svTag)
+        {
+            sHash += L"_";
+            sHash += svTag;
+        };
+
         switch (m_eSubparadigm)
         {
         case SUBPARADIGM_NOUN:
         case SUBPARADIGM_PRONOUN:
-            sHash = sSubparadigmToStr(m_eSubparadigm) + L"_" + sNumberToStr(m_eNumber) + L"_" + sCaseToStr(m_eCase);
+            sHash += svSubparadigmToStr(m_eSubparadigm);
+            fnAppend(svNumberToStr(m_eNumber));
+            fnAppend(svCaseToStr(m_eCase));
             break;
 
         case SUBPARADIGM_LAST_NAME_NOUN:
-            sHash = sSubparadigmToStr(m_eSubparadigm);
+            sHash += svSubparadigmToStr(m_eSubparadigm);
             if (NUM_SG == m_eNumber)
             {
-                sHash += L"_" + sGenderToStr(GENDER_M);
+                fnAppend(svGenderToStr(GENDER_M));
             }
-            sHash += L"_" + sNumberToStr(m_eNumber);
-            sHash += L"_" + sCaseToStr(m_eCase);
+            fnAppend(svNumberToStr(m_eNumber));
+            fnAppend(svCaseToStr(m_eCase));
             break;
 
         case SUBPARADIGM_LAST_NAME_NOUN_F:
-            sHash = sSubparadigmToStr(m_eSubparadigm);
+            sHash += svSubparadigmToStr(m_eSubparadigm);
             if (NUM_SG == m_eNumber)
             {
-                sHash += L"_" + sGenderToStr(GENDER_F);
+                fnAppend(svGenderToStr(GENDER_F));
             }
-            sHash += L"_" + sNumberToStr(m_eNumber);
-            sHash += L"_" + sCaseToStr(m_eCase);
+            fnAppend(svNumberToStr(m_eNumber));
+            fnAppend(svCaseToStr(m_eCase));
             break;
 
         case SUBPARADIGM_NUM:
         case SUBPARADIGM_NUM_2TO4:
+            sHash += svSubparadigmToStr(m_eSubparadigm);
             if (m_eGender != GENDER_UNDEFINED)
             {
-                sHash = sSubparadigmToStr(m_eSubparadigm) + L"_" + sGenderToStr(m_eGender) + L"_" + sCaseToStr(m_eCase);
+                fnAppend(svGenderToStr(m_eGender));
+                fnAppend(svCaseToStr(m_eCase));
                 if (ANIM_NO == m_eAnimacy)
                 {
                     sHash += L"_Inanim";
@@ -482,7 +688,7 @@ public:
             }
             else
             {
-                sHash = sSubparadigmToStr(m_eSubparadigm) + L"_" + sCaseToStr(m_eCase);
+                fnAppend(svCaseToStr(m_eCase));
             }
             break;
 
@@ -493,49 +699,51 @@ public:
         case SUBPARADIGM_PART_PRES_PASS_LONG:
         case SUBPARADIGM_PART_PAST_ACT:
         case SUBPARADIGM_PART_PAST_PASS_LONG:
-            sHash = sSubparadigmToStr(m_eSubparadigm);
+            sHash += svSubparadigmToStr(m_eSubparadigm);
             if (NUM_SG == m_eNumber)
             {
-                sHash += L"_" + sGenderToStr(m_eGender);
+                fnAppend(svGenderToStr(m_eGender));
             }
-            sHash += L"_" + sNumberToStr(m_eNumber);
-            sHash += L"_" + sCaseToStr(m_eCase);
+            fnAppend(svNumberToStr(m_eNumber));
+            fnAppend(svCaseToStr(m_eCase));
 
             if (m_eCase == CASE_ACC && (m_eNumber == NUM_PL || GENDER_M == m_eGender))
             {
-                sHash += L"_" + sAnimacyToStr(m_eAnimacy);
+                fnAppend(svAnimacyToStr(m_eAnimacy));
             }
             break;
 
         case SUBPARADIGM_LAST_NAME_LONG_ADJ:
         case SUBPARADIGM_LAST_NAME_PRONOUN_ADJ:
-            sHash = sSubparadigmToStr(m_eSubparadigm);
+            sHash += svSubparadigmToStr(m_eSubparadigm);
             if (NUM_SG == m_eNumber)
             {
-                sHash += L"_" + sGenderToStr(m_eGender);
+                fnAppend(svGenderToStr(m_eGender));
             }
-            sHash += L"_" + sNumberToStr(m_eNumber);
-            sHash += L"_" + sCaseToStr(m_eCase);
+            fnAppend(svNumberToStr(m_eNumber));
+            fnAppend(svCaseToStr(m_eCase));
             break;
 
         case SUBPARADIGM_PAST_TENSE:
         case SUBPARADIGM_SHORT_ADJ:
         case SUBPARADIGM_PART_PRES_PASS_SHORT:
         case SUBPARADIGM_PART_PAST_PASS_SHORT:
-            sHash = sSubparadigmToStr(m_eSubparadigm) + L"_";
+            sHash += svSubparadigmToStr(m_eSubparadigm);
             if (NUM_PL == m_eNumber)
             {
-                sHash += sNumberToStr(m_eNumber);
+                fnAppend(svNumberToStr(m_eNumber));
             }
             else
             {
-                sHash += sGenderToStr(m_eGender);
+                fnAppend(svGenderToStr(m_eGender));
             }
             break;
 
         case SUBPARADIGM_PRESENT_TENSE:
         case SUBPARADIGM_IMPERATIVE:
-            sHash = sSubparadigmToStr(m_eSubparadigm) + L"_" + sNumberToStr(m_eNumber) + L"_" + sPersonToStr(m_ePerson);
+            sHash += svSubparadigmToStr(m_eSubparadigm);
+            fnAppend(svNumberToStr(m_eNumber));
+            fnAppend(svPersonToStr(m_ePerson));
             break;
 
         case SUBPARADIGM_ADVERBIAL_PRESENT:
@@ -543,7 +751,7 @@ public:
         case SUBPARADIGM_INFINITIVE:
         case SUBPARADIGM_COMPARATIVE:
         case SUBPARADIGM_UNDEFINED:
-            sHash = sSubparadigmToStr(m_eSubparadigm);
+            sHash += svSubparadigmToStr(m_eSubparadigm);
             break;
 
         default:
@@ -559,6 +767,32 @@ public:
 
     } // sGramHash()
 
+    //
+    // String hash <-> gram code. A code made from a hash turns back into the 
+    // same hash, so stored codes and stored hashes are interchangeable.
+    //
+    static ET_ReturnCode eHashToCode(const CEString& sHash, uint32_t& uiCode)
+    {
+        CGramHasher hasher;
+        ET_ReturnCode rc = hasher.eDecodeHash(sHash);
+        if (H_NO_ERROR == rc)
+        {
+            uiCode = hasher.uiGramCode();
+        }
+        return rc;
+    }
+
+    static ET_ReturnCode eCodeToHash(uint32_t uiCode, CEString& sHash)
+    {
+        CGramHasher hasher;
+        ET_ReturnCode rc = hasher.eDecodeCode(uiCode);
+        if (H_NO_ERROR == rc)
+        {
+            sHash = hasher.sGramHash();
+        }
+        return rc;
+    }
+
  
     ET_ReturnCode eDecodeHash (const CEString& sHash)
     {
@@ -569,7 +803,19 @@ public:
             sSource.ResetSeparators();
             sSource.SetBreakChars(L"_");
 
-            if (sSource.uiNFields() < 1)
+            // No hash has more than five fields, the rest of the string is never scanned
+            CEStringView arrFields[5];
+            unsigned int uiFields = 0;
+            for (const CEStringView& svField : sSource.Fields())
+            {
+                arrFields[uiFields++] = svField;
+                if (5 == uiFields)
+                {
+                    break;
+                }
+            }
+
+            if (uiFields < 1)
             {
                 CEString sMsg(L"Unable to parse hash: ");
                 ERROR_LOG(sMsg + sHash);
@@ -586,17 +832,22 @@ public:
             }
             else
             {
-                m_eSubparadigm = eStrToSubparadigm(sSource.sGetField(0));
+                m_eSubparadigm = eStrToSubparadigm(arrFields[0]);
             }
 
             m_ePos = Hlib::eSubparadigmToPos(m_eSubparadigm);
+            if (SUBPARADIGM_LAST_NAME_NOUN == m_eSubparadigm || SUBPARADIGM_LAST_NAME_NOUN_F == m_eSubparadigm ||
+                SUBPARADIGM_LAST_NAME_LONG_ADJ == m_eSubparadigm || SUBPARADIGM_LAST_NAME_PRONOUN_ADJ == m_eSubparadigm)
+            {
+                m_ePos = POS_LAST_NAME;
+            }
 
             switch (m_eSubparadigm)
             {
                 case SUBPARADIGM_NOUN:
                 case SUBPARADIGM_PRONOUN:
                 {
-                    if (sSource.uiNFields() < 3)
+                    if (uiFields < 3)
                     {
                         CEString sMsg(L"No number and/or case: ");
                         ERROR_LOG(sMsg + sSource);
@@ -604,8 +855,8 @@ public:
                         return ET_ReturnCode(H_ERROR_INVALID_ARG);
                     }
 
-                    m_eNumber = eStrToNumber(sSource.sGetField(1));
-                    m_eCase = eStrToCase(sSource.sGetField(2));
+                    m_eNumber = eStrToNumber(arrFields[1]);
+                    m_eCase = eStrToCase(arrFields[2]);
                     break;
                 }           // case SUBPARADIGM_NOUN
 
@@ -613,23 +864,23 @@ public:
                 case SUBPARADIGM_NUM_2TO4:
                 {
                     m_eGender = GENDER_UNDEFINED;
-                    if (sSource.uiNFields() >= 3)
+                    if (uiFields >= 3)
                     {
-                        m_eGender = eStrToGender(sSource.sGetField(1));
-                        m_eCase = eStrToCase(sSource.sGetField(2));
+                        m_eGender = eStrToGender(arrFields[1]);
+                        m_eCase = eStrToCase(arrFields[2]);
                     }
-                    else if (sSource.uiNFields() >= 2)
+                    else if (uiFields >= 2)
                     {
-                        m_eCase = eStrToCase(sSource.sGetField(1));
+                        m_eCase = eStrToCase(arrFields[1]);
                     }
 
-                    if (sSource.uiNFields() >= 4)
+                    if (uiFields >= 4)
                     {
-                        if (sSource.sGetField(3) == L"Inanim")
+                        if (arrFields[3] == L"Inanim")
                         {
                             m_eAnimacy = ANIM_NO;
                         }
-                        else if (sSource.sGetField(3) == L"Anim")
+                        else if (arrFields[3] == L"Anim")
                         {
                             m_eAnimacy = ANIM_YES;
                         }
@@ -651,11 +902,15 @@ public:
                 case SUBPARADIGM_PART_PAST_PASS_LONG:            // e.g., порождённому, PPastPL_M_Sg_D
                 case SUBPARADIGM_PRONOUN_ADJ:                    // e.g., PronAdj_M_Sg_N
                 case SUBPARADIGM_NUM_ADJ:                        // e.g., NumAdj_M_Sg_N
+                case SUBPARADIGM_LAST_NAME_NOUN:                 // e.g., LastNameNoun_M_Sg_G
+                case SUBPARADIGM_LAST_NAME_NOUN_F:               // e.g., LastNameNounFeminine_F_Sg_G
+                case SUBPARADIGM_LAST_NAME_LONG_ADJ:             // e.g., LastNameLongAdj_Pl_D
+                case SUBPARADIGM_LAST_NAME_PRONOUN_ADJ:
                 {
                     m_eNumber = NUM_UNDEFINED;
                     m_eGender = GENDER_UNDEFINED;
 
-                    if (sSource.uiNFields() < 3)
+                    if (uiFields < 3)
                     {
                         CEString sMsg(L"Unable to decode hash.");
                         ERROR_LOG(sMsg + sSource);
@@ -663,14 +918,16 @@ public:
                         return ET_ReturnCode(H_ERROR_INVALID_ARG);
                     }
 
-                    if (L"Pl" == sSource.sGetField(1))
+                    unsigned int uiAnimacyField = 0;
+                    if (L"Pl" == arrFields[1])
                     {
                         m_eNumber = NUM_PL;
-                        m_eCase = eStrToCase(sSource.sGetField(2));
+                        m_eCase = eStrToCase(arrFields[2]);
+                        uiAnimacyField = 3;
                     }
                     else
                     {
-                        if (sSource.uiNFields() < 4)
+                        if (uiFields < 4)
                         {
                             CEString sMsg(L"Unable to decode hash.");
                             ERROR_LOG(sMsg + sSource);
@@ -679,9 +936,23 @@ public:
                         }
 
                         m_eNumber = NUM_SG;
-                        m_eGender = eStrToGender(sSource.sGetField(1));
-                        m_eNumber = eStrToNumber(sSource.sGetField(2));
-                        m_eCase = eStrToCase(sSource.sGetField(3));
+                        m_eGender = eStrToGender(arrFields[1]);
+                        m_eNumber = eStrToNumber(arrFields[2]);
+                        m_eCase = eStrToCase(arrFields[3]);
+                        uiAnimacyField = 4;
+                    }
+
+                    // Accusative of M Sg and Pl, e.g., AdjL_Pl_A_Anim
+                    if (uiFields > uiAnimacyField)
+                    {
+                        if (L"Anim" == arrFields[uiAnimacyField])
+                        {
+                            m_eAnimacy = ANIM_YES;
+                        }
+                        else if (L"Inanim" == arrFields[uiAnimacyField])
+                        {
+                            m_eAnimacy = ANIM_NO;
+                        }
                     }
                     break;
                 }           //  case SUBPARADIGM_LONG_ADJ
@@ -691,7 +962,7 @@ public:
                 case SUBPARADIGM_PART_PRES_PASS_SHORT:
                 case SUBPARADIGM_PART_PAST_PASS_SHORT:
                 {
-                    if (sSource.uiNFields() < 2)
+                    if (uiFields < 2)
                     {
                         CEString sMsg(L"Unable to decode hash.");
                         ERROR_LOG(sMsg + sSource);
@@ -701,14 +972,14 @@ public:
 
                     m_eNumber = NUM_UNDEFINED;
                     m_eGender = GENDER_UNDEFINED;
-                    if (L"Pl" == sSource.sGetField(1))
+                    if (L"Pl" == arrFields[1])
                     {
                         m_eNumber = NUM_PL;
                     }
                     else
                     {
                         m_eNumber = NUM_SG;
-                        m_eGender = eStrToGender(sSource.sGetField(1));
+                        m_eGender = eStrToGender(arrFields[1]);
                     }
                     break;
                 
@@ -717,15 +988,15 @@ public:
                 case SUBPARADIGM_PRESENT_TENSE:
                 case SUBPARADIGM_IMPERATIVE:
                 {
-                    if (sSource.uiNFields() < 3)
+                    if (uiFields < 3)
                     {
                         CEString sMsg(L"Unable to decode hash.");
                         ERROR_LOG(sMsg + sSource);
                         m_eSubparadigm = SUBPARADIGM_UNDEFINED;
                         return ET_ReturnCode(H_ERROR_INVALID_ARG);
                     }
-                    m_eNumber = eStrToNumber(sSource.sGetField(1));
-                    m_ePerson = eStrToPerson(sSource.sGetField(2));
+                    m_eNumber = eStrToNumber(arrFields[1]);
+                    m_ePerson = eStrToPerson(arrFields[2]);
 
                     break;
                 
@@ -1170,6 +1441,389 @@ public:
 
 };      //  class CGramHasher
 
+//
+// Every paradigm that Initialize(), SetParadigm() and bIncrement() walk through, 
+// unrolled once into flat arrays of slots. A slot holds the gram code and the 
+// hash string of one step, so iterating a paradigm is an array walk and does 
+// not touch the hasher state machine or allocate.
+//
+struct StParadigmSlot
+{
+    uint32_t uiGramCode;
+    CEStringView svGramHash;
+};
+
+class CParadigmSlots
+{
+public:
+    CParadigmSlots() : m_pBegin(nullptr), m_pEnd(nullptr)
+    {}
+
+    CParadigmSlots(const StParadigmSlot * pBegin, const StParadigmSlot * pEnd) : m_pBegin(pBegin), m_pEnd(pEnd)
+    {}
+
+    const StParadigmSlot * begin() const
+    {
+        return m_pBegin;
+    }
+
+    const StParadigmSlot * end() const
+    {
+        return m_pEnd;
+    }
+
+    unsigned int uiSize() const
+    {
+        return (unsigned int)(m_pEnd - m_pBegin);
+    }
+
+    const StParadigmSlot& operator[] (unsigned int uiAt) const
+    {
+        assert(uiAt < uiSize());
+        return m_pBegin[uiAt];
+    }
+
+private:
+    const StParadigmSlot * m_pBegin;
+    const StParadigmSlot * m_pEnd;
+
+};      //  class CParadigmSlots
+
+class CParadigmTables
+{
+public:
+    // Built on first use, immutable afterwards
+    static const CParadigmTables * pGetInstance()
+    {
+        static const CParadigmTables s_Tables;
+        return &s_Tables;
+    }
+
+    CParadigmTables(const CParadigmTables&) = delete;
+    CParadigmTables& operator=(const CParadigmTables&) = delete;
+
+    //
+    // stStart is a hasher right after Initialize() / SetParadigm(); the slots 
+    // are the states it would pass through, starting with its own. False if 
+    // that starting state is not one of the tabulated paradigms.
+    //
+    bool bGetParadigm(const CGramInfo& stStart, CParadigmSlots& Slots) const
+    {
+        uint32_t uiStartCode = stStart.uiGramCode();
+        auto itParadigm = lower_bound(m_vecParadigms.begin(), m_vecParadigms.end(), uiStartCode, 
+                                      [](const StParadigm& stParadigm, uint32_t uiCode) { return stParadigm.uiStartCode < uiCode; });
+        if (m_vecParadigms.end() == itParadigm || itParadigm->uiStartCode != uiStartCode)
+        {
+            return false;
+        }
+
+        Slots = CParadigmSlots(m_vecSlots.data() + itParadigm->uiFirstSlot, 
+                               m_vecSlots.data() + itParadigm->uiFirstSlot + itParadigm->uiSlots);
+        return true;
+    }
+
+    unsigned int uiParadigmCount() const
+    {
+        return (unsigned int)m_vecParadigms.size();
+    }
+
+private:
+    struct StParadigm
+    {
+        uint32_t uiStartCode;
+        unsigned int uiFirstSlot;
+        unsigned int uiSlots;
+    };
+
+    static constexpr unsigned int cuiMaxSlots_ = 256;       // a longer walk means bIncrement() does not terminate
+
+    CParadigmTables()
+    {
+        vector<CEString> vecHashes;
+        auto fnAdd = [&](CGramHasher hasher)
+        {
+            StParadigm stParadigm { hasher.uiGramCode(), (unsigned int)m_vecSlots.size(), 0 };
+            for (auto& stExisting : m_vecParadigms)
+            {
+                if (stExisting.uiStartCode == stParadigm.uiStartCode)
+                {
+                    return;
+                }
+            }
+            do
+            {
+                if (m_vecSlots.size() - stParadigm.uiFirstSlot >= cuiMaxSlots_)
+                {
+                    throw CException(H_ERROR_UNEXPECTED, L"Paradigm walk exceeds the slot limit.");
+                }
+                m_vecSlots.push_back(StParadigmSlot { hasher.uiGramCode(), CEStringView() });
+                vecHashes.push_back(hasher.sGramHash());
+            } while (hasher.bIncrement());
+            stParadigm.uiSlots = (unsigned int)m_vecSlots.size() - stParadigm.uiFirstSlot;
+            m_vecParadigms.push_back(stParadigm);
+        };
+
+        CGramHasher hasher;
+        for (ET_Gender eGender : { GENDER_M, GENDER_F, GENDER_N })
+        {
+            for (ET_Animacy eAnimacy : { ANIM_YES, ANIM_NO })
+            {
+                hasher.Initialize(POS_NOUN, SUBPARADIGM_NOUN, eGender, eAnimacy);
+                fnAdd(hasher);
+            }
+        }
+
+        for (ET_PartOfSpeech ePos : { POS_ADJ, POS_PRONOUN_ADJ, POS_NUM_ADJ })
+        {
+            for (ET_Subparadigm eSp : { SUBPARADIGM_LONG_ADJ, SUBPARADIGM_SHORT_ADJ, SUBPARADIGM_PRONOUN_ADJ })
+            {
+                hasher.Initialize(ePos);
+                hasher.SetParadigm(eSp);
+                fnAdd(hasher);
+            }
+        }
+
+        hasher.Initialize(POS_LAST_NAME);
+        fnAdd(hasher);
+        hasher.SetParadigm(SUBPARADIGM_LAST_NAME_PRONOUN_ADJ);
+        fnAdd(hasher);
+        hasher.Initialize(POS_LAST_NAME, SUBPARADIGM_LAST_NAME_NOUN, GENDER_M, ANIM_YES);
+        fnAdd(hasher);
+        hasher.Initialize(POS_LAST_NAME, SUBPARADIGM_LAST_NAME_NOUN_F, GENDER_F, ANIM_YES);
+        fnAdd(hasher);
+
+        for (ET_Aspect eAspect : { ASPECT_IMPERFECTIVE, ASPECT_PERFECTIVE })
+        {
+            for (ET_Reflexivity eReflexivity : { REFL_YES, REFL_NO })
+            {
+                for (ET_Subparadigm eSp : { SUBPARADIGM_INFINITIVE, SUBPARADIGM_PRESENT_TENSE, SUBPARADIGM_PAST_TENSE, 
+                                            SUBPARADIGM_IMPERATIVE, SUBPARADIGM_ADVERBIAL_PRESENT, SUBPARADIGM_ADVERBIAL_PAST,
+                                            SUBPARADIGM_PART_PRES_ACT, SUBPARADIGM_PART_PRES_PASS_LONG, SUBPARADIGM_PART_PRES_PASS_SHORT,
+                                            SUBPARADIGM_PART_PAST_ACT, SUBPARADIGM_PART_PAST_PASS_LONG, SUBPARADIGM_PART_PAST_PASS_SHORT })
+                {
+                    hasher.Initialize(eAspect, eReflexivity);
+                    hasher.SetParadigm(eSp);
+                    fnAdd(hasher);
+                }
+            }
+        }
+
+        // One buffer for all hash strings; the views are taken once it stops growing
+        size_t uiChars = 0;
+        for (auto& sHash : vecHashes)
+        {
+            uiChars += sHash.uiLength();
+        }
+        m_stl_sHashes.reserve(uiChars);
+        vector<size_t> vecOffsets;
+        vecOffsets.reserve(vecHashes.size());
+        for (auto& sHash : vecHashes)
+        {
+            vecOffsets.push_back(m_stl_sHashes.length());
+            m_stl_sHashes.append((const wchar_t *)sHash, sHash.uiLength());
+        }
+        for (size_t uiSlot = 0; uiSlot < m_vecSlots.size(); ++uiSlot)
+        {
+            m_vecSlots[uiSlot].svGramHash = CEStringView(m_stl_sHashes.data() + vecOffsets[uiSlot], vecHashes[uiSlot].uiLength());
+        }
+
+        sort(m_vecParadigms.begin(), m_vecParadigms.end(), 
+             [](const StParadigm& stLhs, const StParadigm& stRhs) { return stLhs.uiStartCode < stRhs.uiStartCode; });
+
+    }   //  CParadigmTables()
+
+    vector<StParadigm> m_vecParadigms;      // sorted by start code
+    vector<StParadigmSlot> m_vecSlots;
+    wstring m_stl_sHashes;
+
+};      //  class CParadigmTables
+
+//
+// Memoizing hash decoder. Dictionaries use a few hundred distinct hash 
+// strings, so after warm-up a decode is one hash table probe under a shared 
+// lock. Entries map a hash to its gram code, or to GramCode::cuiInvalid_ for 
+// hashes eDecodeHash() rejects, so bad input is logged once rather than per row.
+//
+class CGramDecoder
+{
+public:
+    static CGramDecoder * pGetInstance()
+    {
+        static CGramDecoder s_Decoder;
+        return &s_Decoder;
+    }
+
+    CGramDecoder()
+    {}
+
+    CGramDecoder(const CGramDecoder&) = delete;
+    CGramDecoder& operator=(const CGramDecoder&) = delete;
+
+    ET_ReturnCode eDecode(const CEStringView& svHash, uint32_t& uiCode)
+    {
+        wstring_view stl_svKey(svHash.pchrData(), svHash.uiLength());
+        {
+            shared_lock<shared_mutex> lock(m_Mutex);
+            auto itCode = m_mapCodes.find(stl_svKey);
+            if (m_mapCodes.end() != itCode)
+            {
+                uiCode = itCode->second;
+                return eReturnCode(uiCode);
+            }
+        }
+
+        uiCode = uiDecodeUncached(svHash);
+        unique_lock<shared_mutex> lock(m_Mutex);
+        Remember(stl_svKey, uiCode);
+
+        return eReturnCode(uiCode);
+    }
+
+    ET_ReturnCode eDecode(const CEStringView& svHash, CGramInfo& stGramInfo)
+    {
+        uint32_t uiCode = GramCode::cuiInvalid_;
+        ET_ReturnCode rc = eDecode(svHash, uiCode);
+        if (H_NO_ERROR != rc)
+        {
+            return rc;
+        }
+        return stGramInfo.eDecodeCode(uiCode);
+    }
+
+    //
+    // Decodes a column of hashes into vecCodes, one code per hash. Hashes 
+    // that do not decode get GramCode::cuiInvalid_ and make the return 
+    // code an error; the rest of the column is still decoded.
+    //
+    ET_ReturnCode eDecodeBatch(const vector<CEString>& vecHashes, vector<uint32_t>& vecCodes)
+    {
+        return eDecodeColumn(vecHashes.size(), [&](size_t uiAt) { return CEStringView(vecHashes[uiAt], vecHashes[uiAt].uiLength()); }, vecCodes);
+    }
+
+    ET_ReturnCode eDecodeBatch(const vector<CEStringView>& vecHashes, vector<uint32_t>& vecCodes)
+    {
+        return eDecodeColumn(vecHashes.size(), [&](size_t uiAt) { return vecHashes[uiAt]; }, vecCodes);
+    }
+
+    unsigned int uiSize() const
+    {
+        shared_lock<shared_mutex> lock(m_Mutex);
+        return (unsigned int)m_mapCodes.size();
+    }
+
+private:
+    // Bounds memory if a loader is fed garbage; later hashes are decoded but not kept
+    static constexpr size_t cuiMaxEntries_ = 1 << 16;
+
+    static ET_ReturnCode eReturnCode(uint32_t uiCode)
+    {
+        return (GramCode::cuiInvalid_ == uiCode) ? ET_ReturnCode(H_ERROR_INVALID_ARG) : H_NO_ERROR;
+    }
+
+    static uint32_t uiDecodeUncached(const CEStringView& svHash)
+    {
+        CGramHasher hasher;
+        if (H_NO_ERROR != hasher.eDecodeHash(CEString(svHash)))
+        {
+            return GramCode::cuiInvalid_;
+        }
+        return hasher.uiGramCode();
+    }
+
+    // Caller holds the exclusive lock
+    void Remember(const wstring_view& stl_svKey, uint32_t uiCode)
+    {
+        if (m_mapCodes.size() >= cuiMaxEntries_ || m_mapCodes.count(stl_svKey) > 0)
+        {
+            return;
+        }
+        m_dqKeys.emplace_back(stl_svKey);       // deque elements do not move, the view stays valid
+        m_mapCodes.emplace(wstring_view(m_dqKeys.back()), uiCode);
+    }
+
+    template <typename T_GetHash>
+    ET_ReturnCode eDecodeColumn(size_t uiHashes, const T_GetHash& fnGetHash, vector<uint32_t>& vecCodes)
+    {
+        vecCodes.assign(uiHashes, GramCode::cuiInvalid_);
+        vector<size_t> vecMisses;
+
+        {
+            shared_lock<shared_mutex> lock(m_Mutex);
+            for (size_t uiAt = 0; uiAt < uiHashes; ++uiAt)
+            {
+                CEStringView svHash = fnGetHash(uiAt);
+                auto itCode = m_mapCodes.find(wstring_view(svHash.pchrData(), svHash.uiLength()));
+                if (m_mapCodes.end() == itCode)
+                {
+                    vecMisses.push_back(uiAt);
+                }
+                else
+                {
+                    vecCodes[uiAt] = itCode->second;
+                }
+            }
+        }
+
+        if (!vecMisses.empty())
+        {
+            // A miss usually repeats further down the column; decode each distinct one once
+            unordered_map<wstring_view, uint32_t, StKeyHash> mapNew;
+            for (size_t uiAt : vecMisses)
+            {
+                CEStringView svHash = fnGetHash(uiAt);
+                wstring_view stl_svKey(svHash.pchrData(), svHash.uiLength());
+                auto itNew = mapNew.find(stl_svKey);
+                if (mapNew.end() == itNew)
+                {
+                    itNew = mapNew.emplace(stl_svKey, uiDecodeUncached(svHash)).first;
+                }
+                vecCodes[uiAt] = itNew->second;
+            }
+
+            unique_lock<shared_mutex> lock(m_Mutex);
+            for (auto& pairNew : mapNew)
+            {
+                Remember(pairNew.first, pairNew.second);
+            }
+        }
+
+        for (uint32_t uiCode : vecCodes)
+        {
+            if (GramCode::cuiInvalid_ == uiCode)
+            {
+                return ET_ReturnCode(H_ERROR_INVALID_ARG);
+            }
+        }
+
+        return H_NO_ERROR;
+
+    }   //  eDecodeColumn (...)
+
+    // Tags are short; FNV over the characters beats hashing their bytes
+    struct StKeyHash
+    {
+        size_t operator()(const wstring_view& stl_svKey) const
+        {
+            return GramTables::uiHashKey(stl_svKey.data(), (unsigned int)stl_svKey.length(), 0);
+        }
+    };
+
+    mutable shared_mutex m_Mutex;
+    unordered_map<wstring_view, uint32_t, StKeyHash> m_mapCodes;       // views into m_dqKeys
+    deque<wstring> m_dqKeys;
+
+};      //  class CGramDecoder
+
+inline CGramHasher::CGramHasher (const CEString& sHash)
+{
+    GramClear();
+    ET_ReturnCode rc = CGramDecoder::pGetInstance()->eDecode(CEStringView(sHash, sHash.uiLength()), *this);
+    if (H_NO_ERROR != rc)
+    {
+        throw CException (rc, L"CGramHasher::eDecode() failed.");
+    }
+}
+
 }   // namespace Hlib
 
 #endif // GRAMHASHER_H_INCLUDED
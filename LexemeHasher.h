@@ -3,7 +3,7 @@
 
 #include <map>
 #include "SqliteWrapper.h"
-#include "MD5.h"
+#include "md5.h"
 
 namespace Hlib
 {
@@ -21,7 +21,8 @@ struct StInflectionHasher
     StInflectionHasher() : m_iInflectionType(-1), m_iAccentType1(-1), m_iAccentType2(-1)
     {}
 
-    CEString sHash()
+    // What both hashes are computed over
+    CEString sHashSource()
     {
         CEString sText (m_sSourceForm);
 
@@ -47,11 +48,34 @@ struct StInflectionHasher
 
         sText += m_sComment;
 
+        return sText;
+
+    }   // sHashSource()
+
+    CEString sHash()
+    {
         CMD5 md5;
-        return md5.sHash (sText);
+        return md5.sHash (sHashSource());
 
     }   // sHash()
 
+    //
+    // Non-cryptographic 128-bit hash of the same text, for rebuilds where 
+    // the digests only need to tell descriptors apart. Not interchangeable 
+    // with sHash() values already stored in a database.
+    //
+    CEString sFastHash()
+    {
+        CEString sText (sHashSource());
+        CHash128 hasher;
+        hasher.UpdateUtf16 (sText, sText.uiLength());
+        wchar_t szHex[Digest::cuiHex128Length_];
+        hasher.FinalHex (szHex);
+
+        return CEString (szHex);
+
+    }   // sFastHash()
+
     bool bSaveToDb (CSqlite * pDbHandle, int64_t llDescriptorId, int64_t llInflectionId)
     {
         try
@@ -38,8 +38,12 @@ namespace Hlib
         {
         }
 
+        // Deleting the instance from here would destroy it a second time
         virtual ~CLogger() {
-            delete pLogger;
+            if (pLogger == this)
+            {
+                pLogger = nullptr;
+            }
         }
 
         static CLogger* pGetInstance()
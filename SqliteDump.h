@@ -0,0 +1,348 @@
+#ifndef C_SQLITEDUMP_H_INCLUDED
+#define C_SQLITEDUMP_H_INCLUDED
+
+//
+// Building blocks of the binary table dump written by CSqlite::bExportBinary()
+// and read by CSqlite::bImportBinary(): LEB128 varints, CRC-32 and a small
+// LZ77 block compressor in the spirit of LZ4.
+//
+// File layout, all integers varints unless noted:
+//
+//   "HLDB" version
+//   per table:
+//     'T' header-size header crc32
+//       where header = name schema-sql columns { name }, strings being
+//       a varint length and UTF-8 bytes, and crc32 (4 bytes LE) covers
+//       the header
+//     per block of up to cuiRowsPerBlock_ rows:
+//       'B' rows method raw-size stored-size
+//       crc32 (4 bytes LE) of the raw block, stored bytes
+//     'E'
+//
+// A raw block holds its rows column by column. Each value is a type byte
+// (ecNull, ecInteger, ...) followed by a zigzag varint, 8 little-endian
+// bytes of a double, or a varint length and the bytes of text or a blob.
+//
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace Hlib
+{
+
+namespace Dump
+{
+
+constexpr char cszMagic_[] = "HLDB";
+constexpr uint64_t cullVersion_ = 1;
+constexpr unsigned int cuiRowsPerBlock_ = 4096;
+
+enum ERecord : unsigned char
+{
+    ecTable = 'T',
+    ecBlock = 'B',
+    ecEndOfTable = 'E'
+};
+
+enum EValueType : unsigned char
+{
+    ecNull,
+    ecInteger,
+    ecReal,
+    ecText,
+    ecBlob
+};
+
+enum EMethod : unsigned char
+{
+    ecStored,
+    ecLz
+};
+
+//
+// Varints and fixed-size integers
+//
+inline void PutVarint (uint64_t ullValue, std::string& stl_sOut)
+{
+    while (ullValue >= 0x80)
+    {
+        stl_sOut.push_back ((char)(0x80 | (ullValue & 0x7F)));
+        ullValue >>= 7;
+    }
+    stl_sOut.push_back ((char)ullValue);
+}
+
+// Advances pchrAt; false on truncated or overlong input
+inline bool bGetVarint (const unsigned char *& pchrAt, const unsigned char * pchrEnd, uint64_t& ullValue)
+{
+    ullValue = 0;
+    for (unsigned int uiShift = 0; uiShift < 64; uiShift += 7)
+    {
+        if (pchrAt >= pchrEnd)
+        {
+            return false;
+        }
+        unsigned char chr = *pchrAt++;
+        ullValue |= (uint64_t)(chr & 0x7F) << uiShift;
+        if (0 == (chr & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+inline uint64_t ullZigZag (int64_t llValue)
+{
+    return ((uint64_t)llValue << 1) ^ (uint64_t)(llValue >> 63);
+}
+
+inline int64_t llUnZigZag (uint64_t ullValue)
+{
+    return (int64_t)(ullValue >> 1) ^ -(int64_t)(ullValue & 1);
+}
+
+inline void PutFixed32 (uint32_t uiValue, std::string& stl_sOut)
+{
+    for (int iByte = 0; iByte < 4; ++iByte)
+    {
+        stl_sOut.push_back ((char)(uiValue >> (8 * iByte)));
+    }
+}
+
+inline uint32_t uiGetFixed32 (const unsigned char * pchrAt)
+{
+    return (uint32_t)pchrAt[0] | ((uint32_t)pchrAt[1] << 8) | ((uint32_t)pchrAt[2] << 16) | ((uint32_t)pchrAt[3] << 24);
+}
+
+inline void PutDouble (double dValue, std::string& stl_sOut)
+{
+    uint64_t ullBits = 0;
+    memcpy (&ullBits, &dValue, sizeof (ullBits));
+    for (int iByte = 0; iByte < 8; ++iByte)
+    {
+        stl_sOut.push_back ((char)(ullBits >> (8 * iByte)));
+    }
+}
+
+inline double dGetDouble (const unsigned char * pchrAt)
+{
+    uint64_t ullBits = 0;
+    for (int iByte = 0; iByte < 8; ++iByte)
+    {
+        ullBits |= (uint64_t)pchrAt[iByte] << (8 * iByte);
+    }
+    double dValue = 0.0;
+    memcpy (&dValue, &ullBits, sizeof (dValue));
+    return dValue;
+}
+
+//
+// CRC-32 (IEEE 802.3, as in zlib), table driven
+//
+namespace Detail
+{
+
+struct StCrcTable
+{
+    uint32_t arrEntries[256];
+
+    StCrcTable()
+    {
+        for (uint32_t uiByte = 0; uiByte < 256; ++uiByte)
+        {
+            uint32_t uiCrc = uiByte;
+            for (int iBit = 0; iBit < 8; ++iBit)
+            {
+                uiCrc = (uiCrc & 1) ? (0xEDB88320 ^ (uiCrc >> 1)) : (uiCrc >> 1);
+            }
+            arrEntries[uiByte] = uiCrc;
+        }
+    }
+};
+
+inline uint32_t uiRead32 (const unsigned char * pchrAt)
+{
+    uint32_t uiValue = 0;
+    memcpy (&uiValue, pchrAt, sizeof (uiValue));
+    return uiValue;
+}
+
+}   //  namespace Detail
+
+inline uint32_t uiCrc32 (const void * pData, size_t uiBytes, uint32_t uiCrc = 0)
+{
+    static const Detail::StCrcTable s_Table;
+    const unsigned char * pchrAt = static_cast<const unsigned char *> (pData);
+    uiCrc = ~uiCrc;
+    for (size_t uiAt = 0; uiAt < uiBytes; ++uiAt)
+    {
+        uiCrc = s_Table.arrEntries[(uiCrc ^ pchrAt[uiAt]) & 0xFF] ^ (uiCrc >> 8);
+    }
+    return ~uiCrc;
+}
+
+//
+// LZ77 block compression. A block is a series of sequences, each a token
+// byte -- literal count in the high nibble, match length - 4 in the low one,
+// 15 meaning "plus a varint" -- then the literals, then a 2-byte offset back
+// into the output. The last sequence has literals only. Matches are found
+// through a hash of the next 4 bytes.
+//
+constexpr unsigned int cuiMinMatch_ = 4;
+constexpr unsigned int cuiMaxOffset_ = 0xFFFF;
+constexpr unsigned int cuiHashBits_ = 14;
+
+namespace Detail
+{
+
+inline uint32_t uiHash4 (const unsigned char * pchrAt)
+{
+    return (uiRead32 (pchrAt) * 2654435761u) >> (32 - cuiHashBits_);
+}
+
+inline void PutSequence (const unsigned char * pchrLiterals, size_t uiLiterals, size_t uiMatch, size_t uiOffset, std::string& stl_sOut)
+{
+    size_t uiMatchCode = (uiMatch > 0) ? uiMatch - cuiMinMatch_ : 0;
+    unsigned char chrToken = (unsigned char)((std::min<size_t> (uiLiterals, 15) << 4) | std::min<size_t> (uiMatchCode, 15));
+    stl_sOut.push_back ((char)chrToken);
+    if (uiLiterals >= 15)
+    {
+        PutVarint (uiLiterals - 15, stl_sOut);
+    }
+    stl_sOut.append ((const char *)pchrLiterals, uiLiterals);
+    if (0 == uiMatch)
+    {
+        return;
+    }
+    stl_sOut.push_back ((char)(uiOffset & 0xFF));
+    stl_sOut.push_back ((char)(uiOffset >> 8));
+    if (uiMatchCode >= 15)
+    {
+        PutVarint (uiMatchCode - 15, stl_sOut);
+    }
+}
+
+}   //  namespace Detail
+
+// Appends the compressed form of the input to stl_sOut
+inline void LzCompress (const void * pData, size_t uiBytes, std::string& stl_sOut)
+{
+    const unsigned char * pchrStart = static_cast<const unsigned char *> (pData);
+    const unsigned char * pchrEnd = pchrStart + uiBytes;
+    const unsigned char * pchrAnchor = pchrStart;       // first byte not yet emitted
+
+    std::vector<uint32_t> vecTable ((size_t)1 << cuiHashBits_, 0);     // offsets + 1, 0 = empty
+    uint32_t * pTable = vecTable.data();
+
+    const unsigned char * pchrAt = pchrStart;
+    unsigned int uiMisses = 0;
+    while (pchrEnd - pchrAt >= (ptrdiff_t)cuiMinMatch_)
+    {
+        uint32_t uiHash = Detail::uiHash4 (pchrAt);
+        uint32_t uiCandidate = pTable[uiHash];
+        pTable[uiHash] = (uint32_t)(pchrAt - pchrStart) + 1;
+
+        const unsigned char * pchrMatch = (0 == uiCandidate) ? pchrAt : pchrStart + uiCandidate - 1;
+        if (pchrMatch == pchrAt || (size_t)(pchrAt - pchrMatch) > cuiMaxOffset_ || Detail::uiRead32 (pchrMatch) != Detail::uiRead32 (pchrAt))
+        {
+            // Skip faster through data that does not compress
+            pchrAt += std::min<size_t> (1 + (uiMisses++ >> 5), pchrEnd - pchrAt);
+            continue;
+        }
+        uiMisses = 0;
+
+        size_t uiMatch = cuiMinMatch_;
+        while (pchrAt + uiMatch < pchrEnd && pchrMatch[uiMatch] == pchrAt[uiMatch])
+        {
+            ++uiMatch;
+        }
+
+        Detail::PutSequence (pchrAnchor, pchrAt - pchrAnchor, uiMatch, pchrAt - pchrMatch, stl_sOut);
+        pchrAt += uiMatch;
+        pchrAnchor = pchrAt;
+    }
+
+    Detail::PutSequence (pchrAnchor, pchrEnd - pchrAnchor, 0, 0, stl_sOut);
+
+}   //  LzCompress (...)
+
+// Inverse of LzCompress(); false unless the input decodes to exactly uiRawBytes
+inline bool bLzDecompress (const void * pData, size_t uiBytes, unsigned char * pchrOut, size_t uiRawBytes)
+{
+    const unsigned char * pchrAt = static_cast<const unsigned char *> (pData);
+    const unsigned char * pchrEnd = pchrAt + uiBytes;
+    size_t uiOut = 0;
+    while (pchrAt < pchrEnd)
+    {
+        unsigned char chrToken = *pchrAt++;
+
+        uint64_t ullLiterals = chrToken >> 4;
+        if (15 == ullLiterals)
+        {
+            uint64_t ullMore = 0;
+            if (!bGetVarint (pchrAt, pchrEnd, ullMore))
+            {
+                return false;
+            }
+            ullLiterals += ullMore;
+        }
+        if (ullLiterals > (uint64_t)(pchrEnd - pchrAt) || ullLiterals > uiRawBytes - uiOut)
+        {
+            return false;
+        }
+        memcpy (pchrOut + uiOut, pchrAt, (size_t)ullLiterals);
+        pchrAt += ullLiterals;
+        uiOut += (size_t)ullLiterals;
+
+        if (pchrAt == pchrEnd)
+        {
+            break;      // last sequence
+        }
+
+        if (pchrEnd - pchrAt < 2)
+        {
+            return false;
+        }
+        size_t uiOffset = (size_t)pchrAt[0] | ((size_t)pchrAt[1] << 8);
+        pchrAt += 2;
+
+        uint64_t ullMatch = chrToken & 0x0F;
+        if (15 == ullMatch)
+        {
+            uint64_t ullMore = 0;
+            if (!bGetVarint (pchrAt, pchrEnd, ullMore))
+            {
+                return false;
+            }
+            ullMatch += ullMore;
+        }
+        ullMatch += cuiMinMatch_;
+
+        if (0 == uiOffset || uiOffset > uiOut || ullMatch > uiRawBytes - uiOut)
+        {
+            return false;
+        }
+
+        // Byte by byte: the source may overlap what is being written
+        const unsigned char * pchrFrom = pchrOut + uiOut - uiOffset;
+        for (size_t uiAt = 0; uiAt < ullMatch; ++uiAt)
+        {
+            pchrOut[uiOut + uiAt] = pchrFrom[uiAt];
+        }
+        uiOut += (size_t)ullMatch;
+    }
+
+    return uiOut == uiRawBytes;
+
+}   //  bLzDecompress (...)
+
+}   //  namespace Dump
+
+}   //  namespace Hlib
+
+#endif  //  C_SQLITEDUMP_H_INCLUDED
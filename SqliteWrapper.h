@@ -2,14 +2,29 @@
 #define H_SQLITE_WRAPPER
 
 #include <memory>
+#include <cctype>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <list>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <sys/stat.h>
 
 #include "Logging.h"
 #include "EString.h"
 #include "Exception.h"
 #include "Callbacks.h"
+#include "SqliteDump.h"
 #include "sqlite3.h"
 
 static const wchar_t* SZ_SEPARATOR = L"|";
@@ -22,1043 +37,3093 @@ namespace Hlib
         {
             if (pSqlite)
             {
-                sqlite3_close(pSqlite);
+                // Defers the close until statements still held by callers are finalized
+                sqlite3_close_v2(pSqlite);
             }
         }
     };
 
-    class CSqlite
+    //
+    // Tuning for CSqlite::bImportTables(). The defaults keep the old behavior:
+    // one transaction per table and the connection's own PRAGMA settings.
+    // PRAGMAs that are set are restored when the import returns or throws.
+    //
+    struct StImportOptions
     {
-    private:
-        unique_ptr<sqlite3, SqliteDeleter> m_spDb_;
+        unsigned int uiRowsPerTransaction { 0 };    // commit every N rows, 0 = once per table
+        CEString sSynchronous;                      // PRAGMA synchronous, e.g. L"OFF"; empty = leave as is
+        CEString sJournalMode;                      // PRAGMA journal_mode, e.g. L"MEMORY"
+        int iCacheSize { 0 };                       // PRAGMA cache_size, pages or -KiB; 0 = leave as is
+        unsigned int uiParseThreads { 0 };          // parse workers besides the reader and the writer, 0 = no pipeline
+    };
 
-#ifndef WIN32
-    private:
-        unique_ptr<char16_t[]> pToWchar16(const CEString& s)
+    //
+    // Reads an import file in large blocks and hands out its lines as UTF-8 
+    // views into the block buffer. A view stays valid until the next call to 
+    // bGetLine(). The buffer grows to fit the longest line, so lines are never 
+    // split.
+    //
+    class CImportReader
+    {
+    public:
+        static constexpr size_t cuiBlockSize_ = 1 << 20;
+
+        CImportReader(const CEString& sPath) : m_ioStream(nullptr), m_uiBegin(0), m_uiEnd(0), m_ullConsumed(0), m_ullFileSize(0), m_bEof(false)
         {
-            auto pStr16 = make_unique<char16_t[]>(s.uiLength()+1);
-            for (int i = 0; i < (int)s.uiLength(); ++i) {
-                pStr16[i] = (char16_t)s[i];
+            m_ioStream = fopen(sPath.stl_sToUtf8().c_str(), "rb");
+            if (!m_ioStream)
+            {
+                throw CException(-1, L"Unable to open import file.");
+            }
+
+            struct stat stStatBuf;
+            if (0 == fstat(fileno(m_ioStream), &stStatBuf))
+            {
+                m_ullFileSize = stStatBuf.st_size;
             }
-            pStr16[s.uiLength()] = u'\0';
-            return pStr16;
+
+            m_vecBuffer.resize(cuiBlockSize_);
         }
 
-        unique_ptr<wchar_t[]> pToWchar32(const void * pUtf16AsVoid, int iBytes)
+        CImportReader(const CImportReader&) = delete;
+        CImportReader& operator=(const CImportReader&) = delete;
+
+        ~CImportReader()
         {
-            auto pUtf32 = make_unique<wchar_t[]>((iBytes/2)+1);
-            for (int i = 0; i < iBytes/2; ++i) {
-                memcpy(&pUtf32[i], (char*)pUtf16AsVoid+(2*i), 2);
-            }
-            return pUtf32;
+            fclose(m_ioStream);
         }
-#endif
 
-    public:
-        CSqlite(const CEString& sDbPath) : m_spDb_(nullptr, SqliteDeleter())
+        // Next line without its '\n', or "\r\n" as written on Windows; false at 
+        // end of file
+        bool bGetLine(string_view& svLine)
         {
-            sqlite3* pSqlite3 = nullptr;
-#ifdef WIN32
-            int iRet = sqlite3_open16(sDbPath, &pSqlite3);
-#else
-            int iRet = sqlite3_open16(pToWchar16(sDbPath).get(), &pSqlite3);
-#endif
-            if (SQLITE_OK != iRet)
+            size_t uiScanFrom = m_uiBegin;
+            while (true)
             {
-                pSqlite3 = nullptr;
-                throw CException(iRet, L"sqlite3_open16 failed.");
+                auto pchrNewline = (const char*)memchr(m_vecBuffer.data() + uiScanFrom, '\n', m_uiEnd - uiScanFrom);
+                if (pchrNewline)
+                {
+                    size_t uiLength = pchrNewline - &m_vecBuffer[m_uiBegin];
+                    svLine = string_view(&m_vecBuffer[m_uiBegin], uiLength);
+                    m_uiBegin += uiLength + 1;
+                    m_ullConsumed += uiLength + 1;
+                    StripCarriageReturn(svLine);
+                    return true;
+                }
+
+                if (m_bEof)
+                {
+                    if (m_uiBegin == m_uiEnd)
+                    {
+                        return false;
+                    }
+                    svLine = string_view(&m_vecBuffer[m_uiBegin], m_uiEnd - m_uiBegin);     // no newline at the end of file
+                    m_ullConsumed += m_uiEnd - m_uiBegin;
+                    m_uiBegin = m_uiEnd;
+                    StripCarriageReturn(svLine);
+                    return true;
+                }
+
+                uiScanFrom = m_uiEnd - m_uiBegin;
+                Refill();
             }
-            m_spDb_.reset(pSqlite3);
         }
 
-    private:
-        sqlite3_stmt* m_pStmt;
-        CEString m_sDbPath;
+        // Bytes handed out so far, for progress reporting
+        uint64_t ullConsumed() const
+        {
+            return m_ullConsumed;
+        }
 
-        int m_iExtendedErrCode;
+        uint64_t ullFileSize() const
+        {
+            return m_ullFileSize;
+        }
 
-    public:
-        void BeginTransaction()
+        //
+        // Splits a line into fields the way the import has always done: 
+        // SZ_SEPARATOR, comma, blank and newline all separate fields, and runs 
+        // of them count as one. All of these are ASCII, so scanning UTF-8 
+        // bytes cannot hit the middle of a character.
+        //
+        static void SplitFields(string_view svLine, vector<string_view>& vecFields)
         {
-            if (NULL == m_spDb_)
+            vecFields.clear();
+            size_t uiAt = 0;
+            while (uiAt < svLine.length())
             {
-                throw CException(-1, L"No DB handle");
+                while (uiAt < svLine.length() && bIsBreak(svLine[uiAt]))
+                {
+                    ++uiAt;
+                }
+                size_t uiStart = uiAt;
+                while (uiAt < svLine.length() && !bIsBreak(svLine[uiAt]))
+                {
+                    ++uiAt;
+                }
+                if (uiAt > uiStart)
+                {
+                    vecFields.emplace_back(svLine.data() + uiStart, uiAt - uiStart);
+                }
             }
+        }
 
-            int iRet = SQLITE_OK;
-            iRet = sqlite3_exec(m_spDb_.get(), "BEGIN TRANSACTION", NULL, NULL, NULL);
-            if (SQLITE_OK != iRet)
+        static bool bIsBreak(char chr)
+        {
+            return '|' == chr || ',' == chr || ' ' == chr || '\n' == chr;     // '|' is SZ_SEPARATOR
+        }
+
+        // True for a line with no fields, i.e. the one that ends a table
+        static bool bIsBlank(string_view svLine)
+        {
+            for (char chr : svLine)
             {
-                CEString sErrTxt;
-                GetLastError(sErrTxt);
-                CEString sMsg(L"sqlite3_exec failed: ");
-                sMsg += sErrTxt;
-                throw CException(iRet, sMsg);
-//
-//                throw CException(iRet, L"sqlite3_exec failed for transaction start");
+                if (!bIsBreak(chr))
+                {
+                    return false;
+                }
             }
+            return true;
         }
 
-        void CommitTransaction()
+        //
+        // Splits a row and checks it against the table: iColumns fields and, 
+        // unless the table autoincrements, a numeric ID in the first one
+        //
+        static bool bParseRow(string_view svLine, int iColumns, bool bAutoincrement, vector<string_view>& vecFields, int64_t& llId)
         {
-            if (NULL == m_spDb_)
+            SplitFields(svLine, vecFields);
+            if ((int)vecFields.size() != iColumns)
             {
-                throw CException(-1, L"No DB handle");
+                return false;
             }
 
-            int iRet = SQLITE_OK;
-            iRet = sqlite3_exec(m_spDb_.get(), "END TRANSACTION", NULL, NULL, NULL);
-            if (SQLITE_OK != iRet)
+            llId = 0;
+            if (!bAutoincrement)
             {
-                CEString sErrTxt;
-                GetLastError(sErrTxt);
-                CEString sMsg(L"sqlite3_exec failed: ");
-                sMsg += sErrTxt;
-                throw CException(iRet, sMsg);
-                //
-                //                throw CException(iRet, L"sqlite3_exec failed for transaction end");
+                const char* pchrEnd = vecFields[0].data() + vecFields[0].length();
+                auto stResult = from_chars(vecFields[0].data(), pchrEnd, llId);
+                return errc() == stResult.ec && pchrEnd == stResult.ptr;
             }
+
+            return true;
         }
 
-        void RollbackTransaction()
+    private:
+        static void StripCarriageReturn(string_view& svLine)
         {
-            if (NULL == m_spDb_)
+            if (!svLine.empty() && '\r' == svLine.back())
             {
-                throw CException(-1, L"No DB handle");
+                svLine.remove_suffix(1);
             }
+        }
 
-            int iRet = SQLITE_OK;
-            iRet = sqlite3_exec(m_spDb_.get(), "END TRANSACTION;", NULL, NULL, NULL);
-            if (SQLITE_OK != iRet)
+        // Moves the unread tail to the front and reads the next block behind it;
+        // a tail that fills the whole buffer doubles it
+        void Refill()
+        {
+            size_t uiTail = m_uiEnd - m_uiBegin;
+            if (m_uiBegin > 0)
             {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                memmove(&m_vecBuffer[0], &m_vecBuffer[m_uiBegin], uiTail);
+                m_uiBegin = 0;
+                m_uiEnd = uiTail;
             }
-        }
 
-        void PrepareForSelect(const CEString& sStmt)
-        {
-            PrepareForSelect(sStmt, m_pStmt);
-        }
+            if (m_vecBuffer.size() - m_uiEnd < cuiBlockSize_ / 2)
+            {
+                m_vecBuffer.resize(max(m_vecBuffer.size() * 2, m_uiEnd + cuiBlockSize_));
+            }
 
-        uint64_t uiPrepareForSelect(const CEString& sStmt)
-        {
-            sqlite3_stmt* pStmt = NULL;
-            PrepareForSelect(sStmt, pStmt);
-            return (uint64_t)pStmt;
+            size_t uiRead = fread(&m_vecBuffer[m_uiEnd], 1, m_vecBuffer.size() - m_uiEnd, m_ioStream);
+            m_uiEnd += uiRead;
+            if (0 == uiRead)
+            {
+                if (ferror(m_ioStream))
+                {
+                    throw CException(-1, L"Error reading import file.");
+                }
+                m_bEof = true;
+            }
         }
 
-        void PrepareForSelect(const CEString& sStmt, sqlite3_stmt*& pStmt)
+        FILE* m_ioStream;
+        vector<char> m_vecBuffer;
+        size_t m_uiBegin;           // first unread byte
+        size_t m_uiEnd;             // end of data in the buffer
+        uint64_t m_ullConsumed;
+        uint64_t m_ullFileSize;
+        bool m_bEof;
+
+    };      //  class CImportReader
+
+    //
+    // Collects export output in a large buffer and writes it out with one 
+    // fwrite per flush. Without a path it only collects, for the workers of 
+    // a parallel export.
+    //
+    class CExportWriter
+    {
+    public:
+        static constexpr size_t cuiBufferSize_ = 1 << 20;
+
+        CExportWriter() : m_ioStream(nullptr)
+        {}
+
+        CExportWriter(const CEString& sPath, bool bBinary = false) : m_ioStream(nullptr)
         {
-#ifdef WIN32
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sStmt, -1, &pStmt, NULL);
-#else
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), pToWchar16(sStmt).get(), -1, &pStmt, NULL);
-#endif
-            if (SQLITE_OK != iRet)
+            m_ioStream = fopen(sPath.stl_sToUtf8().c_str(), bBinary ? "wb" : "w");
+            if (!m_ioStream)
             {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                throw CException(-1, L"Unable to open export file.");
             }
+            m_stl_sBuffer.reserve(cuiBufferSize_ + cuiBufferSize_ / 4);
         }
 
-        void PrepareForInsert(const CEString& sTable, int iColumns, bool bIgnoreOnConflict = false)
-        {
-            uiPrepareForInsert(sTable, iColumns, m_pStmt, bIgnoreOnConflict);
-        }
+        CExportWriter(const CExportWriter&) = delete;
+        CExportWriter& operator=(const CExportWriter&) = delete;
 
-        uint64_t uiPrepareForInsert(const CEString& sTable, int iColumns, sqlite3_stmt*& pStmt, bool bIgnoreOnConflict = false)
+        // Close() reports errors; this is for the exception path
+        ~CExportWriter()
         {
-            CEString sStmt(L"INSERT ");
-            if (bIgnoreOnConflict)
+            if (m_ioStream)
             {
-                sStmt += L"OR IGNORE ";
+                fwrite(m_stl_sBuffer.data(), 1, m_stl_sBuffer.length(), m_ioStream);
+                fclose(m_ioStream);
             }
+        }
 
-            sStmt += L"INTO ";
-            sStmt += sTable;
-            sStmt += L" VALUES (NULL, ";
-            for (int iCol = 0; iCol < iColumns; ++iCol)
+        void Append(const char* pchrData, size_t uiBytes)
+        {
+            m_stl_sBuffer.append(pchrData, uiBytes);
+            if (m_ioStream && m_stl_sBuffer.length() >= cuiBufferSize_)
             {
-                if (iCol > 0)
-                {
-                    sStmt += L",";
-                }
-                sStmt += L"?";
+                Flush();
             }
-            sStmt += L")";
+        }
 
-#ifdef WIN32
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sStmt, -1, &pStmt, NULL);
-#else
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), pToWchar16(sStmt).get(), -1, &pStmt, NULL);
-#endif
-            if (SQLITE_OK != iRet)
+        void Append(char chr)
+        {
+            m_stl_sBuffer.push_back(chr);
+            if (m_ioStream && m_stl_sBuffer.length() >= cuiBufferSize_)
             {
-                CEString sErrTxt;
-                GetLastError(sErrTxt);
-                CEString sMsg(L"sqlite3_prepare16_v2 failed: ");
-                sMsg += sErrTxt;
-                throw CException(iRet, sMsg);
+                Flush();
             }
-
-            return (uint64_t)pStmt;
         }
 
-        void PrepareForUpdate(const CEString& sTable, const vector<CEString>& vecColumns, int64_t llPrimaryKey)
+        // Output collected so far; leaves the writer empty
+        string stl_sTake()
         {
-            uiPrepareForUpdate(sTable, vecColumns, llPrimaryKey, m_pStmt);
+            return std::move(m_stl_sBuffer);
         }
 
-        void PrepareForUpdate(const CEString& sTable, const vector<CEString>& vecColumns)
+        // Bytes appended since the last flush
+        size_t uiBuffered() const
         {
-            uiPrepareForUpdate(sTable, vecColumns, -1, m_pStmt);
+            return m_stl_sBuffer.length();
         }
 
-        uint64_t uiPrepareForUpdate(const CEString& sTable, const vector<CEString>& vecColumns, int64_t llPrimaryKey, sqlite3_stmt*& pStmt)
+        void Flush()
         {
-            CEString sStmt = L"UPDATE ";
-            sStmt += sTable;
-            sStmt += L" SET ";
-            for (int iCol = 0; iCol < (int)vecColumns.size(); ++iCol)
+            if (m_stl_sBuffer.empty())
             {
-                if (iCol > 0)
-                {
-                    sStmt += L", ";
-                }
-                sStmt += vecColumns[iCol];
-                sStmt += L"=";
-                sStmt += L"?";
+                return;
             }
 
-            if (llPrimaryKey > -1)
+            size_t uiWritten = fwrite(m_stl_sBuffer.data(), 1, m_stl_sBuffer.length(), m_ioStream);
+            if (uiWritten != m_stl_sBuffer.length())
             {
-                sStmt += L" WHERE ID = ";
-                sStmt += CEString::sToString(llPrimaryKey);
+                throw CException(-1, L"Error writing export table.");
             }
+            m_stl_sBuffer.clear();
+        }
 
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sStmt, -1, &pStmt, NULL);
-            if (SQLITE_OK != iRet)
+        void Close()
+        {
+            Flush();
+            int iRet = fclose(m_ioStream);
+            m_ioStream = nullptr;
+            if (0 != iRet)
             {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                throw CException(-1, L"Error closing export file.");
             }
+        }
 
-            return (uint64_t)pStmt;
-
-        }       //  uiPrepareForUpdate()
+    private:
+        FILE* m_ioStream;
+        string m_stl_sBuffer;
 
-        void PrepareForInsertOrReplace(const CEString& sTable, int iColumns)
-        {
-            uiPrepareForInsertOrReplace(sTable, iColumns, m_pStmt);
-        }
+    };      //  class CExportWriter
 
-        uint64_t uiPrepareForInsertOrReplace(const CEString& sTable, int iColumns, sqlite3_stmt*& pStmt)
+    //
+    // Sequential reader for binary dumps; throws on short or failed reads
+    //
+    class CDumpReader
+    {
+    public:
+        CDumpReader(const CEString& sPath) : m_ioStream(nullptr), m_ullConsumed(0), m_ullFileSize(0)
         {
-            CEString sStmt(L"INSERT ");
-            sStmt += L"OR REPLACE INTO ";
-            sStmt += sTable;
-            sStmt += L" VALUES (NULL, ";
-            for (int iCol = 0; iCol < iColumns; ++iCol)
+            m_ioStream = fopen(sPath.stl_sToUtf8().c_str(), "rb");
+            if (!m_ioStream)
             {
-                if (iCol > 0)
-                {
-                    sStmt += L",";
-                }
-                sStmt += L"?";
+                throw CException(-1, L"Unable to open import file.");
             }
-            sStmt += L")";
 
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sStmt, -1, &pStmt, NULL);
-            if (SQLITE_OK != iRet)
+            struct stat stStatBuf;
+            if (0 == fstat(fileno(m_ioStream), &stStatBuf))
             {
-                CEString sErrTxt;
-                GetLastError(sErrTxt);
-                CEString sMsg(L"sqlite3_prepare16_v2 failed: ");
-                sMsg += sErrTxt;
-                throw CException(iRet, sMsg);
+                m_ullFileSize = stStatBuf.st_size;
             }
+        }
 
-            return (uint64_t)pStmt;
+        CDumpReader(const CDumpReader&) = delete;
+        CDumpReader& operator=(const CDumpReader&) = delete;
 
-        }       //  uiPrepareForInsertOrReplace()
+        ~CDumpReader()
+        {
+            fclose(m_ioStream);
+        }
 
-        void Delete(const CEString& sStmt)
+        // False at end of file
+        bool bReadByte(unsigned char& chr)
         {
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sStmt, -1, &m_pStmt, NULL);
-            if (SQLITE_OK != iRet)
+            int iChr = getc(m_ioStream);
+            if (EOF == iChr)
             {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                if (ferror(m_ioStream))
+                {
+                    throw CException(-1, L"Error reading import file.");
+                }
+                return false;
             }
+            chr = (unsigned char)iChr;
+            ++m_ullConsumed;
+            return true;
+        }
 
-            iRet = sqlite3_step(m_pStmt);
-            if (SQLITE_OK != iRet && SQLITE_DONE != iRet)
+        uint64_t ullReadVarint()
+        {
+            uint64_t ullValue = 0;
+            for (unsigned int uiShift = 0; uiShift < 64; uiShift += 7)
             {
-                throw CException(iRet, L"sqlite3_step failed");
+                unsigned char chr = 0;
+                if (!bReadByte(chr))
+                {
+                    throw CException(-1, L"Truncated binary dump.");
+                }
+                ullValue |= (uint64_t)(chr & 0x7F) << uiShift;
+                if (0 == (chr & 0x80))
+                {
+                    return ullValue;
+                }
             }
+            throw CException(-1, L"Malformed varint in binary dump.");
+        }
 
-            iRet = sqlite3_finalize(m_pStmt);
-            if (SQLITE_OK != iRet)
+        void Read(string& stl_sOut, uint64_t ullBytes)
+        {
+            if (ullBytes > m_ullFileSize)
             {
-                throw CException(iRet, L"sqlite3_finalize failed");
+                throw CException(-1, L"Truncated binary dump.");
+            }
+            stl_sOut.resize((size_t)ullBytes);
+            if (ullBytes > 0 && fread(&stl_sOut[0], 1, (size_t)ullBytes, m_ioStream) != ullBytes)
+            {
+                throw CException(-1, L"Truncated binary dump.");
             }
+            m_ullConsumed += ullBytes;
         }
 
-        void Bind(int iColumn, bool bValue)
+        uint64_t ullConsumed() const
         {
-            Bind(iColumn, bValue, m_pStmt);
+            return m_ullConsumed;
         }
 
-        void Bind(int iColumn, bool bValue, uint64_t uiHandle)
+        uint64_t ullFileSize() const
         {
-            Bind(iColumn, bValue, (sqlite3_stmt*)uiHandle);
+            return m_ullFileSize;
         }
 
-        void Bind(int iColumn, bool bValue, sqlite3_stmt* pStmt)
+    private:
+        FILE* m_ioStream;
+        uint64_t m_ullConsumed;
+        uint64_t m_ullFileSize;
+
+    };      //  class CDumpReader
+
+    //
+    // Blocking FIFO with a fixed capacity, used to pass work between the 
+    // threads of a pipelined import. Close() wakes everyone up: pushes fail 
+    // from then on and pops drain what is left.
+    //
+    template <typename T>
+    class CBoundedQueue
+    {
+    public:
+        explicit CBoundedQueue(size_t uiCapacity) : m_uiCapacity(uiCapacity), m_bClosed(false)
+        {}
+
+        // Blocks while the queue is full; false if it has been closed
+        bool bPush(T&& Item)
         {
-            int iRet = sqlite3_bind_int(pStmt, iColumn, bValue);
-            if (SQLITE_OK != iRet)
+            unique_lock<mutex> lock(m_Mutex);
+            m_cvNotFull.wait(lock, [&]() { return m_bClosed || m_deqItems.size() < m_uiCapacity; });
+            if (m_bClosed)
             {
-                throw CException(iRet, L"sqlite3_bind_int failed");
+                return false;
             }
+            m_deqItems.push_back(std::move(Item));
+            m_cvNotEmpty.notify_one();
+            return true;
         }
 
-        void Bind(int iColumn, int iValue)
+        // Blocks while the queue is empty; false once it is closed and drained
+        bool bPop(T& Item)
         {
-            Bind(iColumn, iValue, m_pStmt);
+            unique_lock<mutex> lock(m_Mutex);
+            m_cvNotEmpty.wait(lock, [&]() { return m_bClosed || !m_deqItems.empty(); });
+            if (m_deqItems.empty())
+            {
+                return false;
+            }
+            Item = std::move(m_deqItems.front());
+            m_deqItems.pop_front();
+            m_cvNotFull.notify_one();
+            return true;
         }
 
-        void Bind(int iColumn, int iValue, uint64_t uiHandle)
+        void Close()
         {
-            Bind(iColumn, iValue, (sqlite3_stmt*)uiHandle);
+            lock_guard<mutex> lock(m_Mutex);
+            m_bClosed = true;
+            m_cvNotEmpty.notify_all();
+            m_cvNotFull.notify_all();
         }
 
-        void Bind(int iColumn, int iValue, sqlite3_stmt* pStmt)
+    private:
+        size_t m_uiCapacity;
+        bool m_bClosed;
+        deque<T> m_deqItems;
+        mutex m_Mutex;
+        condition_variable m_cvNotEmpty;
+        condition_variable m_cvNotFull;
+
+    };      //  class CBoundedQueue
+
+    //
+    // A run of whole lines from one import table. The reader thread copies 
+    // the lines in, a parse worker fills in the rows, the writer inserts them.
+    //
+    struct StImportBatch
+    {
+        static constexpr size_t cuiTargetBytes_ = 1 << 18;
+
+        string stl_sLines;                  // each line ends with '\n'
+        uint64_t ullConsumed { 0 };         // reader position after the last line, for progress
+        vector<string_view> vecFields;      // iColumns views into stl_sLines per row
+        vector<int64_t> vecIds;             // one per row
+        vector<string_view> vecRejected;    // lines with a bad field count or ID
+        promise<void> Parsed;               // set by the worker, carries its exception if any
+    };
+
+    class CSqlite
+    {
+    public:
+        static constexpr unsigned int cuiDefaultStatementCacheCapacity_ = 64;
+        static constexpr int ciExportBusyTimeoutMs_ = 5000;
+
+    private:
+        unique_ptr<sqlite3, SqliteDeleter> m_spDb_;
+
+        //
+        // Prepared statements keyed by their UTF-8 text. Statements handed out 
+        // by pPrepare() are checked out until Finalize() gives them back; idle 
+        // ones wait in the LRU list, most recently used first.
+        //
+        struct StStatementCache
         {
-            int iRet = sqlite3_bind_int(pStmt, iColumn, iValue);
-            if (SQLITE_OK != iRet)
+            list<pair<string, sqlite3_stmt*>> lstIdle;
+            unordered_map<string_view, list<pair<string, sqlite3_stmt*>>::iterator> mapIdle;    // keys point into lstIdle
+            unordered_map<sqlite3_stmt*, string> mapCheckedOut;
+            unsigned int uiCapacity { cuiDefaultStatementCacheCapacity_ };
+
+            StStatementCache()
+            {}
+
+            StStatementCache(StStatementCache&&) = default;
+
+            StStatementCache& operator=(StStatementCache&& Source)
             {
-                throw CException(iRet, L"sqlite3_bind_int failed");
+                if (this != &Source)
+                {
+                    FinalizeIdle();
+                    lstIdle = std::move(Source.lstIdle);
+                    mapIdle = std::move(Source.mapIdle);
+                    mapCheckedOut = std::move(Source.mapCheckedOut);
+                    uiCapacity = Source.uiCapacity;
+                }
+                return *this;
             }
-        }
 
-        void Bind(int iColumn, uint64_t uiValue)
-        {
-            Bind(iColumn, uiValue, m_pStmt);
-        }
-
-        void Bind(int iColumn, uint64_t uiValue, uint64_t uiHandle)
-        {
-            Bind(iColumn, uiValue, (sqlite3_stmt*)uiHandle);
-        }
+            ~StStatementCache()
+            {
+                FinalizeIdle();
+            }
 
-        void Bind(int iColumn, uint64_t uiValue, sqlite3_stmt* pStmt)
-        {
-            int iRet = sqlite3_bind_int64(pStmt, iColumn, (int64_t)uiValue);
-            if (SQLITE_OK != iRet)
+            // Only when the connection goes away or is moved over, taking its 
+            // bind buffers along; otherwise statements go through FinalizeStatement()
+            void FinalizeIdle()
             {
-                throw CException(iRet, L"sqlite3_bind_int64 failed");
+                mapIdle.clear();
+                for (auto& pairEntry : lstIdle)
+                {
+                    sqlite3_finalize(pairEntry.second);
+                }
+                lstIdle.clear();
             }
-        }
+        };
 
-        void Bind(int iColumn, int64_t llValue)
-        {
-            Bind(iColumn, llValue, m_pStmt);
-        }
+        StStatementCache m_stStatementCache;
 
-        void Bind(int iColumn, int64_t llValue, uint64_t uiHandle)
-        {
-            Bind(iColumn, llValue, (sqlite3_stmt*)uiHandle);
-        }
+#ifndef WIN32
+    private:
+        // UTF-8 copies of bound text, one per statement and column. They must 
+        // live until the statement is stepped, and reusing them keeps repeated 
+        // binds allocation-free. Kept while a statement sits in the cache and 
+        // dropped by FinalizeStatement(), which every finalize goes through: a 
+        // later statement at the same address must not inherit them.
+        unordered_map<sqlite3_stmt*, vector<string>> m_mapBindBuffers;
 
-        void Bind(int iColumn, int64_t llValue, sqlite3_stmt* pStmt)
+        void BindUtf8(int iColumn, const CEStringView& svValue, sqlite3_stmt* pStmt)
         {
-            int iRet = sqlite3_bind_int64(pStmt, iColumn, llValue);
-            if (SQLITE_OK != iRet)
+            // Sized once: growing the vector would move short strings whose 
+            // inline buffers are already bound to other columns
+            auto& vecBuffers = m_mapBindBuffers[pStmt];
+            if (vecBuffers.empty())
             {
-                throw CException(iRet, L"sqlite3_bind_int64 failed");
+                vecBuffers.resize(sqlite3_bind_parameter_count(pStmt) + 1);
+            }
+            if ((int)vecBuffers.size() <= iColumn)
+            {
+                throw CException(SQLITE_RANGE, L"Bind parameter index out of range");
             }
-        }
 
-        void Bind(int iColumn, const CEString& sValue)
-        {
-            Bind(iColumn, sValue, m_pStmt);
+            string& stl_sUtf8 = vecBuffers[iColumn];
+            stl_sUtf8.resize(Utf8::uiMaxEncodedLength(svValue.uiLength()));
+            stl_sUtf8.resize(Utf8::uiEncode(svValue.pchrData(), svValue.uiLength(), &stl_sUtf8[0]));
+
+            int iRet = sqlite3_bind_text64(pStmt, iColumn, stl_sUtf8.data(), stl_sUtf8.length(), SQLITE_STATIC, SQLITE_UTF8);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_text64 failed");
+            }
         }
+#endif
 
-        void Bind(int iColumn, const CEString& sValue, uint64_t uiHandle)
+    public:
+        enum EOpenMode
         {
-            Bind(iColumn, sValue, (sqlite3_stmt*)uiHandle);
-        }
+            ecOpenReadWrite,        // creates the database if needed
+            ecOpenReadOnly
+        };
 
-        void Bind(int iColumn, const CEString& sValue, sqlite3_stmt* pStmt)
+        CSqlite(const CEString& sDbPath, EOpenMode eMode = ecOpenReadWrite) : m_spDb_(nullptr, SqliteDeleter())
         {
+            sqlite3* pSqlite3 = nullptr;
+            int iRet = SQLITE_OK;
+            if (ecOpenReadOnly == eMode)
+            {
+                iRet = sqlite3_open_v2(sDbPath.stl_sToUtf8().c_str(), &pSqlite3, SQLITE_OPEN_READONLY, nullptr);
+            }
+            else
+            {
 #ifdef WIN32
-            int iRet = sqlite3_bind_text16(pStmt, iColumn, (wchar_t*)sValue, -1, SQLITE_STATIC);
+                iRet = sqlite3_open16(sDbPath, &pSqlite3);
 #else
-            int iRet = sqlite3_bind_text16(pStmt, iColumn, pToWchar16(sValue).get(), -1, SQLITE_STATIC);
+                // Same flags as sqlite3_open16(), but new databases get UTF-8 text 
+                // which is what Bind() and GetData() pass through unconverted
+                iRet = sqlite3_open_v2(sDbPath.stl_sToUtf8().c_str(), &pSqlite3, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr);
 #endif
+            }
             if (SQLITE_OK != iRet)
             {
-                throw CException(iRet, L"sqlite3_bind_text16 failed");
+                sqlite3_close(pSqlite3);    // a handle is returned even on failure
+                pSqlite3 = nullptr;
+                throw CException(iRet, L"Unable to open database.");
             }
+            m_spDb_.reset(pSqlite3);
         }
 
-        void InsertRow()
-        {
-            InsertRow(m_pStmt);
-        }
+    private:
+        sqlite3_stmt* m_pStmt { nullptr };
+        CEString m_sDbPath;
 
-        void InsertRow(uint64_t uiHandle)
-        {
-            InsertRow((sqlite3_stmt*)uiHandle);
-        }
+        int m_iExtendedErrCode;
 
-        void InsertRow(sqlite3_stmt* pStmt)
+        // Compiles sSql or, if bCache is set, takes an idle compiled copy from 
+        // the statement cache; cached statements go back there in Finalize()
+        sqlite3_stmt* pPrepare(const CEString& sSql, bool bCache = true)
         {
             if (NULL == m_spDb_)
             {
                 throw CException(-1, L"No DB handle");
             }
 
-            if (NULL == pStmt)
+            string stl_sSql = sSql.stl_sToUtf8();
+            if (bCache)
             {
-                throw CException(-1, L"No statement");
+                auto itIdle = m_stStatementCache.mapIdle.find(stl_sSql);
+                if (m_stStatementCache.mapIdle.end() != itIdle)
+                {
+                    auto itEntry = itIdle->second;
+                    sqlite3_stmt* pStmt = itEntry->second;
+                    m_stStatementCache.mapIdle.erase(itIdle);
+                    m_stStatementCache.mapCheckedOut.emplace(pStmt, std::move(itEntry->first));
+                    m_stStatementCache.lstIdle.erase(itEntry);
+                    return pStmt;
+                }
             }
 
-            int iRet = sqlite3_step(pStmt);
-            if (SQLITE_DONE != iRet)
+            sqlite3_stmt* pStmt = NULL;
+            int iRet = sqlite3_prepare_v2(m_spDb_.get(), stl_sSql.c_str(), (int)stl_sSql.length() + 1, &pStmt, NULL);
+            if (SQLITE_OK != iRet)
             {
-                throw CException(iRet, L"sqlite3_step failed");
+                CEString sErrTxt;
+                GetLastError(sErrTxt);
+                CEString sMsg(L"sqlite3_prepare_v2 failed: ");
+                sMsg += sErrTxt;
+                throw CException(iRet, sMsg);
             }
 
-            iRet = sqlite3_reset(pStmt);
-            if (SQLITE_OK != iRet)
+            if (bCache && pStmt)
             {
-                throw CException(iRet, L"sqlite3_reset failed");
+                m_stStatementCache.mapCheckedOut.emplace(pStmt, std::move(stl_sSql));
             }
 
-        }   // InsertRow()
+            return pStmt;
 
-        void UpdateRow()
-        {
-            UpdateRow(m_pStmt);
-        }
+        }   //  pPrepare (...)
 
-        void UpdateRow(uint64_t uiHandle)
+        // Idle statements are reset with bindings cleared, so that a reused one 
+        // behaves like a freshly prepared one
+        void ReturnToCache(sqlite3_stmt* pStmt, string&& stl_sSql)
         {
-            UpdateRow((sqlite3_stmt*)uiHandle);
-        }
+            int iRet = sqlite3_reset(pStmt);
+            sqlite3_clear_bindings(pStmt);
 
-        void UpdateRow(sqlite3_stmt* pStmt)
-        {
-            if (NULL == m_spDb_)
+            if (m_stStatementCache.mapIdle.count(stl_sSql) > 0)
             {
-                throw CException(-1, L"No DB handle");
+                FinalizeStatement(pStmt);
+            }
+            else
+            {
+                m_stStatementCache.lstIdle.emplace_front(std::move(stl_sSql), pStmt);
+                auto itEntry = m_stStatementCache.lstIdle.begin();
+                m_stStatementCache.mapIdle.emplace(string_view(itEntry->first), itEntry);
+                TrimStatementCache();
             }
 
-            if (NULL == pStmt)
+            // Same error a real finalize would have reported
+            if (SQLITE_OK != iRet)
             {
-                throw CException(-1, L"No statement");
+                throw CException(iRet, L"sqlite3_finalize failed");
             }
+        }
 
-            int iRet = sqlite3_step(pStmt);
-            if (SQLITE_DONE != iRet)
+        void TrimStatementCache()
+        {
+            while (m_stStatementCache.lstIdle.size() > m_stStatementCache.uiCapacity)
             {
-                throw CException(iRet, L"sqlite3_step failed");
+                auto& pairOldest = m_stStatementCache.lstIdle.back();
+                m_stStatementCache.mapIdle.erase(string_view(pairOldest.first));
+                sqlite3_stmt* pStmt = pairOldest.second;
+                m_stStatementCache.lstIdle.pop_back();
+                FinalizeStatement(pStmt);
             }
+        }
 
-            iRet = sqlite3_reset(pStmt);
+        void FinalizeStatement(sqlite3_stmt* pStmt)
+        {
+#ifndef WIN32
+            m_mapBindBuffers.erase(pStmt);
+#endif
+            int iRet = sqlite3_finalize(pStmt);
             if (SQLITE_OK != iRet)
             {
-                throw CException(iRet, L"sqlite3_reset failed");
+                throw CException(iRet, L"sqlite3_finalize failed");
             }
+        }
 
-        }   // UpdateRow()
-
-        bool bGetRow()
+        CEString sGetPragma(const CEString& sName)
         {
-            return bGetRow(m_pStmt);
+            CEString sQuery(L"PRAGMA ");
+            sQuery += sName;
+            sqlite3_stmt* pStmt = pPrepare(sQuery, false);
+
+            CEString sValue;
+            if (SQLITE_ROW == sqlite3_step(pStmt))
+            {
+                sValue = CEString::sFromUtf8((const char*)sqlite3_column_text(pStmt, 0));
+            }
+            FinalizeStatement(pStmt);
+
+            return sValue;
         }
 
-        bool bGetRow(uint64_t uiHandle)
+        void SetPragma(const CEString& sName, const CEString& sValue)
         {
-            return bGetRow((sqlite3_stmt*)uiHandle);
+            CEString sQuery(L"PRAGMA ");
+            sQuery += sName;
+            sQuery += L" = ";
+            sQuery += sValue;
+            Exec(sQuery);
         }
 
-        bool bGetRow(sqlite3_stmt* pStmt)
+        // Sets a PRAGMA for the lifetime of the object, no-op if sValue is empty
+        class CScopedPragma
         {
-            if (NULL == m_spDb_)
+        public:
+            CScopedPragma(CSqlite& Db, const CEString& sName, const CEString& sValue) : m_Db(Db), m_sName(sName), m_bSet(false)
             {
-                throw CException(-1, L"No DB handle");
+                if (sValue.bIsEmpty())
+                {
+                    return;
+                }
+                m_sSaved = m_Db.sGetPragma(m_sName);
+                m_Db.SetPragma(m_sName, sValue);
+                m_bSet = true;
             }
 
-            if (NULL == pStmt)
+            CScopedPragma(const CScopedPragma&) = delete;
+            CScopedPragma& operator=(const CScopedPragma&) = delete;
+
+            ~CScopedPragma()
             {
-                throw CException(-1, L"No statement");
+                if (!m_bSet)
+                {
+                    return;
+                }
+                try
+                {
+                    m_Db.SetPragma(m_sName, m_sSaved);
+                }
+                catch (...)
+                {}
             }
 
-            int iRet = sqlite3_step(pStmt);
-            if (SQLITE_DONE == iRet)
+        private:
+            CSqlite& m_Db;
+            CEString m_sName;
+            CEString m_sSaved;
+            bool m_bSet;
+        };
+
+        //
+        // Transaction that is rolled back unless committed when the object goes 
+        // away, so a failed import does not leave it open. Declare it after 
+        // any CScopedPragma: PRAGMAs such as synchronous cannot be restored 
+        // inside a transaction.
+        //
+        class CScopedTransaction
+        {
+        public:
+            CScopedTransaction(CSqlite& Db) : m_Db(Db)
             {
-                iRet = sqlite3_reset(pStmt);
-                return false;
+                m_Db.BeginTransaction();
             }
 
-            if (SQLITE_ROW != iRet)
+            CScopedTransaction(const CScopedTransaction&) = delete;
+            CScopedTransaction& operator=(const CScopedTransaction&) = delete;
+
+            ~CScopedTransaction()
             {
-                throw CException(iRet, L"sqlite3_step failed");
+                if (0 == sqlite3_get_autocommit(m_Db.m_spDb_.get()))
+                {
+                    sqlite3_exec(m_Db.m_spDb_.get(), "ROLLBACK", NULL, NULL, NULL);
+                }
             }
 
-            return true;
+            // Commits and starts the next transaction
+            void CommitAndBegin()
+            {
+                m_Db.CommitTransaction();
+                m_Db.BeginTransaction();
+            }
 
-        }   // bGetRow (...)
+            void Commit()
+            {
+                m_Db.CommitTransaction();
+            }
 
-        void GetData(int iColumn, bool& bValue)
+        private:
+            CSqlite& m_Db;
+        };
+
+        //
+        // Read transaction that keeps a parallel export on one state of the 
+        // database. With a rollback journal its shared lock stops other 
+        // connections from committing until it ends. Under WAL writers go on, 
+        // so each worker opens the snapshot taken here; that needs sqlite built 
+        // with SQLITE_ENABLE_SNAPSHOT, and without it bPinned() is false.
+        //
+        class CScopedExportSnapshot
         {
-            GetData(iColumn, bValue, m_pStmt);
-        }
+        public:
+            CScopedExportSnapshot(CSqlite& Db) : m_Db(Db), m_bOpen(false), m_bPinned(false)
+            {
+                bool bWal = (m_Db.sGetPragma(L"journal_mode") == L"wal");
+#ifndef SQLITE_ENABLE_SNAPSHOT
+                if (bWal)
+                {
+                    return;
+                }
+#endif
+                m_Db.BeginTransaction();
+                m_bOpen = true;
+                try
+                {
+                    // BEGIN is deferred, the first read starts the transaction
+                    sqlite3_stmt* pStmt = m_Db.pPrepare(L"SELECT count(*) FROM sqlite_master", false);
+                    int iRet = sqlite3_step(pStmt);
+                    m_Db.FinalizeStatement(pStmt);
+                    if (SQLITE_ROW != iRet)
+                    {
+                        throw CException(iRet, L"Unable to start the export read transaction.");
+                    }
+#ifdef SQLITE_ENABLE_SNAPSHOT
+                    if (bWal)
+                    {
+                        iRet = sqlite3_snapshot_get(m_Db.m_spDb_.get(), "main", &m_pSnapshot);
+                        if (SQLITE_OK != iRet)
+                        {
+                            throw CException(iRet, L"sqlite3_snapshot_get failed");
+                        }
+                    }
+#endif
+                }
+                catch (...)
+                {
+                    End();
+                    throw;
+                }
+                m_bPinned = true;
+            }
 
-        void GetData(int iColumn, bool& bValue, uint64_t uiHandle)
+            CScopedExportSnapshot(const CScopedExportSnapshot&) = delete;
+            CScopedExportSnapshot& operator=(const CScopedExportSnapshot&) = delete;
+
+            ~CScopedExportSnapshot()
+            {
+                End();
+            }
+
+            bool bPinned() const
+            {
+                return m_bPinned;
+            }
+
+            // For a worker connection, between its BEGIN and its first read
+            void Open(CSqlite& Worker) const
+            {
+#ifdef SQLITE_ENABLE_SNAPSHOT
+                if (m_pSnapshot)
+                {
+                    int iRet = sqlite3_snapshot_open(Worker.m_spDb_.get(), "main", m_pSnapshot);
+                    if (SQLITE_OK != iRet)
+                    {
+                        throw CException(iRet, L"sqlite3_snapshot_open failed");
+                    }
+                }
+#else
+                (void)Worker;
+#endif
+            }
+
+        private:
+            void End()
+            {
+#ifdef SQLITE_ENABLE_SNAPSHOT
+                if (m_pSnapshot)
+                {
+                    sqlite3_snapshot_free(m_pSnapshot);
+                    m_pSnapshot = nullptr;
+                }
+#endif
+                if (m_bOpen)
+                {
+                    m_bOpen = false;
+                    try
+                    {
+                        m_Db.CommitTransaction();
+                    }
+                    catch (...)
+                    {}
+                }
+            }
+
+            CSqlite& m_Db;
+            bool m_bOpen;
+            bool m_bPinned;
+#ifdef SQLITE_ENABLE_SNAPSHOT
+            sqlite3_snapshot* m_pSnapshot { nullptr };
+#endif
+        };
+
+        // Binds a parsed row and inserts it; with autoincrement the first 
+        // field is not stored and the others shift down by one
+        void InsertImportRow(const string_view* pFields, int iColumns, bool bAutoincrement, int64_t llId, sqlite3_stmt* pStmt)
         {
-            GetData(iColumn, bValue, (sqlite3_stmt*)uiHandle);
+            int iBindOffset = 0;
+            if (!bAutoincrement)
+            {
+                Bind(1, llId, pStmt);
+                iBindOffset = 1;
+            }
+
+            for (int iField = 1; iField < iColumns; ++iField)
+            {
+                BindUtf8(iField + iBindOffset, pFields[iField].data(), pFields[iField].length(), pStmt);
+            }
+
+            InsertRow(pStmt);
         }
 
-        void GetData(int iColumn, bool& bValue, sqlite3_stmt* pStmt)
+        void LogRejectedImportRow(string_view svLine)
         {
-            int iRet = sqlite3_column_int(pStmt, iColumn);
-            bValue = (iRet != 0);
+            CEString sMsg(L"Number of fields does not match number of columns or bad row ID: ");
+            sMsg += CEString::sFromUtf8(svLine.data(), svLine.length());
+            sMsg += L"\n";
+            wchar_t* szMsg = sMsg;
+            ERROR_LOG(szMsg);
         }
 
-        void GetData(int iColumn, int& iValue)
-        {
-            GetData(iColumn, iValue, m_pStmt);
-        }
-
-        void GetData(int iColumn, int& iValue, uint64_t uiHandle)
-        {
-            GetData(iColumn, iValue, (sqlite3_stmt*)uiHandle);
-        }
-
-        void GetData(int iColumn, int& iValue, sqlite3_stmt* pStmt)
-        {
-            iValue = sqlite3_column_int(pStmt, iColumn);
-        }
-
-        void GetData(int iColumn, int64_t& ll_value)
+        //
+        // Pipelined body of bImport(): a reader thread cuts the table into 
+        // batches of whole lines, uiParseThreads workers split and validate 
+        // them, and this thread, the only one touching the connection, inserts 
+        // them in file order. Both queues are bounded, so the reader stays at 
+        // most a few batches ahead of the inserts.
+        //
+        void ImportPipelined(CImportReader& Reader, int iColumns, bool bAutoincrement, sqlite3_stmt* pStmt, 
+                             unsigned int uiParseThreads, const function<void(uint64_t, uint64_t)>& fnInserted)
         {
-            GetData(iColumn, ll_value, m_pStmt);
-        }
+            using SpBatch = shared_ptr<StImportBatch>;
+            size_t uiMaxInFlight = 2 * (size_t)uiParseThreads + 2;
+            CBoundedQueue<SpBatch> queueToParse(uiMaxInFlight);
+            CBoundedQueue<SpBatch> queueToWrite(uiMaxInFlight);      // same batches, in file order
+            exception_ptr spReaderError;
 
-        void GetData(int iColumn, int64_t& llValue, uint64_t uiHandle)
-        {
-            GetData(iColumn, llValue, (sqlite3_stmt*)uiHandle);
-        }
+            auto fnRead = [&]()
+            {
+                try
+                {
+                    SpBatch spBatch;
+                    string_view svLine;
+                    bool bEndOfTable = false;
+                    while (!bEndOfTable)
+                    {
+                        spBatch = make_shared<StImportBatch>();
+                        spBatch->stl_sLines.reserve(StImportBatch::cuiTargetBytes_ + 1024);
+                        while (spBatch->stl_sLines.length() < StImportBatch::cuiTargetBytes_)
+                        {
+                            if (!Reader.bGetLine(svLine) || CImportReader::bIsBlank(svLine))
+                            {
+                                bEndOfTable = true;
+                                break;
+                            }
+                            spBatch->stl_sLines.append(svLine.data(), svLine.length());
+                            spBatch->stl_sLines.push_back('\n');
+                        }
+                        spBatch->ullConsumed = Reader.ullConsumed();
 
-        void GetData(int iColumn, int64_t& llValue, sqlite3_stmt* pStmt)
-        {
-            llValue = (int64_t)sqlite3_column_int64(pStmt, iColumn);
-        }
+                        if (spBatch->stl_sLines.empty())
+                        {
+                            break;
+                        }
+                        SpBatch spToWrite = spBatch;
+                        if (!queueToWrite.bPush(std::move(spToWrite)) || !queueToParse.bPush(std::move(spBatch)))
+                        {
+                            break;      // writer gave up
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    spReaderError = current_exception();
+                }
+                queueToParse.Close();
+                queueToWrite.Close();
+            };
 
-        void GetData(int iColumn, uint64_t& uiValue)
-        {
-            GetData(iColumn, uiValue, m_pStmt);
-        }
+            auto fnParse = [&]()
+            {
+                SpBatch spBatch;
+                vector<string_view> vecRowFields;
+                while (queueToParse.bPop(spBatch))
+                {
+                    try
+                    {
+                        string_view svLines(spBatch->stl_sLines);
+                        size_t uiAt = 0;
+                        while (uiAt < svLines.length())
+                        {
+                            size_t uiEnd = svLines.find('\n', uiAt);
+                            string_view svLine = svLines.substr(uiAt, uiEnd - uiAt);
+                            uiAt = uiEnd + 1;
+
+                            int64_t llId = 0;
+                            if (CImportReader::bParseRow(svLine, iColumns, bAutoincrement, vecRowFields, llId))
+                            {
+                                spBatch->vecFields.insert(spBatch->vecFields.end(), vecRowFields.begin(), vecRowFields.end());
+                                spBatch->vecIds.push_back(llId);
+                            }
+                            else
+                            {
+                                spBatch->vecRejected.push_back(svLine);
+                            }
+                        }
+                        spBatch->Parsed.set_value();
+                    }
+                    catch (...)
+                    {
+                        spBatch->Parsed.set_exception(current_exception());
+                    }
+                    spBatch.reset();
+                }
+            };
 
-        void GetData(int iColumn, unsigned int& uiValue, uint64_t uiHandle)
-        {
-            GetData(iColumn, uiValue, (sqlite3_stmt*)uiHandle);
-        }
+            vector<thread> vecThreads;
 
-        void GetData(int iColumn, unsigned int& uiValue, sqlite3_stmt* pStmt)
-        {
-            uiValue = sqlite3_column_int(pStmt, iColumn);
-        }
+            // Closing the queues unblocks the reader and the workers if the 
+            // inserts fail, so the threads can always be joined
+            struct StJoiner
+            {
+                CBoundedQueue<SpBatch>& queueToParse;
+                CBoundedQueue<SpBatch>& queueToWrite;
+                vector<thread>& vecThreads;
+                ~StJoiner()
+                {
+                    queueToParse.Close();
+                    queueToWrite.Close();
+                    for (auto& Thread : vecThreads)
+                    {
+                        Thread.join();
+                    }
+                }
+            } stJoiner { queueToParse, queueToWrite, vecThreads };
 
-        //        void GetData(int iColumn, unsigned int64_t& ull_value)
-        //        {
-        //            GetData(iColumn, ull_value, m_pStmt);
-        //        }
+            vecThreads.emplace_back(fnRead);
+            for (unsigned int uiThread = 0; uiThread < uiParseThreads; ++uiThread)
+            {
+                vecThreads.emplace_back(fnParse);
+            }
 
-        void GetData(int iColumn, uint64_t& ull_value, uint64_t uiHandle)
-        {
-            GetData(iColumn, ull_value, (sqlite3_stmt*)uiHandle);
-        }
+            SpBatch spBatch;
+            while (queueToWrite.bPop(spBatch))
+            {
+                spBatch->Parsed.get_future().get();     // rethrows a worker's exception
 
-        void GetData(int iColumn, uint64_t& ull_value, sqlite3_stmt* pStmt)
-        {
-            ull_value = sqlite3_column_int64(pStmt, iColumn);
-        }
+                for (string_view svRejected : spBatch->vecRejected)
+                {
+                    LogRejectedImportRow(svRejected);
+                }
 
-        void GetData(int iColumn, CEString& sValue)
-        {
-            GetData(iColumn, sValue, m_pStmt);
-        }
+                for (size_t uiRow = 0; uiRow < spBatch->vecIds.size(); ++uiRow)
+                {
+                    InsertImportRow(&spBatch->vecFields[uiRow * iColumns], iColumns, bAutoincrement, spBatch->vecIds[uiRow], pStmt);
+                }
 
-        void GetData(int iColumn, CEString& sValue, uint64_t uiHandle)
-        {
-            GetData(iColumn, sValue, (sqlite3_stmt*)uiHandle);
-        }
+                fnInserted(spBatch->vecIds.size(), spBatch->ullConsumed);
+            }
 
-        void GetData(int iColumn, CEString& sValue, sqlite3_stmt* pStmt)
-        {
-            const void* p_ = sqlite3_column_text16(pStmt, iColumn);
-            if (p_)
+            if (spReaderError)
             {
-#ifdef WIN32
-                sValue = static_cast<wchar_t*>(const_cast<void*>(p_));
-#else
-                auto iByteSize = sqlite3_column_bytes16(pStmt, iColumn);
-                sValue = pToWchar32(p_, iByteSize).get();
-#endif
+                rethrow_exception(spReaderError);
             }
-        }
 
-        void Finalize()
-        {
-            Finalize(m_pStmt);
-        }
+        }   //  ImportPipelined (...)
 
-        void Finalize(uint64_t uiHandle)
+    public:
+        //
+        // Cached prepared statement that goes back to the cache when the handle 
+        // is destroyed. Converts to sqlite3_stmt*, so it can be passed to Bind(),
+        // InsertRow(), bGetRow(), GetData() etc.
+        //
+        class CStatement
         {
-            Finalize((sqlite3_stmt*)uiHandle);
-        }
+        public:
+            CStatement() : m_pOwner(nullptr), m_pStmt(nullptr)
+            {}
 
-        void Finalize(sqlite3_stmt* pStmt)
-        {
-            if (NULL == m_spDb_)
+            CStatement(CSqlite& Owner, sqlite3_stmt* pStmt) : m_pOwner(&Owner), m_pStmt(pStmt)
+            {}
+
+            CStatement(const CStatement&) = delete;
+            CStatement& operator=(const CStatement&) = delete;
+
+            CStatement(CStatement&& Source) noexcept : m_pOwner(Source.m_pOwner), m_pStmt(Source.m_pStmt)
             {
-                throw CException(-1, L"No DB handle");
+                Source.m_pStmt = nullptr;
             }
 
-            if (NULL == pStmt)
+            CStatement& operator=(CStatement&& Source) noexcept
             {
-                throw CException(-1, L"No statement handle");
+                if (this != &Source)
+                {
+                    Release();
+                    m_pOwner = Source.m_pOwner;
+                    m_pStmt = Source.m_pStmt;
+                    Source.m_pStmt = nullptr;
+                }
+                return *this;
             }
 
-            int iRet = sqlite3_finalize(pStmt);
-            if (SQLITE_OK != iRet)
+            ~CStatement()
             {
-                throw CException(iRet, L"sqlite3_finalize failed");
+                Release();
             }
-        }
 
-        void Exec(const CEString& sQuery)
-        {
-            int iMaxUtf8SizeInBytes = 2 * sQuery.uiLength() + 1;
-
-            char* pchrUtf8Query = new char[iMaxUtf8SizeInBytes];
-            if (NULL == pchrUtf8Query)
+            sqlite3_stmt* pGet() const
             {
-                throw CException(H_ERROR_POINTER, L"Unable to allocate memory.");
+                return m_pStmt;
             }
 
-            auto length = wcstombs(pchrUtf8Query, sQuery, sQuery.uiLength());
-            if ((size_t)-1 == length)   // -1 cast to (size_t) per documentation
+            operator sqlite3_stmt*() const
             {
-                throw CException(H_ERROR_POINTER, L"UTF-16 to UTF-8 conversion error or bad query string.");
+                return m_pStmt;
             }
 
-            pchrUtf8Query[length] = '\0';
-
-            int iRet = sqlite3_exec(m_spDb_.get(), pchrUtf8Query, NULL, NULL, NULL);
-            if (SQLITE_OK != iRet)
+            // Errors from the last step were reported when it ran; the one 
+            // repeated by reset is of no interest here
+            void Release() noexcept
             {
-                CEString sMsg(L"sqlite3_exec failed, error ");
-                sMsg += CEString::sToString(iRet);
-                throw CException(iRet, L"sqlite3_exec failed");
+                if (m_pOwner && m_pStmt)
+                {
+                    try
+                    {
+                        m_pOwner->Finalize(m_pStmt);
+                    }
+                    catch (...)
+                    {}
+                }
+                m_pStmt = nullptr;
             }
 
-            delete[] pchrUtf8Query;
+        private:
+            CSqlite* m_pOwner;
+            sqlite3_stmt* m_pStmt;
+
+        };      //  class CStatement
+
+        CStatement Prepare(const CEString& sSql)
+        {
+            return CStatement(*this, pPrepare(sSql));
         }
 
-        int64_t llGetLastKey()
+        void SetStatementCacheCapacity(unsigned int uiCapacity)
         {
-            return llGetLastKey(m_pStmt);
+            m_stStatementCache.uiCapacity = uiCapacity;
+            TrimStatementCache();
         }
 
-        int64_t llGetLastKey(uint64_t uiHandle)
+        unsigned int uiStatementCacheSize() const
         {
-            return llGetLastKey((sqlite3_stmt*)uiHandle);
+            return (unsigned int)m_stStatementCache.lstIdle.size();
         }
 
-        int64_t llGetLastKey(sqlite3_stmt* pStmt)
+        // Finalizes idle statements; ones checked out are not affected
+        void ClearStatementCache()
         {
-            if (NULL == m_spDb_)
+            while (!m_stStatementCache.lstIdle.empty())
             {
-                throw CException(-1, L"No DB handle");
+                auto& pairEntry = m_stStatementCache.lstIdle.front();
+                m_stStatementCache.mapIdle.erase(string_view(pairEntry.first));
+                sqlite3_stmt* pStmt = pairEntry.second;
+                m_stStatementCache.lstIdle.pop_front();
+                FinalizeStatement(pStmt);
             }
+        }
 
-            if (NULL == pStmt)
+    public:
+        // Path of the main database file, empty for in-memory and temporary databases
+        CEString sGetDbPath() const
+        {
+            if (NULL == m_spDb_)
             {
-                throw CException(-1, L"No statement handle");
+                throw CException(-1, L"No DB handle");
             }
 
-            return sqlite3_last_insert_rowid(m_spDb_.get());
+            const char* szPath = sqlite3_db_filename(m_spDb_.get(), "main");
+            return szPath ? CEString::sFromUtf8(szPath) : CEString();
         }
 
-        int iGetLastError()
+        // How long to retry when another connection holds a lock
+        void SetBusyTimeout(int iMilliseconds)
         {
             if (NULL == m_spDb_)
             {
-                return -1;
+                throw CException(-1, L"No DB handle");
             }
 
-            return sqlite3_extended_errcode(m_spDb_.get());
+            sqlite3_busy_timeout(m_spDb_.get(), iMilliseconds);
         }
 
-        void GetLastError(CEString& sError)
+        void BeginTransaction()
         {
             if (NULL == m_spDb_)
             {
                 throw CException(-1, L"No DB handle");
             }
 
-            wchar_t* szError = (wchar_t*)sqlite3_errmsg16(m_spDb_.get());
-            sError = szError;
-            auto szErrorUtf8 = sqlite3_errmsg(m_spDb_.get());
-            CEString sMsg{ L"Sqlite error: " };
-            sMsg += CEString::sFromUtf8(szErrorUtf8);
-            ERROR_LOG(sMsg);
+            int iRet = SQLITE_OK;
+            iRet = sqlite3_exec(m_spDb_.get(), "BEGIN TRANSACTION", NULL, NULL, NULL);
+            if (SQLITE_OK != iRet)
+            {
+                CEString sErrTxt;
+                GetLastError(sErrTxt);
+                CEString sMsg(L"sqlite3_exec failed: ");
+                sMsg += sErrTxt;
+                throw CException(iRet, sMsg);
+//
+//                throw CException(iRet, L"sqlite3_exec failed for transaction start");
+            }
         }
 
-        bool bTableExists(const CEString& sTable)
+        void CommitTransaction()
         {
-            CEString sQuery(L"SELECT name FROM sqlite_master WHERE type='table';");
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sQuery, -1, &m_pStmt, NULL);
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            int iRet = SQLITE_OK;
+            iRet = sqlite3_exec(m_spDb_.get(), "END TRANSACTION", NULL, NULL, NULL);
             if (SQLITE_OK != iRet)
             {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                CEString sErrTxt;
+                GetLastError(sErrTxt);
+                CEString sMsg(L"sqlite3_exec failed: ");
+                sMsg += sErrTxt;
+                throw CException(iRet, sMsg);
+                //
+                //                throw CException(iRet, L"sqlite3_exec failed for transaction end");
             }
+        }
 
-            do
+        void RollbackTransaction()
+        {
+            if (NULL == m_spDb_)
             {
-                iRet = sqlite3_step(m_pStmt);
-                if (SQLITE_DONE == iRet)
-                {
-                    iRet = sqlite3_reset(m_pStmt);
-                    Finalize();
-                    return false;
-                }
+                throw CException(-1, L"No DB handle");
+            }
 
-                if (SQLITE_ROW != iRet)
-                {
-                    throw CException(iRet, L"sqlite3_step failed");
-                }
+            int iRet = SQLITE_OK;
+            iRet = sqlite3_exec(m_spDb_.get(), "END TRANSACTION;", NULL, NULL, NULL);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+            }
+        }
 
-                CEString sCurrent;
-                GetData(0, sCurrent);
-                if (sTable == sCurrent)
-                {
-                    Finalize();
-                    return true;
-                }
+        void PrepareForSelect(const CEString& sStmt)
+        {
+            PrepareForSelect(sStmt, m_pStmt);
+        }
 
-            } while (SQLITE_ROW == iRet);
+        uint64_t uiPrepareForSelect(const CEString& sStmt)
+        {
+            sqlite3_stmt* pStmt = NULL;
+            PrepareForSelect(sStmt, pStmt);
+            return (uint64_t)pStmt;
+        }
 
-            Finalize();
-            return false;
+        void PrepareForSelect(const CEString& sStmt, sqlite3_stmt*& pStmt)
+        {
+            pStmt = pPrepare(sStmt);
+        }
 
-        }   //  b_TableExists (...)
+        void PrepareForInsert(const CEString& sTable, int iColumns, bool bIgnoreOnConflict = false)
+        {
+            uiPrepareForInsert(sTable, iColumns, m_pStmt, bIgnoreOnConflict);
+        }
 
-        bool bTableEmpty(const CEString& sTable)
+        uint64_t uiPrepareForInsert(const CEString& sTable, int iColumns, sqlite3_stmt*& pStmt, bool bIgnoreOnConflict = false)
         {
-            CEString sQuery(L"SELECT * FROM ");
-            sQuery += sTable;
-            sQuery += L";";
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sQuery, -1, &m_pStmt, NULL);
-            if (SQLITE_OK != iRet)
+            CEString sStmt(L"INSERT ");
+            if (bIgnoreOnConflict)
             {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                sStmt += L"OR IGNORE ";
             }
 
-            iRet = sqlite3_step(m_pStmt);
+            sStmt += L"INTO ";
+            sStmt += sTable;
+            sStmt += L" VALUES (NULL, ";
+            for (int iCol = 0; iCol < iColumns; ++iCol)
+            {
+                if (iCol > 0)
+                {
+                    sStmt += L",";
+                }
+                sStmt += L"?";
+            }
+            sStmt += L")";
+
+            pStmt = pPrepare(sStmt);
+
+            return (uint64_t)pStmt;
+        }
+
+        void PrepareForUpdate(const CEString& sTable, const vector<CEString>& vecColumns, int64_t llPrimaryKey)
+        {
+            uiPrepareForUpdate(sTable, vecColumns, llPrimaryKey, m_pStmt);
+        }
+
+        void PrepareForUpdate(const CEString& sTable, const vector<CEString>& vecColumns)
+        {
+            uiPrepareForUpdate(sTable, vecColumns, -1, m_pStmt);
+        }
+
+        uint64_t uiPrepareForUpdate(const CEString& sTable, const vector<CEString>& vecColumns, int64_t llPrimaryKey, sqlite3_stmt*& pStmt)
+        {
+            CEString sStmt = L"UPDATE ";
+            sStmt += sTable;
+            sStmt += L" SET ";
+            for (int iCol = 0; iCol < (int)vecColumns.size(); ++iCol)
+            {
+                if (iCol > 0)
+                {
+                    sStmt += L", ";
+                }
+                sStmt += vecColumns[iCol];
+                sStmt += L"=";
+                sStmt += L"?";
+            }
+
+            if (llPrimaryKey > -1)
+            {
+                sStmt += L" WHERE ID = ";
+                sStmt += CEString::sToString(llPrimaryKey);
+            }
+
+            pStmt = pPrepare(sStmt);
+
+            return (uint64_t)pStmt;
+
+        }       //  uiPrepareForUpdate()
+
+        void PrepareForInsertOrReplace(const CEString& sTable, int iColumns)
+        {
+            uiPrepareForInsertOrReplace(sTable, iColumns, m_pStmt);
+        }
+
+        uint64_t uiPrepareForInsertOrReplace(const CEString& sTable, int iColumns, sqlite3_stmt*& pStmt)
+        {
+            CEString sStmt(L"INSERT ");
+            sStmt += L"OR REPLACE INTO ";
+            sStmt += sTable;
+            sStmt += L" VALUES (NULL, ";
+            for (int iCol = 0; iCol < iColumns; ++iCol)
+            {
+                if (iCol > 0)
+                {
+                    sStmt += L",";
+                }
+                sStmt += L"?";
+            }
+            sStmt += L")";
+
+            pStmt = pPrepare(sStmt);
+
+            return (uint64_t)pStmt;
+
+        }       //  uiPrepareForInsertOrReplace()
+
+        void Delete(const CEString& sStmt)
+        {
+            m_pStmt = pPrepare(sStmt, false);
+
+            int iRet = sqlite3_step(m_pStmt);
+            if (SQLITE_OK != iRet && SQLITE_DONE != iRet)
+            {
+                throw CException(iRet, L"sqlite3_step failed");
+            }
+
+            FinalizeStatement(m_pStmt);
+        }
+
+        void Bind(int iColumn, bool bValue)
+        {
+            Bind(iColumn, bValue, m_pStmt);
+        }
+
+        void Bind(int iColumn, bool bValue, uint64_t uiHandle)
+        {
+            Bind(iColumn, bValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void Bind(int iColumn, bool bValue, sqlite3_stmt* pStmt)
+        {
+            int iRet = sqlite3_bind_int(pStmt, iColumn, bValue);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_int failed");
+            }
+        }
+
+        void Bind(int iColumn, int iValue)
+        {
+            Bind(iColumn, iValue, m_pStmt);
+        }
+
+        void Bind(int iColumn, int iValue, uint64_t uiHandle)
+        {
+            Bind(iColumn, iValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void Bind(int iColumn, int iValue, sqlite3_stmt* pStmt)
+        {
+            int iRet = sqlite3_bind_int(pStmt, iColumn, iValue);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_int failed");
+            }
+        }
+
+        void Bind(int iColumn, uint64_t uiValue)
+        {
+            Bind(iColumn, uiValue, m_pStmt);
+        }
+
+        void Bind(int iColumn, uint64_t uiValue, uint64_t uiHandle)
+        {
+            Bind(iColumn, uiValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void Bind(int iColumn, uint64_t uiValue, sqlite3_stmt* pStmt)
+        {
+            int iRet = sqlite3_bind_int64(pStmt, iColumn, (int64_t)uiValue);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_int64 failed");
+            }
+        }
+
+        void Bind(int iColumn, int64_t llValue)
+        {
+            Bind(iColumn, llValue, m_pStmt);
+        }
+
+        void Bind(int iColumn, int64_t llValue, uint64_t uiHandle)
+        {
+            Bind(iColumn, llValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void Bind(int iColumn, int64_t llValue, sqlite3_stmt* pStmt)
+        {
+            int iRet = sqlite3_bind_int64(pStmt, iColumn, llValue);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_int64 failed");
+            }
+        }
+
+        void Bind(int iColumn, const CEString& sValue)
+        {
+            Bind(iColumn, sValue, m_pStmt);
+        }
+
+        void Bind(int iColumn, const CEString& sValue, uint64_t uiHandle)
+        {
+            Bind(iColumn, sValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void Bind(int iColumn, const CEString& sValue, sqlite3_stmt* pStmt)
+        {
+#ifdef WIN32
+            int iRet = sqlite3_bind_text16(pStmt, iColumn, (wchar_t*)sValue, -1, SQLITE_STATIC);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_text16 failed");
+            }
+#else
+            BindUtf8(iColumn, CEStringView(sValue), pStmt);
+#endif
+        }
+
+        void Bind(int iColumn, const CEStringView& svValue)
+        {
+            Bind(iColumn, svValue, m_pStmt);
+        }
+
+        void Bind(int iColumn, const CEStringView& svValue, uint64_t uiHandle)
+        {
+            Bind(iColumn, svValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        // Views are not null-terminated and may not outlive the call: on Windows
+        // sqlite gets an explicit byte count and makes its own copy, elsewhere 
+        // the text is bound from the statement's own UTF-8 buffer
+        void Bind(int iColumn, const CEStringView& svValue, sqlite3_stmt* pStmt)
+        {
+#ifdef WIN32
+            int iRet = sqlite3_bind_text16(pStmt, iColumn, svValue.pchrData(), 
+                                           (int)(svValue.uiLength() * sizeof(wchar_t)), SQLITE_TRANSIENT);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_text16 failed");
+            }
+#else
+            BindUtf8(iColumn, svValue, pStmt);
+#endif
+        }
+
+        // The bytes are not copied and must stay valid until the statement is stepped
+        void BindUtf8(int iColumn, const char* pchrUtf8, size_t uiBytes, sqlite3_stmt* pStmt)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            int iRet = sqlite3_bind_text64(pStmt, iColumn, pchrUtf8, uiBytes, SQLITE_STATIC, SQLITE_UTF8);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_text64 failed");
+            }
+        }
+
+        void Bind(int iColumn, const CEStringUtf8& sValue)
+        {
+            Bind(iColumn, sValue, m_pStmt);
+        }
+
+        void Bind(int iColumn, const CEStringUtf8& sValue, uint64_t uiHandle)
+        {
+            Bind(iColumn, sValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        // Zero-copy: sqlite reads the caller's bytes, so sValue must stay 
+        // unchanged until the statement is stepped or the column rebound
+        void Bind(int iColumn, const CEStringUtf8& sValue, sqlite3_stmt* pStmt)
+        {
+            int iRet = sqlite3_bind_text(pStmt, iColumn, sValue.szData(), (int)sValue.uiBytes(), SQLITE_STATIC);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_bind_text failed");
+            }
+        }
+
+        void InsertRow()
+        {
+            InsertRow(m_pStmt);
+        }
+
+        void InsertRow(uint64_t uiHandle)
+        {
+            InsertRow((sqlite3_stmt*)uiHandle);
+        }
+
+        void InsertRow(sqlite3_stmt* pStmt)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            if (NULL == pStmt)
+            {
+                throw CException(-1, L"No statement");
+            }
+
+            int iRet = sqlite3_step(pStmt);
+            if (SQLITE_DONE != iRet)
+            {
+                throw CException(iRet, L"sqlite3_step failed");
+            }
+
+            iRet = sqlite3_reset(pStmt);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_reset failed");
+            }
+
+        }   // InsertRow()
+
+        void UpdateRow()
+        {
+            UpdateRow(m_pStmt);
+        }
+
+        void UpdateRow(uint64_t uiHandle)
+        {
+            UpdateRow((sqlite3_stmt*)uiHandle);
+        }
+
+        void UpdateRow(sqlite3_stmt* pStmt)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            if (NULL == pStmt)
+            {
+                throw CException(-1, L"No statement");
+            }
+
+            int iRet = sqlite3_step(pStmt);
+            if (SQLITE_DONE != iRet)
+            {
+                throw CException(iRet, L"sqlite3_step failed");
+            }
+
+            iRet = sqlite3_reset(pStmt);
+            if (SQLITE_OK != iRet)
+            {
+                throw CException(iRet, L"sqlite3_reset failed");
+            }
+
+        }   // UpdateRow()
+
+        bool bGetRow()
+        {
+            return bGetRow(m_pStmt);
+        }
+
+        bool bGetRow(uint64_t uiHandle)
+        {
+            return bGetRow((sqlite3_stmt*)uiHandle);
+        }
+
+        bool bGetRow(sqlite3_stmt* pStmt)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            if (NULL == pStmt)
+            {
+                throw CException(-1, L"No statement");
+            }
+
+            int iRet = sqlite3_step(pStmt);
+            if (SQLITE_DONE == iRet)
+            {
+                iRet = sqlite3_reset(pStmt);
+                return false;
+            }
+
+            if (SQLITE_ROW != iRet)
+            {
+                throw CException(iRet, L"sqlite3_step failed");
+            }
+
+            return true;
+
+        }   // bGetRow (...)
+
+        void GetData(int iColumn, bool& bValue)
+        {
+            GetData(iColumn, bValue, m_pStmt);
+        }
+
+        void GetData(int iColumn, bool& bValue, uint64_t uiHandle)
+        {
+            GetData(iColumn, bValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void GetData(int iColumn, bool& bValue, sqlite3_stmt* pStmt)
+        {
+            int iRet = sqlite3_column_int(pStmt, iColumn);
+            bValue = (iRet != 0);
+        }
+
+        void GetData(int iColumn, int& iValue)
+        {
+            GetData(iColumn, iValue, m_pStmt);
+        }
+
+        void GetData(int iColumn, int& iValue, uint64_t uiHandle)
+        {
+            GetData(iColumn, iValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void GetData(int iColumn, int& iValue, sqlite3_stmt* pStmt)
+        {
+            iValue = sqlite3_column_int(pStmt, iColumn);
+        }
+
+        void GetData(int iColumn, int64_t& ll_value)
+        {
+            GetData(iColumn, ll_value, m_pStmt);
+        }
+
+        void GetData(int iColumn, int64_t& llValue, uint64_t uiHandle)
+        {
+            GetData(iColumn, llValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void GetData(int iColumn, int64_t& llValue, sqlite3_stmt* pStmt)
+        {
+            llValue = (int64_t)sqlite3_column_int64(pStmt, iColumn);
+        }
+
+        void GetData(int iColumn, uint64_t& uiValue)
+        {
+            GetData(iColumn, uiValue, m_pStmt);
+        }
+
+        void GetData(int iColumn, unsigned int& uiValue, uint64_t uiHandle)
+        {
+            GetData(iColumn, uiValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void GetData(int iColumn, unsigned int& uiValue, sqlite3_stmt* pStmt)
+        {
+            uiValue = sqlite3_column_int(pStmt, iColumn);
+        }
+
+        //        void GetData(int iColumn, unsigned int64_t& ull_value)
+        //        {
+        //            GetData(iColumn, ull_value, m_pStmt);
+        //        }
+
+        void GetData(int iColumn, uint64_t& ull_value, uint64_t uiHandle)
+        {
+            GetData(iColumn, ull_value, (sqlite3_stmt*)uiHandle);
+        }
+
+        void GetData(int iColumn, uint64_t& ull_value, sqlite3_stmt* pStmt)
+        {
+            ull_value = sqlite3_column_int64(pStmt, iColumn);
+        }
+
+        void GetData(int iColumn, CEString& sValue)
+        {
+            GetData(iColumn, sValue, m_pStmt);
+        }
+
+        void GetData(int iColumn, CEString& sValue, uint64_t uiHandle)
+        {
+            GetData(iColumn, sValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        void GetData(int iColumn, CEString& sValue, sqlite3_stmt* pStmt)
+        {
+#ifdef WIN32
+            const void* p_ = sqlite3_column_text16(pStmt, iColumn);
+            if (p_)
+            {
+                sValue = static_cast<wchar_t*>(const_cast<void*>(p_));
+            }
+#else
+            // Decoded straight into sValue's buffer
+            auto pchrText = reinterpret_cast<const char*>(sqlite3_column_text(pStmt, iColumn));
+            if (pchrText)
+            {
+                sValue.AssignUtf8(pchrText, sqlite3_column_bytes(pStmt, iColumn));
+            }
+#endif
+        }
+
+        void GetData(int iColumn, CEStringUtf8& sValue)
+        {
+            GetData(iColumn, sValue, m_pStmt);
+        }
+
+        void GetData(int iColumn, CEStringUtf8& sValue, uint64_t uiHandle)
+        {
+            GetData(iColumn, sValue, (sqlite3_stmt*)uiHandle);
+        }
+
+        // Text as sqlite stores it, no transcoding; NULL gives an empty string
+        void GetData(int iColumn, CEStringUtf8& sValue, sqlite3_stmt* pStmt)
+        {
+            auto pchrText = reinterpret_cast<const char*>(sqlite3_column_text(pStmt, iColumn));
+            if (pchrText)
+            {
+                sValue.Assign(pchrText, sqlite3_column_bytes(pStmt, iColumn));
+            }
+            else
+            {
+                sValue.Erase();
+            }
+        }
+
+        void Finalize()
+        {
+            Finalize(m_pStmt);
+        }
+
+        void Finalize(uint64_t uiHandle)
+        {
+            Finalize((sqlite3_stmt*)uiHandle);
+        }
+
+        void Finalize(sqlite3_stmt* pStmt)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            if (NULL == pStmt)
+            {
+                throw CException(-1, L"No statement handle");
+            }
+
+            auto itCheckedOut = m_stStatementCache.mapCheckedOut.find(pStmt);
+            if (m_stStatementCache.mapCheckedOut.end() != itCheckedOut)
+            {
+                string stl_sSql = std::move(itCheckedOut->second);
+                m_stStatementCache.mapCheckedOut.erase(itCheckedOut);
+                ReturnToCache(pStmt, std::move(stl_sSql));
+                return;
+            }
+
+            FinalizeStatement(pStmt);
+        }
+
+        void Exec(const CEString& sQuery)
+        {
+            ExecUtf8(sQuery.stl_sToUtf8());
+        }
+
+        int64_t llGetLastKey()
+        {
+            return llGetLastKey(m_pStmt);
+        }
+
+        int64_t llGetLastKey(uint64_t uiHandle)
+        {
+            return llGetLastKey((sqlite3_stmt*)uiHandle);
+        }
+
+        int64_t llGetLastKey(sqlite3_stmt* pStmt)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            if (NULL == pStmt)
+            {
+                throw CException(-1, L"No statement handle");
+            }
+
+            return sqlite3_last_insert_rowid(m_spDb_.get());
+        }
+
+        int iGetLastError()
+        {
+            if (NULL == m_spDb_)
+            {
+                return -1;
+            }
+
+            return sqlite3_extended_errcode(m_spDb_.get());
+        }
+
+        void GetLastError(CEString& sError)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            sError = CEString::sFromUtf8(sqlite3_errmsg(m_spDb_.get()));
+            CEString sMsg{ L"Sqlite error: " };
+            sMsg += sError;
+            ERROR_LOG(sMsg);
+        }
+
+        bool bTableExists(const CEString& sTable)
+        {
+            CEString sQuery(L"SELECT name FROM sqlite_master WHERE type='table';");
+            m_pStmt = pPrepare(sQuery);
+
+            int iRet = SQLITE_OK;
+            do
+            {
+                iRet = sqlite3_step(m_pStmt);
+                if (SQLITE_DONE == iRet)
+                {
+                    iRet = sqlite3_reset(m_pStmt);
+                    Finalize();
+                    return false;
+                }
+
+                if (SQLITE_ROW != iRet)
+                {
+                    throw CException(iRet, L"sqlite3_step failed");
+                }
+
+                CEString sCurrent;
+                GetData(0, sCurrent);
+                if (sTable == sCurrent)
+                {
+                    Finalize();
+                    return true;
+                }
+
+            } while (SQLITE_ROW == iRet);
+
+            Finalize();
+            return false;
+
+        }   //  b_TableExists (...)
+
+        bool bTableEmpty(const CEString& sTable)
+        {
+            CEString sQuery(L"SELECT * FROM ");
+            sQuery += sTable;
+            sQuery += L";";
+            m_pStmt = pPrepare(sQuery);
+
+            int iRet = sqlite3_step(m_pStmt);
+            if (SQLITE_DONE == iRet)
+            {
+                Finalize();
+                return false;
+            }
+
+            if (SQLITE_ROW != iRet)
+            {
+                Finalize();
+                throw CException(iRet, L"sqlite3_step failed");
+            }
+
+            Finalize();
+            return true;
+
+        }   //  TableEmpty (...)
+
+        int64_t llRows(const CEString& sTable)
+        {
+            CEString sQuery(L"SELECT COUNT (*) FROM ");
+            sQuery += sTable;
+            sQuery += L";";
+            m_pStmt = pPrepare(sQuery);
+
+            int iRet = sqlite3_step(m_pStmt);
             if (SQLITE_DONE == iRet)
             {
-                iRet = sqlite3_reset(m_pStmt);
+                Finalize();
+                return 0;
+            }
+
+            if (SQLITE_ROW != iRet)
+            {
+                Finalize();
+                throw CException(iRet, L"sqlite3_step failed");
+            }
+
+            int64_t llCount = sqlite3_column_int64(m_pStmt, 0);
+            Finalize();
+            return llCount;
+
+        }   //  llRows (...)
+
+        // Progress delegate invoked from C#/CLR
+        typedef void(*PROGRESS_CALLBACK_CLR) (int iPercentDone, bool bOperationComplete);
+
+        //
+        // With uiThreads > 0 tables, and rowid ranges of large tables, are 
+        // formatted concurrently on read-only connections of their own; the file 
+        // comes out the same. All workers read the state this connection sees 
+        // when the export starts, see CScopedExportSnapshot. The export runs 
+        // serially instead for in-memory databases, inside an open transaction 
+        // (workers could not see its changes) and under WAL when sqlite lacks 
+        // the snapshot API.
+        //
+        bool bExportTables(CEString& sPath, const vector<CEString>& vecTables, PROGRESS_CALLBACK_CLR pProgress, unsigned int uiThreads = 0)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            int64_t llRowsToExport = 0;
+            for (auto& sTable : vecTables)
+            {
+                llRowsToExport += llEstimateRows(sTable);
+            }
+
+            if (llRowsToExport < 1)
+            {
+                // Nothing to export: the file is created empty
+                CExportWriter(sPath).Close();
+                return true;
+            }
+
+            CExportWriter Writer(sPath);
+
+            int iPercentDone = 0;
+            auto fnProgress = [&](int64_t llRowsDone)
+            {
+                int iPd = (int)(((double)llRowsDone / (double)llRowsToExport) * 100);
+                if (iPd > iPercentDone)
+                {
+                    iPercentDone = min(iPd, 100);
+                    pProgress(iPercentDone, false);
+                }
+            };
+
+            CEString sDbPath = sGetDbPath();
+            unique_ptr<CScopedExportSnapshot> spSnapshot;
+            if (uiThreads > 0 && !sDbPath.bIsEmpty() && 0 != sqlite3_get_autocommit(m_spDb_.get()))
+            {
+                spSnapshot = make_unique<CScopedExportSnapshot>(*this);
+            }
+
+            if (spSnapshot && spSnapshot->bPinned())
+            {
+                ExportParallel(sDbPath, vecTables, Writer, uiThreads, *spSnapshot, fnProgress);
+            }
+            else
+            {
+                int64_t llRowsBefore = 0;
+                for (auto& sTable : vecTables)
+                {
+                    llRowsBefore += ExportTable(sTable, Writer, [&](int64_t llRowsDone)
+                    {
+                        fnProgress(llRowsBefore + llRowsDone);
+                    });
+                }
+            }
+
+            Writer.Close();
+
+            pProgress(100, false);
+
+            return true;
+
+        }   //  ExportTables (...)
+
+        //
+        // Note: existing tables will be overwritten
+        //
+        bool bImportTables(CEString& sPath, bool bMerge, PROGRESS_CALLBACK_CLR pProgress, const StImportOptions& stOptions = StImportOptions())
+        {
+            if (nullptr == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            // Set outside of any transaction: journal_mode cannot change inside one
+            CScopedPragma pragmaSynchronous(*this, L"synchronous", stOptions.sSynchronous);
+            CScopedPragma pragmaJournalMode(*this, L"journal_mode", stOptions.sJournalMode);
+            CScopedPragma pragmaCacheSize(*this, L"cache_size", 
+                                          stOptions.iCacheSize != 0 ? CEString::sToString(stOptions.iCacheSize) : CEString());
+
+            CImportReader Reader(sPath);
+            vector<string_view> vecFields;
+            string_view svLine;
+            while (true)
+            {
+                //
+                // Get table name
+                //
+                CEString sTable;
+                while (sTable.bIsEmpty() && Reader.bGetLine(svLine))
+                {
+                    CImportReader::SplitFields(svLine, vecFields);
+                    if (!vecFields.empty())
+                    {
+                        sTable = CEString::sFromUtf8(vecFields[0].data(), vecFields[0].length());
+                    }
+                }
+
+                if (sTable.bIsEmpty())
+                {
+                    break;      // end of file after the terminating line of the last table
+                }
+
+                //
+                // Get table descriptor
+                //
+                vecFields.clear();
+                while (vecFields.empty() && Reader.bGetLine(svLine))
+                {
+                    CImportReader::SplitFields(svLine, vecFields);
+                }
+
+                if (vecFields.empty())
+                {
+                    throw CException(-1, L"Error reading import file header.");
+                }
+
+                CEString sDescriptor;
+                for (auto& svField : vecFields)
+                {
+                    if (!sDescriptor.bIsEmpty())
+                    {
+                        sDescriptor += SZ_SEPARATOR;
+                    }
+                    sDescriptor += CEString::sFromUtf8(svField.data(), svField.length());
+                }
+
+                int iColumns = (int)vecFields.size();
+
+                if (!bMerge)
+                {
+                    bool b_ = bCreateImportTable(sTable, sDescriptor, iColumns);
+                    if (!b_)
+                    {
+                        throw CException(-1, L"Unable to create import table.");
+                    }
+                }
+
+                bool bRet = bImport(Reader, sTable, iColumns, bMerge, pProgress, stOptions.uiRowsPerTransaction, stOptions.uiParseThreads);
+                if (!bRet)
+                {
+                    throw CException(-1, L"Table import failed.");
+                }
+
+            }   //  while (true)
+
+            pProgress(100, false);
+
+            return true;
+
+        }   //  ImportTables (...)
+
+        //
+        // Binary dump, see SqliteDump.h for the format. Values keep their 
+        // sqlite types, each table carries its CREATE TABLE statement and 
+        // the rows travel in compressed, checksummed blocks.
+        //
+        bool bExportBinary(CEString& sPath, const vector<CEString>& vecTables, PROGRESS_CALLBACK_CLR pProgress)
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            int64_t llRowsToExport = 0;
+            for (auto& sTable : vecTables)
+            {
+                llRowsToExport += llEstimateRows(sTable);
+            }
+
+            CExportWriter Writer(sPath, true);
+            string stl_sFileHeader(Dump::cszMagic_);
+            Dump::PutVarint(Dump::cullVersion_, stl_sFileHeader);
+            Writer.Append(stl_sFileHeader.data(), stl_sFileHeader.length());
+
+            int64_t llRowsBefore = 0;
+            int iPercentDone = 0;
+            for (auto& sTable : vecTables)
+            {
+                llRowsBefore += ExportBinaryTable(sTable, Writer, [&](int64_t llRowsDone)
+                {
+                    if (llRowsToExport < 1)
+                    {
+                        return;
+                    }
+                    int iPd = (int)(((double)(llRowsBefore + llRowsDone) / (double)llRowsToExport) * 100);
+                    if (iPd > iPercentDone)
+                    {
+                        iPercentDone = min(iPd, 100);
+                        pProgress(iPercentDone, false);
+                    }
+                });
+            }
+
+            Writer.Close();
+
+            pProgress(100, false);
+
+            return true;
+
+        }   //  bExportBinary (...)
+
+        //
+        // Loads a dump written by bExportBinary(). Unless bMerge is set, 
+        // existing tables are dropped and created again from the dump's schema.
+        //
+        bool bImportBinary(CEString& sPath, bool bMerge, PROGRESS_CALLBACK_CLR pProgress, const StImportOptions& stOptions = StImportOptions())
+        {
+            if (NULL == m_spDb_)
+            {
+                throw CException(-1, L"No DB handle");
+            }
+
+            CScopedPragma pragmaSynchronous(*this, L"synchronous", stOptions.sSynchronous);
+            CScopedPragma pragmaJournalMode(*this, L"journal_mode", stOptions.sJournalMode);
+            CScopedPragma pragmaCacheSize(*this, L"cache_size", 
+                                          stOptions.iCacheSize != 0 ? CEString::sToString(stOptions.iCacheSize) : CEString());
+
+            CDumpReader Reader(sPath);
+
+            string stl_sMagic;
+            Reader.Read(stl_sMagic, strlen(Dump::cszMagic_));
+            if (stl_sMagic != Dump::cszMagic_)
+            {
+                throw CException(-1, L"Not a binary dump.");
+            }
+            if (Reader.ullReadVarint() != Dump::cullVersion_)
+            {
+                throw CException(-1, L"Unsupported binary dump version.");
+            }
+
+            int iPercentDone = 0;
+            unsigned char chrRecord = 0;
+            while (Reader.bReadByte(chrRecord))
+            {
+                if (Dump::ecTable != chrRecord)
+                {
+                    throw CException(-1, L"Binary dump: table header expected.");
+                }
+                ImportBinaryTable(Reader, bMerge, stOptions.uiRowsPerTransaction, [&]()
+                {
+                    if (Reader.ullFileSize() > 0)
+                    {
+                        int iPd = (int)(((double)Reader.ullConsumed() / (double)Reader.ullFileSize()) * 100);
+                        if (iPd > iPercentDone)
+                        {
+                            iPercentDone = min(iPd, 100);
+                            pProgress(iPercentDone, false);
+                        }
+                    }
+                });
+            }
+
+            pProgress(100, false);
+
+            return true;
+
+        }   //  bImportBinary (...)
+
+        //
+        //  Helpers
+        //
+
+        //
+        // Lowest and highest rowid, one b-tree descent each. False for tables 
+        // without a rowid; llLast < llFirst for an empty table.
+        //
+        bool bGetRowidRange(const CEString& sTable, int64_t& llFirst, int64_t& llLast)
+        {
+            CEString sQuery(L"SELECT min(rowid), max(rowid) FROM ");
+            sQuery += sTable;
+            string stl_sQuery = sQuery.stl_sToUtf8();
+
+            sqlite3_stmt* pStmt = NULL;
+            if (SQLITE_OK != sqlite3_prepare_v2(m_spDb_.get(), stl_sQuery.c_str(), (int)stl_sQuery.length() + 1, &pStmt, NULL))
+            {
+                FinalizeStatement(pStmt);
                 return false;
             }
 
-            if (SQLITE_ROW != iRet)
+            llFirst = 0;
+            llLast = -1;
+            if (SQLITE_ROW == sqlite3_step(pStmt) && SQLITE_NULL != sqlite3_column_type(pStmt, 0))
             {
-                throw CException(iRet, L"sqlite3_step failed");
+                llFirst = sqlite3_column_int64(pStmt, 0);
+                llLast = sqlite3_column_int64(pStmt, 1);
+            }
+            FinalizeStatement(pStmt);
+
+            return true;
+
+        }   //  bGetRowidRange (...)
+
+        //
+        // Row count for progress reporting, taken from the rowid range rather 
+        // than a COUNT(*) scan. Exact unless rows were deleted, 0 only for an 
+        // empty table. Tables without a rowid are counted.
+        //
+        int64_t llEstimateRows(const CEString& sTable)
+        {
+            int64_t llFirst = 0, llLast = -1;
+            if (!bGetRowidRange(sTable, llFirst, llLast))
+            {
+                return llRows(sTable);
+            }
+
+            if (llLast < llFirst)
+            {
+                return 0;
+            }
+
+            uint64_t ullSpan = (uint64_t)llLast - (uint64_t)llFirst;
+            return (int64_t)min(ullSpan, (uint64_t)INT64_MAX - 1) + 1;
+
+        }   //  llEstimateRows (...)
+
+        // SELECT * returns rowid order unless the planner picks a covering index
+        bool bScansInRowidOrder(const CEString& sTable)
+        {
+            CEString sQuery(L"EXPLAIN QUERY PLAN SELECT * FROM ");
+            sQuery += sTable;
+            sqlite3_stmt* pStmt = pPrepare(sQuery, false);
+
+            bool bRowidOrder = true;
+            while (SQLITE_ROW == sqlite3_step(pStmt))
+            {
+                const char* szDetail = (const char*)sqlite3_column_text(pStmt, 3);
+                if (szDetail && strstr(szDetail, "INDEX"))
+                {
+                    bRowidOrder = false;
+                }
+            }
+            FinalizeStatement(pStmt);
+
+            return bRowidOrder;
+        }
+
+        //
+        // Part of a table for a parallel export: all of it or a rowid range,
+        // with the table name and header in front of the first part and the 
+        // empty line after the last one
+        //
+        struct StExportUnit
+        {
+            size_t uiTable { 0 };
+            bool bHead { true };
+            bool bTail { true };
+            bool bRowidRange { false };
+            int64_t llFirstRowid { 0 };
+            int64_t llLastRowid { 0 };
+        };
+
+        static constexpr int64_t cllExportUnitRows_ = 1 << 16;
+        static constexpr uint64_t cullMaxExportUnitsPerTable_ = 1024;
+
+        // Splits large tables scanned in rowid order into rowid ranges
+        vector<StExportUnit> vecPlanExport(const vector<CEString>& vecTables)
+        {
+            vector<StExportUnit> vecUnits;
+            for (size_t uiTable = 0; uiTable < vecTables.size(); ++uiTable)
+            {
+                StExportUnit stUnit;
+                stUnit.uiTable = uiTable;
+
+                int64_t llFirst = 0, llLast = -1;
+                if (!bGetRowidRange(vecTables[uiTable], llFirst, llLast) || llLast - llFirst < cllExportUnitRows_ 
+                    || !bScansInRowidOrder(vecTables[uiTable]))
+                {
+                    vecUnits.push_back(stUnit);
+                    continue;
+                }
+
+                uint64_t ullSpan = (uint64_t)llLast - (uint64_t)llFirst;
+                uint64_t ullStep = max((uint64_t)cllExportUnitRows_, ullSpan / cullMaxExportUnitsPerTable_ + 1);
+                stUnit.bRowidRange = true;
+                for (uint64_t ullOffset = 0; ullOffset <= ullSpan; ullOffset += ullStep)
+                {
+                    stUnit.bHead = (0 == ullOffset);
+                    stUnit.bTail = (ullSpan - ullOffset < ullStep);
+                    stUnit.llFirstRowid = (int64_t)((uint64_t)llFirst + ullOffset);
+                    stUnit.llLastRowid = stUnit.bTail ? llLast : (int64_t)((uint64_t)stUnit.llFirstRowid + ullStep - 1);
+                    vecUnits.push_back(stUnit);
+                    if (stUnit.bTail)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            return vecUnits;
+
+        }   //  vecPlanExport (...)
+
+        //
+        // Workers each open a read-only connection and format units into 
+        // memory; this thread writes them out in order. Workers stay at most 
+        // 2 * uiThreads units ahead of the writer.
+        //
+        void ExportParallel(const CEString& sDbPath, const vector<CEString>& vecTables, CExportWriter& Writer, 
+                            unsigned int uiThreads, const CScopedExportSnapshot& Snapshot, const function<void(int64_t)>& fnProgress)
+        {
+            vector<StExportUnit> vecUnits = vecPlanExport(vecTables);
+            vector<promise<pair<string, int64_t>>> vecResults(vecUnits.size());     // text and row count per unit
+            size_t uiMaxAhead = 2 * (size_t)uiThreads;
+
+            mutex Mutex;
+            condition_variable cvProgress;
+            size_t uiNextUnit = 0;
+            size_t uiWritten = 0;
+            bool bAbort = false;
+
+            auto fnClaim = [&](size_t& uiUnit)
+            {
+                unique_lock<mutex> lock(Mutex);
+                cvProgress.wait(lock, [&]() { return bAbort || uiNextUnit >= vecUnits.size() || uiNextUnit < uiWritten + uiMaxAhead; });
+                if (bAbort || uiNextUnit >= vecUnits.size())
+                {
+                    return false;
+                }
+                uiUnit = uiNextUnit++;
+                return true;
+            };
+
+            auto fnWork = [&]()
+            {
+                unique_ptr<CSqlite> spDb;
+                exception_ptr spOpenError;
+                try
+                {
+                    spDb = make_unique<CSqlite>(sDbPath, ecOpenReadOnly);
+                    spDb->SetBusyTimeout(ciExportBusyTimeoutMs_);
+                    spDb->BeginTransaction();       // one snapshot for all units of this worker
+                    Snapshot.Open(*spDb);
+                }
+                catch (...)
+                {
+                    spOpenError = current_exception();
+                }
+
+                size_t uiUnit = 0;
+                while (fnClaim(uiUnit))
+                {
+                    if (spOpenError)
+                    {
+                        vecResults[uiUnit].set_exception(spOpenError);     // surfaces in the writer
+                        return;
+                    }
+
+                    try
+                    {
+                        CExportWriter Chunk;
+                        const StExportUnit& stUnit = vecUnits[uiUnit];
+                        int64_t llRows = spDb->ExportUnit(vecTables[stUnit.uiTable], stUnit, Chunk, [](int64_t) {});
+                        vecResults[uiUnit].set_value(make_pair(Chunk.stl_sTake(), llRows));
+                    }
+                    catch (...)
+                    {
+                        vecResults[uiUnit].set_exception(current_exception());
+                    }
+                }
+
+                if (spDb)
+                {
+                    try
+                    {
+                        spDb->CommitTransaction();
+                    }
+                    catch (...)
+                    {}
+                }
+            };
+
+            vector<thread> vecThreads;
+
+            // Stops the workers and joins them on every way out
+            struct StJoiner
+            {
+                mutex& Mutex;
+                condition_variable& cvProgress;
+                bool& bAbort;
+                vector<thread>& vecThreads;
+                ~StJoiner()
+                {
+                    {
+                        lock_guard<mutex> lock(Mutex);
+                        bAbort = true;
+                    }
+                    cvProgress.notify_all();
+                    for (auto& Thread : vecThreads)
+                    {
+                        Thread.join();
+                    }
+                }
+            } stJoiner { Mutex, cvProgress, bAbort, vecThreads };
+
+            for (unsigned int uiThread = 0; uiThread < uiThreads; ++uiThread)
+            {
+                vecThreads.emplace_back(fnWork);
+            }
+
+            int64_t llRowsDone = 0;
+            for (size_t uiUnit = 0; uiUnit < vecUnits.size(); ++uiUnit)
+            {
+                auto pairResult = vecResults[uiUnit].get_future().get();
+                Writer.Append(pairResult.first.data(), pairResult.first.length());
+                llRowsDone += pairResult.second;
+                fnProgress(llRowsDone);
+
+                {
+                    lock_guard<mutex> lock(Mutex);
+                    ++uiWritten;
+                }
+                cvProgress.notify_all();
             }
 
-            return true;
+        }   //  ExportParallel (...)
 
-        }   //  TableEmpty (...)
+        //
+        // Writes one table in the export format: its name, a header with the 
+        // column names, one SZ_SEPARATOR-delimited line per row and an empty 
+        // line. Column text goes from sqlite to the writer without conversion.
+        // Returns the number of rows; fnProgress gets the running count.
+        //
+        int64_t ExportTable(const CEString& sTable, CExportWriter& Writer, const function<void(int64_t)>& fnProgress)
+        {
+            return ExportUnit(sTable, StExportUnit(), Writer, fnProgress);
+        }
 
-        int64_t llRows(const CEString& sTable)
+        int64_t ExportUnit(const CEString& sTable, const StExportUnit& stUnit, CExportWriter& Writer, const function<void(int64_t)>& fnProgress)
         {
-            CEString sQuery(L"SELECT COUNT (*) FROM ");
+            static constexpr int64_t cllProgressInterval = 4096;
+
+            CEString sQuery(L"SELECT * FROM ");
             sQuery += sTable;
+            if (stUnit.bRowidRange)
+            {
+                sQuery += L" WHERE rowid BETWEEN ? AND ?";
+            }
             sQuery += L";";
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sQuery, -1, &m_pStmt, NULL);
-            if (SQLITE_OK != iRet)
+            CStatement stSelect = Prepare(sQuery);
+            sqlite3_stmt* pStmt = stSelect;
+            if (stUnit.bRowidRange)
             {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                Bind(1, stUnit.llFirstRowid, pStmt);
+                Bind(2, stUnit.llLastRowid, pStmt);
             }
 
-            iRet = sqlite3_step(m_pStmt);
-            if (SQLITE_DONE == iRet)
+            int iColumns = sqlite3_column_count(pStmt);
+            if (stUnit.bHead)
             {
-                iRet = sqlite3_reset(m_pStmt);
-                return 0;
+                string stl_sName = sTable.stl_sToUtf8();
+                Writer.Append(stl_sName.data(), stl_sName.length());
+                Writer.Append('\n');
+
+                for (int iCol = 0; iCol < iColumns; ++iCol)
+                {
+                    if (iCol > 0)
+                    {
+                        Writer.Append('|');     // SZ_SEPARATOR
+                    }
+                    const char* szName = sqlite3_column_name(pStmt, iCol);
+                    Writer.Append(szName, strlen(szName));
+                }
+                Writer.Append('\n');
             }
 
-            if (SQLITE_ROW != iRet)
+            int64_t llRow = 0;
+            while (bGetRow(pStmt))
             {
-                throw CException(iRet, L"sqlite3_step failed");
+                // As before, a separator is only written once the line has 
+                // something in it, so leading empty columns leave no trace
+                bool bLineStarted = false;
+                for (int iCol = 0; iCol < iColumns; ++iCol)
+                {
+                    const char* pchrText = (const char*)sqlite3_column_text(pStmt, iCol);
+                    int iBytes = sqlite3_column_bytes(pStmt, iCol);
+                    if (bLineStarted)
+                    {
+                        Writer.Append('|');
+                    }
+                    if (pchrText && iBytes > 0)
+                    {
+                        Writer.Append(pchrText, iBytes);
+                        bLineStarted = true;
+                    }
+                }
+                Writer.Append('\n');
+
+                if (0 == (++llRow % cllProgressInterval))
+                {
+                    fnProgress(llRow);
+                }
             }
+            fnProgress(llRow);
 
-            return sqlite3_column_int64(m_pStmt, 0);
+            if (stUnit.bTail)
+            {
+                Writer.Append('\n');
+            }
 
-        }   //  llRows (...)
+            return llRow;
 
-        // Progress delegate invoked from C#/CLR
-        typedef void(*PROGRESS_CALLBACK_CLR) (int iPercentDone, bool bOperationComplete);
+        }   //  ExportUnit (...)
+
+        static constexpr uint64_t cullMaxDumpBlockBytes_ = 1ULL << 31;
 
-        bool bExportTables(CEString& sPath, const vector<CEString>& vecTables, PROGRESS_CALLBACK_CLR pProgress)
+        int64_t ExportBinaryTable(const CEString& sTable, CExportWriter& Writer, const function<void(int64_t)>& fnProgress)
         {
-            if (NULL == m_spDb_)
-            {
-                throw CException(-1, L"No DB handle");
-            }
+            static constexpr size_t cuiMaxBlockBytes = 1 << 20;
 
-            auto ioOutStream = fopen(sPath.stl_sToUtf8().c_str(), "w");
-            if (!ioOutStream)
+            // Schema
+            string stl_sSchema;
             {
-                throw CException(-1, L"Unable to open export file.");
+                CStatement stSchema = Prepare(L"SELECT sql FROM sqlite_master WHERE type='table' AND name=?;");
+                Bind(1, sTable, stSchema);
+                if (bGetRow(stSchema))
+                {
+                    const char* szSql = (const char*)sqlite3_column_text(stSchema, 0);
+                    stl_sSchema = szSql ? szSql : "";
+                }
             }
 
-            vector<CEString>::const_iterator itTable = vecTables.begin();
-
-            int64_t llRowsToExport = 0;
-            for (itTable = vecTables.begin();
-                itTable != vecTables.end();
-                ++itTable)
+            CEString sQuery(L"SELECT * FROM ");
+            sQuery += sTable;
+            sQuery += L";";
+            CStatement stSelect = Prepare(sQuery);
+            sqlite3_stmt* pStmt = stSelect;
+            int iColumns = sqlite3_column_count(pStmt);
+
+            // Table header
+            string stl_sHeader;
+            string stl_sName = sTable.stl_sToUtf8();
+            Dump::PutVarint(stl_sName.length(), stl_sHeader);
+            stl_sHeader += stl_sName;
+            Dump::PutVarint(stl_sSchema.length(), stl_sHeader);
+            stl_sHeader += stl_sSchema;
+            Dump::PutVarint(iColumns, stl_sHeader);
+            for (int iCol = 0; iCol < iColumns; ++iCol)
             {
-                llRowsToExport += llRows(*itTable);
+                const char* szName = sqlite3_column_name(pStmt, iCol);
+                Dump::PutVarint(strlen(szName), stl_sHeader);
+                stl_sHeader += szName;
             }
 
-            if (llRowsToExport < 1)
-            {
-                return true;
-            }
+            string stl_sRecord(1, (char)Dump::ecTable);
+            Dump::PutVarint(stl_sHeader.length(), stl_sRecord);
+            stl_sRecord += stl_sHeader;
+            Dump::PutFixed32(Dump::uiCrc32(stl_sHeader.data(), stl_sHeader.length()), stl_sRecord);
+            Writer.Append(stl_sRecord.data(), stl_sRecord.length());
 
-            int64_t llRow = 0;
+            // Rows, one column after another within a block
+            vector<string> vecColumns(iColumns);
+            string stl_sRaw;
+            string stl_sCompressed;
+            unsigned int uiRowsInBlock = 0;
+            size_t uiBlockBytes = 0;
+            int64_t llRows = 0;
 
-            for (vector<CEString>::const_iterator itTable = vecTables.begin();
-                itTable != vecTables.end();
-                ++itTable)
+            auto fnFlushBlock = [&]()
             {
-                CEString sQuery(L"SELECT * FROM ");
-                //            str_query += sTable;
-                sQuery += *itTable;
-                sQuery += L";";
-
-                sqlite3_stmt* pStmt = NULL;
-                int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sQuery, -1, &pStmt, NULL);
-                if (SQLITE_OK != iRet)
+                if (0 == uiRowsInBlock)
                 {
-                    throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                    return;
                 }
 
-                CEString sTableName(*itTable);
-                sTableName += L"\n";
-                iRet = fputs(sTableName.stl_sToUtf8().c_str(), ioOutStream);
-                if (iRet < 0)
+                stl_sRaw.clear();
+                for (auto& stl_sColumn : vecColumns)
                 {
-                    ERROR_LOG(L"Error writing export table name. \n");
+                    stl_sRaw += stl_sColumn;
+                    stl_sColumn.clear();
                 }
 
-                CEString sHeader;
-                int iColumns = sqlite3_column_count(pStmt);
-                for (int iColName = 0; iColName < iColumns; ++iColName)
-                {
-                    sHeader += (wchar_t*)sqlite3_column_name16(pStmt, iColName);
-                    if (iColName < iColumns - 1)
-                    {
-                        sHeader += SZ_SEPARATOR;
-                    }
-                }
-                sHeader += L"\n";
+                stl_sCompressed.clear();
+                Dump::LzCompress(stl_sRaw.data(), stl_sRaw.length(), stl_sCompressed);
+                bool bCompressed = stl_sCompressed.length() < stl_sRaw.length();
+                const string& stl_sStored = bCompressed ? stl_sCompressed : stl_sRaw;
 
-                iRet = fputs(sHeader.stl_sToUtf8().c_str(), ioOutStream);
-                if (iRet < 0)
-                {
-                    ERROR_LOG(L"Error writing export table header. \n");
-                }
+                stl_sRecord.assign(1, (char)Dump::ecBlock);
+                Dump::PutVarint(uiRowsInBlock, stl_sRecord);
+                stl_sRecord.push_back((char)(bCompressed ? Dump::ecLz : Dump::ecStored));
+                Dump::PutVarint(stl_sRaw.length(), stl_sRecord);
+                Dump::PutVarint(stl_sStored.length(), stl_sRecord);
+                Dump::PutFixed32(Dump::uiCrc32(stl_sRaw.data(), stl_sRaw.length()), stl_sRecord);
+                Writer.Append(stl_sRecord.data(), stl_sRecord.length());
+                Writer.Append(stl_sStored.data(), stl_sStored.length());
+
+                uiRowsInBlock = 0;
+                uiBlockBytes = 0;
+                fnProgress(llRows);
+            };
 
-                int iPercentDone = 0;
-                while (bGetRow(pStmt))
+            while (bGetRow(pStmt))
+            {
+                for (int iCol = 0; iCol < iColumns; ++iCol)
                 {
-                    CEString sOut;
-                    for (int iCol = 0; iCol < iColumns; ++iCol)
+                    string& stl_sColumn = vecColumns[iCol];
+                    size_t uiBefore = stl_sColumn.length();
+                    switch (sqlite3_column_type(pStmt, iCol))
                     {
-                        CEString sCol;
-                        GetData(iCol, sCol, pStmt);
-                        if (sOut.uiLength() > 0)
+                        case SQLITE_INTEGER:
+                            stl_sColumn.push_back((char)Dump::ecInteger);
+                            Dump::PutVarint(Dump::ullZigZag(sqlite3_column_int64(pStmt, iCol)), stl_sColumn);
+                            break;
+
+                        case SQLITE_FLOAT:
+                            stl_sColumn.push_back((char)Dump::ecReal);
+                            Dump::PutDouble(sqlite3_column_double(pStmt, iCol), stl_sColumn);
+                            break;
+
+                        case SQLITE_TEXT:
                         {
-                            sOut += SZ_SEPARATOR;
+                            const char* pchrText = (const char*)sqlite3_column_text(pStmt, iCol);
+                            int iBytes = sqlite3_column_bytes(pStmt, iCol);
+                            stl_sColumn.push_back((char)Dump::ecText);
+                            Dump::PutVarint(iBytes, stl_sColumn);
+                            stl_sColumn.append(pchrText, iBytes);
+                            break;
                         }
-                        sOut += sCol;
-                    }
-                    sOut += L"\n";
 
-                    iRet = fputs(sOut.stl_sToUtf8().c_str(), ioOutStream);
-                    if (iRet < 0)
-                    {
-                        throw CException(iRet, L"Error writing export table.");
-                    }
+                        case SQLITE_BLOB:
+                        {
+                            const char* pchrBlob = (const char*)sqlite3_column_blob(pStmt, iCol);
+                            int iBytes = sqlite3_column_bytes(pStmt, iCol);
+                            stl_sColumn.push_back((char)Dump::ecBlob);
+                            Dump::PutVarint(iBytes, stl_sColumn);
+                            stl_sColumn.append(pchrBlob ? pchrBlob : "", iBytes);
+                            break;
+                        }
 
-                    int iPd = (int)(((double)llRow / (double)llRowsToExport) * 100);
-                    if (iPd > iPercentDone)
-                    {
-                        iPercentDone = min(iPd, 100);
-                        pProgress(iPercentDone, false);
+                        default:
+                            stl_sColumn.push_back((char)Dump::ecNull);
                     }
+                    uiBlockBytes += stl_sColumn.length() - uiBefore;
+                }
 
-                    ++llRow;
-
-                }       //  while (...)
-
-                iRet = fputs("\n", ioOutStream);
-                if (iRet < 0)
+                ++llRows;
+                if (++uiRowsInBlock >= Dump::cuiRowsPerBlock_ || uiBlockBytes >= cuiMaxBlockBytes)
                 {
-                    ERROR_LOG(L"Error writing terminating line. \n");
+                    fnFlushBlock();
                 }
+            }
+            fnFlushBlock();
 
-            }   //  for (vector<CEString> ...
+            Writer.Append((char)Dump::ecEndOfTable);
 
-            fclose(ioOutStream);
+            return llRows;
 
-            pProgress(100, false);
+        }   //  ExportBinaryTable (...)
 
-            return true;
+        void ExecUtf8(const string& stl_sSql)
+        {
+            int iRet = sqlite3_exec(m_spDb_.get(), stl_sSql.c_str(), NULL, NULL, NULL);
+            if (SQLITE_OK != iRet)
+            {
+                CEString sErrTxt;
+                GetLastError(sErrTxt);
+                CEString sMsg(L"sqlite3_exec failed: ");
+                sMsg += sErrTxt;
+                throw CException(iRet, sMsg);
+            }
+        }
 
-        }   //  ExportTables (...)
+        // "name" with embedded quotes doubled, for names that come from a dump
+        static string stl_sQuoteIdentifier(const string& stl_sName)
+        {
+            string stl_sQuoted("\"");
+            for (char chr : stl_sName)
+            {
+                stl_sQuoted += chr;
+                if ('"' == chr)
+                {
+                    stl_sQuoted += '"';
+                }
+            }
+            return stl_sQuoted + '"';
+        }
 
         //
-        // Note: existing tables will be overwritten
+        // Lets the schema from a dump compile only into a CREATE TABLE of the 
+        // dump's table in the main database, along with the indices behind its 
+        // PRIMARY KEY and UNIQUE constraints and sqlite_sequence for 
+        // AUTOINCREMENT. Everything else, e.g. ATTACH, a view, a trigger or 
+        // CREATE TABLE ... AS SELECT, is denied.
         //
-        bool bImportTables(CEString& sPath, bool bMerge, PROGRESS_CALLBACK_CLR pProgress)
+        static int iAuthorizeDumpSchema(void* pTable, int iAction, const char* szArg1, const char* szArg2, const char* szDb, const char*)
         {
-            if (nullptr == m_spDb_)
+            const string& stl_sTable = *(const string*)pTable;
+            if (nullptr == szDb || 0 != sqlite3_stricmp(szDb, "main"))
             {
-                throw CException(-1, L"No DB handle");
+                return SQLITE_DENY;
             }
 
-            auto ioInStream = fopen(sPath.stl_sToUtf8().c_str(), "r");
-            if (!ioInStream)
+            auto bIs = [](const char* szName, const char* szExpected)
             {
-                throw CException(-1, L"Unable to open import file.");
+                return nullptr != szName && 0 == sqlite3_stricmp(szName, szExpected);
+            };
+            bool bSchemaTable = bIs(szArg1, "sqlite_master") || bIs(szArg1, "sqlite_schema");
+
+            switch (iAction)
+            {
+                case SQLITE_CREATE_TABLE:
+                    return (bIs(szArg1, stl_sTable.c_str()) || bIs(szArg1, "sqlite_sequence")) ? SQLITE_OK : SQLITE_DENY;
+
+                case SQLITE_CREATE_INDEX:
+                    return bIs(szArg2, stl_sTable.c_str()) ? SQLITE_OK : SQLITE_DENY;
+
+                case SQLITE_INSERT:
+                case SQLITE_UPDATE:
+                    return bSchemaTable ? SQLITE_OK : SQLITE_DENY;
+
+                case SQLITE_READ:
+                    return (bSchemaTable || bIs(szArg1, stl_sTable.c_str())) ? SQLITE_OK : SQLITE_DENY;
+
+                default:
+                    return SQLITE_DENY;
             }
+        }
 
-            int iCharsRead = 0;
-            //            int iPercentDone = 0;
-                //        int iEntriesRead = 0;
+        // Runs a dump's CREATE TABLE statement; the dump file is not trusted
+        void CreateDumpTable(const string& stl_sTable, const string& stl_sSchema)
+        {
+            sqlite3_stmt* pStmt = nullptr;
+            const char* pchrTail = nullptr;
+            sqlite3_set_authorizer(m_spDb_.get(), iAuthorizeDumpSchema, (void*)&stl_sTable);
+            int iRet = sqlite3_prepare_v2(m_spDb_.get(), stl_sSchema.c_str(), (int)stl_sSchema.length(), &pStmt, &pchrTail);
+            sqlite3_set_authorizer(m_spDb_.get(), nullptr, nullptr);
+            if (SQLITE_OK != iRet || nullptr == pStmt)
+            {
+                FinalizeStatement(pStmt);
+                throw CException(-1, L"Binary dump: table schema is not a CREATE TABLE of the dumped table.");
+            }
 
-            char szLineBuf[10000] { 0 };
-            while (!feof(ioInStream))
+            for (const char* pchrAt = pchrTail; pchrAt < stl_sSchema.data() + stl_sSchema.length(); ++pchrAt)
             {
-                //
-                // Get table name
-                //
-                CEString sTable;
-                while (!feof(ioInStream) && sTable.bIsEmpty())
+                if (!isspace((unsigned char)*pchrAt))
                 {
-                    char* szRet = fgets(szLineBuf, 10000, ioInStream);
-                    if (nullptr == szRet)
-                    {
-                        throw CException(-1, L"Error reading table name.");
-                    }
-                    else
-                    {
-                        sTable = CEString::sFromUtf8(szLineBuf);
-                    }
+                    FinalizeStatement(pStmt);
+                    throw CException(-1, L"Binary dump: table schema holds more than one statement.");
                 }
+            }
 
-                if (feof(ioInStream))
-                {
-                    continue;
-                }
+            iRet = sqlite3_step(pStmt);
+            FinalizeStatement(pStmt);
+            if (SQLITE_DONE != iRet)
+            {
+                throw CException(iRet, L"Binary dump: unable to create table.");
+            }
+        }
 
-                if (sTable.bIsEmpty())
+        // Reads one table from just after its 'T' through its 'E'
+        void ImportBinaryTable(CDumpReader& Reader, bool bMerge, unsigned int uiRowsPerTransaction, const function<void()>& fnProgress)
+        {
+            string stl_sHeader;
+            Reader.Read(stl_sHeader, Reader.ullReadVarint());
+            string stl_sCrc;
+            Reader.Read(stl_sCrc, 4);
+            if (Dump::uiGetFixed32((const unsigned char*)stl_sCrc.data()) != Dump::uiCrc32(stl_sHeader.data(), stl_sHeader.length()))
+            {
+                throw CException(-1, L"Binary dump: table header checksum mismatch.");
+            }
+
+            const unsigned char* pchrAt = (const unsigned char*)stl_sHeader.data();
+            const unsigned char* pchrEnd = pchrAt + stl_sHeader.length();
+            auto fnGetString = [&](string& stl_sOut)
+            {
+                uint64_t ullLength = 0;
+                if (!Dump::bGetVarint(pchrAt, pchrEnd, ullLength) || ullLength > (uint64_t)(pchrEnd - pchrAt))
                 {
-                    assert(0);
-                    throw CException(-1, L"Empty table name.");
+                    throw CException(-1, L"Binary dump: malformed table header.");
                 }
+                stl_sOut.assign((const char*)pchrAt, (size_t)ullLength);
+                pchrAt += ullLength;
+            };
+
+            string stl_sTable, stl_sSchema;
+            fnGetString(stl_sTable);
+            fnGetString(stl_sSchema);
+            uint64_t ullColumns = 0;
+            if (!Dump::bGetVarint(pchrAt, pchrEnd, ullColumns) || 0 == ullColumns || ullColumns > (uint64_t)(pchrEnd - pchrAt))
+            {
+                throw CException(-1, L"Binary dump: malformed table header.");
+            }
+            int iColumns = (int)ullColumns;
+            vector<string> vecNames(iColumns);
+            for (auto& stl_sName : vecNames)
+            {
+                fnGetString(stl_sName);
+            }
 
-                sTable.Trim(L"\n ");
+            // Also takes back the DROP if the dump's schema is refused
+            CScopedTransaction Transaction(*this);
 
-                //
-                // Get table descriptor
-                //
-                //char szLineBuf[10000]{ 0 };
-                CEString sDescriptor;
-                while (!feof(ioInStream) && sDescriptor.bIsEmpty())
+            if (!bMerge)
+            {
+                ExecUtf8("DROP TABLE IF EXISTS " + stl_sQuoteIdentifier(stl_sTable) + ";");
+                if (stl_sSchema.empty())
                 {
-                    char * szRet = fgets(szLineBuf, 10000, ioInStream);
-                    if (nullptr == szRet)
-                    {
-                        throw CException(-1, L"Error reading import file header.");
-                    }
-                    else
+                    string stl_sCreate = "CREATE TABLE " + stl_sQuoteIdentifier(stl_sTable) + " (";
+                    for (int iCol = 0; iCol < iColumns; ++iCol)
                     {
-                        sDescriptor = CEString::sFromUtf8(szLineBuf);
+                        stl_sCreate += (iCol > 0) ? ", " : "";
+                        stl_sCreate += stl_sQuoteIdentifier(vecNames[iCol]);
                     }
+                    stl_sSchema = stl_sCreate + ");";
                 }
+                CreateDumpTable(stl_sTable, stl_sSchema);
+            }
 
-                sDescriptor.Trim(L"\n ");
+            CEString sStmt = L"INSERT INTO ";
+            sStmt += CEString::sFromUtf8(stl_sQuoteIdentifier(stl_sTable));
+            sStmt += L" VALUES (";
+            for (int iCol = 0; iCol < iColumns; ++iCol)
+            {
+                sStmt += (iCol > 0) ? L",?" : L"?";
+            }
+            sStmt += L")";
+            CStatement stInsert = Prepare(sStmt);
+            sqlite3_stmt* pStmt = stInsert;
+
+            struct StValue
+            {
+                unsigned char chrType;
+                int64_t llValue;
+                double dValue;
+                const char* pchrData;
+                size_t uiBytes;
+            };
+            vector<StValue> vecValues;
+            string stl_sStored;
+            vector<unsigned char> vecRaw;
+            unsigned int uiRowsInTransaction = 0;
+
+            unsigned char chrRecord = 0;
+            while (true)
+            {
+                if (!Reader.bReadByte(chrRecord))
+                {
+                    throw CException(-1, L"Truncated binary dump.");
+                }
+                if (Dump::ecEndOfTable == chrRecord)
+                {
+                    break;
+                }
+                if (Dump::ecBlock != chrRecord)
+                {
+                    throw CException(-1, L"Binary dump: data block expected.");
+                }
 
-                if (feof(ioInStream))
+                uint64_t ullRows = Reader.ullReadVarint();
+                unsigned char chrMethod = 0;
+                if (!Reader.bReadByte(chrMethod))
                 {
-                    continue;
+                    throw CException(-1, L"Truncated binary dump.");
                 }
+                uint64_t ullRawBytes = Reader.ullReadVarint();
+                uint64_t ullStoredBytes = Reader.ullReadVarint();
+                Reader.Read(stl_sCrc, 4);
+                Reader.Read(stl_sStored, ullStoredBytes);
 
-                if (sDescriptor.bIsEmpty())
+                // Every value takes at least its type byte
+                if (ullRawBytes > cullMaxDumpBlockBytes_ || ullRows > ullRawBytes || ullRows * ullColumns > ullRawBytes)
                 {
-                    assert(0);
-                    throw CException(-1, L"Empty table descriptor.");
+                    throw CException(-1, L"Binary dump: malformed block.");
                 }
 
-                CEString sSeparators(SZ_SEPARATOR);
-                sSeparators += L", \n";
-                CEString sHeader(sDescriptor);
-                sHeader.ResetSeparators();
-                sHeader.SetBreakChars(sSeparators);
-                if (sHeader.uiGetNumOfFields() < 1)
+                const unsigned char* pchrRaw = (const unsigned char*)stl_sStored.data();
+                if (Dump::ecLz == chrMethod)
+                {
+                    vecRaw.resize((size_t)ullRawBytes);
+                    if (!Dump::bLzDecompress(stl_sStored.data(), stl_sStored.length(), vecRaw.data(), vecRaw.size()))
+                    {
+                        throw CException(-1, L"Binary dump: corrupt block.");
+                    }
+                    pchrRaw = vecRaw.data();
+                }
+                else if (Dump::ecStored != chrMethod || ullStoredBytes != ullRawBytes)
                 {
-                    throw CException(-1, L"Parsing error: no fields.");
+                    throw CException(-1, L"Binary dump: malformed block.");
                 }
 
-                int iColumns = sHeader.uiNFields();
+                if (Dump::uiGetFixed32((const unsigned char*)stl_sCrc.data()) != Dump::uiCrc32(pchrRaw, (size_t)ullRawBytes))
+                {
+                    throw CException(-1, L"Binary dump: block checksum mismatch.");
+                }
 
-                if (!bMerge)
+                // Columns follow one another; values of row r sit at r, rows + r, ...
+                size_t uiRows = (size_t)ullRows;
+                vecValues.resize(uiRows * iColumns);
+                const unsigned char* pchrValue = pchrRaw;
+                const unsigned char* pchrRawEnd = pchrRaw + ullRawBytes;
+                for (size_t uiValue = 0; uiValue < vecValues.size(); ++uiValue)
                 {
-                    bool b_ = bCreateImportTable(sTable, sDescriptor, iColumns);
-                    if (!b_)
+                    StValue& stValue = vecValues[uiValue];
+                    if (pchrValue >= pchrRawEnd)
                     {
-                        throw CException(-1, L"Unable to create import table.");
+                        throw CException(-1, L"Binary dump: malformed block.");
+                    }
+                    stValue.chrType = *pchrValue++;
+                    uint64_t ullValue = 0;
+                    switch (stValue.chrType)
+                    {
+                        case Dump::ecNull:
+                            break;
+
+                        case Dump::ecInteger:
+                            if (!Dump::bGetVarint(pchrValue, pchrRawEnd, ullValue))
+                            {
+                                throw CException(-1, L"Binary dump: malformed block.");
+                            }
+                            stValue.llValue = Dump::llUnZigZag(ullValue);
+                            break;
+
+                        case Dump::ecReal:
+                            if (pchrRawEnd - pchrValue < 8)
+                            {
+                                throw CException(-1, L"Binary dump: malformed block.");
+                            }
+                            stValue.dValue = Dump::dGetDouble(pchrValue);
+                            pchrValue += 8;
+                            break;
+
+                        case Dump::ecText:
+                        case Dump::ecBlob:
+                            if (!Dump::bGetVarint(pchrValue, pchrRawEnd, ullValue) || ullValue > (uint64_t)(pchrRawEnd - pchrValue))
+                            {
+                                throw CException(-1, L"Binary dump: malformed block.");
+                            }
+                            stValue.pchrData = (const char*)pchrValue;
+                            stValue.uiBytes = (size_t)ullValue;
+                            pchrValue += ullValue;
+                            break;
+
+                        default:
+                            throw CException(-1, L"Binary dump: unknown value type.");
                     }
                 }
-
-                bool bRet = bImport(ioInStream, sTable, iColumns, iCharsRead, bMerge, pProgress);
-                if (!bRet)
+                if (pchrValue != pchrRawEnd)
                 {
-                    throw CException(-1, L"Table import failed.");
+                    throw CException(-1, L"Binary dump: malformed block.");
                 }
 
-            }   //  while (!feof (ioInstream))
+                for (size_t uiRow = 0; uiRow < uiRows; ++uiRow)
+                {
+                    for (int iCol = 0; iCol < iColumns; ++iCol)
+                    {
+                        const StValue& stValue = vecValues[iCol * uiRows + uiRow];
+                        int iRet = SQLITE_OK;
+                        switch (stValue.chrType)
+                        {
+                            case Dump::ecInteger:
+                                iRet = sqlite3_bind_int64(pStmt, iCol + 1, stValue.llValue);
+                                break;
+                            case Dump::ecReal:
+                                iRet = sqlite3_bind_double(pStmt, iCol + 1, stValue.dValue);
+                                break;
+                            case Dump::ecText:
+                                iRet = sqlite3_bind_text64(pStmt, iCol + 1, stValue.pchrData, stValue.uiBytes, SQLITE_STATIC, SQLITE_UTF8);
+                                break;
+                            case Dump::ecBlob:
+                                iRet = sqlite3_bind_blob64(pStmt, iCol + 1, stValue.pchrData, stValue.uiBytes, SQLITE_STATIC);
+                                break;
+                            default:
+                                iRet = sqlite3_bind_null(pStmt, iCol + 1);
+                        }
+                        if (SQLITE_OK != iRet)
+                        {
+                            throw CException(iRet, L"Binding a binary dump value failed.");
+                        }
+                    }
+
+                    InsertRow(pStmt);
 
-            fclose(ioInStream);
+                    if (uiRowsPerTransaction > 0 && ++uiRowsInTransaction >= uiRowsPerTransaction)
+                    {
+                        Transaction.CommitAndBegin();
+                        uiRowsInTransaction = 0;
+                    }
+                }
 
-            pProgress(100, false);
+                fnProgress();
 
-            return true;
+            }   //  while (true)
 
-        }   //  ImportTables (...)
+            Transaction.Commit();
+
+        }   //  ImportBinaryTable (...)
 
-        //
-        //  Helpers
-        //
         bool bCreateImportTable(const CEString& sTable, const CEString& sDescriptor, int iColumns)
         {
             CEString sSeparators(SZ_SEPARATOR);
@@ -1072,20 +3137,14 @@ namespace Hlib
                 CEString sDropStmt(L"DROP TABLE ");
                 sDropStmt += sTable;
 
-                sqlite3_stmt* pStmt = NULL;
-                int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sDropStmt, -1, &pStmt, NULL);
-                if (SQLITE_OK != iRet)
-                {
-                    throw CException(iRet, L"sqlite3_prepare16_v2 failed for drop.");
-                }
-
-                iRet = sqlite3_step(pStmt);
+                sqlite3_stmt* pStmt = pPrepare(sDropStmt, false);
+                int iRet = sqlite3_step(pStmt);
                 if (SQLITE_DONE != iRet)
                 {
                     throw CException(iRet, L"sqlite3_step failed for drop.");
                 }
 
-                sqlite3_reset(pStmt);
+                FinalizeStatement(pStmt);
             }
 
             CEString sCreateStmt(L"CREATE TABLE ");
@@ -1101,43 +3160,31 @@ namespace Hlib
             }
             sCreateStmt += L");";
 
-            sqlite3_stmt* pStmt = NULL;
-            int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sCreateStmt, -1, &pStmt, NULL);
-            if (SQLITE_OK != iRet)
-            {
-                throw CException(iRet, L"sqlite3_prepare16_v2 failed for create.");
-            }
-
-            iRet = sqlite3_step(pStmt);
+            sqlite3_stmt* pStmt = pPrepare(sCreateStmt, false);
+            int iRet = sqlite3_step(pStmt);
             if (SQLITE_DONE != iRet)
             {
                 throw CException(iRet, L"sqlite3_step failed for create.");
             }
 
-            iRet = sqlite3_finalize(pStmt);
-            if (SQLITE_OK != iRet)
-            {
-                throw CException(iRet, L"sqlite3_finalize failed for create.");
-            }
+            FinalizeStatement(pStmt);
 
             return true;
 
         }   //  b_CreateImportTable (...)
 
-        bool bImport(FILE* ioInstream,
+        //
+        // Reads rows up to the terminating empty line. Fields are bound straight 
+        // from the reader's buffer: no per-line strings and no UTF-8 round trip.
+        //
+        bool bImport(CImportReader& Reader,
             const CEString& sTable,
             int iColumns,
-            int iCharsRead,
             bool bAutoincrement,
-            PROGRESS_CALLBACK_CLR pProgress)
+            PROGRESS_CALLBACK_CLR pProgress,
+            unsigned int uiRowsPerTransaction = 0,
+            unsigned int uiParseThreads = 0)
         {
-            struct stat stStatBuf;
-            auto iRet = fstat(fileno(ioInstream), &stStatBuf);
-            if (iRet != 0)
-            {
-                throw CException(iRet, L"Unable to stat import table file.");
-            }
-            long lFileLength = stStatBuf.st_size;
             int iPercentDone = 0;
 
             CEString sStmt = L"INSERT INTO ";
@@ -1171,87 +3218,69 @@ namespace Hlib
                 sStmt += L")";
             }
 
-            sqlite3_stmt* pStmt = NULL;
-
-            BeginTransaction();
+            // Compiled once and reset by InsertRow() after every row
+            CStatement stInsert = Prepare(sStmt);
+            sqlite3_stmt* pStmt = stInsert;
 
-            CEString sSeparators(SZ_SEPARATOR);
-            sSeparators += L", \n";
-            int iEntriesRead = 0;
+            CScopedTransaction Transaction(*this);
+            unsigned int uiRowsInTransaction = 0;
 
-            char szLineBuf[10000];
-            CEString sLine;
-//            sLine.ResetSeparators();
-//            sLine.SetBreakChars(sSeparators);
-            for (; !feof(ioInstream); ++iEntriesRead)
+            // Batched commits and progress, called on this thread after rows are inserted
+            auto fnInserted = [&](uint64_t ullRows, uint64_t ullConsumed)
             {
-                int iRet = sqlite3_prepare16_v2(m_spDb_.get(), sStmt, -1, &pStmt, NULL);
-                if (SQLITE_OK != iRet)
+                if (uiRowsPerTransaction > 0)
                 {
-                    throw CException(iRet, L"sqlite3_prepare16_v2 failed");
+                    uiRowsInTransaction += (unsigned int)ullRows;
+                    if (uiRowsInTransaction >= uiRowsPerTransaction)
+                    {
+                        Transaction.CommitAndBegin();
+                        uiRowsInTransaction = 0;
+                    }
                 }
 
-                char* szRet = fgets(szLineBuf, 10000, ioInstream);
-                if (nullptr == szRet)
+                if (Reader.ullFileSize() > 0)
                 {
-                    throw CException(-1, L"Error reading table name.");
-                }
-                else
-                {
-                    sLine = CEString::sFromUtf8(szLineBuf);
+                    int iPd = (int)(((double)ullConsumed / (double)Reader.ullFileSize()) * 100);
+                    if (iPd > iPercentDone)
+                    {
+                        iPercentDone = min(iPd, 100);
+                        pProgress(iPercentDone, false);
+                    }
                 }
-                sLine.ResetSeparators();
-                sLine.SetBreakChars(sSeparators);
-                sLine.Trim(sSeparators);
-                if (sLine.bIsEmpty())
+            };
+
+            if (uiParseThreads > 0)
+            {
+                ImportPipelined(Reader, iColumns, bAutoincrement, pStmt, uiParseThreads, fnInserted);
+                Transaction.Commit();
+                return true;
+            }
+
+            vector<string_view> vecFields;
+            vecFields.reserve(iColumns);
+            string_view svLine;
+            while (Reader.bGetLine(svLine))
+            {
+                if (CImportReader::bIsBlank(svLine))
                 {
                     break;
                 }
 
-                iCharsRead += sLine.uiLength();
-
-                if ((int)sLine.uiNFields() != iColumns)
+                int64_t llId = 0;
+                if (!CImportReader::bParseRow(svLine, iColumns, bAutoincrement, vecFields, llId))
                 {
-                    CEString sMsg(L"Number of fields does not match number of columns: ");
-                    sMsg += sLine;
-                    sMsg += L"\n";
-                    wchar_t* szMsg = sMsg;
-                    ERROR_LOG(szMsg);
+                    LogRejectedImportRow(svLine);
                     //                    throw CException (-1, L"Number of fields does not match number of columns.");
                     continue;
                 }
 
-                if (!bAutoincrement)
-                {
-                    wstring wstrColumn(sLine.sGetField(0));
-                    int64_t llId = stoll(wstrColumn.c_str());
-                    Bind(1, llId, pStmt);
-                    for (int iCol = 2; iCol < iColumns + 1; ++iCol)
-                    {
-                        Bind(iCol, sLine.sGetField(iCol - 1), pStmt);
-                    }
-                }
-                else
-                {
-                    for (int iCol = 1; iCol < iColumns; ++iCol)
-                    {
-                        Bind(iCol, sLine.sGetField(iCol), pStmt);
-                    }
-                }
-
-                InsertRow(pStmt);
-                Finalize(pStmt);
+                InsertImportRow(vecFields.data(), iColumns, bAutoincrement, llId, pStmt);
 
-                int iPd = (int)(((double)iCharsRead / (double)lFileLength) * 100);
-                if (iPd > iPercentDone)
-                {
-                    iPercentDone = min(iPd, 100);
-                    pProgress(iPercentDone, false);
-                }
+                fnInserted(1, Reader.ullConsumed());
 
-            }   //  for (; !feof (ioInstream); ++iEntriesRead)
+            }   //  while (Reader.bGetLine (...))
 
-            CommitTransaction();
+            Transaction.Commit();
 
             return true;
 
@@ -0,0 +1,77 @@
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+//
+// Minimal benchmark support: wall clock timer and a global heap allocation counter.
+// The counting operator new/delete live in BenchmarkAlloc.cpp, which every 
+// benchmark executable links.
+//
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+namespace Hlib
+{
+    namespace Bench
+    {
+        inline std::atomic<unsigned long long> g_ullAllocations{0};
+        inline std::atomic<unsigned long long> g_ullBytesAllocated{0};
+
+        struct StAllocStats
+        {
+            unsigned long long ullAllocations;
+            unsigned long long ullBytes;
+        };
+
+        inline StAllocStats stGetAllocStats()
+        {
+            return { g_ullAllocations.load(), g_ullBytesAllocated.load() };
+        }
+
+        class CTimer
+        {
+        public:
+            CTimer() : m_Start(std::chrono::steady_clock::now())
+            {}
+
+            double dElapsedMs() const
+            {
+                auto duration = std::chrono::steady_clock::now() - m_Start;
+                return std::chrono::duration<double, std::milli>(duration).count();
+            }
+
+        private:
+            std::chrono::steady_clock::time_point m_Start;
+        };
+
+        //
+        // Runs fn once and reports time and the number of heap allocations it made;
+        // returns the time in ms
+        //
+        template <typename Fn>
+        double Measure(const char* szName, Fn&& fn)
+        {
+            auto stBefore = stGetAllocStats();
+            CTimer timer;
+            fn();
+            double dMs = timer.dElapsedMs();
+            auto stAfter = stGetAllocStats();
+            std::printf("%-48s %10.2f ms %12llu allocs %14llu bytes\n", szName, dMs,
+                        stAfter.ullAllocations - stBefore.ullAllocations,
+                        stAfter.ullBytes - stBefore.ullBytes);
+            return dMs;
+        }
+
+        // Keeps the optimizer from discarding a computed value
+        template <typename T>
+        void DoNotOptimize(const T& value)
+        {
+            asm volatile("" : : "r,m"(value) : "memory");
+        }
+
+    }   //  namespace Bench
+
+}   //  namespace Hlib
+
+#endif  //  BENCHMARK_H_INCLUDED
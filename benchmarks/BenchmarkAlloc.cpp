@@ -0,0 +1,44 @@
+//
+// Global operator new/delete that feed the counters in Benchmark.h
+//
+
+#include <cstdlib>
+#include <new>
+
+#include "Benchmark.h"
+
+void* operator new(std::size_t uiSize)
+{
+    Hlib::Bench::g_ullAllocations.fetch_add(1, std::memory_order_relaxed);
+    Hlib::Bench::g_ullBytesAllocated.fetch_add(uiSize, std::memory_order_relaxed);
+    if (void* p = std::malloc(uiSize ? uiSize : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t uiSize)
+{
+    return operator new(uiSize);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
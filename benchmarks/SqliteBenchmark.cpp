@@ -0,0 +1,440 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include "SqliteWrapper.h"
+
+using namespace Hlib;
+using namespace Hlib::Bench;
+
+static const unsigned int cuiRows = 200000;
+
+//
+// Word form + gram hash pairs, the shape of most dictionary tables
+//
+static vector<pair<CEString, CEString>> vecMakeRows()
+{
+    static const wchar_t* arrStems[] = { L"перерабатыва", L"поднима", L"выписыва", L"красив", L"стол", L"ёж", L"делающ" };
+    static const wchar_t* arrEndings[] = { L"ющий", L"ющийся", L"ть", L"ая", L"ом", L"ами", L"ему" };
+    vector<pair<CEString, CEString>> vecRows;
+    vecRows.reserve(cuiRows);
+    unsigned int uiSeed = 12345;
+    for (unsigned int uiRow = 0; uiRow < cuiRows; ++uiRow)
+    {
+        uiSeed = uiSeed * 1103515245 + 12345;
+        CEString sForm(arrStems[(uiSeed >> 16) % 7]);
+        sForm += arrEndings[(uiSeed >> 8) % 7];
+        CEString sGram(L"Part Pres Act M Sg N ");
+        sGram += CEString::sToString(uiRow % 1000);
+        vecRows.emplace_back(sForm, sGram);
+    }
+    return vecRows;
+}
+
+static void ReportRate(double dMs)
+{
+    std::printf("%-48s %10.0f rows/s\n", "", cuiRows / (dMs / 1000.0));
+}
+
+// What Bind(CEString) used to do on Linux, with the copy kept alive for sqlite
+static unique_ptr<char16_t[]> pToUtf16(const CEString& s)
+{
+    auto pStr16 = make_unique<char16_t[]>(s.uiLength() + 1);
+    for (unsigned int uiAt = 0; uiAt < s.uiLength(); ++uiAt)
+    {
+        pStr16[uiAt] = (char16_t)s[uiAt];
+    }
+    pStr16[s.uiLength()] = u'\0';
+    return pStr16;
+}
+
+static void BindFetchBenchmarks()
+{
+    std::printf("\n--- sqlite bind/fetch, %u rows ---\n", cuiRows);
+
+    auto vecRows = vecMakeRows();
+    CSqlite db(L":memory:");
+    db.Exec(L"CREATE TABLE forms_old (id INTEGER PRIMARY KEY, wordform TEXT, gram TEXT)");
+    db.Exec(L"CREATE TABLE forms (id INTEGER PRIMARY KEY, wordform TEXT, gram TEXT)");
+
+    sqlite3_stmt* pOldInsert = nullptr;
+    db.uiPrepareForInsert(L"forms_old", 2, pOldInsert);
+    db.BeginTransaction();
+    ReportRate(Measure("insert, UTF-16 copy per bind (old)", [&]()
+    {
+        for (auto& pairRow : vecRows)
+        {
+            auto pForm = pToUtf16(pairRow.first);
+            auto pGram = pToUtf16(pairRow.second);
+            sqlite3_bind_text16(pOldInsert, 1, pForm.get(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text16(pOldInsert, 2, pGram.get(), -1, SQLITE_TRANSIENT);
+            db.InsertRow(pOldInsert);
+        }
+    }));
+    db.CommitTransaction();
+    db.Finalize(pOldInsert);
+
+    sqlite3_stmt* pInsert = nullptr;
+    db.uiPrepareForInsert(L"forms", 2, pInsert);
+    db.BeginTransaction();
+    ReportRate(Measure("insert, CSqlite::Bind (UTF-8)", [&]()
+    {
+        for (auto& pairRow : vecRows)
+        {
+            db.Bind(1, pairRow.first, pInsert);
+            db.Bind(2, pairRow.second, pInsert);
+            db.InsertRow(pInsert);
+        }
+    }));
+    db.CommitTransaction();
+    db.Finalize(pInsert);
+
+    sqlite3_stmt* pOldSelect = nullptr;
+    db.PrepareForSelect(L"SELECT wordform, gram FROM forms_old", pOldSelect);
+    ReportRate(Measure("fetch, UTF-16 + 2-byte copies (old)", [&]()
+    {
+        unsigned int uiChars = 0;
+        CEString sValue;
+        while (db.bGetRow(pOldSelect))
+        {
+            for (int iCol = 0; iCol < 2; ++iCol)
+            {
+                const void* pText = sqlite3_column_text16(pOldSelect, iCol);
+                int iBytes = sqlite3_column_bytes16(pOldSelect, iCol);
+                auto pUtf32 = make_unique<wchar_t[]>((iBytes / 2) + 1);
+                for (int iAt = 0; iAt < iBytes / 2; ++iAt)
+                {
+                    memcpy(&pUtf32[iAt], (const char*)pText + (2 * iAt), 2);
+                }
+                sValue = pUtf32.get();
+                uiChars += sValue.uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    }));
+    db.Finalize(pOldSelect);
+
+    sqlite3_stmt* pSelect = nullptr;
+    db.PrepareForSelect(L"SELECT wordform, gram FROM forms", pSelect);
+    ReportRate(Measure("fetch, CSqlite::GetData (UTF-8)", [&]()
+    {
+        unsigned int uiChars = 0;
+        CEString sValue;
+        while (db.bGetRow(pSelect))
+        {
+            for (int iCol = 0; iCol < 2; ++iCol)
+            {
+                db.GetData(iCol, sValue, pSelect);
+                uiChars += sValue.uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    }));
+    db.Finalize(pSelect);
+
+    sqlite3_stmt* pUtf8Select = nullptr;
+    db.PrepareForSelect(L"SELECT wordform, gram FROM forms", pUtf8Select);
+    ReportRate(Measure("fetch, CSqlite::GetData into CEStringUtf8", [&]()
+    {
+        unsigned int uiBytes = 0;
+        CEStringUtf8 sValue;
+        while (db.bGetRow(pUtf8Select))
+        {
+            for (int iCol = 0; iCol < 2; ++iCol)
+            {
+                db.GetData(iCol, sValue, pUtf8Select);
+                uiBytes += sValue.uiBytes();
+            }
+        }
+        DoNotOptimize(uiBytes);
+    }));
+    db.Finalize(pUtf8Select);
+}
+
+//
+// Prepare, bind, insert and finalize per row, as StInflectionHasher::bSaveToDb() does
+//
+static void StatementCacheBenchmarks()
+{
+    std::printf("\n--- sqlite prepare per row, %u rows ---\n", cuiRows);
+
+    auto vecRows = vecMakeRows();
+
+    // With no room in the cache every statement is compiled and finalized, as before
+    CSqlite dbUncached(L":memory:");
+    dbUncached.SetStatementCacheCapacity(0);
+    dbUncached.Exec(L"CREATE TABLE hashes (id INTEGER PRIMARY KEY, wordform TEXT, gram TEXT)");
+    dbUncached.BeginTransaction();
+    ReportRate(Measure("prepare + finalize every row (old)", [&]()
+    {
+        for (auto& pairRow : vecRows)
+        {
+            sqlite3_stmt* pStmt = nullptr;
+            dbUncached.uiPrepareForInsert(L"hashes", 2, pStmt);
+            dbUncached.Bind(1, pairRow.first, pStmt);
+            dbUncached.Bind(2, pairRow.second, pStmt);
+            dbUncached.InsertRow(pStmt);
+            dbUncached.Finalize(pStmt);
+        }
+    }));
+    dbUncached.CommitTransaction();
+
+    CSqlite db(L":memory:");
+    db.Exec(L"CREATE TABLE hashes (id INTEGER PRIMARY KEY, wordform TEXT, gram TEXT)");
+
+    db.BeginTransaction();
+    ReportRate(Measure("PrepareForInsert + Finalize, cached", [&]()
+    {
+        for (auto& pairRow : vecRows)
+        {
+            sqlite3_stmt* pStmt = nullptr;
+            db.uiPrepareForInsert(L"hashes", 2, pStmt);
+            db.Bind(1, pairRow.first, pStmt);
+            db.Bind(2, pairRow.second, pStmt);
+            db.InsertRow(pStmt);
+            db.Finalize(pStmt);
+        }
+    }));
+    db.CommitTransaction();
+}
+
+static void NoProgress(int, bool)
+{}
+
+//
+// bImportTables() from a pipe-separated dump into a database file
+//
+static void ImportBenchmarks()
+{
+    std::printf("\n--- sqlite import, %u rows ---\n", cuiRows);
+
+    CEString sDumpPath(L"/tmp/hlib_import_bench.txt");
+    FILE* ioDump = fopen(sDumpPath.stl_sToUtf8().c_str(), "w");
+    if (!ioDump)
+    {
+        std::printf("Unable to create %s\n", sDumpPath.stl_sToUtf8().c_str());
+        return;
+    }
+    fputs("forms\nid|wordform|gram\n", ioDump);
+    auto vecRows = vecMakeRows();
+    unsigned int uiId = 0;
+    for (auto& pairRow : vecRows)
+    {
+        string stl_sGram = pairRow.second.stl_sToUtf8();
+        replace(stl_sGram.begin(), stl_sGram.end(), ' ', '_');     // blanks separate fields in the dump
+        fprintf(ioDump, "%u|%s|%s\n", ++uiId, pairRow.first.stl_sToUtf8().c_str(), stl_sGram.c_str());
+    }
+    fputs("\n", ioDump);
+    fclose(ioDump);
+
+    auto Import = [&](const char* szLabel, const StImportOptions& stOptions)
+    {
+        const char* szDbPath = "/tmp/hlib_import_bench.db3";
+        remove(szDbPath);
+        CSqlite db(CEString::sFromUtf8(szDbPath));
+        ReportRate(Measure(szLabel, [&]()
+        {
+            db.bImportTables(sDumpPath, false, NoProgress, stOptions);
+        }));
+        remove(szDbPath);
+    };
+
+    Import("bImportTables, default options", StImportOptions());
+
+    StImportOptions stBatched;
+    stBatched.uiRowsPerTransaction = 50000;
+    Import("commit every 50000 rows", stBatched);
+
+    StImportOptions stTuned;
+    stTuned.sSynchronous = L"OFF";
+    stTuned.sJournalMode = L"MEMORY";
+    stTuned.iCacheSize = -65536;
+    Import("synchronous=OFF, journal_mode=MEMORY, 64 MB cache", stTuned);
+
+    StImportOptions stPipelined;
+    stPipelined.uiParseThreads = 1;
+    Import("pipelined, 1 parse thread", stPipelined);
+    stPipelined.uiParseThreads = 3;
+    Import("pipelined, 3 parse threads", stPipelined);
+
+    remove(sDumpPath.stl_sToUtf8().c_str());
+}
+
+//
+// bExportTables() against the row loop it replaced: a CEString per row, 
+// a UTF-8 conversion and an fputs per row, after a COUNT(*) per table
+//
+static void ExportBenchmarks()
+{
+    std::printf("\n--- sqlite export, %u rows ---\n", cuiRows);
+
+    // A file, so that the parallel export can open connections of its own
+    const char* szDbPath = "/tmp/hlib_export_bench.db3";
+    remove(szDbPath);
+    auto vecRows = vecMakeRows();
+    CSqlite db(CEString::sFromUtf8(szDbPath));
+    db.Exec(L"CREATE TABLE forms (id INTEGER PRIMARY KEY, wordform TEXT, gram TEXT)");
+    sqlite3_stmt* pInsert = nullptr;
+    db.uiPrepareForInsert(L"forms", 2, pInsert);
+    db.BeginTransaction();
+    for (auto& pairRow : vecRows)
+    {
+        db.Bind(1, pairRow.first, pInsert);
+        db.Bind(2, pairRow.second, pInsert);
+        db.InsertRow(pInsert);
+    }
+    db.CommitTransaction();
+    db.Finalize(pInsert);
+
+    const char* szOutPath = "/tmp/hlib_export_bench.txt";
+
+    ReportRate(Measure("CEString line + fputs per row (old)", [&]()
+    {
+        FILE* ioOut = fopen(szOutPath, "w");
+        DoNotOptimize(db.llRows(L"forms"));
+        sqlite3_stmt* pStmt = nullptr;
+        db.PrepareForSelect(L"SELECT * FROM forms;", pStmt);
+        int iColumns = sqlite3_column_count(pStmt);
+        CEString sOut;
+        CEString sCol;
+        string stl_sOutUtf8;
+        while (db.bGetRow(pStmt))
+        {
+            sOut.Erase();
+            for (int iCol = 0; iCol < iColumns; ++iCol)
+            {
+                sCol.Erase();
+                db.GetData(iCol, sCol, pStmt);
+                if (sOut.uiLength() > 0)
+                {
+                    sOut += L"|";
+                }
+                sOut += sCol;
+            }
+            sOut += L"\n";
+            sOut.ToUtf8(stl_sOutUtf8);
+            fputs(stl_sOutUtf8.c_str(), ioOut);
+        }
+        db.Finalize(pStmt);
+        fclose(ioOut);
+    }));
+
+    CEString sOutPath = CEString::sFromUtf8(szOutPath);
+    vector<CEString> vecTables { L"forms" };
+    ReportRate(Measure("bExportTables, buffered column text", [&]()
+    {
+        db.bExportTables(sOutPath, vecTables, NoProgress);
+    }));
+
+    for (unsigned int uiThreads : { 2u, 4u })
+    {
+        char szLabel[64];
+        snprintf(szLabel, sizeof(szLabel), "bExportTables, %u threads", uiThreads);
+        ReportRate(Measure(szLabel, [&]()
+        {
+            db.bExportTables(sOutPath, vecTables, NoProgress, uiThreads);
+        }));
+    }
+
+    remove(szOutPath);
+    remove(szDbPath);
+}
+
+static long lFileSize(const char* szPath)
+{
+    FILE* ioFile = fopen(szPath, "rb");
+    if (!ioFile)
+    {
+        return -1;
+    }
+    fseek(ioFile, 0, SEEK_END);
+    long lSize = ftell(ioFile);
+    fclose(ioFile);
+    return lSize;
+}
+
+//
+// Pipe-separated text against the binary dump: size, export and import
+//
+static void DumpBenchmarks()
+{
+    std::printf("\n--- sqlite text vs binary dump, %u rows ---\n", cuiRows);
+
+    const char* szDbPath = "/tmp/hlib_dump_bench.db3";
+    remove(szDbPath);
+    auto vecRows = vecMakeRows();
+    {
+        CSqlite db(CEString::sFromUtf8(szDbPath));
+        db.Exec(L"CREATE TABLE forms (id INTEGER PRIMARY KEY, wordform TEXT, gram TEXT)");
+        sqlite3_stmt* pInsert = nullptr;
+        db.uiPrepareForInsert(L"forms", 2, pInsert);
+        db.BeginTransaction();
+        for (auto& pairRow : vecRows)
+        {
+            CEString sGram(pairRow.second);
+            for (unsigned int uiAt = 0; uiAt < sGram.uiLength(); ++uiAt)
+            {
+                if (L' ' == sGram[uiAt])
+                {
+                    sGram.sReplace(uiAt, L'_');     // blanks separate fields in the text dump
+                }
+            }
+            db.Bind(1, pairRow.first, pInsert);
+            db.Bind(2, sGram, pInsert);
+            db.InsertRow(pInsert);
+        }
+        db.CommitTransaction();
+        db.Finalize(pInsert);
+    }
+
+    CSqlite db(CEString::sFromUtf8(szDbPath));
+    vector<CEString> vecTables { L"forms" };
+    const char* szTextPath = "/tmp/hlib_dump_bench.txt";
+    const char* szBinaryPath = "/tmp/hlib_dump_bench.hldb";
+    CEString sTextPath = CEString::sFromUtf8(szTextPath);
+    CEString sBinaryPath = CEString::sFromUtf8(szBinaryPath);
+
+    ReportRate(Measure("export, text", [&]()
+    {
+        db.bExportTables(sTextPath, vecTables, NoProgress);
+    }));
+    ReportRate(Measure("export, binary", [&]()
+    {
+        db.bExportBinary(sBinaryPath, vecTables, NoProgress);
+    }));
+    std::printf("%-48s %10ld bytes\n", "text dump", lFileSize(szTextPath));
+    std::printf("%-48s %10ld bytes\n", "binary dump", lFileSize(szBinaryPath));
+
+    const char* szTargetPath = "/tmp/hlib_dump_bench_target.db3";
+    auto Import = [&](const char* szLabel, const function<void(CSqlite&)>& fnImport)
+    {
+        remove(szTargetPath);
+        CSqlite dbTarget(CEString::sFromUtf8(szTargetPath));
+        ReportRate(Measure(szLabel, [&]()
+        {
+            fnImport(dbTarget);
+        }));
+        remove(szTargetPath);
+    };
+
+    Import("import, text", [&](CSqlite& dbTarget)
+    {
+        dbTarget.bImportTables(sTextPath, false, NoProgress);
+    });
+    Import("import, binary", [&](CSqlite& dbTarget)
+    {
+        dbTarget.bImportBinary(sBinaryPath, false, NoProgress);
+    });
+
+    remove(szTextPath);
+    remove(szBinaryPath);
+    remove(szDbPath);
+}
+
+int main()
+{
+    BindFetchBenchmarks();
+    StatementCacheBenchmarks();
+    ImportBenchmarks();
+    ExportBenchmarks();
+    DumpBenchmarks();
+    return 0;
+}
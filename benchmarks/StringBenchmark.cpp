@@ -0,0 +1,1051 @@
+#define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
+
+#include <codecvt>
+#include <iomanip>
+#include <sstream>
+
+#include "Benchmark.h"
+#include "EString.h"
+#include "GramHasher.h"
+#include "md5.h"
+
+using namespace Hlib;
+using namespace Hlib::Bench;
+
+//
+// Synthetic Russian word forms: 2-5 syllables, deterministic
+//
+static vector<wstring> vecMakeWordList(unsigned int uiWords)
+{
+    static const wchar_t* arrSyllables[] = { L"ка", L"ро", L"ве", L"ли", L"ну", L"сты", L"пре", L"до",
+                                             L"жи", L"ма", L"тель", L"ство", L"ско", L"ни", L"го", L"щий" };
+    static const wchar_t* arrEndings[] = { L"", L"а", L"ом", L"ами", L"ых", L"ей", L"ую", L"ться" };
+
+    vector<wstring> vecWords;
+    vecWords.reserve(uiWords);
+    unsigned int uiSeed = 12345;
+    for (unsigned int uiWord = 0; uiWord < uiWords; ++uiWord)
+    {
+        wstring sWord;
+        uiSeed = uiSeed * 1103515245 + 12345;
+        unsigned int uiSyllables = 2 + (uiSeed >> 16) % 4;
+        for (unsigned int uiSyl = 0; uiSyl < uiSyllables; ++uiSyl)
+        {
+            uiSeed = uiSeed * 1103515245 + 12345;
+            sWord += arrSyllables[(uiSeed >> 16) % 16];
+        }
+        uiSeed = uiSeed * 1103515245 + 12345;
+        sWord += arrEndings[(uiSeed >> 16) % 8];
+        vecWords.push_back(sWord);
+    }
+    return vecWords;
+}
+
+//
+// Reallocation count of the old fixed-block policy (10 wchar_t's per block,
+// buffer resized to fit whenever the new length reached the end of the last block)
+//
+static unsigned int uiBlockPolicyReallocations(unsigned int uiChunkLength, unsigned int uiChunks)
+{
+    const unsigned int uiBlockSize = 10;
+    unsigned int uiBlocks = 1;
+    unsigned int uiLength = 0;
+    unsigned int uiReallocations = 0;
+    for (unsigned int uiChunk = 0; uiChunk < uiChunks; ++uiChunk)
+    {
+        uiLength += uiChunkLength;
+        if (uiLength >= uiBlocks * uiBlockSize)
+        {
+            uiBlocks = ((uiLength + 1) / uiBlockSize) + 1;
+            ++uiReallocations;
+        }
+    }
+    return uiReallocations;
+}
+
+static void AppendBenchmarks()
+{
+    std::printf("\n--- operator+= growth ---\n");
+
+    const wchar_t* szChunk = L"Noun_Sg_N|";      // 10 chars, typical export/hash fragment
+    const unsigned int uiChunks = 9000;
+
+    std::printf("old block policy (simulated): %u reallocations for %u appends\n",
+                uiBlockPolicyReallocations(10, uiChunks), uiChunks);
+
+    Measure("append, geometric growth", [&]()
+    {
+        for (int iRep = 0; iRep < 20; ++iRep)
+        {
+            CEString sOut;
+            for (unsigned int uiChunk = 0; uiChunk < uiChunks; ++uiChunk)
+            {
+                sOut += szChunk;
+            }
+            DoNotOptimize(sOut.uiLength());
+        }
+    });
+
+    Measure("append, Reserve() up front", [&]()
+    {
+        for (int iRep = 0; iRep < 20; ++iRep)
+        {
+            CEString sOut;
+            sOut.Reserve(uiChunks * 10);
+            for (unsigned int uiChunk = 0; uiChunk < uiChunks; ++uiChunk)
+            {
+                sOut += szChunk;
+            }
+            DoNotOptimize(sOut.uiLength());
+        }
+    });
+
+    Measure("reused builder, Erase() per line", [&]()
+    {
+        CEString sLine;
+        for (int iLine = 0; iLine < 20000; ++iLine)
+        {
+            sLine.Erase();
+            for (int iCol = 0; iCol < 8; ++iCol)
+            {
+                sLine += szChunk;
+            }
+            DoNotOptimize(sLine.uiLength());
+        }
+    });
+}
+
+static void WordListBenchmarks()
+{
+    std::printf("\n--- word list: short strings ---\n");
+
+    const unsigned int uiWords = 100000;
+    auto vecWords = vecMakeWordList(uiWords);
+
+    vector<CEString> vecForms;
+    vecForms.reserve(uiWords);
+    Measure("construct 100k word forms", [&]()
+    {
+        for (auto& sWord : vecWords)
+        {
+            vecForms.emplace_back(sWord.c_str());
+        }
+    });
+
+    Measure("copy 100k word forms", [&]()
+    {
+        vector<CEString> vecCopies(vecForms);
+        DoNotOptimize(vecCopies.size());
+    });
+
+    Measure("build 100k gram tags (a + \"_\" + b + ...)", [&]()
+    {
+        const wchar_t* arrNumbers[] = { L"Sg", L"Pl" };
+        const wchar_t* arrCases[] = { L"N", L"A", L"G", L"P", L"D", L"I" };
+        unsigned int uiTotal = 0;
+        for (unsigned int uiAt = 0; uiAt < uiWords; ++uiAt)
+        {
+            CEString sHash = CEString(L"Noun") + L"_" + arrNumbers[uiAt % 2] + L"_" + arrCases[uiAt % 6];
+            uiTotal += sHash.uiLength();
+        }
+        DoNotOptimize(uiTotal);
+    });
+
+    Measure("append word forms to line builder", [&]()
+    {
+        CEString sLine;
+        unsigned int uiTotal = 0;
+        for (unsigned int uiAt = 0; uiAt < uiWords; ++uiAt)
+        {
+            if (uiAt % 10 == 0)
+            {
+                uiTotal += sLine.uiLength();
+                sLine.Erase();
+            }
+            sLine += vecForms[uiAt];
+            sLine += L"|";
+        }
+        DoNotOptimize(uiTotal);
+    });
+}
+
+static void SeparatorBenchmarks()
+{
+    std::printf("\n--- separators ---\n");
+    std::printf("sizeof(CEString): %u bytes\n", (unsigned int)sizeof(CEString));
+
+    CEString sHash(L"Noun_Sg_N");
+    sHash.SetBreakChars(L"_");
+    sHash.SetPunctuation(L".,");
+    sHash.SetVowels(CEString::g_szRusVowels);
+
+    Measure("copy 100k strings with custom separators", [&]()
+    {
+        unsigned int uiTotal = 0;
+        for (int iAt = 0; iAt < 100000; ++iAt)
+        {
+            CEString sCopy(sHash);
+            uiTotal += sCopy.uiLength();
+        }
+        DoNotOptimize(uiTotal);
+    });
+
+    Measure("100k SetBreakChars() on fresh strings", [&]()
+    {
+        unsigned int uiTotal = 0;
+        for (int iAt = 0; iAt < 100000; ++iAt)
+        {
+            CEString sLine(L"Noun_Sg_N");
+            sLine.SetBreakChars(L"_");
+            uiTotal += sLine.uiLength();
+        }
+        DoNotOptimize(uiTotal);
+    });
+}
+
+//
+// Lines of 6-14 word forms with punctuation, about 4 MB of wchar_t's in total
+//
+static vector<wstring> vecMakeCorpus()
+{
+    static const wchar_t* arrPunctuation[] = { L"", L"", L"", L",", L"", L"", L".", L"" , L"…", L" —" };
+    auto vecWords = vecMakeWordList(20000);
+    vector<wstring> vecLines;
+    size_t uiChars = 0;
+    unsigned int uiSeed = 777;
+    unsigned int uiWord = 0;
+    while (uiChars * sizeof(wchar_t) < 4 * 1024 * 1024)
+    {
+        wstring sLine;
+        uiSeed = uiSeed * 1103515245 + 12345;
+        unsigned int uiWords = 6 + (uiSeed >> 16) % 9;
+        for (unsigned int uiAt = 0; uiAt < uiWords; ++uiAt)
+        {
+            if (uiAt > 0)
+            {
+                sLine += L' ';
+            }
+            sLine += vecWords[uiWord++ % vecWords.size()];
+            uiSeed = uiSeed * 1103515245 + 12345;
+            sLine += arrPunctuation[(uiSeed >> 16) % 10];
+        }
+        uiChars += sLine.length();
+        vecLines.push_back(sLine);
+    }
+    return vecLines;
+}
+
+static void TokenizerBenchmarks()
+{
+    auto vecLines = vecMakeCorpus();
+    size_t uiChars = 0;
+    for (auto& sLine : vecLines)
+    {
+        uiChars += sLine.length();
+    }
+    std::printf("\n--- tokenizer: %u lines, %.1f MB ---\n", (unsigned int)vecLines.size(),
+                (double)(uiChars * sizeof(wchar_t)) / (1024 * 1024));
+
+    // What the tokenizer used to do for every character
+    Measure("classify chars with bIn() per set", [&]()
+    {
+        const wchar_t* szBreaks = L" \n";
+        const wchar_t* szTabs = L"\t";
+        const wchar_t* szPunctuation = L".,;:/?<>[]{}~!()-—_\'\"\\…";
+        const wchar_t* szEscape = L"\27";
+        unsigned int uiSeparators = 0;
+        for (auto& sLine : vecLines)
+        {
+            for (wchar_t chr : sLine)
+            {
+                if (CEString::bIn(chr, szBreaks) || CEString::bIn(chr, szTabs) ||
+                    CEString::bIn(chr, szPunctuation) || CEString::bIn(chr, szEscape))
+                {
+                    ++uiSeparators;
+                }
+            }
+        }
+        DoNotOptimize(uiSeparators);
+    });
+
+    Measure("tokenize lines, breaks only", [&]()
+    {
+        unsigned int uiFields = 0;
+        for (auto& sLine : vecLines)
+        {
+            CEString sTokenized(sLine.c_str());
+            uiFields += sTokenized.uiGetNumOfFields();
+        }
+        DoNotOptimize(uiFields);
+    });
+
+    Measure("tokenize lines, all separator sets", [&]()
+    {
+        unsigned int uiTokens = 0;
+        for (auto& sLine : vecLines)
+        {
+            CEString sTokenized(sLine.c_str());
+            sTokenized.EnableTabs();
+            sTokenized.EnablePunctuation();
+            sTokenized.EnableEscapeChars();
+            uiTokens += sTokenized.uiGetNumOfTokens();
+        }
+        DoNotOptimize(uiTokens);
+    });
+}
+
+static void FieldBenchmarks()
+{
+    auto vecLines = vecMakeCorpus();
+    vector<CEString> vecTokenized;
+    vecTokenized.reserve(vecLines.size());
+    for (auto& sLine : vecLines)
+    {
+        vecTokenized.emplace_back(sLine.c_str());
+        vecTokenized.back().uiGetNumOfFields();
+    }
+    std::printf("\n--- field extraction: %u lines ---\n", (unsigned int)vecTokenized.size());
+
+    Measure("sGetField, every field", [&]()
+    {
+        size_t uiChars = 0;
+        for (auto& sLine : vecTokenized)
+        {
+            for (unsigned int uiField = 0; uiField < sLine.uiGetNumOfFields(); ++uiField)
+            {
+                uiChars += sLine.sGetField(uiField).uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    Measure("svGetField, every field", [&]()
+    {
+        size_t uiChars = 0;
+        for (auto& sLine : vecTokenized)
+        {
+            for (unsigned int uiField = 0; uiField < sLine.uiGetNumOfFields(); ++uiField)
+            {
+                uiChars += sLine.svGetField(uiField).uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    // Callers that only look at the head of each line
+    Measure("first 3 fields via svGetField, fresh strings", [&]()
+    {
+        size_t uiChars = 0;
+        for (auto& sLine : vecLines)
+        {
+            CEString sFresh(sLine.c_str());
+            unsigned int uiFields = min (3u, sFresh.uiGetNumOfFields());
+            for (unsigned int uiField = 0; uiField < uiFields; ++uiField)
+            {
+                uiChars += sFresh.svGetField(uiField).uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    Measure("first 3 fields via Fields(), fresh strings", [&]()
+    {
+        size_t uiChars = 0;
+        for (auto& sLine : vecLines)
+        {
+            CEString sFresh(sLine.c_str());
+            unsigned int uiFields = 0;
+            for (const CEStringView& svField : sFresh.Fields())
+            {
+                uiChars += svField.uiLength();
+                if (++uiFields == 3)
+                {
+                    break;
+                }
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    // One wide export-style line: walking its fields used to be quadratic
+    CEString sWide;
+    for (unsigned int uiField = 0; uiField < 15000; ++uiField)
+    {
+        sWide += L"поле";
+        sWide += L"|";
+    }
+    sWide.SetBreakChars(L"|");
+    Measure("svGetField over a 15000-field line x 10", [&]()
+    {
+        size_t uiChars = 0;
+        for (unsigned int uiPass = 0; uiPass < 10; ++uiPass)
+        {
+            for (unsigned int uiField = 0; uiField < sWide.uiGetNumOfFields(); ++uiField)
+            {
+                uiChars += sWide.svGetField(uiField).uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    const wchar_t * arrHashes[] = { L"Noun_Sg_N", L"Noun_Pl_Part", L"AdjL_M_Sg_G", L"AdjL_Pl_D", L"Pres_Sg_3", 
+                                    L"PPastPL_F_Sg_I", L"AdjS_N", L"Impv_Pl_2", L"VAdv_Pres", L"Inf" };
+    Measure("CGramHasher::eDecodeHash x 200000", [&]()
+    {
+        unsigned int uiDecoded = 0;
+        CGramHasher Hasher;
+        for (unsigned int uiPass = 0; uiPass < 20000; ++uiPass)
+        {
+            for (auto szHash : arrHashes)
+            {
+                uiDecoded += (H_NO_ERROR == Hasher.eDecodeHash(szHash)) ? 1 : 0;
+            }
+        }
+        DoNotOptimize(uiDecoded);
+    });
+
+    // What eStrToSubparadigm and friends used to look tags up in
+    map<CEString, ET_Subparadigm, less<>> mapSubparadigms;
+    for (auto& stEntry : GramTables::arrSubparadigms)
+    {
+        mapSubparadigms[stEntry.szKey] = stEntry.eValue;
+    }
+    vector<CEString> vecTags;
+    for (auto& stEntry : GramTables::arrSubparadigms)
+    {
+        vecTags.emplace_back(stEntry.szKey);
+    }
+    Measure("subparadigm tag lookup, std::map x 330000 (old)", [&]()
+    {
+        unsigned int uiSum = 0;
+        for (unsigned int uiPass = 0; uiPass < 10000; ++uiPass)
+        {
+            for (auto& sTag : vecTags)
+            {
+                uiSum += mapSubparadigms.find(CEStringView(sTag, sTag.uiLength()))->second;
+            }
+        }
+        DoNotOptimize(uiSum);
+    });
+    Measure("subparadigm tag lookup, perfect hash x 330000", [&]()
+    {
+        unsigned int uiSum = 0;
+        for (unsigned int uiPass = 0; uiPass < 10000; ++uiPass)
+        {
+            for (auto& sTag : vecTags)
+            {
+                uiSum += eStrToSubparadigm(CEStringView(sTag, sTag.uiLength()));
+            }
+        }
+        DoNotOptimize(uiSum);
+    });
+
+    // All forms of a reflexive imperfective verb, the way callers enumerate them
+    const ET_Subparadigm arrVerbParadigms[] = { SUBPARADIGM_INFINITIVE, SUBPARADIGM_PRESENT_TENSE, SUBPARADIGM_PAST_TENSE, 
+                                                SUBPARADIGM_IMPERATIVE, SUBPARADIGM_PART_PRES_ACT, SUBPARADIGM_PART_PAST_ACT };
+    Measure("verb paradigm, bIncrement + sGramHash x 2000", [&]()
+    {
+        size_t uiChars = 0;
+        CGramHasher hasher;
+        for (unsigned int uiPass = 0; uiPass < 2000; ++uiPass)
+        {
+            for (auto eSp : arrVerbParadigms)
+            {
+                hasher.Initialize(ASPECT_IMPERFECTIVE, REFL_YES);
+                hasher.SetParadigm(eSp);
+                do
+                {
+                    uiChars += hasher.sGramHash().uiLength();
+                } while (hasher.bIncrement());
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+    CParadigmTables::pGetInstance();      // built on first use, not timed
+    Measure("verb paradigm, CParadigmTables x 2000", [&]()
+    {
+        size_t uiChars = 0;
+        CGramHasher hasher;
+        CParadigmSlots Slots;
+        for (unsigned int uiPass = 0; uiPass < 2000; ++uiPass)
+        {
+            for (auto eSp : arrVerbParadigms)
+            {
+                hasher.Initialize(ASPECT_IMPERFECTIVE, REFL_YES);
+                hasher.SetParadigm(eSp);
+                CParadigmTables::pGetInstance()->bGetParadigm(hasher, Slots);
+                for (auto& stSlot : Slots)
+                {
+                    uiChars += stSlot.svGramHash.uiLength();
+                }
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    vector<uint32_t> vecCodes;
+    for (auto szHash : arrHashes)
+    {
+        uint32_t uiCode = 0;
+        CGramHasher::eHashToCode(szHash, uiCode);
+        vecCodes.push_back(uiCode);
+    }
+    Measure("CGramHasher::sGramHash x 200000", [&]()
+    {
+        size_t uiChars = 0;
+        CGramHasher Hasher;
+        for (unsigned int uiPass = 0; uiPass < 20000; ++uiPass)
+        {
+            for (auto uiCode : vecCodes)
+            {
+                Hasher.eDecodeCode(uiCode);
+                uiChars += Hasher.sGramHash().uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    // Longer than the 23 characters CEString keeps inline: one allocation each
+    vector<uint32_t> vecLongCodes;
+    for (auto szHash : { L"LastNameNounFeminine_F_Sg_Part", L"LastNameNounFeminine_F_Sg_N", L"LastNameNounFeminine_Pl_G", L"LastNameNounFeminine_Pl_I" })
+    {
+        uint32_t uiCode = 0;
+        CGramHasher::eHashToCode(szHash, uiCode);
+        vecLongCodes.push_back(uiCode);
+    }
+    Measure("CGramHasher::sGramHash, long hashes x 200000", [&]()
+    {
+        size_t uiChars = 0;
+        CGramHasher Hasher;
+        for (unsigned int uiPass = 0; uiPass < 50000; ++uiPass)
+        {
+            for (auto uiCode : vecLongCodes)
+            {
+                Hasher.eDecodeCode(uiCode);
+                uiChars += Hasher.sGramHash().uiLength();
+            }
+        }
+        DoNotOptimize(uiChars);
+    });
+    Measure("GramCode decode + compare x 200000", [&]()
+    {
+        unsigned int uiAccusatives = 0;
+        for (unsigned int uiPass = 0; uiPass < 20000; ++uiPass)
+        {
+            for (auto uiCode : vecCodes)
+            {
+                DoNotOptimize(uiCode);
+                uiAccusatives += (GramCode::eCase(uiCode) == CASE_ACC && GramCode::eNumber(uiCode) == NUM_PL) ? 1 : 0;
+            }
+        }
+        DoNotOptimize(uiAccusatives);
+    });
+}
+
+static void RegexBenchmarks()
+{
+    std::printf("\n--- regex ---\n");
+
+    auto vecWords = vecMakeWordList(50000);
+    vector<CEString> vecForms;
+    vecForms.reserve(vecWords.size());
+    for (auto& sWord : vecWords)
+    {
+        vecForms.emplace_back(sWord.c_str());
+    }
+    const wchar_t * szPattern = L"^(.*?)([аеёиоуыэюя])([^аеёиоуыэюя]*)$";
+
+    // What bRegexEvaluate used to do for every call
+    Measure("compile wregex + copy to wstring per call", [&]()
+    {
+        unsigned int uiMatches = 0;
+        for (auto& sForm : vecForms)
+        {
+            wregex regex_ (szPattern);
+            wsmatch match_;
+            wstring wstrData (sForm);
+            uiMatches += regex_match (wstrData, match_, regex_) ? 1 : 0;
+        }
+        DoNotOptimize(uiMatches);
+    });
+
+    Measure("bRegexMatch, pattern text (cached)", [&]()
+    {
+        unsigned int uiMatches = 0;
+        for (auto& sForm : vecForms)
+        {
+            uiMatches += sForm.bRegexMatch(szPattern) ? 1 : 0;
+        }
+        DoNotOptimize(uiMatches);
+    });
+
+    auto spRegex = CRegex::spGet(szPattern);
+    Measure("bRegexMatch, precompiled handle", [&]()
+    {
+        unsigned int uiMatches = 0;
+        for (auto& sForm : vecForms)
+        {
+            uiMatches += sForm.bRegexMatch(spRegex) ? 1 : 0;
+        }
+        DoNotOptimize(uiMatches);
+    });
+
+    // Same handle-based calls on each engine, over typical word-form patterns
+    pair<const char *, const wchar_t *> arrPatterns[] = 
+    {
+        { "last vowel", szPattern }, 
+        { "participle ending", L"(.*)(ющ|ащ|ущ|ящ)(ий|ая|ее|ие|его|ему|им|ем)" }, 
+        { "verb prefix/suffix", L"(по|пере|вы|за)?(.+?)(ть|ться|ти|чь)" }
+    };
+    for (auto& pairPattern : arrPatterns)
+    {
+        auto spStd = make_shared<const CRegex>(pairPattern.second, ecRegexEngineStd);
+        auto spNfa = make_shared<const CRegex>(pairPattern.second);
+        std::printf("%s:\n", pairPattern.first);
+        for (auto& spEngine : { spStd, spNfa })
+        {
+            Measure(spEngine->bNfa() ? "  bRegexMatch, NFA engine" : "  bRegexMatch, std::regex engine", [&]()
+            {
+                unsigned int uiMatches = 0;
+                for (auto& sForm : vecForms)
+                {
+                    uiMatches += sForm.bRegexMatch(spEngine) ? 1 : 0;
+                }
+                DoNotOptimize(uiMatches);
+            });
+        }
+    }
+}
+
+static void SearchBenchmarks()
+{
+    std::printf("\n--- search primitives ---\n");
+
+    auto vecWords = vecMakeWordList(200000);
+    vector<CEString> vecForms;
+    vecForms.reserve(vecWords.size());
+    for (auto& sWord : vecWords)
+    {
+        vecForms.emplace_back(sWord.c_str());
+        vecForms.back().SetVowels(CEString::g_szRusVowels);
+    }
+
+    Measure("count syllables, wcscspn loop (old)", [&]()
+    {
+        unsigned int uiTotal = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sForm : vecForms)
+            {
+                const wchar_t* szData = sForm;
+                unsigned int uiAt = 0;
+                do
+                {
+                    unsigned int uiStartAt = uiAt;
+                    uiAt = (unsigned int)wcscspn(&szData[uiAt], CEString::g_szRusVowels) + uiStartAt;
+                    if (uiAt < sForm.uiLength())
+                    {
+                        ++uiTotal;
+                    }
+                } while (++uiAt < sForm.uiLength());
+            }
+        }
+        DoNotOptimize(uiTotal);
+    });
+
+    Measure("count syllables, uiGetNumOfSyllables()", [&]()
+    {
+        unsigned int uiTotal = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sForm : vecForms)
+            {
+                uiTotal += sForm.uiGetNumOfSyllables();
+            }
+        }
+        DoNotOptimize(uiTotal);
+    });
+
+    auto vecLines = vecMakeCorpus();
+    vector<CEString> vecLineStrings;
+    for (auto& sLine : vecLines)
+    {
+        vecLineStrings.emplace_back(sLine.c_str());
+    }
+
+    Measure("find substring in corpus lines, wcsstr (old)", [&]()
+    {
+        unsigned int uiFound = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sLine : vecLineStrings)
+            {
+                uiFound += wcsstr(sLine, L"скони") ? 1 : 0;
+            }
+        }
+        DoNotOptimize(uiFound);
+    });
+
+    Measure("find substring in corpus lines, uiFind()", [&]()
+    {
+        unsigned int uiFound = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sLine : vecLineStrings)
+            {
+                uiFound += (sLine.uiFind(L"скони") != ecNotFound) ? 1 : 0;
+            }
+        }
+        DoNotOptimize(uiFound);
+    });
+
+    Measure("find last punctuation in lines, bIn loop (old)", [&]()
+    {
+        unsigned int uiTotal = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sLine : vecLineStrings)
+            {
+                for (int iAt = sLine.uiLength() - 1; iAt >= 0; --iAt)
+                {
+                    if (CEString::bIn(sLine[iAt], L",.…—"))
+                    {
+                        uiTotal += iAt;
+                        break;
+                    }
+                }
+            }
+        }
+        DoNotOptimize(uiTotal);
+    });
+
+    Measure("find last punctuation, set built per call (old)", [&]()
+    {
+        unsigned int uiTotal = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sLine : vecLineStrings)
+            {
+                size_t uiAt = Scan::uiFindLast(sLine, sLine.uiLength(), Scan::CCharSet(L",.…—"));
+                uiTotal += (sLine.uiLength() == uiAt) ? 0 : (unsigned int)uiAt;
+            }
+        }
+        DoNotOptimize(uiTotal);
+    });
+
+    Measure("find last punctuation in lines, uiFindLastOf()", [&]()
+    {
+        unsigned int uiTotal = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sLine : vecLineStrings)
+            {
+                unsigned int uiAt = sLine.uiFindLastOf(L",.…—");
+                uiTotal += (ecNotFound == uiAt) ? 0 : uiAt;
+            }
+        }
+        DoNotOptimize(uiTotal);
+    });
+
+    Measure("find last punctuation, prebuilt CCharSet", [&]()
+    {
+        const Scan::CCharSet Punctuation(L",.…—");
+        unsigned int uiTotal = 0;
+        for (int iRep = 0; iRep < 5; ++iRep)
+        {
+            for (auto& sLine : vecLineStrings)
+            {
+                unsigned int uiAt = sLine.uiFindLastOf(Punctuation);
+                uiTotal += (ecNotFound == uiAt) ? 0 : uiAt;
+            }
+        }
+        DoNotOptimize(uiTotal);
+    });
+}
+
+static void Utf8Benchmarks()
+{
+    std::printf("\n--- UTF-8 ---\n");
+
+    // Word-form lines plus the numeric columns typical of a table export
+    auto vecCorpus = vecMakeCorpus();
+    vector<CEString> vecLines;
+    for (auto& sLine : vecCorpus)
+    {
+        vecLines.emplace_back(sLine.c_str());
+        vecLines.emplace_back((L"1048576|" + to_wstring(sLine.length()) + L"|0|1|65536|4294967296|0|0|1|0").c_str());
+    }
+
+    Measure("encode, wstring_convert (old)", [&]()
+    {
+        size_t uiBytes = 0;
+        for (auto& sLine : vecLines)
+        {
+            wstring_convert<codecvt_utf8<wchar_t>> converter;
+            uiBytes += converter.to_bytes(sLine).length();
+        }
+        DoNotOptimize(uiBytes);
+    });
+
+    Measure("encode, stl_sToUtf8", [&]()
+    {
+        size_t uiBytes = 0;
+        for (auto& sLine : vecLines)
+        {
+            uiBytes += sLine.stl_sToUtf8().length();
+        }
+        DoNotOptimize(uiBytes);
+    });
+
+    Measure("encode, ToUtf8 into a reused string", [&]()
+    {
+        size_t uiBytes = 0;
+        string stl_sOut;
+        for (auto& sLine : vecLines)
+        {
+            sLine.ToUtf8(stl_sOut);
+            uiBytes += stl_sOut.length();
+        }
+        DoNotOptimize(uiBytes);
+    });
+
+    vector<string> vecUtf8;
+    for (auto& sLine : vecLines)
+    {
+        vecUtf8.push_back(sLine.stl_sToUtf8());
+    }
+
+    Measure("decode, wstring_convert (old)", [&]()
+    {
+        unsigned int uiChars = 0;
+        for (auto& stl_sLine : vecUtf8)
+        {
+            wstring_convert<codecvt_utf8<wchar_t>> converter;
+            CEString sLine(converter.from_bytes(stl_sLine).c_str());
+            uiChars += sLine.uiLength();
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    Measure("decode, AssignUtf8 into a reused CEString", [&]()
+    {
+        unsigned int uiChars = 0;
+        CEString sLine;
+        for (auto& stl_sLine : vecUtf8)
+        {
+            sLine.AssignUtf8(stl_sLine.data(), stl_sLine.length());
+            uiChars += sLine.uiLength();
+        }
+        DoNotOptimize(uiChars);
+    });
+
+    // Dictionary-style storage; heap bytes are in the allocation column
+    auto vecWords = vecMakeWordList(200000);
+    std::printf("sizeof(CEString) = %u, sizeof(CEStringUtf8) = %u\n", 
+                (unsigned int)sizeof(CEString), (unsigned int)sizeof(CEStringUtf8));
+    Measure("store 200000 words as CEString", [&]()
+    {
+        vector<CEString> vecStored;
+        vecStored.reserve(vecWords.size());
+        for (auto& sWord : vecWords)
+        {
+            vecStored.emplace_back(sWord.c_str());
+        }
+        DoNotOptimize(vecStored.data());
+    });
+
+    Measure("store 200000 words as CEStringUtf8", [&]()
+    {
+        vector<CEStringUtf8> vecStored;
+        vecStored.reserve(vecWords.size());
+        for (auto& sWord : vecWords)
+        {
+            vecStored.emplace_back(sWord.c_str());
+        }
+        DoNotOptimize(vecStored.data());
+    });
+}
+
+//
+// A dictionary load: one gram hash per word form row, drawn from every 
+// tabulated paradigm slot with a skew towards the frequent ones
+//
+static void GramDecodeBenchmarks()
+{
+    const unsigned int cuiRows = 200000;
+    std::printf("\n--- gram hash decoding, %u rows ---\n", cuiRows);
+
+    vector<CEString> vecDistinct;
+    CGramHasher hasher;
+    for (ET_Gender eGender : { GENDER_M, GENDER_F, GENDER_N })
+    {
+        hasher.Initialize(POS_NOUN, SUBPARADIGM_NOUN, eGender, ANIM_NO);
+        do { vecDistinct.push_back(hasher.sGramHash()); } while (hasher.bIncrement());
+    }
+    hasher.Initialize(POS_ADJ);
+    do { vecDistinct.push_back(hasher.sGramHash()); } while (hasher.bIncrement());
+    for (ET_Subparadigm eSp : { SUBPARADIGM_PRESENT_TENSE, SUBPARADIGM_PAST_TENSE, SUBPARADIGM_IMPERATIVE, 
+                                SUBPARADIGM_PART_PRES_ACT, SUBPARADIGM_PART_PAST_PASS_LONG, SUBPARADIGM_PART_PAST_PASS_SHORT })
+    {
+        hasher.Initialize(ASPECT_IMPERFECTIVE, REFL_NO);
+        hasher.SetParadigm(eSp);
+        do { vecDistinct.push_back(hasher.sGramHash()); } while (hasher.bIncrement());
+    }
+
+    vector<CEString> vecColumn;
+    vecColumn.reserve(cuiRows);
+    unsigned int uiSeed = 12345;
+    for (unsigned int uiRow = 0; uiRow < cuiRows; ++uiRow)
+    {
+        uiSeed = uiSeed * 1103515245 + 12345;
+        unsigned int uiRandom = (uiSeed >> 8) % (unsigned int)vecDistinct.size();
+        vecColumn.push_back(vecDistinct[(uiRandom * uiRandom) / (unsigned int)vecDistinct.size()]);
+    }
+
+    Measure("CGramHasher::eDecodeHash per row (old)", [&]()
+    {
+        unsigned int uiCases = 0;
+        CGramHasher Decoder;
+        for (auto& sHash : vecColumn)
+        {
+            Decoder.eDecodeHash(sHash);
+            uiCases += Decoder.m_eCase;
+        }
+        DoNotOptimize(uiCases);
+    });
+
+    vector<uint32_t> vecCodes;
+    CGramDecoder::pGetInstance()->eDecodeBatch(vecDistinct, vecCodes);      // warm, the cold case is timed below
+    Measure("CGramHasher(sHash) per row, memoized", [&]()
+    {
+        unsigned int uiCases = 0;
+        for (auto& sHash : vecColumn)
+        {
+            CGramHasher Decoded(sHash);
+            uiCases += Decoded.m_eCase;
+        }
+        DoNotOptimize(uiCases);
+    });
+
+    Measure("CGramDecoder::eDecode per row", [&]()
+    {
+        unsigned int uiCases = 0;
+        CGramInfo stGramInfo;
+        CGramDecoder * pDecoder = CGramDecoder::pGetInstance();
+        for (auto& sHash : vecColumn)
+        {
+            pDecoder->eDecode(CEStringView(sHash, sHash.uiLength()), stGramInfo);
+            uiCases += stGramInfo.m_eCase;
+        }
+        DoNotOptimize(uiCases);
+    });
+
+    Measure("CGramDecoder::eDecodeBatch, whole column", [&]()
+    {
+        CGramDecoder::pGetInstance()->eDecodeBatch(vecColumn, vecCodes);
+        DoNotOptimize(vecCodes.data());
+    });
+
+    Measure("CGramDecoder::eDecodeBatch, cold decoder", [&]()
+    {
+        CGramDecoder Decoder;
+        Decoder.eDecodeBatch(vecColumn, vecCodes);
+        DoNotOptimize(vecCodes.data());
+    });
+}
+
+static void HashBenchmarks()
+{
+    const unsigned int cuiSources = 100000;
+    std::printf("\n--- content hashes, %u inflection sources ---\n", cuiSources);
+
+    // Shaped like StInflectionHasher::sHashSource()
+    vector<wstring> vecWords = vecMakeWordList(1000);
+    vector<CEString> vecSources;
+    vecSources.reserve(cuiSources);
+    for (unsigned int uiSource = 0; uiSource < cuiSources; ++uiSource)
+    {
+        wstring sSource = vecWords[uiSource % vecWords.size()] + L"м" + std::to_wstring(uiSource % 17) + 
+            L"0" + std::to_wstring(uiSource % 7) + L"10" + std::to_wstring(uiSource % 5) + L"0000";
+        vecSources.push_back(CEString(sSource.c_str()));
+    }
+
+    Measure("CMD5::sHash", [&]()
+    {
+        CMD5 md5;
+        unsigned int uiLength = 0;
+        for (auto& sSource : vecSources)
+        {
+            uiLength += md5.sHash(sSource).uiLength();
+        }
+        DoNotOptimize(uiLength);
+    });
+
+    Measure("CHash128, hex digest", [&]()
+    {
+        CHash128 hash128;
+        wchar_t szHex[Digest::cuiHex128Length_];
+        unsigned int uiSum = 0;
+        for (auto& sSource : vecSources)
+        {
+            hash128.Init();
+            hash128.UpdateUtf16(sSource, sSource.uiLength());
+            hash128.FinalHex(szHex);
+            uiSum += szHex[0];
+        }
+        DoNotOptimize(uiSum);
+    });
+
+    vector<unsigned char> vecDigests(cuiSources * CMD5::cuiDigestBytes_);
+    CMD5 md5;
+    for (unsigned int uiSource = 0; uiSource < cuiSources; ++uiSource)
+    {
+        md5.Init();
+        md5.UpdateUtf16(vecSources[uiSource], vecSources[uiSource].uiLength());
+        md5.Final(&vecDigests[uiSource * CMD5::cuiDigestBytes_]);
+    }
+
+    Measure("digest to hex, wstringstream (old)", [&]()
+    {
+        unsigned int uiLength = 0;
+        for (unsigned int uiSource = 0; uiSource < cuiSources; ++uiSource)
+        {
+            std::wstringstream ss;
+            for (size_t uiByte = 0; uiByte < CMD5::cuiDigestBytes_; ++uiByte)
+            {
+                ss << std::hex << std::setw(2) << std::setfill(L'0') << (int)vecDigests[uiSource * CMD5::cuiDigestBytes_ + uiByte];
+            }
+            CEString sHex(ss.str().c_str());
+            uiLength += sHex.uiLength();
+        }
+        DoNotOptimize(uiLength);
+    });
+
+    Measure("digest to hex, Digest::ToHex", [&]()
+    {
+        unsigned int uiLength = 0;
+        wchar_t szHex[Digest::cuiHex128Length_];
+        for (unsigned int uiSource = 0; uiSource < cuiSources; ++uiSource)
+        {
+            Digest::ToHex(&vecDigests[uiSource * CMD5::cuiDigestBytes_], CMD5::cuiDigestBytes_, szHex);
+            CEString sHex(szHex);
+            uiLength += sHex.uiLength();
+        }
+        DoNotOptimize(uiLength);
+    });
+}
+
+int main()
+{
+    AppendBenchmarks();
+    WordListBenchmarks();
+    SeparatorBenchmarks();
+    TokenizerBenchmarks();
+    FieldBenchmarks();
+    SearchBenchmarks();
+    RegexBenchmarks();
+    Utf8Benchmarks();
+    GramDecodeBenchmarks();
+    HashBenchmarks();
+    return 0;
+}
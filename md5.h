@@ -1,95 +1,197 @@
 #ifndef C_MD5_INCLUDED
 #define C_MD5_INCLUDED
 
-#include <wincrypt.h>
+//
+// MD5 (RFC 1321), self-contained. Wide strings are hashed as UTF-16LE, the
+// bytes the wincrypt-based version used to see on Windows, so digests stored
+// by earlier builds still match.
+//
 
-using namespace std;
+#include "EString.h"
+#include "ContentHash.h"
 
 namespace Hlib
 {
 
 class CMD5
 {
-
-private:
-    HCRYPTPROV hCryptProv;
-    HCRYPTHASH hHash;
-
 public:
+    static constexpr size_t cuiDigestBytes_ = 16;
+
     CMD5()
     {
-        hCryptProv = NULL;
-        hHash = NULL;
         Init();
     }
 
-    ~CMD5()
+    void Init()
     {
-        Null();
-    }
+        m_arrState[0] = 0x67452301;
+        m_arrState[1] = 0xEFCDAB89;
+        m_arrState[2] = 0x98BADCFE;
+        m_arrState[3] = 0x10325476;
+        m_ullLength = 0;
+        m_uiBuffered = 0;
 
-    void Init()
+    }   //  Init()
+
+    void Update (const void * pData, size_t uiBytes)
     {
-        BOOL uiRet = CryptAcquireContext (&hCryptProv, NULL, NULL, PROV_RSA_FULL, CRYPT_VERIFYCONTEXT);
-        if (!uiRet)
+        const unsigned char * pchrAt = static_cast<const unsigned char *> (pData);
+        m_ullLength += uiBytes;
+
+        if (m_uiBuffered > 0)
         {
-            throw CException (GetLastError(), L"CMD5::Init(): CryptAcquireContext() failed.");
+            size_t uiTake = (uiBytes < cuiBlock_ - m_uiBuffered) ? uiBytes : cuiBlock_ - m_uiBuffered;
+            memcpy (m_arrBuffer + m_uiBuffered, pchrAt, uiTake);
+            m_uiBuffered += uiTake;
+            pchrAt += uiTake;
+            uiBytes -= uiTake;
+            if (m_uiBuffered < cuiBlock_)
+            {
+                return;
+            }
+            Block (m_arrBuffer);
+            m_uiBuffered = 0;
         }
 
-        uiRet = CryptCreateHash (hCryptProv, CALG_MD5, 0, 0, &hHash);
-        if (!uiRet)
+        for (; uiBytes >= cuiBlock_; pchrAt += cuiBlock_, uiBytes -= cuiBlock_)
         {
-            throw CException (GetLastError(), L"CMD5::Init(): CryptCreateHash() failed.");
+            Block (pchrAt);
         }
 
-    }   //  Init()
+        memcpy (m_arrBuffer, pchrAt, uiBytes);
+        m_uiBuffered = uiBytes;
 
-    CEString sHash (const CEString& sSource)
+    }   //  Update (...)
+
+    void UpdateUtf16 (const wchar_t * pchrData, size_t uiLength)
     {
-        BOOL uiRet = CryptHashData (hHash, 
-                                    (BYTE *)sSource.pToBytes(), 
-                                    sSource.uiLength()* sizeof(wchar_t), 0);
-        if (!uiRet)
-        {
-            throw CException (-1, L"CMD5::sHash():CryptHashData() failed.");
-        }
+        Digest::UpdateUtf16 (*this, pchrData, uiLength);
+    }
+
+    // Leaves the hasher to be Init()'ed before reuse
+    void Final (unsigned char * pDigest)
+    {
+        uint64_t ullBits = m_ullLength * 8;
+
+        static const unsigned char s_arrPadding[cuiBlock_] = { 0x80 };
+        size_t uiPad = (m_uiBuffered < 56) ? 56 - m_uiBuffered : 120 - m_uiBuffered;
+        Update (s_arrPadding, uiPad);
 
-        BYTE byteHash[16];
-        DWORD dwLength = 16;
-        uiRet = CryptGetHashParam (hHash, HP_HASHVAL, byteHash, &dwLength, 0);
-        if (!uiRet)
+        unsigned char arrBits[8];
+        for (int iByte = 0; iByte < 8; ++iByte)
         {
-            throw CException (-1, L"CT_Hash::sHash(): CryptGetHashParam() failed.");
+            arrBits[iByte] = (unsigned char)(ullBits >> (8 * iByte));
         }
+        Update (arrBits, 8);
 
-        wstringstream io_;
-        io_.fill ('0');
-        for (int iByte = 0; iByte < 16; ++iByte)
+        for (int iWord = 0; iWord < 4; ++iWord)
         {
-            io_.width (2);
-            io_ << hex << byteHash[iByte];
+            for (int iByte = 0; iByte < 4; ++iByte)
+            {
+                pDigest[4 * iWord + iByte] = (unsigned char)(m_arrState[iWord] >> (8 * iByte));
+            }
         }
 
-        return io_.str().c_str();
+    }   //  Final (...)
+
+    // szOut must hold Digest::cuiHex128Length_ characters
+    void FinalHex (wchar_t * szOut)
+    {
+        unsigned char arrDigest[cuiDigestBytes_];
+        Final (arrDigest);
+        Digest::ToHex (arrDigest, cuiDigestBytes_, szOut);
+    }
+
+    // Lowercase hex MD5 of the string's UTF-16LE bytes
+    CEString sHash (const CEString& sSource)
+    {
+        Init();
+        UpdateUtf16 (sSource, sSource.uiLength());
+        wchar_t szHex[Digest::cuiHex128Length_];
+        FinalHex (szHex);
+        Init();
+
+        return CEString (szHex);
 
     }   // sHash()
 
-    void Null()
+private:
+    static constexpr size_t cuiBlock_ = 64;
+
+    static uint32_t uiRotl (uint32_t uiValue, int iBits)
     {
-        if (hHash)
+        return (uiValue << iBits) | (uiValue >> (32 - iBits));
+    }
+
+    void Block (const unsigned char * pchrBlock)
+    {
+        static const uint32_t s_arrSines[64] =
+        {
+            0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+            0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+            0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+            0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+            0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+            0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+            0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+            0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391
+        };
+        static const int s_arrShifts[4][4] = { { 7, 12, 17, 22 }, { 5, 9, 14, 20 }, { 4, 11, 16, 23 }, { 6, 10, 15, 21 } };
+
+        uint32_t arrWords[16];
+        for (int iWord = 0; iWord < 16; ++iWord)
         {
-            CryptDestroyHash (hHash);
-            hHash = NULL;
+            const unsigned char * pchrWord = pchrBlock + 4 * iWord;
+            arrWords[iWord] = (uint32_t)pchrWord[0] | ((uint32_t)pchrWord[1] << 8) |
+                ((uint32_t)pchrWord[2] << 16) | ((uint32_t)pchrWord[3] << 24);
         }
-        if (hCryptProv) 
+
+        uint32_t uiA = m_arrState[0], uiB = m_arrState[1], uiC = m_arrState[2], uiD = m_arrState[3];
+        for (int iStep = 0; iStep < 64; ++iStep)
         {
-            CryptReleaseContext (hCryptProv, 0);
-            hCryptProv = NULL;
+            int iRound = iStep / 16;
+            uint32_t uiF = 0;
+            int iWord = 0;
+            switch (iRound)
+            {
+                case 0:
+                    uiF = (uiB & uiC) | (~uiB & uiD);
+                    iWord = iStep;
+                    break;
+                case 1:
+                    uiF = (uiD & uiB) | (~uiD & uiC);
+                    iWord = (5 * iStep + 1) % 16;
+                    break;
+                case 2:
+                    uiF = uiB ^ uiC ^ uiD;
+                    iWord = (3 * iStep + 5) % 16;
+                    break;
+                default:
+                    uiF = uiC ^ (uiB | ~uiD);
+                    iWord = (7 * iStep) % 16;
+            }
+
+            uint32_t uiTemp = uiD;
+            uiD = uiC;
+            uiC = uiB;
+            uiB = uiB + uiRotl (uiA + uiF + s_arrSines[iStep] + arrWords[iWord], s_arrShifts[iRound][iStep % 4]);
+            uiA = uiTemp;
         }
-    
-    }   //  Null()
 
-};
+        m_arrState[0] += uiA;
+        m_arrState[1] += uiB;
+        m_arrState[2] += uiC;
+        m_arrState[3] += uiD;
+
+    }   //  Block (...)
+
+    uint32_t m_arrState[4];
+    uint64_t m_ullLength;
+    unsigned char m_arrBuffer[cuiBlock_];
+    size_t m_uiBuffered;
+
+};      //  class CMD5
 
 }   //  namespace Hlib
 
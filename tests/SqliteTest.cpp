@@ -0,0 +1,816 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "Logging.h"
+#include "SqliteWrapper.h"
+
+using namespace Hlib;
+
+//
+// Scratch files live in the temp directory and are removed on the way out
+//
+static std::string stl_sTempPath(const char* szName)
+{
+    return (std::filesystem::temp_directory_path() / (std::string("hlib_sqlite_test_") + szName)).string();
+}
+
+static void RemoveDb(const std::string& stl_sPath)
+{
+    for (const char* szSuffix : { "", "-journal", "-wal", "-shm" })
+    {
+        std::remove((stl_sPath + szSuffix).c_str());
+    }
+}
+
+static void WriteFile(const std::string& stl_sPath, const std::string& stl_sContents)
+{
+    std::ofstream ioOut(stl_sPath, std::ios::binary);
+    ioOut << stl_sContents;
+}
+
+// Import file with one table: name, header and iRows rows of id|form|gram
+static std::string stl_sMakeImportTable(const char* szTable, int iRows)
+{
+    std::ostringstream ioOut;
+    ioOut << szTable << "\nid|form|gram\n";
+    for (int iRow = 1; iRow <= iRows; ++iRow)
+    {
+        ioOut << iRow << "|слово" << iRow << "|Noun_Sg_" << (iRow % 6) << "\n";
+    }
+    ioOut << "\n";
+    return ioOut.str();
+}
+
+static CEString sGetPragma(CSqlite& db, const wchar_t* szName)
+{
+    CSqlite::CStatement stPragma = db.Prepare(CEString(L"PRAGMA ") + szName);
+    CEString sValue;
+    if (SQLITE_ROW == sqlite3_step(stPragma))
+    {
+        sValue = CEString::sFromUtf8((const char*)sqlite3_column_text(stPragma, 0));
+    }
+    return sValue;
+}
+
+// Every row, in rowid order, with the type of each value
+static std::string stl_sTableContents(CSqlite& db, const char* szTable)
+{
+    std::string stl_sContents;
+    CSqlite::CStatement stSelect = db.Prepare(CEString(L"SELECT * FROM ") + CEString::sFromUtf8(szTable) + L" ORDER BY rowid");
+    int iColumns = sqlite3_column_count(stSelect);
+    while (SQLITE_ROW == sqlite3_step(stSelect))
+    {
+        for (int iCol = 0; iCol < iColumns; ++iCol)
+        {
+            stl_sContents += std::to_string(sqlite3_column_type(stSelect, iCol)) + ":";
+            stl_sContents.append((const char*)sqlite3_column_blob(stSelect, iCol), sqlite3_column_bytes(stSelect, iCol));
+            stl_sContents += '|';
+        }
+        stl_sContents += '\n';
+    }
+    return stl_sContents;
+}
+
+static std::string stl_sReadFile(const std::string& stl_sPath)
+{
+    std::ifstream ioIn(stl_sPath, std::ios::binary);
+    std::ostringstream ioContents;
+    ioContents << ioIn.rdbuf();
+    return ioContents.str();
+}
+
+//
+// Tables for the export tests: a sparse rowid table with NULLs, reals and 
+// empty strings, one whose lines start with empty columns, a WITHOUT ROWID 
+// table and one that SELECT * reads through a covering index
+//
+static const std::vector<CEString> g_vecExportTables { L"exp_plain", L"exp_loose", L"exp_norowid", L"exp_covered" };
+
+static void CreateExportTables(CSqlite& db, int iRows)
+{
+    CEString sRows = CEString::sToString(iRows);
+    db.BeginTransaction();
+    db.Exec(L"CREATE TABLE exp_plain (id INTEGER PRIMARY KEY, a TEXT, b REAL, c INTEGER)");
+    db.Exec(L"WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + sRows + L") "
+            L"INSERT INTO exp_plain SELECT i * 3, CASE i % 4 WHEN 0 THEN NULL WHEN 1 THEN '' ELSE 'слово' || i END, "
+            L"i * 0.1, CASE WHEN i % 5 = 0 THEN NULL ELSE i * i END FROM n");
+    db.Exec(L"INSERT INTO exp_plain VALUES (1, 'x', 1e300, 9223372036854775807), (2, NULL, -2.5, -9223372036854775808)");
+
+    db.Exec(L"CREATE TABLE exp_loose (a TEXT, b TEXT, c TEXT)");
+    db.Exec(L"INSERT INTO exp_loose VALUES ('', NULL, 'x'), (NULL, 'y', ''), ('z', '', ''), (NULL, NULL, NULL), ('Ёж', 'a b', 'c')");
+
+    db.Exec(L"CREATE TABLE exp_norowid (k TEXT PRIMARY KEY, v REAL) WITHOUT ROWID");
+    db.Exec(L"WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 200) "
+            L"INSERT INTO exp_norowid SELECT 'ключ' || (200 - i), i / 7.0 FROM n");
+
+    db.Exec(L"CREATE TABLE exp_covered (id INTEGER PRIMARY KEY, k TEXT, v TEXT)");
+    db.Exec(L"CREATE INDEX ix_covered ON exp_covered (k, v)");
+    db.Exec(L"WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + sRows + L") "
+            L"INSERT INTO exp_covered SELECT i, 1000000 - i, 'v' || i FROM n");
+    db.CommitTransaction();
+
+    // Statistics that make the narrow index look cheaper than the table
+    db.Exec(L"ANALYZE");
+    db.Exec(L"UPDATE sqlite_stat1 SET stat = '" + sRows + L" 1 1 sz=5' WHERE idx = 'ix_covered'");
+    db.Exec(L"INSERT INTO sqlite_stat1 VALUES ('exp_covered', NULL, '" + sRows + L" sz=200')");
+    db.Exec(L"ANALYZE sqlite_schema");
+}
+
+static bool bScansCoveringIndex(CSqlite& db)
+{
+    CSqlite::CStatement stPlan = db.Prepare(L"EXPLAIN QUERY PLAN SELECT * FROM exp_covered");
+    bool bCovering = false;
+    while (SQLITE_ROW == sqlite3_step(stPlan))
+    {
+        bCovering = bCovering || strstr((const char*)sqlite3_column_text(stPlan, 3), "COVERING INDEX");
+    }
+    return bCovering;
+}
+
+// What bExportTables wrote before it streamed column text: a CEString per value
+static std::string stl_sReferenceExport(CSqlite& db, const std::vector<CEString>& vecTables)
+{
+    std::string stl_sOut;
+    for (auto& sTable : vecTables)
+    {
+        CSqlite::CStatement stSelect = db.Prepare(L"SELECT * FROM " + sTable + L";");
+        sqlite3_stmt* pStmt = stSelect;
+        int iColumns = sqlite3_column_count(pStmt);
+
+        CEString sHeader(sTable);
+        sHeader += L"\n";
+        for (int iCol = 0; iCol < iColumns; ++iCol)
+        {
+            sHeader += CEString::sFromUtf8(sqlite3_column_name(pStmt, iCol));
+            sHeader += (iCol < iColumns - 1) ? SZ_SEPARATOR : L"\n";
+        }
+        stl_sOut += sHeader.stl_sToUtf8();
+
+        while (db.bGetRow(pStmt))
+        {
+            CEString sOut;
+            for (int iCol = 0; iCol < iColumns; ++iCol)
+            {
+                CEString sCol;
+                db.GetData(iCol, sCol, pStmt);
+                if (sOut.uiLength() > 0)
+                {
+                    sOut += SZ_SEPARATOR;
+                }
+                sOut += sCol;
+            }
+            sOut += L"\n";
+            stl_sOut += sOut.stl_sToUtf8();
+        }
+        stl_sOut += "\n";
+    }
+    return stl_sOut;
+}
+
+// True if bImportBinary() throws on the dump and leaves the connection as 
+// it found it: no open transaction and its own PRAGMA synchronous
+static bool bRejectsDump(const std::string& stl_sDump)
+{
+    std::string stl_sDumpDb = stl_sTempPath("rejected.db");
+    std::string stl_sDumpPath = stl_sTempPath("rejected.hldb");
+    RemoveDb(stl_sDumpDb);
+    WriteFile(stl_sDumpPath, stl_sDump);
+    bool bRejected = false;
+    {
+        CSqlite db(CEString::sFromUtf8(stl_sDumpDb));
+        CEString sDumpPath = CEString::sFromUtf8(stl_sDumpPath);
+        CEString sSynchronous = sGetPragma(db, L"synchronous");
+        StImportOptions stOptions;
+        stOptions.sSynchronous = L"OFF";
+        try
+        {
+            db.bImportBinary(sDumpPath, false, [](int, bool) {}, stOptions);
+        }
+        catch (CException&)
+        {
+            bRejected = true;
+        }
+        if (bRejected)
+        {
+            try
+            {
+                db.BeginTransaction();
+                db.CommitTransaction();
+            }
+            catch (CException&)
+            {
+                bRejected = false;
+            }
+            bRejected = bRejected && sGetPragma(db, L"synchronous") == sSynchronous;
+        }
+    }
+    std::remove(stl_sDumpPath.c_str());
+    RemoveDb(stl_sDumpDb);
+    return bRejected;
+}
+
+// Dump of a one-column table with a single stored block of raw bytes
+static std::string stl_sMakeDump(const std::string& stl_sRaw, uint64_t ullRows, 
+                                 const std::string& stl_sTable = "crafted", const std::string& stl_sSchema = "")
+{
+    std::string stl_sDump(Dump::cszMagic_);
+    Dump::PutVarint(Dump::cullVersion_, stl_sDump);
+
+    std::string stl_sHeader;
+    for (auto& stl_sString : { stl_sTable, stl_sSchema })
+    {
+        Dump::PutVarint(stl_sString.length(), stl_sHeader);
+        stl_sHeader += stl_sString;
+    }
+    Dump::PutVarint(1, stl_sHeader);
+    Dump::PutVarint(1, stl_sHeader);
+    stl_sHeader += "a";
+    stl_sDump += (char)Dump::ecTable;
+    Dump::PutVarint(stl_sHeader.length(), stl_sDump);
+    stl_sDump += stl_sHeader;
+    Dump::PutFixed32(Dump::uiCrc32(stl_sHeader.data(), stl_sHeader.length()), stl_sDump);
+
+    stl_sDump += (char)Dump::ecBlock;
+    Dump::PutVarint(ullRows, stl_sDump);
+    stl_sDump += (char)Dump::ecStored;
+    Dump::PutVarint(stl_sRaw.length(), stl_sDump);
+    Dump::PutVarint(stl_sRaw.length(), stl_sDump);
+    Dump::PutFixed32(Dump::uiCrc32(stl_sRaw.data(), stl_sRaw.length()), stl_sDump);
+    stl_sDump += stl_sRaw;
+    stl_sDump += (char)Dump::ecEndOfTable;
+    return stl_sDump;
+}
+
+//
+// Progress callbacks are plain function pointers, so what they look at 
+// goes through globals
+//
+static CSqlite* g_pObserver = nullptr;          // second connection, sees committed rows only
+static CSqlite* g_pImporting = nullptr;
+static CEString g_sObservedTable;
+static std::vector<int64_t> g_vecObservedRows;
+static CEString g_sSynchronousDuringImport;
+static CSqlite* g_pWriter = nullptr;            // second connection, writes while an export runs
+static int g_iLateWrites = 0;
+static int g_iBlockedWrites = 0;
+
+static void ObserveProgress(int, bool)
+{
+    if (g_pObserver)
+    {
+        g_vecObservedRows.push_back(g_pObserver->llRows(g_sObservedTable));
+    }
+    if (g_pImporting)
+    {
+        g_sSynchronousDuringImport = sGetPragma(*g_pImporting, L"synchronous");
+    }
+    if (g_pWriter)
+    {
+        try
+        {
+            g_pWriter->Exec(L"INSERT INTO exp_loose VALUES ('late', 'late', 'late')");
+            ++g_iLateWrites;
+        }
+        catch (CException&)
+        {
+            ++g_iBlockedWrites;
+        }
+    }
+}
+
+int main()
+{
+    bool bErrors {false};
+
+    std::string stl_sDbPath = stl_sTempPath("main.db");
+    RemoveDb(stl_sDbPath);
+
+    {
+        // Statement cache
+        CSqlite db(CEString::sFromUtf8(stl_sDbPath));
+        db.Exec(L"CREATE TABLE cache_test (id INTEGER PRIMARY KEY, row INTEGER, name TEXT)");
+        db.ClearStatementCache();
+
+        sqlite3_stmt* pFirst = nullptr;
+        {
+            CSqlite::CStatement stSelect = db.Prepare(L"SELECT ?");
+            pFirst = stSelect;
+            db.Bind(1, (int64_t)42, pFirst);
+            if (SQLITE_ROW != sqlite3_step(pFirst) || 42 != sqlite3_column_int64(pFirst, 0))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Statement cache: select failed");
+            }
+        }   // returned mid-step, with the parameter still bound
+
+        bool bMatch = 1 == db.uiStatementCacheSize();
+        {
+            CSqlite::CStatement stSelect = db.Prepare(L"SELECT ?");
+            sqlite3_stmt* pStmt = stSelect;
+            bMatch = bMatch && pStmt == pFirst && 0 == db.uiStatementCacheSize();
+
+            // Reset and bindings cleared: the statement starts over with NULL
+            bMatch = bMatch && !sqlite3_stmt_busy(pStmt) && SQLITE_ROW == sqlite3_step(pStmt) &&
+                SQLITE_NULL == sqlite3_column_type(pStmt, 0);
+        }
+        if (!bMatch || 1 != db.uiStatementCacheSize())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Statement cache: no reuse, reset or binding cleanup");
+        }
+
+        // The PrepareFor* family gives its statement back in Finalize()
+        db.ClearStatementCache();
+        for (int iRow = 0; iRow < 3; ++iRow)
+        {
+            db.PrepareForInsert(L"cache_test", 2);
+            db.Bind(1, (int64_t)iRow);
+            db.Bind(2, CEString(L"строка"));
+            db.InsertRow();
+            db.Finalize();
+        }
+        if (1 != db.uiStatementCacheSize() || 3 != db.llRows(L"cache_test"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Statement cache: PrepareForInsert/Finalize");
+        }
+
+        // LRU: with room for two, the oldest of A, B, C is dropped
+        db.ClearStatementCache();
+        db.SetStatementCacheCapacity(2);
+        for (const wchar_t* szSql : { L"SELECT 1", L"SELECT 2", L"SELECT 3" })
+        {
+            db.Prepare(szSql);
+        }
+        bMatch = 2 == db.uiStatementCacheSize();
+        {
+            CSqlite::CStatement stMiss = db.Prepare(L"SELECT 1");      // evicted, compiled anew
+            bMatch = bMatch && 2 == db.uiStatementCacheSize();
+            CSqlite::CStatement stHit = db.Prepare(L"SELECT 2");       // still idle, checked out
+            bMatch = bMatch && 1 == db.uiStatementCacheSize();
+        }
+        if (!bMatch || 2 != db.uiStatementCacheSize())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Statement cache: LRU trim");
+        }
+
+        // Capacity 0 turns the cache off
+        db.SetStatementCacheCapacity(0);
+        bMatch = 0 == db.uiStatementCacheSize();
+        db.Prepare(L"SELECT 4");
+        db.PrepareForSelect(L"SELECT name FROM cache_test");
+        CEString sName;
+        bMatch = bMatch && db.bGetRow() && (db.GetData(0, sName), sName == L"строка");
+        db.Finalize();
+        if (!bMatch || 0 != db.uiStatementCacheSize())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Statement cache: capacity 0");
+        }
+    }
+
+    {
+        // Import: commits every N rows, PRAGMAs set for the import and restored
+        std::string stl_sImportPath = stl_sTempPath("import.txt");
+        const int ciRows = 5000;
+        WriteFile(stl_sImportPath, stl_sMakeImportTable("import_test", ciRows));
+        CEString sImportPath = CEString::sFromUtf8(stl_sImportPath);
+
+        CSqlite db(CEString::sFromUtf8(stl_sDbPath));
+        CSqlite dbObserver(CEString::sFromUtf8(stl_sDbPath));
+        db.Exec(L"PRAGMA synchronous = FULL");
+        db.Exec(L"PRAGMA cache_size = -3000");
+        g_pObserver = &dbObserver;
+        g_sObservedTable = L"import_test";
+
+        StImportOptions stOptions;
+        stOptions.uiRowsPerTransaction = 1000;
+        stOptions.sSynchronous = L"OFF";
+        stOptions.sJournalMode = L"MEMORY";
+        stOptions.iCacheSize = -8000;
+        g_pImporting = &db;
+        db.bImportTables(sImportPath, false, ObserveProgress, stOptions);
+        g_pImporting = nullptr;
+
+        bool bPartial = false;
+        bool bMatch = !g_vecObservedRows.empty();
+        for (int64_t llRows : g_vecObservedRows)
+        {
+            bMatch = bMatch && (0 == llRows % 1000 || ciRows == llRows);
+            bPartial = bPartial || (llRows > 0 && llRows < ciRows);
+        }
+        if (!bMatch || !bPartial || ciRows != db.llRows(L"import_test"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Import: commits are not every uiRowsPerTransaction rows");
+        }
+
+        if (g_sSynchronousDuringImport != L"0" || sGetPragma(db, L"synchronous") != L"2" || 
+            sGetPragma(db, L"cache_size") != L"-3000" || sGetPragma(db, L"journal_mode") != L"delete")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Import: PRAGMAs not applied or not restored");
+        }
+
+        // The default is one transaction per table
+        g_vecObservedRows.clear();
+        db.bImportTables(sImportPath, false, ObserveProgress);
+        bMatch = !g_vecObservedRows.empty();
+        for (int64_t llRows : g_vecObservedRows)
+        {
+            bMatch = bMatch && (0 == llRows || ciRows == llRows);
+        }
+        if (!bMatch || ciRows != db.llRows(L"import_test"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Import: default import committed before the end of the table");
+        }
+
+        g_pObserver = nullptr;
+        std::remove(stl_sImportPath.c_str());
+    }
+
+    {
+        // Import: lines longer than the old 10000-byte buffer and the 1 MB 
+        // read block, and a last line without a newline, with Unix and with 
+        // Windows line ends
+        std::string stl_sLong20k, stl_sLong3M;
+        for (int iChar = 0; iChar < 10000; ++iChar)
+        {
+            stl_sLong20k += "ж";        // 2 bytes in UTF-8
+        }
+        for (int iChar = 0; iChar < 1500000; ++iChar)
+        {
+            stl_sLong3M += "я";
+        }
+        std::string stl_sImportPath = stl_sTempPath("long.txt");
+        CSqlite db(CEString::sFromUtf8(stl_sDbPath));
+
+        for (std::string stl_sEol : { "\n", "\r\n" })
+        {
+            WriteFile(stl_sImportPath, "long_test" + stl_sEol + "id|text" + stl_sEol + "1|" + stl_sLong20k + stl_sEol 
+                                       + "2|" + stl_sLong3M + stl_sEol + "3|short" + stl_sEol + stl_sEol 
+                                       + "next_test" + stl_sEol + "id|text" + stl_sEol + "1|last");
+
+            std::vector<std::string> vecLines;
+            {
+                CImportReader Reader(CEString::sFromUtf8(stl_sImportPath));
+                string_view svLine;
+                while (Reader.bGetLine(svLine))
+                {
+                    vecLines.emplace_back(svLine);
+                }
+            }
+            if (vecLines != std::vector<std::string> { "long_test", "id|text", "1|" + stl_sLong20k, "2|" + stl_sLong3M, "3|short", "",
+                                                       "next_test", "id|text", "1|last" })
+            {
+                bErrors = true;
+                ERROR_LOG(L"CImportReader: long or unterminated lines");
+            }
+
+            CEString sImportPath = CEString::sFromUtf8(stl_sImportPath);
+            db.bImportTables(sImportPath, false, ObserveProgress);
+
+            // Read back as UTF-8, the 3 MB value is past CEString's size limit
+            std::vector<std::string> vecTexts;
+            for (auto szQuery : { L"SELECT text FROM long_test ORDER BY id", L"SELECT text FROM next_test ORDER BY id" })
+            {
+                CSqlite::CStatement stSelect = db.Prepare(szQuery);
+                while (SQLITE_ROW == sqlite3_step(stSelect))
+                {
+                    vecTexts.emplace_back((const char*)sqlite3_column_text(stSelect, 0), sqlite3_column_bytes(stSelect, 0));
+                }
+            }
+            if (vecTexts != std::vector<std::string> { stl_sLong20k, stl_sLong3M, "short", "last" })
+            {
+                bErrors = true;
+                ERROR_LOG(L"Import: long or unterminated lines");
+            }
+        }
+
+        std::remove(stl_sImportPath.c_str());
+    }
+
+    {
+        // Pipelined import gives the serial import's rows, bad lines included
+        std::string stl_sImportPath = stl_sTempPath("pipeline.txt");
+        std::string stl_sTableA = stl_sMakeImportTable("pipe_a", 30000);
+        stl_sTableA.insert(stl_sTableA.find("\n100|"), "\nx|wrong field count\nabc|bad|id");
+        WriteFile(stl_sImportPath, stl_sTableA + stl_sMakeImportTable("pipe_b", 100));
+        CEString sImportPath = CEString::sFromUtf8(stl_sImportPath);
+
+        CSqlite db(CEString::sFromUtf8(stl_sDbPath));
+        db.bImportTables(sImportPath, false, ObserveProgress);
+        std::string stl_sSerial = stl_sTableContents(db, "pipe_a") + stl_sTableContents(db, "pipe_b");
+
+        for (unsigned int uiThreads : { 1, 3 })
+        {
+            StImportOptions stOptions;
+            stOptions.uiParseThreads = uiThreads;
+            stOptions.uiRowsPerTransaction = 7000;
+            db.bImportTables(sImportPath, false, ObserveProgress, stOptions);
+            std::string stl_sPipelined = stl_sTableContents(db, "pipe_a") + stl_sTableContents(db, "pipe_b");
+            if (stl_sPipelined != stl_sSerial || 30000 != db.llRows(L"pipe_a") || 100 != db.llRows(L"pipe_b"))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Pipelined import differs from the serial one");
+            }
+        }
+
+        // A failed insert, here a duplicate id well into the table, reaches the 
+        // caller; the import is rolled back and its PRAGMAs restored
+        CEString sSynchronous = sGetPragma(db, L"synchronous");
+        CEString sJournalMode = sGetPragma(db, L"journal_mode");
+        std::string stl_sDuplicate = stl_sMakeImportTable("pipe_dup", 20000);
+        stl_sDuplicate.insert(stl_sDuplicate.find("\n15000|"), "\n7|duplicate|id");
+        WriteFile(stl_sImportPath, stl_sDuplicate);
+        for (unsigned int uiThreads : { 0, 2 })
+        {
+            StImportOptions stOptions;
+            stOptions.uiParseThreads = uiThreads;
+            stOptions.sSynchronous = L"OFF";
+            stOptions.sJournalMode = L"MEMORY";
+            bool bThrown = false;
+            try
+            {
+                db.bImportTables(sImportPath, false, ObserveProgress, stOptions);
+            }
+            catch (CException&)
+            {
+                bThrown = true;
+            }
+            if (!bThrown || 0 != db.llRows(L"pipe_dup"))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Import: failed insert did not reach the caller");
+            }
+            if (sGetPragma(db, L"synchronous") != sSynchronous || sGetPragma(db, L"journal_mode") != sJournalMode)
+            {
+                bErrors = true;
+                ERROR_LOG(L"Import: PRAGMAs not restored after a failed import");
+            }
+            try
+            {
+                db.BeginTransaction();
+                db.CommitTransaction();
+            }
+            catch (CException&)
+            {
+                bErrors = true;
+                ERROR_LOG(L"Import: failed import left its transaction open");
+            }
+        }
+
+        std::remove(stl_sImportPath.c_str());
+    }
+
+    {
+        // Text export is byte-identical to the CEString-based one
+        std::string stl_sExportDb = stl_sTempPath("export.db");
+        std::string stl_sExportPath = stl_sTempPath("export.txt");
+        RemoveDb(stl_sExportDb);
+        CSqlite db(CEString::sFromUtf8(stl_sExportDb));
+        CreateExportTables(db, 1000);
+        if (!bScansCoveringIndex(db))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Export test setup: exp_covered is not read through its index");
+        }
+
+        CEString sExportPath = CEString::sFromUtf8(stl_sExportPath);
+        db.bExportTables(sExportPath, g_vecExportTables, ObserveProgress);
+        if (stl_sReadFile(stl_sExportPath) != stl_sReferenceExport(db, g_vecExportTables))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Export differs from the reference");
+        }
+
+        std::remove(stl_sExportPath.c_str());
+        RemoveDb(stl_sExportDb);
+    }
+
+    {
+        // Parallel export writes the serial export's bytes, from one database state
+        std::string stl_sExportDb = stl_sTempPath("parallel.db");
+        std::string stl_sExportPath = stl_sTempPath("parallel.txt");
+        RemoveDb(stl_sExportDb);
+        CSqlite db(CEString::sFromUtf8(stl_sExportDb));
+        CreateExportTables(db, 100000);        // exp_plain spans several rowid ranges
+        if (!bScansCoveringIndex(db))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Export test setup: exp_covered is not read through its index");
+        }
+
+        std::string stl_sReference = stl_sReferenceExport(db, g_vecExportTables);
+        CEString sExportPath = CEString::sFromUtf8(stl_sExportPath);
+        for (unsigned int uiThreads : { 0, 2, 4 })
+        {
+            db.bExportTables(sExportPath, g_vecExportTables, ObserveProgress, uiThreads);
+            if (stl_sReadFile(stl_sExportPath) != stl_sReference)
+            {
+                bErrors = true;
+                ERROR_LOG(L"Export with " + CEString::sToString(uiThreads) + L" threads differs from the reference");
+            }
+        }
+
+        // Workers share the snapshot, so commits from elsewhere wait for the export
+        CSqlite dbWriter(CEString::sFromUtf8(stl_sExportDb));
+        g_pWriter = &dbWriter;
+        db.bExportTables(sExportPath, g_vecExportTables, ObserveProgress, 2);
+        g_pWriter = nullptr;
+        if (g_iLateWrites != 0 || g_iBlockedWrites < 1)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Write during parallel export was not held off");
+        }
+        if (stl_sReadFile(stl_sExportPath) != stl_sReference)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Parallel export picked up a concurrent write");
+        }
+        try
+        {
+            dbWriter.Exec(L"DELETE FROM exp_loose WHERE a = 'late'");
+        }
+        catch (CException&)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Parallel export kept the database locked");
+        }
+
+        // Uncommitted rows of this connection are exported, as in a serial export
+        db.BeginTransaction();
+        db.Exec(L"INSERT INTO exp_loose VALUES ('new', '', NULL), ('', 'new', NULL)");
+        db.bExportTables(sExportPath, g_vecExportTables, ObserveProgress, 2);
+        std::string stl_sUncommitted = stl_sReferenceExport(db, g_vecExportTables);
+        if (stl_sUncommitted == stl_sReference || stl_sReadFile(stl_sExportPath) != stl_sUncommitted)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Parallel export inside a transaction missed its changes");
+        }
+        db.Exec(L"ROLLBACK");
+
+        std::remove(stl_sExportPath.c_str());
+        RemoveDb(stl_sExportDb);
+    }
+
+    {
+        // Binary dump keeps values and their types; damaged dumps are refused
+        std::string stl_sSourceDb = stl_sTempPath("binary.db");
+        std::string stl_sRestoredDb = stl_sTempPath("restored.db");
+        std::string stl_sDumpPath = stl_sTempPath("binary.hldb");
+        RemoveDb(stl_sSourceDb);
+        RemoveDb(stl_sRestoredDb);
+
+        CSqlite db(CEString::sFromUtf8(stl_sSourceDb));
+        db.BeginTransaction();
+        db.Exec(L"CREATE TABLE bin_types (id INTEGER PRIMARY KEY, i INTEGER, r REAL, t TEXT, b BLOB, n)");
+        db.Exec(L"INSERT INTO bin_types VALUES "
+                L"(1, -9223372036854775808, 0.1, 'ёжик', x'00ff0000', NULL), "
+                L"(2, 9223372036854775807, 1e300, '', x'', 42), "
+                L"(3, 0, 5e-324, 'a' || char(0) || 'b', NULL, 'text'), "
+                L"(4, NULL, NULL, NULL, zeroblob(10), 2.5), "
+                L"(5, -1, -2.5, 'x', x'0102', x'00')");
+        db.Exec(L"WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 10000) "
+                L"INSERT INTO bin_types SELECT i + 10, i * i * i, i / 3.0, 'слово ' || (i % 50), "
+                L"CAST('блоб' || (i % 7) AS BLOB), CASE i % 3 WHEN 0 THEN NULL WHEN 1 THEN i ELSE 'n' || i END FROM n");
+        db.CommitTransaction();
+
+        CEString sDumpPath = CEString::sFromUtf8(stl_sDumpPath);
+        db.bExportBinary(sDumpPath, { L"bin_types" }, ObserveProgress);
+        {
+            CSqlite dbRestored(CEString::sFromUtf8(stl_sRestoredDb));
+            dbRestored.bImportBinary(sDumpPath, false, ObserveProgress);
+        }
+
+        db.Exec(L"ATTACH DATABASE '" + CEString::sFromUtf8(stl_sRestoredDb) + L"' AS restored");
+        CEString sColumns(L"SELECT rowid, *, typeof(i), typeof(r), typeof(t), typeof(b), typeof(n) FROM ");
+        for (auto& sQuery : { L"SELECT count(*) FROM (" + sColumns + L"main.bin_types EXCEPT " + sColumns + L"restored.bin_types)",
+                              L"SELECT count(*) FROM (" + sColumns + L"restored.bin_types EXCEPT " + sColumns + L"main.bin_types)" })
+        {
+            CSqlite::CStatement stDiff = db.Prepare(sQuery);
+            if (SQLITE_ROW != sqlite3_step(stDiff) || 0 != sqlite3_column_int64(stDiff, 0))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Binary dump round trip changed values");
+            }
+        }
+        {
+            CSqlite::CStatement stSchema = db.Prepare(L"SELECT (SELECT sql FROM main.sqlite_schema WHERE name = 'bin_types') "
+                                                      L"IS (SELECT sql FROM restored.sqlite_schema WHERE name = 'bin_types')");
+            if (SQLITE_ROW != sqlite3_step(stSchema) || 1 != sqlite3_column_int(stSchema, 0))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Binary dump round trip changed the schema");
+            }
+        }
+        db.Exec(L"DETACH DATABASE restored");
+
+        std::string stl_sDump = stl_sReadFile(stl_sDumpPath);
+        for (size_t uiStep = 0; uiStep < 40; ++uiStep)
+        {
+            size_t uiAt = uiStep * stl_sDump.length() / 40;
+            if (!bRejectsDump(stl_sDump.substr(0, uiAt)))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Dump truncated to " + CEString::sToString((int)uiAt) + L" bytes was not cleanly rejected");
+            }
+            std::string stl_sDamaged(stl_sDump);
+            stl_sDamaged[uiAt + 1] ^= 0x10;
+            if (!bRejectsDump(stl_sDamaged))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Dump with byte " + CEString::sToString((int)uiAt + 1) + L" changed was not cleanly rejected");
+            }
+        }
+
+        // Valid checksums, but a bit flipped in the data or a stray byte after the last value
+        std::string stl_sRaw { (char)Dump::ecInteger, (char)Dump::ullZigZag(5) };
+        if (bRejectsDump(stl_sMakeDump(stl_sRaw, 1)))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Hand-made dump was rejected");
+        }
+        std::string stl_sFlipped = stl_sMakeDump(stl_sRaw, 1);
+        stl_sFlipped[stl_sFlipped.length() - 2] ^= 0x02;
+        if (!bRejectsDump(stl_sFlipped))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Block with a bad checksum was not cleanly rejected");
+        }
+        if (!bRejectsDump(stl_sMakeDump(stl_sRaw + (char)Dump::ecNull, 1)))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Block with trailing bytes was not cleanly rejected");
+        }
+
+        // Names and schemas from the dump run no SQL of their own
+        for (const char* szSchema : { "CREATE TABLE crafted (a); DROP TABLE victim;", "CREATE TABLE victim (a)",
+                                      "CREATE TABLE crafted AS SELECT * FROM victim", "CREATE TEMP TABLE crafted (a)",
+                                      "CREATE VIEW crafted AS SELECT 1", "ATTACH DATABASE ':memory:' AS crafted" })
+        {
+            if (!bRejectsDump(stl_sMakeDump(stl_sRaw, 1, "crafted", szSchema)))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Dump schema " + CEString::sFromUtf8(szSchema) + L" was not cleanly rejected");
+            }
+        }
+
+        std::string stl_sCraftedPath = stl_sTempPath("crafted.hldb");
+        CEString sCraftedPath = CEString::sFromUtf8(stl_sCraftedPath);
+        db.Exec(L"CREATE TABLE victim (a)");
+        db.Exec(L"INSERT INTO victim VALUES (1)");
+        for (auto& stl_sDump : { stl_sMakeDump(stl_sRaw, 1, "crafted", "CREATE TABLE crafted (a); DROP TABLE victim;"),
+                                 stl_sMakeDump(stl_sRaw, 1, "victim; DROP TABLE victim; --") })
+        {
+            WriteFile(stl_sCraftedPath, stl_sDump);
+            try
+            {
+                db.bImportBinary(sCraftedPath, false, ObserveProgress);
+            }
+            catch (CException&)
+            {}
+            if (1 != db.llRows(L"victim"))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Binary dump ran SQL from its table header");
+            }
+        }
+
+        // Names that need quoting are fine
+        WriteFile(stl_sCraftedPath, stl_sMakeDump(stl_sRaw, 1, "we\"ird", "CREATE TABLE \"we\"\"ird\" (\"a b\")"));
+        db.bImportBinary(sCraftedPath, false, ObserveProgress);
+        db.bImportBinary(sCraftedPath, true, ObserveProgress);
+        {
+            CSqlite::CStatement stSelect = db.Prepare(L"SELECT count(*), sum(\"a b\") FROM \"we\"\"ird\"");
+            if (SQLITE_ROW != sqlite3_step(stSelect) || 2 != sqlite3_column_int(stSelect, 0) || 10 != sqlite3_column_int(stSelect, 1))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Binary dump of a table with a quoted name");
+            }
+        }
+        std::remove(stl_sCraftedPath.c_str());
+
+        std::remove(stl_sDumpPath.c_str());
+        RemoveDb(stl_sRestoredDb);
+        RemoveDb(stl_sSourceDb);
+    }
+
+    RemoveDb(stl_sDbPath);
+
+    if (!bErrors)
+    {
+        std::cout << "\n*** OK\n";
+    }
+    else
+    {
+        std::cout << "\n*** Test failed\n";
+    }
+
+    return bErrors ? 1 : 0;
+}
@@ -2,9 +2,12 @@
 
 
 #include <stdlib.h>
+#include <map>
 #include "Logging.h"
 #include "EString.h"
 #include "Exception.h"
+#include "GramHasher.h"
+#include "md5.h"
 
 using namespace Hlib;
 
@@ -1104,6 +1107,825 @@ int main()
         }
     }
 
+    {
+        CEString sGrowth;
+        for (int iAt = 0; iAt < 1000; ++iAt)
+        {
+            sGrowth += L"ab";
+        }
+        if (2000 != sGrowth.uiLength() || sGrowth.uiCapacity() < sGrowth.uiLength())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Growth error");
+        }
+
+        sGrowth.Erase();
+        if (sGrowth.uiCapacity() < 2000)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Erase() should keep capacity");
+        }
+        sGrowth.ShrinkToFit();
+        if (sGrowth.uiCapacity() >= 2000)
+        {
+            bErrors = true;
+            ERROR_LOG(L"ShrinkToFit error");
+        }
+
+        CEString sReserved(L"абв");
+        sReserved.Reserve(500);
+        if (sReserved.uiCapacity() < 500 || sReserved != L"абв")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Reserve error");
+        }
+
+        CEString sSelf(L"0123456789");
+        sSelf += sSelf;
+        sSelf += sSelf;
+        if (sSelf != L"0123456789012345678901234567890123456789")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Self-append error");
+        }
+
+        CEString sInsertSelf(L"abc");
+        sInsertSelf.sInsert(1, sInsertSelf);
+        if (sInsertSelf != L"aabcbc")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Self-insert error");
+        }
+
+        CEString sTokenized(L"one two");
+        sTokenized.SetBreakChars(L" ");
+        if (2 != sTokenized.uiGetNumOfFields())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Tokenizer error");
+        }
+        sTokenized += L" three";
+        if (3 != sTokenized.uiGetNumOfFields() || sTokenized.sGetField(2) != L"three")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Tokens not refreshed after append");
+        }
+    }
+
+    {
+        // Short strings are stored inline, longer ones on the heap
+        CEString sShort(L"Noun_Sg_N");
+        CEString sShortMoved(std::move(sShort));
+        if (sShortMoved != L"Noun_Sg_N" || sShort.uiLength() != 0 || sShort != L"")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Inline move error");
+        }
+        sShort = L"reused";
+        if (sShort != L"reused")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Moved-from string not reusable");
+        }
+
+        CEString sLong(L"абвгдеёжзийклмнопрстуфхцчшщъыьэюя");
+        CEString sLongCopy(sLong);
+        CEString sLongMoved;
+        sLongMoved = std::move(sLong);
+        if (sLongCopy != sLongMoved || sLongMoved.uiLength() != 33)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Heap copy/move error");
+        }
+
+        sLongMoved.sErase(5);
+        sLongMoved.ShrinkToFit();
+        if (sLongMoved != L"абвгд")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Shrink to inline error");
+        }
+
+        CEString sSwapA(L"short");
+        CEString sSwapB(L"a string that is too long to be stored inline");
+        std::swap(sSwapA, sSwapB);
+        if (sSwapA != L"a string that is too long to be stored inline" || sSwapB != L"short")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Swap error");
+        }
+    }
+
+    {
+        // Copies share the source's separator configuration
+        CEString sFields(L"Noun_Sg_N");
+        sFields.SetBreakChars(L"_");
+        CEString sFieldsCopy(sFields);
+        if (3 != sFieldsCopy.uiGetNumOfFields() || sFieldsCopy.sGetField(1) != L"Sg")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Separators not copied");
+        }
+
+        CEString sDefault;
+        sDefault = L"раз два";
+        CEString sDefaultCopy(sDefault);
+        if (2 != sDefaultCopy.uiGetNumOfFields())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Default separators not copied");
+        }
+
+        sFieldsCopy.SetBreakChars(L"S");
+        if (3 != sFields.uiGetNumOfFields() || 2 != sFieldsCopy.uiGetNumOfFields())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Separator change leaked into another string");
+        }
+
+        CEString sPath(L"usr/local lib");
+        sPath.SetBreakChars(L"/");
+        CEString sPathCopy(sPath);
+        CEString sPathDefault(L"usr/local lib");
+        if (2 != sPathCopy.uiNFields() || sPathCopy.sGetField(1) != L"local lib" || 2 != sPathDefault.uiNFields())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Copy lost custom break chars");
+        }
+
+        CEString sVowelsTest(L"молоко");
+        sVowelsTest.SetVowels(CEString::g_szRusVowels);
+        CEString sVowelsCopy(sVowelsTest);
+        if (3 != sVowelsCopy.uiGetNumOfSyllables())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Vowels not copied");
+        }
+
+        sVowelsCopy.ResetSeparators();
+        sVowelsCopy.EnableVowels();
+        if (3 != sVowelsCopy.uiGetNumOfSyllables())
+        {
+            bErrors = true;
+            ERROR_LOG(L"Vowels lost after reset");
+        }
+    }
+
+    {
+        // Built-in profiles bypass the intern map; user-defined ones leave it with their last string
+        unsigned int uiBefore = CSeparatorProfile::uiInterned();
+        for (int iAt = 0; iAt < 100; ++iAt)
+        {
+            CEString sHash(L"AdjL_M_Sg_G");
+            sHash.ResetSeparators();
+            sHash.SetBreakChars(L"_");
+            sHash.EnableBreaks();
+            if (4 != sHash.uiNFields())
+            {
+                bErrors = true;
+                ERROR_LOG(L"Built-in separator profile error");
+                break;
+            }
+        }
+        if (CSeparatorProfile::uiInterned() != uiBefore)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Built-in separator profile was interned");
+        }
+
+        CEString sKept(L"a0b1c");
+        sKept.SetBreakChars(L"01");
+        for (int iAt = 0; iAt < 2000; ++iAt)
+        {
+            CEString sKey(L"a0b1c");
+            sKey.SetBreakChars(to_wstring(iAt).c_str());
+            CEString sSame(L"a0b1c");
+            sSame.SetBreakChars(L"01");
+            if (sSame.uiNFields() != 3)
+            {
+                bErrors = true;
+                ERROR_LOG(L"Interned separator profile error");
+                break;
+            }
+        }
+        if (CSeparatorProfile::uiInterned() > uiBefore + 1 || 3 != sKept.uiNFields() || sKept.sGetField(2) != L"c")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Separator profiles not released");
+        }
+    }
+
+    {
+        // Punctuation outside the Latin/Cyrillic table
+        CEString sPunct(L"слово… другое — третье.");
+        sPunct.EnablePunctuation();
+        if (3 != sPunct.uiGetNumOfFields() || ecTokenPunctuation != sPunct.eGetTokenType(1) ||
+            ecTokenPunctuation != sPunct.eGetTokenType(5) || sPunct.sGetField(2) != L"третье")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Punctuation tokenizer error");
+        }
+
+        CEString sTabs(L"a\tb c");
+        sTabs.EnableTabs();
+        if (3 != sTabs.uiGetNumOfFields() || ecTokenTab != sTabs.eGetTokenType(1) || ecTokenSpace != sTabs.eGetTokenType(3))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Tab tokenizer error");
+        }
+    }
+
+    {
+        // Search kernels, long enough to go through the vector paths
+        CEString sLong(L"пролетарии всех стран, соединяйтесь! Workers of the world, unite!");
+        sLong.SetVowels(CEString::g_szRusVowels);
+        if (sLong.uiFind(L"соединяйтесь") != 23 || sLong.uiFind(L"unite", 30) != 59 || 
+            sLong.uiFind(L"unite!!") != ecNotFound || sLong.uiFind(L"e", 62) != 63)
+        {
+            bErrors = true;
+            ERROR_LOG(L"uiFind error");
+        }
+
+        if (sLong.uiFindFirstOf(L"!,") != 21 || sLong.uiFindLastOf(L"!,") != 64 || 
+            sLong.uiFindOneOf(22, L"!,") != 35 || sLong.uiFindFirstOf(L"#") != ecNotFound)
+        {
+            bErrors = true;
+            ERROR_LOG(L"uiFindFirstOf/uiFindLastOf error");
+        }
+
+        if (sLong.uiFindFirstOf(CEString::g_szRusConsonants) != 0 || sLong.uiFindLastOf(CEString::g_szRusVowels) != 32 ||
+            sLong.uiFindFirstOf(L".,;:/?<>[]{}~!()-—_…") != 21)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Large set search error");
+        }
+
+        // More distinct sets than the per-thread cache holds, twice over
+        const wchar_t * arrSingle[] = { L"п", L"р", L"о", L"л", L"е", L"т", L"а", L"и", L"в", L"с", L"х", L"!" };
+        for (int iPass = 0; iPass < 2; ++iPass)
+        {
+            for (auto szSet : arrSingle)
+            {
+                if (sLong.uiFindFirstOf(szSet) != sLong.uiFind(szSet) || 
+                    sLong.uiFindFirstOf(Scan::CCharSet(szSet)) != sLong.uiFind(szSet))
+                {
+                    bErrors = true;
+                    ERROR_LOG(L"Cached set search error");
+                }
+            }
+        }
+
+        if (12 != sLong.uiGetNumOfSyllables() || 9 != sLong.uiGetVowelPos(4) || 4 != sLong.uiGetSyllableFromVowelPos(9))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Syllable count error");
+        }
+
+        if (!sLong.bStartsWith(L"пролетарии всех") || sLong.bStartsWith(L"пролетарий"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"bStartsWith error");
+        }
+
+        // Compare the kernels against a plain loop over every start position
+        const wchar_t * arrSets[] = { L"о", L"оа!", L"аеёиоуыэюяАЕЁИОУЫЭЮЯ", L".,;:/?<>[]{}~!()-—_…", L"abcdefghijklmnopqrstuvwxyzабв" };
+        for (auto szSet : arrSets)
+        {
+            for (unsigned int uiStart = 0; uiStart < sLong.uiLength(); ++uiStart)
+            {
+                unsigned int uiExpected = ecNotFound;
+                unsigned int uiExpectedCount = 0;
+                for (unsigned int uiAt = uiStart; uiAt < sLong.uiLength(); ++uiAt)
+                {
+                    if (CEString::bIn(sLong[uiAt], szSet))
+                    {
+                        uiExpected = (ecNotFound == uiExpected) ? uiAt : uiExpected;
+                        ++uiExpectedCount;
+                    }
+                }
+                Scan::CCharSet Set(szSet);
+                if (sLong.uiFindOneOf(uiStart, szSet) != uiExpected || sLong.uiFindOneOf(uiStart, Set) != uiExpected ||
+                    Scan::uiCount(&sLong[uiStart], sLong.uiLength() - uiStart, Set) != uiExpectedCount)
+                {
+                    bErrors = true;
+                    ERROR_LOG(L"Set search mismatch");
+                }
+            }
+        }
+    }
+
+    {
+        // Views
+        CEString sFields(L"Noun Sg Part");
+        CEStringView svCase = sFields.svGetField(2);
+        if (svCase != L"Part" || L"Part" != svCase || svCase == L"Par" || svCase == L"Parts" || 
+            svCase.uiLength() != 4 || svCase != sFields.sGetField(2) || sFields.sGetField(2) != svCase)
+        {
+            bErrors = true;
+            ERROR_LOG(L"svGetField error");
+        }
+
+        if (!(sFields.svGetField(0) < svCase) || !(L"Pa" < svCase) || !(svCase > L"Pa") || 
+            !(svCase <= L"Part") || svCase >= L"Partial")
+        {
+            bErrors = true;
+            ERROR_LOG(L"CEStringView comparison error");
+        }
+
+        if (sFields.svGetToken(1) != L" " || sFields.svSubstr(5, 2) != L"Sg" || sFields.svSubstr(8) != L"Part" || 
+            !sFields.svSubstr(12).bIsEmpty() || !svCase.bStartsWith(L"Pa") || !svCase.bEndsWith(L"rt") || svCase.svSubstr(1, 2) != L"ar")
+        {
+            bErrors = true;
+            ERROR_LOG(L"View accessor error");
+        }
+
+        CEString sCase(svCase);
+        sCase += L"itive";
+        sFields = sFields.svGetField(0);
+        if (sCase != L"Partitive" || sFields != L"Noun" || sFields.uiGetNumOfFields() != 1)
+        {
+            bErrors = true;
+            ERROR_LOG(L"CEString from view error");
+        }
+
+        const wchar_t * szText = L"один, два;\tтри  «четыре»!";
+        CEString sFromText(szText);
+        CEString sFromView(CEStringView(szText, wcslen(szText)));
+        if (sFromText.uiNFields() != sFromView.uiNFields() || sFromText.uiNFields() != 3 || 
+            sFromView.sGetField(2) != sFromText.sGetField(2))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Separator profile of a string built from a view");
+        }
+
+        map<CEString, int, less<>> mapKeys = { { L"Sg", 1 }, { L"Pl", 2 } };
+        CEString sKeys(L"Pl_Sg");
+        sKeys.SetBreakChars(L"_");
+        auto itKey = mapKeys.find(sKeys.svGetField(0));
+        if (mapKeys.end() == itKey || 2 != itKey->second || mapKeys.end() != mapKeys.find(CEStringView(L"P")))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Heterogeneous lookup error");
+        }
+    }
+
+    {
+        // Indexed field lookup
+        CEString sMixed(L"один, два; три  четыре");
+        sMixed.EnablePunctuation();
+        if (4 != sMixed.uiGetNumOfFields() || 2 != sMixed.uiGetNumOfFields(ecTokenPunctuation) || 
+            3 != sMixed.uiGetNumOfFields(ecTokenSpace) || 0 != sMixed.uiGetNumOfFields(ecTokenTab) ||
+            sMixed.svGetField(3) != L"четыре" || sMixed.svGetField(1, ecTokenPunctuation) != L";" || 
+            sMixed.svGetField(2, ecTokenSpace) != L"  " || sMixed.uiGetFieldOffset(2) != 11)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Indexed field lookup error");
+        }
+
+        CEString sCopy(sMixed);
+        sMixed = L"x";
+        if (sCopy.svGetField(2) != L"три" || 1 != sMixed.uiGetNumOfFields() || sMixed.svGetField(0) != L"x")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Field index not refreshed");
+        }
+
+        bool bCaught = false;
+        try
+        {
+            sCopy.svGetField(2, ecTokenPunctuation);
+        }
+        catch (CException&)
+        {
+            bCaught = true;
+        }
+        if (!bCaught)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Expected out of range exception");
+        }
+
+        CEString sWide;
+        for (unsigned int uiField = 0; uiField < 2000; ++uiField)
+        {
+            sWide += CEString::sToString(uiField);
+            sWide += L"|";
+        }
+        sWide.SetBreakChars(L"|");
+        if (2000 != sWide.uiGetNumOfFields() || sWide.svGetField(1999) != L"1999" || sWide.svGetField(1234) != L"1234")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Wide line field error");
+        }
+    }
+
+    {
+        // Streaming field iterator
+        CEString sFields(L"  один, два; три  четыре ");
+        sFields.EnablePunctuation();
+        const wchar_t * arrExpected[] = { L"один", L"два", L"три", L"четыре" };
+        unsigned int uiField = 0;
+        for (const CEStringView& svField : sFields.Fields())
+        {
+            if (uiField >= 4 || svField != arrExpected[uiField] || svField != sFields.svGetField(uiField))
+            {
+                bErrors = true;
+                ERROR_LOG(L"Field iterator error");
+            }
+            ++uiField;
+        }
+
+        unsigned int uiPunct = 0;
+        for (const CEStringView& svPunct : sFields.Fields(ecTokenPunctuation))
+        {
+            uiPunct += (svPunct == L"," || svPunct == L";") ? 1 : 0;
+        }
+
+        if (4 != uiField || 2 != uiPunct)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Field iterator count error");
+        }
+
+        CEString sEmpty;
+        CEString sSpaces(L"   ");
+        auto itField = sFields.Fields().begin();
+        auto itSecond = itField;
+        ++itSecond;
+        if (sEmpty.Fields().begin() != sEmpty.Fields().end() || sSpaces.Fields().begin() != sSpaces.Fields().end() ||
+            itField == itSecond || *itSecond != L"два" || itField.uiOffset() != 2 || *itField != L"один")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Field iterator boundary error");
+        }
+
+        // Stops early: the bad escape further down the line is never reached
+        CEString sLong(L"a b c \27unterminated");
+        sLong.EnableEscapeChars();
+        CEStringView svSecond;
+        unsigned int uiSeen = 0;
+        for (const CEStringView& svField : sLong.Fields())
+        {
+            if (++uiSeen == 2)
+            {
+                svSecond = svField;
+                break;
+            }
+        }
+        if (svSecond != L"b")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Field iterator early exit error");
+        }
+    }
+
+    {
+        // Regex cache and precompiled handles
+        CEString sForm(L"перерабатывающий");
+        if (!sForm.bRegexMatch(L"(пере)(.+)(ий)") || 3 != sForm.uiGetNumOfRegexMatches() || 
+            sForm.sGetRegexMatch(0) != L"пере" || sForm.svGetRegexMatch(1) != L"рабатывающ" || sForm.svGetRegexMatch(2) != L"ий")
+        {
+            bErrors = true;
+            ERROR_LOG(L"bRegexMatch error");
+        }
+
+        auto spRegex = CRegex::spGet(L"(пере)(.+)(ий)");
+        if (spRegex != CRegex::spGet(L"(пере)(.+)(ий)") || spRegex->sPattern() != L"(пере)(.+)(ий)")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Regex cache miss");
+        }
+
+        CEString sOther(L"x перевыполняющий");
+        if (sOther.bRegexMatch(spRegex) || !sOther.bRegexSearch(spRegex) || sOther.svGetRegexMatch(1) != L"выполняющ" || 
+            sOther.uiGetFieldOffset(0, ecTokenRegexMatch) != 2)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Precompiled regex error");
+        }
+
+        if (sOther.bRegexSearch(L"(unbalanced"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Invalid regex should not match");
+        }
+
+        CRegex::SetCacheCapacity(2);
+        CRegex::spGet(L"a+");
+        CRegex::spGet(L"b+");
+        auto spC = CRegex::spGet(L"c+");
+        if (2 != CRegex::uiCacheSize() || spRegex == CRegex::spGet(L"(пере)(.+)(ий)") || spC != CRegex::spGet(L"c+"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Regex cache eviction error");
+        }
+        CRegex::SetCacheCapacity(CRegex::cuiDefaultCacheCapacity_);
+
+        // The evicted handle stays usable
+        if (!sForm.bRegexMatch(spRegex) || sForm.svGetRegexMatch(0) != L"пере")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Evicted regex handle error");
+        }
+    }
+
+    {
+        // NFA regex engine must agree with std::regex on the patterns it accepts
+        const wchar_t * arrPatterns[] = 
+        {
+            L"(пере)(.+)(ий)", L"^(.*?)([аеёиоуыэюя])([^аеёиоуыэюя]*)$", L"(.*)(ющ|ащ|ущ|ящ)(ий|ая|ее|ие)",
+            L"(по|пере|вы)?(.+?)(ся|сь)?", L"^[а-я\\-]+$", L"([^-]+)-([^-]+)", L"(а|аб|абв)(в?)", L"(?:ер|е)+(.)",
+            L"о{2,3}", L"x?y??", L"(a)|(b)", L"а.б", L"[-ая]+", L"ий$", L"^$", L"\\.\\*"
+        };
+        const wchar_t * arrSubjects[] = 
+        {
+            L"перерабатывающий", L"поднимающийся", L"выписать", L"кто-то", L"ааббвв", L"еререр", L"тоооот",
+            L"xyy", L"ab", L"а\nб", L"а-я", L"", L"ый", L"a.*", L"вверх-вниз"
+        };
+
+        vector<int> vecNfa, vecStd;
+        for (auto szPattern : arrPatterns)
+        {
+            CRegex rxNfa(szPattern);
+            CRegex rxStd(szPattern, ecRegexEngineStd);
+            if (!rxNfa.bNfa() || rxStd.bNfa() || rxNfa.uiGroups() != rxStd.uiGroups())
+            {
+                bErrors = true;
+                ERROR_LOG(L"Regex engine selection error");
+                continue;
+            }
+
+            for (auto szSubject : arrSubjects)
+            {
+                unsigned int uiLength = (unsigned int)wcslen(szSubject);
+                for (bool bMatchMode : { true, false })
+                {
+                    bool bNfa = rxNfa.bEvaluate(szSubject, uiLength, bMatchMode, vecNfa);
+                    bool bStd = rxStd.bEvaluate(szSubject, uiLength, bMatchMode, vecStd);
+                    if (bNfa != bStd || (bNfa && vecNfa != vecStd))
+                    {
+                        bErrors = true;
+                        ERROR_LOG((wstring(L"Regex engine mismatch: ") + szPattern + L" / " + szSubject).c_str());
+                    }
+                }
+            }
+        }
+
+        // Outside the NFA subset: std::regex takes over
+        for (auto szPattern : { L"\\d+", L"(a)\\1", L"a(?=b)", L"(a*)*", L"(ab)+", L"[[:alpha:]]" })
+        {
+            if (CRegex(szPattern).bNfa())
+            {
+                bErrors = true;
+                ERROR_LOG((wstring(L"Regex should fall back on std::regex: ") + szPattern).c_str());
+            }
+        }
+
+        CEString sWord(L"выписать");
+        if (!sWord.bRegexMatch(L"(.+?)(\\S+)") || sWord.svGetRegexMatch(0) != L"в" || !CEString::bStringOverAlphabet(sWord, L"а-я") ||
+            CEString::bStringOverAlphabet(CEString(L"вы-писать"), L"а-я"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Regex fallback error");
+        }
+    }
+
+    {
+        // UTF-8 conversions: ASCII runs long enough for the vector path, Cyrillic, 
+        // 4-byte sequences and malformed input
+        CEString sMixed(L"abcdefghijklmnopqrstuvwxyz0123456789 перерабатывающий \U0001F600 ёж");
+        string stl_sUtf8 = sMixed.stl_sToUtf8();
+        const char * szExpected = u8"abcdefghijklmnopqrstuvwxyz0123456789 перерабатывающий \U0001F600 ёж";
+        if (stl_sUtf8 != szExpected || CEString::sFromUtf8(stl_sUtf8) != sMixed || 
+            CEString::stl_sToUtf8(L"ёж") != u8"ёж" || CEString::sToString("abc") != L"abc")
+        {
+            bErrors = true;
+            ERROR_LOG(L"UTF-8 round trip error");
+        }
+
+        // Truncated sequence, stray continuation byte, overlong '/', encoded surrogate
+        const char arrMalformed[] = "a\xD0\xC0\xAF\x80\xED\xA0\x80z\xD0";
+        CEString sDecoded = CEString::sFromUtf8(arrMalformed, sizeof(arrMalformed) - 1);
+        if (sDecoded != L"a\xFFFD\xFFFD\xFFFD\xFFFD\xFFFD\xFFFD\xFFFDz\xFFFD")
+        {
+            bErrors = true;
+            ERROR_LOG(L"UTF-8 malformed input error");
+        }
+
+        CEString sLine;
+        string stl_sOut;
+        for (const char * szLine : { u8"длинная строка, которой нужен буфер в куче", "ab" })
+        {
+            sLine.AssignUtf8(szLine, strlen(szLine));
+            sLine.ToUtf8(stl_sOut);
+            if (stl_sOut != szLine)
+            {
+                bErrors = true;
+                ERROR_LOG(L"AssignUtf8/ToUtf8 error");
+            }
+        }
+    }
+
+    {
+        // Compact UTF-8 storage
+        CEString sWord(L"перерабатывающий");
+        CEStringUtf8 sCompact(sWord);
+        CEString sBack;
+        sCompact.ToEString(sBack);
+        if (sCompact.uiBytes() != 32 || sCompact.stl_sGet() != sWord.stl_sToUtf8() || sBack != sWord || 
+            sCompact.sToEString() != sWord || !CEStringUtf8().bIsEmpty())
+        {
+            bErrors = true;
+            ERROR_LOG(L"CEStringUtf8 conversion error");
+        }
+
+        CEStringUtf8 sLower(L"ёж"), sUpper(L"Ёж"), sLatin(L"z");
+        if (!(sLatin < sUpper) || !(sUpper < sLower) || sLower != CEStringUtf8(u8"ёж") || 
+            (CEString(L"Ёж") < CEString(L"ёж")) != (sUpper < sLower))
+        {
+            bErrors = true;
+            ERROR_LOG(L"CEStringUtf8 comparison error");
+        }
+
+        sCompact = sWord.svSubstr(0, 4);
+        if (sCompact != CEStringUtf8(u8"пере"))
+        {
+            bErrors = true;
+            ERROR_LOG(L"CEStringUtf8 view assignment error");
+        }
+    }
+
+    {
+        // Packed gram codes
+        constexpr uint32_t uiCode = GramCode::uiEncode(POS_ADJ, SUBPARADIGM_LONG_ADJ, CASE_ACC, NUM_SG, GENDER_M, 
+                                                       PERSON_UNDEFINED, ANIM_YES, ASPECT_UNDEFINED, REFL_UNDEFINED);
+        static_assert(GramCode::eCase(uiCode) == CASE_ACC && GramCode::eAnimacy(uiCode) == ANIM_YES && 
+                      GramCode::eSubparadigm(uiCode) == SUBPARADIGM_LONG_ADJ && GramCode::bIsValid(uiCode), "GramCode error");
+        static_assert(GramCode::uiEncode(POS_UNDEFINED, SUBPARADIGM_UNDEFINED, CASE_UNDEFINED, NUM_UNDEFINED, GENDER_UNDEFINED, 
+                                         PERSON_UNDEFINED, ANIM_UNDEFINED, ASPECT_UNDEFINED, REFL_UNDEFINED) == 0, "GramCode error");
+
+        for (const wchar_t * szHash : { L"Noun_Sg_Part", L"AdjL_M_Sg_A_Anim", L"AdjL_Pl_A_Inanim", L"PPastPL_F_Sg_I", L"AdjS_Pl", 
+                                        L"Pres_Pl_3", L"VAdv_Past", L"Numeral24_M_A_Anim", L"LastNameNounFeminine_F_Sg_D", L"Adv" })
+        {
+            uint32_t uiHashCode = 0;
+            CEString sBack;
+            if (H_NO_ERROR != CGramHasher::eHashToCode(szHash, uiHashCode) || 
+                H_NO_ERROR != CGramHasher::eCodeToHash(uiHashCode, sBack) || sBack != szHash)
+            {
+                bErrors = true;
+                ERROR_LOG(L"Gram code round trip error");
+            }
+        }
+
+        CGramHasher hasher(L"AdjL_M_Sg_A_Anim");
+        CEString sInvalid;
+        if (hasher.uiGramCode() != uiCode || GramCode::bIsValid(uiCode | (1u << GramCode::cuiBits_)) || 
+            H_NO_ERROR == CGramHasher::eCodeToHash(SUBPARADIGM_COUNT << GramCode::cuiSubparadigmShift_, sInvalid))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Gram code error");
+        }
+    }
+
+    {
+        // Tag tables
+        for (auto& stEntry : GramTables::arrSubparadigms)
+        {
+            if (eStrToSubparadigm(stEntry.szKey) != stEntry.eValue || svSubparadigmToStr(stEntry.eValue) != stEntry.szKey)
+            {
+                bErrors = true;
+                ERROR_LOG(L"Subparadigm table error");
+            }
+        }
+
+        CEString sTag(L"AdjL_Part");
+        if (eStrToSubparadigm(L"Bogus") != SUBPARADIGM_UNDEFINED || eStrToSubparadigm(L"AdjLL") != SUBPARADIGM_UNDEFINED || 
+            eStrToCase(sTag.svSubstr(5)) != CASE_PART || eStrToCase(L"Num") != CASE_NUM || eStrToPerson(L"3") != PERSON_3 ||
+            svCaseToStr(CASE_NUM) != L"Num" || sGenderToStr(GENDER_UNDEFINED) != L"" || sPosToStr(POS_COMPAR) != L"AdjComp")
+        {
+            bErrors = true;
+            ERROR_LOG(L"Tag table error");
+        }
+    }
+
+    {
+        // Precomputed paradigms against the bIncrement() walk
+        vector<CGramHasher> vecStarts(4);
+        vecStarts[0].Initialize(POS_NOUN, SUBPARADIGM_NOUN, GENDER_F, ANIM_NO);
+        vecStarts[1].Initialize(POS_ADJ);
+        vecStarts[2].Initialize(ASPECT_IMPERFECTIVE, REFL_YES);
+        vecStarts[3].Initialize(POS_LAST_NAME, SUBPARADIGM_LAST_NAME_NOUN_F, GENDER_F, ANIM_YES);
+        vecStarts.push_back(vecStarts[2]);
+        vecStarts.back().SetParadigm(SUBPARADIGM_PART_PRES_PASS_LONG);
+
+        for (auto& hasher : vecStarts)
+        {
+            CParadigmSlots Slots;
+            bool bMatch = CParadigmTables::pGetInstance()->bGetParadigm(hasher, Slots);
+            unsigned int uiSlot = 0;
+            do
+            {
+                bMatch = bMatch && uiSlot < Slots.uiSize() && Slots[uiSlot].uiGramCode == hasher.uiGramCode() && 
+                    Slots[uiSlot].svGramHash == hasher.sGramHash();
+                ++uiSlot;
+            } while (hasher.bIncrement());
+
+            if (!bMatch || uiSlot != Slots.uiSize())
+            {
+                bErrors = true;
+                ERROR_LOG(L"Paradigm table error");
+            }
+        }
+
+        CGramHasher hasherPronoun;
+        hasherPronoun.Initialize(POS_PRONOUN, SUBPARADIGM_PRONOUN, GENDER_M, ANIM_YES);
+        CParadigmSlots Slots;
+        if (CParadigmTables::pGetInstance()->bGetParadigm(hasherPronoun, Slots))
+        {
+            bErrors = true;
+            ERROR_LOG(L"Paradigm table lookup error");
+        }
+    }
+
+    {
+        // Memoizing decoder
+        CGramDecoder Decoder;
+        vector<CEString> vecColumn { L"Noun_Sg_N", L"AdjL_Pl_A_Anim", L"Noun_Sg_N", L"Noun_Sg", L"Pres_Pl_3", L"AdjL_Pl_A_Anim" };
+        vector<uint32_t> vecCodes;
+        ET_ReturnCode rcBatch = Decoder.eDecodeBatch(vecColumn, vecCodes);
+
+        bool bMatch = H_NO_ERROR != rcBatch && vecCodes.size() == vecColumn.size() && Decoder.uiSize() == 4;
+        for (unsigned int uiAt = 0; uiAt < vecColumn.size() && bMatch; ++uiAt)
+        {
+            uint32_t uiExpected = GramCode::cuiInvalid_;
+            CGramHasher::eHashToCode(vecColumn[uiAt], uiExpected);
+            uint32_t uiSingle = 0;
+            Decoder.eDecode(CEStringView(vecColumn[uiAt], vecColumn[uiAt].uiLength()), uiSingle);
+            bMatch = vecCodes[uiAt] == uiExpected && uiSingle == uiExpected;
+        }
+
+        CGramInfo stGramInfo;
+        bMatch = bMatch && H_NO_ERROR == Decoder.eDecode(L"PPastPL_F_Sg_I", stGramInfo) && 
+            stGramInfo.m_eCase == CASE_INST && stGramInfo.m_eGender == GENDER_F && Decoder.uiSize() == 5 &&
+            CGramHasher(L"Impv_Pl_2").m_ePerson == PERSON_2;
+        if (!bMatch)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Gram decoder error");
+        }
+    }
+
+    {
+        // Content hashes
+        CMD5 md5;
+        bool bMatch = md5.sHash(L"") == L"d41d8cd98f00b204e9800998ecf8427e" && 
+            md5.sHash(L"abc") == L"ce1473cf80c6b3fda8e3dfc006adc315";
+
+        const char * szFox = "The quick brown fox jumps over the lazy dog";
+        wchar_t szHex[Digest::cuiHex128Length_];
+        CHash128 hash128;
+        hash128.Update(szFox, strlen(szFox));
+        hash128.FinalHex(szHex);
+        bMatch = bMatch && CEString(szHex) == L"6c1b07bc7bbc4be347939ac4a93c437a";
+        hash128.Init();
+        hash128.UpdateUtf16(L"abc", 3);
+        hash128.FinalHex(szHex);
+        bMatch = bMatch && CEString(szHex) == L"e34d9eb074a1250c2be09e39dd667177";
+
+        // Same digest however the input is split
+        CEString sLong;
+        for (int iRepeat = 0; iRepeat < 40; ++iRepeat)
+        {
+            sLong += L"Лексема_";
+        }
+        CEString sWhole = md5.sHash(sLong);
+        hash128.Init();
+        hash128.UpdateUtf16(sLong, sLong.uiLength());
+        wchar_t szWhole128[Digest::cuiHex128Length_];
+        hash128.FinalHex(szWhole128);
+        for (unsigned int uiSplit : { 1, 7, 8, 31, 32, 33, 100 })
+        {
+            md5.Init();
+            hash128.Init();
+            for (unsigned int uiAt = 0; uiAt < sLong.uiLength(); uiAt += uiSplit)
+            {
+                unsigned int uiLength = std::min(uiSplit, sLong.uiLength() - uiAt);
+                md5.UpdateUtf16((const wchar_t *)sLong + uiAt, uiLength);
+                hash128.UpdateUtf16((const wchar_t *)sLong + uiAt, uiLength);
+            }
+            md5.FinalHex(szHex);
+            bMatch = bMatch && sWhole == CEString(szHex);
+            hash128.FinalHex(szHex);
+            bMatch = bMatch && CEString(szWhole128) == CEString(szHex);
+        }
+
+        if (!bMatch)
+        {
+            bErrors = true;
+            ERROR_LOG(L"Content hash error");
+        }
+    }
+
     //
     // Done!
     //
@@ -1120,5 +1942,6 @@ int main()
 
 //_CrtDumpMemoryLeaks();
 
+    return bErrors ? 1 : 0;
 
 }